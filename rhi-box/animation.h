@@ -22,35 +22,51 @@ class Animation
 public:
     Animation() = default;
 
-    Animation(const std::string& path, Model *model)
+    Animation(const std::string& path, Model *model,
+              std::shared_ptr<QtIOSystem::Counters> io = std::make_shared<QtIOSystem::Counters>())
     {
         Assimp::Importer importer{};
-        const auto       scene = importer.ReadFile(path, aiProcess_Triangulate);
+        importer.SetIOHandler(new QtIOSystem{ std::move(io) });
+        const auto scene = importer.ReadFile(path, aiProcess_Triangulate);
         if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             qDebug() << importer.GetErrorString();
             return;
         }
+        load(scene, model);
+    }
 
-        //
-        const auto animation  = scene->mAnimations[0];
-        auto&      bone_infos = model->bone_infos();
-        duration_             = animation->mDuration;
-        ticks_                = animation->mTicksPerSecond;
+    // Reuses a scene that was already parsed for the model.
+    Animation(const aiScene *scene, Model *model) { load(scene, model); }
 
-        for (unsigned i = 0; i < animation->mNumChannels; ++i) {
-            const auto        channel = animation->mChannels[i];
-            const std::string name    = channel->mNodeName.data;
+    // Hierarchy and channels cooked into the model's .skinned.qmesh, no assimp involved.
+    Animation(const qmesh::File& file, Model *model)
+    {
+        const auto& header = file.header();
+        if (header.nodeCount) {
+            std::vector<std::vector<quint32>> children(header.nodeCount);
+            for (quint32 i = 1; i < header.nodeCount; ++i) {
+                const auto parent = file.node(i).parent;
+                if (parent >= 0 && quint32(parent) < i) {
+                    children[quint32(parent)].push_back(i);
+                }
+            }
+            read_cooked_node(root_, file, children, 0);
+        }
+
+        auto& bone_infos = model->bone_infos();
+        duration_        = header.animationDuration;
+        ticks_           = header.ticksPerSecond;
+        for (quint32 i = 0; i < header.channelCount; ++i) {
+            const auto&       channel = file.channel(i);
+            const std::string name{ file.string(channel.nameOffset, channel.nameLength) };
 
             if (!bone_infos.contains(name)) {
                 bone_infos[name] = { name, static_cast<int>(bone_infos.size()) };
             }
-            bones_.emplace_back(name, bone_infos[name].id, channel);
+            bones_.emplace_back(name, bone_infos[name].id, file, channel);
         }
 
         bone_infos_ = bone_infos;
-
-        //
-        read_heirarchy_data(root_, scene->mRootNode);
     }
 
     Bone *find(const std::string& name)
@@ -69,6 +85,33 @@ public:
     const std::map<std::string, BoneInfo>& bone_infos() { return bone_infos_; }
 
 private:
+    void load(const aiScene *scene, Model *model)
+    {
+        read_heirarchy_data(root_, scene->mRootNode);
+        bone_infos_ = model->bone_infos();
+        if (!scene->mNumAnimations) {
+            return;
+        }
+
+        //
+        const auto animation  = scene->mAnimations[0];
+        auto&      bone_infos = model->bone_infos();
+        duration_             = animation->mDuration;
+        ticks_                = animation->mTicksPerSecond;
+
+        for (unsigned i = 0; i < animation->mNumChannels; ++i) {
+            const auto        channel = animation->mChannels[i];
+            const std::string name    = channel->mNodeName.data;
+
+            if (!bone_infos.contains(name)) {
+                bone_infos[name] = { name, static_cast<int>(bone_infos.size()) };
+            }
+            bones_.emplace_back(name, bone_infos[name].id, channel);
+        }
+
+        bone_infos_ = bone_infos;
+    }
+
     void read_heirarchy_data(AssimpNodeData& dest, const aiNode *src)
     {
         dest.name      = src->mName.data;
@@ -81,6 +124,20 @@ private:
         }
     }
 
+    void read_cooked_node(AssimpNodeData& dest, const qmesh::File& file,
+                          const std::vector<std::vector<quint32>>& children, const quint32 index)
+    {
+        const auto& node = file.node(index);
+        dest.name        = std::string(file.string(node.nameOffset, node.nameLength));
+        dest.transform   = qmesh::toMatrix(node.transform);
+
+        for (const auto child : children[index]) {
+            AssimpNodeData data{};
+            read_cooked_node(data, file, children, child);
+            dest.children.push_back(data);
+        }
+    }
+
 private:
     double                          duration_{};
     double                          ticks_{};
@@ -1,5 +1,7 @@
 #ifndef BONE_H
 #define BONE_H
+#include "qtrhi3d/qmesh.h"
+
 #include <assimp/scene.h>
 #include <QMatrix4x4>
 #include <utility>
@@ -55,6 +57,29 @@ public:
         }
     }
 
+    // From a channel cooked into a .skinned.qmesh.
+    Bone(std::string name, const int id, const qmesh::File& file, const qmesh::Channel& channel)
+        : name_(std::move(name)), id_(id)
+    {
+        for (quint32 i = 0; i < channel.positionCount; ++i) {
+            const auto& key = file.key(channel.firstPosition + i);
+            positions_.push_back({ .position = { key.value[0], key.value[1], key.value[2] }, .timestamp = key.time });
+        }
+
+        for (quint32 i = 0; i < channel.rotationCount; ++i) {
+            const auto& key = file.key(channel.firstRotation + i);
+            rotations_.push_back({
+                                  .orientation = { key.value[0], key.value[1], key.value[2], key.value[3] },
+                                  .timestamp   = key.time,
+                                  });
+        }
+
+        for (quint32 i = 0; i < channel.scaleCount; ++i) {
+            const auto& key = file.key(channel.firstScale + i);
+            scales_.push_back({ .scale = { key.value[0], key.value[1], key.value[2] }, .timestamp = key.time });
+        }
+    }
+
     void update(const double time)
     {
         const auto translation = interpolate_position(time);
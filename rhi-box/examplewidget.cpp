@@ -1,6 +1,9 @@
 #include "examplewidget.h"
 #include "model.h"
+#include <assimp/Importer.hpp>
+#include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QMimeData>
 #include <QMouseEvent>
 
@@ -19,6 +22,8 @@ void RhiWidget::initialize(QRhiCommandBuffer *)
     if (rhi_) {
 
         qDebug() << "[RHI WIDGET] -> :" << rhi_->backendName();
+        // imports transcode cooked textures for these formats
+        qtex::Targets::query(rhi_);
     } else {
         qCritical() << "[RHI WIDGET]  RHI is null.";
         return;
@@ -54,7 +59,16 @@ void RhiWidget::render(QRhiCommandBuffer *cb)
     mvp_.rotate(rotation_);
     mvp_.scale(scale_);
 
-
+    {
+        QMutexLocker lock(&pending_mutex_);
+        for (auto& imported : pending_) {
+            if (imported.generation != import_generation_) continue;
+            items_.emplace_back(std::move(imported.model));
+            animations_.emplace_back(std::move(imported.animation));
+            animators_.emplace_back(std::make_unique<Animator>(animations_.back().get()));
+        }
+        pending_.clear();
+    }
 
     for (auto& item : items_) {
 
@@ -80,14 +94,48 @@ void RhiWidget::render(QRhiCommandBuffer *cb)
 }
 
 void RhiWidget::load(const QString& path)
+{
+    import({ path });
+}
+
+void RhiWidget::import(const QStringList& paths)
 {
     items_.clear();
     animations_.clear();
     animators_.clear();
 
-    items_.emplace_back(std::make_unique<Model>(path));
-    animations_.emplace_back(std::make_unique<Animation>(path.toStdString(), dynamic_cast<Model *>(items_.back().get())));
-    animators_.emplace_back(std::make_unique<Animator>(animations_.back().get()));
+    const int generation = ++import_generation_;
+    for (const auto& path : paths) {
+        import_pool_.start([this, path, generation]() {
+            ImportedModel imported{ generation, std::make_unique<Model>() };
+            const auto    io = std::make_shared<QtIOSystem::Counters>();
+            if (const auto cooked = imported.model->load_cooked(path, &import_pool_, io.get())) {
+                // the clip is cooked too, so the source is not parsed at all
+                imported.animation = std::make_unique<Animation>(*cooked, imported.model.get());
+                io->dump(qPrintable(path));
+
+                QMutexLocker lock(&pending_mutex_);
+                pending_.push_back(std::move(imported));
+                return;
+            }
+
+            Assimp::Importer importer{};
+            importer.SetIOHandler(new QtIOSystem{ io });
+            const auto scene = importer.ReadFile(path.toStdString(), Model::IMPORT_FLAGS);
+            if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+                qDebug() << importer.GetErrorString();
+                return;
+            }
+
+            imported.model->load(scene, QFileInfo{ QtIOSystem::normalize(path) }.dir().absolutePath().toStdString(),
+                                 &import_pool_, io.get());
+            imported.animation = std::make_unique<Animation>(scene, imported.model.get());
+            io->dump(qPrintable(path));
+
+            QMutexLocker lock(&pending_mutex_);
+            pending_.push_back(std::move(imported));
+        });
+    }
 
     update();
 }
@@ -133,17 +181,10 @@ void RhiWidget::dragEnterEvent(QDragEnterEvent *event)
 
 void RhiWidget::dropEvent(QDropEvent *event)
 {
-    items_.clear();
-    animations_.clear();
-    animators_.clear();
-
+    QStringList paths{};
     for (const auto mimedata = event->mimeData(); auto& url : mimedata->urls()) {
-        items_.emplace_back(std::make_unique<Model>(url.toLocalFile()));
-        animations_.emplace_back(std::make_unique<Animation>(url.toLocalFile().toStdString(),
-                                                             dynamic_cast<Model *>(items_.back().get())));
-
-        animators_.emplace_back(std::make_unique<Animator>(animations_.back().get()));
+        paths.push_back(url.toLocalFile());
     }
 
-    update();
+    import(paths);
 }
@@ -5,7 +5,9 @@
 #include "animator.h"
 #include "render-item.h"
 
+#include <QMutex>
 #include <QRhiWidget>
+#include <QThreadPool>
 #include <rhi/qrhi.h>
 
 class RhiWidget : public QRhiWidget
@@ -30,6 +32,17 @@ protected:
     void dropEvent(QDropEvent *event) override;
 
 private:
+    struct ImportedModel
+    {
+        int                        generation{};
+        std::unique_ptr<Model>     model{};
+        std::unique_ptr<Animation> animation{};
+    };
+
+    // Replaces the scene with paths; parsing and conversion run on importPool_
+    // and finished models are picked up by render().
+    void import(const QStringList& paths);
+
     QRhi *rhi_{};
 
     QMatrix4x4 mvp_{};
@@ -44,6 +57,12 @@ private:
     std::vector<std::unique_ptr<RenderItem>> items_{};
     std::vector<std::unique_ptr<Animation>>  animations_{};
     std::vector<std::unique_ptr<Animator>>   animators_{};
+
+    int                        import_generation_{};
+    QMutex                     pending_mutex_{};
+    std::vector<ImportedModel> pending_{};
+    // declared last so running imports finish before the members above go away
+    QThreadPool import_pool_{};
 };
 
 #endif //! RHI_WIDGET_H
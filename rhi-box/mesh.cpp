@@ -1,4 +1,5 @@
 #include "mesh.h"
+#include "qtrhi3d/rhicache.h"
 
 #include <QFile>
 #include <utility>
@@ -13,9 +14,22 @@ static QShader LoadShader(const QString& name)
 Mesh::Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices, std::vector<Material> materials,
            QMatrix4x4 transform)
     : vertices(std::move(vertices)), indices(std::move(indices)), materials(std::move(materials)),
-    transform_(transform)
+    transform_(transform), vertex_data_(this->vertices.data()),
+    vertex_count_(static_cast<quint32>(this->vertices.size())), index_data_(this->indices.data()),
+    index_count_(static_cast<quint32>(this->indices.size()))
 {}
 
+Mesh::Mesh(std::shared_ptr<qmesh::File> file, quint32 submesh, std::vector<Material> materials)
+    : materials(std::move(materials)), cooked_(std::move(file))
+{
+    const auto& s = cooked_->submesh(submesh);
+    transform_    = qmesh::toMatrix(s.transform);
+    vertex_data_  = cooked_->vertices(s);
+    vertex_count_ = s.vertexCount;
+    index_data_   = cooked_->indices(s);
+    index_count_  = s.indexCount;
+}
+
 void Mesh::create(QRhi *rhi, QRhiRenderTarget *rt)
 {
     if (rhi_ != rhi) {
@@ -25,19 +39,19 @@ void Mesh::create(QRhi *rhi, QRhiRenderTarget *rt)
 
     if (!pipeline_) {
         vbuf_.reset(rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer,
-                                   static_cast<quint32>(vertices.size() * sizeof(Vertex))));
+                                   vertex_count_ * static_cast<quint32>(sizeof(Vertex))));
         vbuf_->create();
 
         ibuf_.reset(rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::IndexBuffer,
-                                   static_cast<quint32>(indices.size() * sizeof(uint32_t))));
+                                   index_count_ * static_cast<quint32>(sizeof(uint32_t))));
         ibuf_->create();
 
         ubuf_.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, 64 + 64 * 500));
         ubuf_->create();
 
-        sampler_.reset(rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
-                                       QRhiSampler::Repeat, QRhiSampler::Repeat));
-        sampler_->create();
+        SamplerKey samplerKey{};
+        samplerKey.mipmapMode = QRhiSampler::None;
+        sampler_ = RhiResourceCache::instance(rhi)->sampler(samplerKey);
 
         std::vector<QRhiShaderResourceBinding> bindings{};
         bindings.emplace_back(QRhiShaderResourceBinding::uniformBuffer(
@@ -46,7 +60,7 @@ void Mesh::create(QRhi *rhi, QRhiRenderTarget *rt)
         for (size_t i = 0; i < materials.size(); ++i) {
             bindings.emplace_back(QRhiShaderResourceBinding::sampledTexture(
                 static_cast<int>(i + 1), QRhiShaderResourceBinding::FragmentStage,
-                materials[i].texture.get(), sampler_.get()));
+                materials[i].texture.get(), sampler_));
         }
 
         srb_.reset(rhi->newShaderResourceBindings());
@@ -91,8 +105,9 @@ void Mesh::create(QRhi *rhi, QRhiRenderTarget *rt)
 void Mesh::upload(QRhiResourceUpdateBatch *rub, const QMatrix4x4& mvp, const std::vector<QMatrix4x4>& bm)
 {
     if (!uploaded_) {
-        rub->uploadStaticBuffer(vbuf_.get(), vertices.data());
-        rub->uploadStaticBuffer(ibuf_.get(), indices.data());
+        rub->uploadStaticBuffer(vbuf_.get(), vertex_data_);
+        rub->uploadStaticBuffer(ibuf_.get(), index_data_);
+        cooked_.reset(); // the batch holds its own copy
         uploaded_ = true;
     }
 
@@ -110,5 +125,5 @@ void Mesh::draw(QRhiCommandBuffer *cb, const QRhiViewport& viewport)
 
     const QRhiCommandBuffer::VertexInput input{ vbuf_.get(), 0 };
     cb->setVertexInput(0, 1, &input, ibuf_.get(), 0, QRhiCommandBuffer::IndexUInt32);
-    cb->drawIndexed(static_cast<quint32>(indices.size()));
+    cb->drawIndexed(index_count_);
 }
@@ -2,6 +2,7 @@
 #define MESH_H
 
 #include "render-item.h"
+#include "qtrhi3d/qmesh.h"
 
 #include <assimp/material.h>
 
@@ -14,6 +15,8 @@ struct Vertex
     float weights[4]{ 0.0f };
 };
 
+static_assert(sizeof(Vertex) == qmesh::vertexStride(qmesh::VertexLayout::Skinned));
+
 struct BoneInfo
 {
     std::string name{};
@@ -33,6 +36,8 @@ class Mesh : public RenderItem
 public:
     Mesh(std::vector<Vertex> vertices, std::vector<uint32_t> indices, std::vector<Material> materials,
          QMatrix4x4 transform);
+    // Geometry stays in the mapped file until it is uploaded.
+    Mesh(std::shared_ptr<qmesh::File> file, quint32 submesh, std::vector<Material> materials);
 
     Mesh(Mesh&&) = default;
 
@@ -53,11 +58,17 @@ private:
     std::unique_ptr<QRhiBuffer>                 vbuf_{};
     std::unique_ptr<QRhiBuffer>                 ibuf_{};
     std::unique_ptr<QRhiBuffer>                 ubuf_{};
-    std::unique_ptr<QRhiSampler>                sampler_{};
+    QRhiSampler                                *sampler_{}; // owned by RhiResourceCache
     std::unique_ptr<QRhiShaderResourceBindings> srb_{};
 
     QMatrix4x4 transform_{};
 
+    std::shared_ptr<qmesh::File> cooked_{};
+    const void                  *vertex_data_{};
+    quint32                      vertex_count_{};
+    const quint32               *index_data_{};
+    quint32                      index_count_{};
+
     bool uploaded_{};
 };
 
@@ -1,6 +1,7 @@
 #include "model.h"
 
 #include "utils.h"
+#include "qtrhi3d/parallel.h"
 
 #include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
@@ -11,51 +12,180 @@
 
 Model::Model(const QString& path) { load(path); }
 
+static constexpr aiTextureType TEXTURE_TYPES[] = {
+    aiTextureType_DIFFUSE,
+    aiTextureType_SPECULAR,
+    aiTextureType_HEIGHT,
+    aiTextureType_AMBIENT,
+};
+
 bool Model::load(const QString& resource)
 {
-    dir_ = QFileInfo{ resource }.dir().absolutePath().toStdString();
+    qDebug() << resource;
+    if (load_cooked(resource)) {
+        return true;
+    }
 
-    qDebug() << dir_;
     Assimp::Importer importer{};
-    const auto       scene =
-        importer.ReadFile(resource.toStdString(), aiProcess_Triangulate | aiProcess_GenSmoothNormals |
-                                                      aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    auto *const      io       = new QtIOSystem{};
+    const auto       counters = io->counters();
+    importer.SetIOHandler(io);
+    const auto scene = importer.ReadFile(resource.toStdString(), IMPORT_FLAGS);
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
         qDebug() << importer.GetErrorString();
         return false;
     }
 
+    load(scene, QFileInfo{ QtIOSystem::normalize(resource) }.dir().absolutePath().toStdString(),
+         QThreadPool::globalInstance(), counters.get());
+    counters->dump(qPrintable(resource));
+    return true;
+}
+
+void Model::load(const aiScene *scene, const std::string& dir, QThreadPool *pool, QtIOSystem::Counters *io)
+{
+    dir_ = dir;
+
     meshes_.clear();
     textures_.clear();
+    images_.clear();
+
+    std::vector<std::pair<const aiMesh *, QMatrix4x4>> instances{};
+    load_node(scene, scene->mRootNode, {}, instances);
+
+    // bone ids depend on visiting order and texture keys are shared, so both
+    // are assigned up front; the conversions below only read them
+    for (const auto& [mesh, transform] : instances) {
+        register_bones(mesh);
+        register_textures(scene, mesh);
+    }
 
-    load_node(scene, scene->mRootNode, {});
+    meshes_.resize(instances.size());
+    parallelFor(pool, static_cast<int>(instances.size()), [&](int i) {
+        meshes_[i] = load_mesh(scene, instances[i].first, instances[i].second);
+    });
+    decode_images(pool, io);
 
     created_  = false;
     uploaded_ = false;
+}
 
-    return true;
+std::shared_ptr<qmesh::File> Model::load_cooked(const QString& resource, QThreadPool *pool,
+                                               QtIOSystem::Counters *io)
+{
+    auto file = qmesh::File::open(qmesh::cookedPath(resource, qmesh::VertexLayout::Skinned),
+                                  qmesh::VertexLayout::Skinned, resource);
+    if (!file) {
+        return nullptr;
+    }
+
+    dir_ = QFileInfo{ QtIOSystem::normalize(resource) }.dir().absolutePath().toStdString();
+    meshes_.clear();
+    textures_.clear();
+    images_.clear();
+
+    const auto& header = file->header();
+    for (quint32 bi = 0; bi < header.boneCount; ++bi) {
+        const auto& b    = file->bone(bi);
+        std::string name{ file->string(b.nameOffset, b.nameLength) };
+        bone_infos_[name] = { .name = name, .id = b.id, .offset = qmesh::toMatrix(b.offset) };
+    }
+
+    for (quint32 si = 0; si < header.submeshCount; ++si) {
+        const auto&           sub = file->submesh(si);
+        std::vector<Material> materials{};
+        for (quint32 ti = sub.firstTexture; ti < sub.firstTexture + sub.textureCount; ++ti) {
+            const auto& tex = file->texture(ti);
+            const auto  key = QtIOSystem::resolve(dir_, std::string(file->string(tex.pathOffset, tex.pathLength)));
+            materials.emplace_back(static_cast<aiTextureType>(tex.type), nullptr, key);
+            textures_[key].reset();
+            images_[key];
+        }
+        meshes_.emplace_back(std::make_unique<Mesh>(file, si, std::move(materials)));
+    }
+    decode_images(pool, io);
+
+    created_  = false;
+    uploaded_ = false;
+    return file;
+}
+
+void Model::decode_images(QThreadPool *pool, QtIOSystem::Counters *io)
+{
+    std::vector<std::pair<const std::string, qtex::Payload> *> images{};
+    for (auto& entry : images_) {
+        images.push_back(&entry);
+    }
+
+    // a cooked .qtex is transcoded for the GPU seen last, the image decoded otherwise
+    const auto targets = qtex::Targets::current();
+    parallelFor(pool, static_cast<int>(images.size()), [&](int i) {
+        auto& [path, image] = *images[i];
+        const auto source = QString::fromStdString(path);
+        if (auto cooked = qtex::File::open(qtex::cookedPath(source), source)) {
+            image = cooked->transcode(targets, false, pool);
+            if (!image.isNull()) {
+                return;
+            }
+        }
+        image = qtex::Payload::fromImage(QtIOSystem::readImage(source, io));
+        if (image.isNull()) {
+            qDebug() << "failed to load texture" << source;
+        }
+    });
 }
 
-void Model::load_node(const aiScene *scene, const aiNode *node, const QMatrix4x4& accumulated_transform)
+void Model::load_node(const aiScene *scene, const aiNode *node, const QMatrix4x4& accumulated_transform,
+                      std::vector<std::pair<const aiMesh *, QMatrix4x4>>& instances)
 {
     const auto transform = accumulated_transform * utils::to_qmatrix4x4(node->mTransformation);
 
     for (uint32_t i = 0; i < node->mNumMeshes; ++i) {
-        load_mesh(scene, scene->mMeshes[node->mMeshes[i]], transform);
+        instances.emplace_back(scene->mMeshes[node->mMeshes[i]], transform);
     }
 
     for (uint32_t i = 0; i < node->mNumChildren; ++i) {
-        load_node(scene, node->mChildren[i], transform);
+        load_node(scene, node->mChildren[i], transform, instances);
+    }
+}
+
+void Model::register_bones(const aiMesh *mesh)
+{
+    for (unsigned bi = 0; bi < mesh->mNumBones; ++bi) {
+        std::string name = mesh->mBones[bi]->mName.C_Str();
+
+        if (!bone_infos_.contains(name)) {
+            const BoneInfo bone{
+                .name   = name,
+                .id     = static_cast<int>(bone_infos_.size()),
+                .offset = utils::to_qmatrix4x4(mesh->mBones[bi]->mOffsetMatrix),
+            };
+            bone_infos_[name] = bone;
+        }
     }
 }
 
-void Model::load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4& transform)
+void Model::register_textures(const aiScene *scene, const aiMesh *mesh)
 {
-    std::vector<Vertex> vertices{};
+    const auto material = scene->mMaterials[mesh->mMaterialIndex];
+
+    for (const auto type : TEXTURE_TYPES) {
+        for (unsigned di = 0; di < material->GetTextureCount(type); di++) {
+            aiString path;
+            material->GetTexture(type, di, &path);
+            const auto key = QtIOSystem::resolve(dir_, std::string(path.data, path.length));
+            textures_[key].reset();
+            images_[key];
+        }
+    }
+}
+
+std::unique_ptr<Mesh> Model::load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4& transform) const
+{
+    std::vector<Vertex> vertices(mesh->mNumVertices);
     for (unsigned mi = 0; mi < mesh->mNumVertices; mi++) {
-        Vertex vertex{
-                      .position = { mesh->mVertices[mi].x, mesh->mVertices[mi].y, mesh->mVertices[mi].z },
-                      };
+        Vertex& vertex = vertices[mi];
+        vertex.position = { mesh->mVertices[mi].x, mesh->mVertices[mi].y, mesh->mVertices[mi].z };
 
         if (mesh->HasNormals()) {
             vertex.normal = { mesh->mNormals[mi].x, mesh->mNormals[mi].y, mesh->mNormals[mi].z };
@@ -64,13 +194,12 @@ void Model::load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4
         if (mesh->mTextureCoords[0]) {
             vertex.coords = { mesh->mTextureCoords[0][mi].x, mesh->mTextureCoords[0][mi].y };
         }
-
-        vertices.push_back(vertex);
     }
 
     std::vector<uint32_t> indices{};
+    indices.reserve(static_cast<size_t>(mesh->mNumFaces) * 3);
     for (unsigned ii = 0; ii < mesh->mNumFaces; ii++) {
-        const auto face = mesh->mFaces[ii];
+        const auto& face = mesh->mFaces[ii];
         for (unsigned ij = 0; ij < face.mNumIndices; ij++) {
             indices.emplace_back(face.mIndices[ij]);
         }
@@ -79,51 +208,16 @@ void Model::load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4
     std::vector<Material> materials{};
     const auto            material = scene->mMaterials[mesh->mMaterialIndex];
 
-    for (unsigned di = 0; di < material->GetTextureCount(aiTextureType_DIFFUSE); di++) {
-        aiString path;
-        material->GetTexture(aiTextureType_DIFFUSE, di, &path);
-        materials.emplace_back(aiTextureType_DIFFUSE, nullptr,
-                               dir_ + "/" + std::string(path.data, path.length));
-        textures_[dir_ + "/" + std::string(path.data, path.length)].reset();
-    }
-
-    for (unsigned di = 0; di < material->GetTextureCount(aiTextureType_SPECULAR); di++) {
-        aiString path;
-        material->GetTexture(aiTextureType_SPECULAR, di, &path);
-        materials.emplace_back(aiTextureType_SPECULAR, nullptr,
-                               dir_ + "/" + std::string(path.data, path.length));
-        textures_[dir_ + "/" + std::string(path.data, path.length)].reset();
-    }
-
-    for (unsigned di = 0; di < material->GetTextureCount(aiTextureType_HEIGHT); di++) {
-        aiString path;
-        material->GetTexture(aiTextureType_HEIGHT, di, &path);
-        materials.emplace_back(aiTextureType_HEIGHT, nullptr,
-                               dir_ + "/" + std::string(path.data, path.length));
-        textures_[dir_ + "/" + std::string(path.data, path.length)].reset();
-    }
-
-    for (unsigned di = 0; di < material->GetTextureCount(aiTextureType_AMBIENT); di++) {
-        aiString path;
-        material->GetTexture(aiTextureType_AMBIENT, di, &path);
-        materials.emplace_back(aiTextureType_AMBIENT, nullptr,
-                               dir_ + "/" + std::string(path.data, path.length));
-        textures_[dir_ + "/" + std::string(path.data, path.length)].reset();
+    for (const auto type : TEXTURE_TYPES) {
+        for (unsigned di = 0; di < material->GetTextureCount(type); di++) {
+            aiString path;
+            material->GetTexture(type, di, &path);
+            materials.emplace_back(type, nullptr, QtIOSystem::resolve(dir_, std::string(path.data, path.length)));
+        }
     }
 
     for (unsigned bi = 0; bi < mesh->mNumBones; ++bi) {
-        std::string name = mesh->mBones[bi]->mName.C_Str();
-
-        if (!bone_infos_.contains(name)) {
-            const BoneInfo bone{
-                .name   = name,
-                .id     = static_cast<int>(bone_infos_.size()),
-                .offset = utils::to_qmatrix4x4(mesh->mBones[bi]->mOffsetMatrix),
-            };
-            bone_infos_[name] = bone;
-        }
-
-        const int id = bone_infos_[name].id;
+        const int id = bone_infos_.at(mesh->mBones[bi]->mName.C_Str()).id;
 
         assert(id != -1);
         const auto weights = mesh->mBones[bi]->mWeights;
@@ -144,18 +238,25 @@ void Model::load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4
         }
     }
 
-    meshes_.emplace_back(std::make_unique<Mesh>(vertices, indices, materials, transform));
+    return std::make_unique<Mesh>(std::move(vertices), std::move(indices), std::move(materials), transform);
 }
 
 void Model::create(QRhi *rhi, QRhiRenderTarget *rt)
 {
     if (!created_) {
+        // textures other models already uploaded are shared through the cache
+        auto *cache = TextureCache::instance(rhi);
         for (auto& [key, value] : textures_) {
-            QImage image{};
-            if (!image.load(QString::fromStdString(key))) continue;
-
-            value.reset(rhi->newTexture(QRhiTexture::RGBA8, image.size()));
-            value->create();
+            auto& image = images_[key];
+            if (image.isNull()) continue;
+
+            const auto           source = QString::fromStdString(key);
+            const TextureOptions options{ false, image.levels.size() > 1, false };
+            if ((value = cache->find(source, options))) {
+                image = {};
+                continue;
+            }
+            value = cache->insert(source, options, image.createTexture(rhi), TextureCache::payloadBytes(image));
         }
 
         for (auto& mesh : meshes_) {
@@ -175,11 +276,11 @@ void Model::upload(QRhiResourceUpdateBatch *rub, const QMatrix4x4& mvp, const st
 {
     if (!uploaded_) {
         for (auto& [path, tex] : textures_) {
-            QImage image{};
-            if (image.load(QString::fromStdString(path))) {
-                rub->uploadTexture(tex.get(), image);
+            if (tex && !images_[path].isNull()) {
+                images_[path].upload(rub, tex.get());
             }
         }
+        images_.clear();
         uploaded_ = true;
     }
 
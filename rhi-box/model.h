@@ -3,17 +3,37 @@
 
 #include "mesh.h"
 #include "render-item.h"
+#include "qtrhi3d/texturecache.h"
+#include "qtrhi3d/qtiosystem.h"
 
+#include <assimp/postprocess.h>
 #include <assimp/scene.h>
+#include <QImage>
+#include <QThreadPool>
 
 class Model final : public RenderItem
 {
 public:
+    static constexpr unsigned IMPORT_FLAGS =
+        aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+    Model() = default;
     explicit Model(const QString& path);
 
+    // Uses the cooked .skinned.qmesh next to resource when it is up to date, assimp otherwise.
     bool load(const QString& resource);
-    void load_node(const aiScene *scene, const aiNode *node, const QMatrix4x4&);
-    void load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4&);
+    // Returns the cooked file, e.g. for its animation, or null when there is none up to date.
+    std::shared_ptr<qmesh::File> load_cooked(const QString& resource,
+                                             QThreadPool *pool = QThreadPool::globalInstance(),
+                                             QtIOSystem::Counters *io = nullptr);
+    // Converts an already parsed scene. Meshes and textures are processed in
+    // parallel on pool; no QRhi calls are made, so this can run off the GUI thread.
+    // Texture reads are added to io when given.
+    void load(const aiScene *scene, const std::string& dir, QThreadPool *pool = QThreadPool::globalInstance(),
+              QtIOSystem::Counters *io = nullptr);
+    void load_node(const aiScene *scene, const aiNode *node, const QMatrix4x4&,
+                   std::vector<std::pair<const aiMesh *, QMatrix4x4>>& instances);
+    [[nodiscard]] std::unique_ptr<Mesh> load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4&) const;
 
     void create(QRhi *rhi, QRhiRenderTarget *rt) override;
     void upload(QRhiResourceUpdateBatch *rub, const QMatrix4x4& mvp,const std::vector<QMatrix4x4>&) override;
@@ -22,12 +42,17 @@ public:
     [[nodiscard]] std::map<std::string, BoneInfo>& bone_infos() { return bone_infos_; }
 
 private:
+    void register_bones(const aiMesh *mesh);
+    void register_textures(const aiScene *scene, const aiMesh *mesh);
+    void decode_images(QThreadPool *pool, QtIOSystem::Counters *io);
+
     std::string dir_;
-    bool        created_;
-    bool        uploaded_;
+    bool        created_{};
+    bool        uploaded_{};
 
     std::vector<std::unique_ptr<Mesh>>                  meshes_{};
     std::map<std::string, std::shared_ptr<QRhiTexture>> textures_{};
+    std::map<std::string, qtex::Payload>                images_{}; // decoded once, dropped after upload
     std::map<std::string, BoneInfo> bone_infos_{};
 };
 
@@ -6,6 +6,7 @@
 #include <QFile>
 #include <array>
 #include <rhi/qshader.h>
+#include "qtrhi3d/rhicache.h"
 
 using namespace std;
 
@@ -76,7 +77,7 @@ void TwoCubesRhiWidget::releaseResources()
     m_srbToon.reset();
     m_uboCubeA.reset();
     m_uboCubeB.reset();
-    m_sampler.reset();
+    m_sampler = nullptr;
     m_tex.reset();
     m_vbuf.reset();
     m_ibuf.reset();
@@ -164,9 +165,9 @@ void TwoCubesRhiWidget::createTexture()
     m_tex.reset(m_rhi->newTexture(QRhiTexture::RGBA8, QSize(W, H)));
     m_tex->create();
 
-    m_sampler.reset(m_rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
-                                      QRhiSampler::Repeat, QRhiSampler::Repeat));
-    m_sampler->create();
+    SamplerKey samplerKey;
+    samplerKey.mipmapMode = QRhiSampler::None;
+    m_sampler = RhiResourceCache::instance(m_rhi)->sampler(samplerKey);
 }
 
 void TwoCubesRhiWidget::buildPipelines()
@@ -208,7 +209,7 @@ void TwoCubesRhiWidget::buildPipelines()
                 1,
                 QRhiShaderResourceBinding::FragmentStage,
                 m_tex.get(),
-                m_sampler.get())
+                m_sampler)
         });
         outSrb->create();
 
@@ -48,7 +48,7 @@ private:
 
     // Texture + sampler
     std::unique_ptr<QRhiTexture> m_tex;
-    std::unique_ptr<QRhiSampler> m_sampler;
+    QRhiSampler *m_sampler = nullptr; // owned by RhiResourceCache
     QImage m_texImg;
 
     // Pipelines
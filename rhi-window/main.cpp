@@ -7,12 +7,16 @@
 #include <QtWidgets/qslider.h>
 #include <QtWidgets/qwidget.h>
 #include "rhiwindow.h"
+#include "qtrhi3d/assetpack.h"
+#include "qtrhi3d/startupprofiler.h"
 #include <utils.h>
 //#define EDITOR_MODE
 
 int main(int argc, char **argv)
 {
+    startup::Profiler &profiler = startup::Profiler::instance(); // starts the startup clock
     QApplication app(argc, argv);
+    const qint64 appUs = profiler.nowUs();
     QRhi::Implementation graphicsApi;
 
 
@@ -46,6 +50,14 @@ int main(int argc, char **argv)
     cmdLineParser.addOption(d3d12Option);
     QCommandLineOption mtlOption({ "m", "metal" }, QLatin1String("Metal"));
     cmdLineParser.addOption(mtlOption);
+    QCommandLineOption verifyIblOption("verify-ibl", QLatin1String("Regenerate the BRDF table on the GPU and compare it with the CPU one"));
+    cmdLineParser.addOption(verifyIblOption);
+    QCommandLineOption atlasOption("material-atlas", QLatin1String("Share one SRB over material texture arrays; atlas layers are not streamed"));
+    cmdLineParser.addOption(atlasOption);
+    QCommandLineOption packOption("pack", QLatin1String("Mount an extra asset pack, overriding assets.qpak"), QLatin1String("file"));
+    cmdLineParser.addOption(packOption);
+    QCommandLineOption profileOption("profile-startup", QLatin1String("Time every step up to the loaded scene, log the report, write a Chrome trace to file and quit; with -n no GPU is needed"), QLatin1String("file"));
+    cmdLineParser.addOption(profileOption);
 
     cmdLineParser.process(app);
     if (cmdLineParser.isSet(nullOption))
@@ -60,6 +72,22 @@ int main(int argc, char **argv)
         graphicsApi = QRhi::D3D12;
     if (cmdLineParser.isSet(mtlOption))
         graphicsApi = QRhi::Metal;
+    BrdfLut::setVerify(cmdLineParser.isSet(verifyIblOption));
+    MaterialAtlas::setEnabled(cmdLineParser.isSet(atlasOption));
+    if (cmdLineParser.isSet(profileOption)) {
+        profiler.enable(cmdLineParser.value(profileOption));
+        profiler.record(QStringLiteral("QApplication"), "startup", 0, appUs);
+    }
+
+    // shaders and textures; without a pack they come from the compiled in resources
+    startup::Scope mountScope("qpak::mount");
+    const QString pack = QCoreApplication::applicationDirPath() + QLatin1String("/assets.qpak");
+    if (QFile::exists(pack) && !qpak::mount(pack))
+        qWarning() << "Cannot mount" << pack;
+    for (const QString &extra : cmdLineParser.values(packOption))
+        if (!qpak::mount(extra))
+            qWarning() << "Cannot mount" << extra;
+    mountScope.end();
 
     // For OpenGL, to ensure there is a depth/stencil buffer for the window.
     // With other APIs this is under the application's control (QRhiRenderBuffer etc.)
@@ -0,0 +1 @@
+#include "assetimporter.h"
@@ -0,0 +1,309 @@
+#ifndef ASSETIMPORTER_H
+#define ASSETIMPORTER_H
+
+#include "fbxmodel.h"
+#include "parallel.h"
+#include "startupprofiler.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QFileInfo>
+#include <QDebug>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <atomic>
+#include <cfloat>
+#include <climits>
+#include <deque>
+#include <memory>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+// Background model import. A job parses the file on a worker (or maps its
+// cooked .qmesh), then converts every mesh instance in parallel and decodes
+// each referenced texture once.
+// Results are queued as they finish; the render thread drains the queue with
+// takeEvents() and feeds them into an FbxModel, so the model fills in
+// progressively while frames keep being presented.
+
+class AssetImporter {
+public:
+    struct Progress {
+        enum Stage { Queued, Parsing, Converting, Finished, Failed };
+        Stage stage = Queued;
+        int meshesDone = 0;
+        int meshesTotal = 0;
+        int texturesDone = 0;
+        int texturesTotal = 0;
+        // placeholder bounds in model space, known right after parsing
+        bool hasBounds = false;
+        QVector3D boundsMin;
+        QVector3D boundsMax;
+        QString error;
+        // file and texture I/O through QtIOSystem so far
+        qint64 bytesRead = 0;
+        qint64 ioUs = 0;
+
+        float fraction() const {
+            if (stage == Finished) return 1.0f;
+            const int total = meshesTotal + texturesTotal;
+            return total ? float(meshesDone + texturesDone) / float(total) : 0.0f;
+        }
+    };
+
+    struct Event {
+        enum Type { Parsed, MeshReady, TextureReady, Finished, Failed };
+        int job = 0;
+        Type type = Parsed;
+        MeshData mesh;
+        std::string texturePath;
+        qtex::Payload texture;
+    };
+
+    explicit AssetImporter(int maxThreads = QThread::idealThreadCount()) {
+        pool_.setMaxThreadCount(qMax(2, maxThreads));
+    }
+
+    ~AssetImporter() {
+        for (auto& [id, job] : jobs_)
+            job->cancelled = true;
+        pool_.waitForDone();
+    }
+
+    AssetImporter(const AssetImporter&) = delete;
+    AssetImporter& operator=(const AssetImporter&) = delete;
+
+    // Starts importing path and returns a job id for progress() and the events.
+    int load(const QString& path) {
+        auto job = std::make_shared<Job>();
+        job->id = ++lastJobId_;
+        job->path = path;
+        jobs_[job->id] = job;
+        pool_.start([this, job]() { run(job); });
+        return job->id;
+    }
+
+    Progress progress(int jobId) const {
+        auto it = jobs_.find(jobId);
+        if (it == jobs_.end())
+            return {};
+        const Job& job = *it->second;
+        QMutexLocker lock(&job.mutex);
+        Progress p = job.progress;
+        p.meshesDone = job.meshesDone.load();
+        p.texturesDone = job.texturesDone.load();
+        p.bytesRead = job.io->readBytes.load();
+        p.ioUs = job.io->ioUs.load();
+        return p;
+    }
+
+    bool isBusy() const { return pool_.activeThreadCount() > 0; }
+
+    // Render thread: takes up to maxEvents finished results in completion order.
+    std::vector<Event> takeEvents(int maxEvents = INT_MAX) {
+        std::vector<Event> out;
+        QMutexLocker lock(&queueMutex_);
+        while (!queue_.empty() && int(out.size()) < maxEvents) {
+            out.push_back(std::move(queue_.front()));
+            queue_.pop_front();
+        }
+        return out;
+    }
+
+    // Applies an event to the model it was requested for.
+    static void apply(FbxModel& model, Event& event) {
+        switch (event.type) {
+        case Event::Parsed:
+            break;
+        case Event::MeshReady:
+            model.addMesh(std::move(event.mesh));
+            break;
+        case Event::TextureReady:
+            model.addTexture(event.texturePath, std::move(event.texture));
+            break;
+        case Event::Finished:
+        case Event::Failed:
+            break;
+        }
+    }
+
+private:
+    struct Job {
+        int id = 0;
+        QString path;
+        std::atomic<bool> cancelled{false};
+        std::atomic<int> meshesDone{0};
+        std::atomic<int> texturesDone{0};
+        std::atomic<int> remaining{0};
+        std::shared_ptr<QtIOSystem::Counters> io = std::make_shared<QtIOSystem::Counters>();
+        mutable QMutex mutex;
+        Progress progress;
+    };
+
+    void run(const std::shared_ptr<Job>& job) {
+        setStage(*job, Progress::Parsing);
+        startup::Scope parseScope("FbxModel parse");
+        if (auto cooked = FbxModel::openCooked(job->path)) {
+            parseScope.end();
+            runCooked(job, cooked);
+            return;
+        }
+        auto importer = std::make_shared<Assimp::Importer>();
+        importer->SetIOHandler(new QtIOSystem(job->io));
+        const aiScene *scene = importer->ReadFile(job->path.toStdString(),
+                                                  FbxModel::IMPORT_FLAGS | aiProcess_GenBoundingBoxes);
+        parseScope.end();
+        if (!scene || !scene->mRootNode || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
+            fail(*job, QString::fromUtf8(importer->GetErrorString()));
+            return;
+        }
+
+        const std::string dir = QFileInfo(QtIOSystem::normalize(job->path)).dir().absolutePath().toStdString();
+        std::vector<std::pair<const aiMesh *, QMatrix4x4>> instances;
+        collectInstances(scene, scene->mRootNode, {}, instances);
+
+        std::set<std::string> texturePaths;
+        QVector3D bmin(FLT_MAX, FLT_MAX, FLT_MAX), bmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (const auto& [mesh, transform] : instances) {
+            const aiMaterial *mat = scene->mMaterials[mesh->mMaterialIndex];
+            for (unsigned t = 0; t < mat->GetTextureCount(aiTextureType_DIFFUSE); ++t) {
+                aiString p;
+                mat->GetTexture(aiTextureType_DIFFUSE, t, &p);
+                texturePaths.insert(QtIOSystem::resolve(dir, std::string(p.data, p.length)));
+            }
+            const aiVector3D& a = mesh->mAABB.mMin;
+            const aiVector3D& b = mesh->mAABB.mMax;
+            for (int c = 0; c < 8; ++c) {
+                const QVector3D corner = transform.map(QVector3D(c & 1 ? b.x : a.x, c & 2 ? b.y : a.y, c & 4 ? b.z : a.z));
+                bmin = QVector3D(qMin(bmin.x(), corner.x()), qMin(bmin.y(), corner.y()), qMin(bmin.z(), corner.z()));
+                bmax = QVector3D(qMax(bmax.x(), corner.x()), qMax(bmax.y(), corner.y()), qMax(bmax.z(), corner.z()));
+            }
+        }
+
+        {
+            QMutexLocker lock(&job->mutex);
+            job->progress.stage = Progress::Converting;
+            job->progress.meshesTotal = int(instances.size());
+            job->progress.texturesTotal = int(texturePaths.size());
+            job->progress.hasBounds = !instances.empty();
+            job->progress.boundsMin = bmin;
+            job->progress.boundsMax = bmax;
+        }
+        // one per texture plus one for the mesh batch
+        job->remaining = int(texturePaths.size()) + 1;
+        push({ job->id, Event::Parsed });
+
+        // textures decode alongside the mesh conversion below
+        startTextureDecodes(job, texturePaths);
+
+        parallelFor(&pool_, int(instances.size()), [&](int i) {
+            if (job->cancelled)
+                return;
+            startup::Scope scope("FbxModel convertMesh");
+            Event e{ job->id, Event::MeshReady };
+            e.mesh = FbxModel::convertMesh(scene, instances[i].first, dir, instances[i].second);
+            ++job->meshesDone;
+            push(std::move(e));
+        });
+        finishOne(job);
+    }
+
+    // A cooked file needs no conversion: the meshes only reference the
+    // mapping, so just the textures go to the pool.
+    void runCooked(const std::shared_ptr<Job>& job, const std::shared_ptr<qmesh::File>& cooked) {
+        const std::string dir = QFileInfo(QtIOSystem::normalize(job->path)).dir().absolutePath().toStdString();
+        const quint32 meshCount = cooked->header().submeshCount;
+        std::vector<MeshData> meshes;
+        std::set<std::string> texturePaths;
+        for (quint32 i = 0; i < meshCount; ++i) {
+            meshes.push_back(FbxModel::cookedMesh(cooked, i, dir));
+            texturePaths.insert(meshes.back().texturePaths.begin(), meshes.back().texturePaths.end());
+        }
+
+        {
+            QMutexLocker lock(&job->mutex);
+            job->progress.stage = Progress::Converting;
+            job->progress.meshesTotal = int(meshCount);
+            job->progress.texturesTotal = int(texturePaths.size());
+            job->progress.hasBounds = meshCount > 0;
+            job->progress.boundsMin = cooked->boundsMin();
+            job->progress.boundsMax = cooked->boundsMax();
+        }
+        job->remaining = int(texturePaths.size()) + 1;
+        push({ job->id, Event::Parsed });
+
+        startTextureDecodes(job, texturePaths);
+        for (MeshData& data : meshes) {
+            Event e{ job->id, Event::MeshReady };
+            e.mesh = std::move(data);
+            ++job->meshesDone;
+            push(std::move(e));
+        }
+        finishOne(job);
+    }
+
+    void startTextureDecodes(const std::shared_ptr<Job>& job, const std::set<std::string>& paths) {
+        for (const std::string& path : paths) {
+            pool_.start([this, job, path]() {
+                Event e{ job->id, Event::TextureReady };
+                e.texturePath = path;
+                if (!job->cancelled) {
+                    startup::Scope scope("FbxModel decodeTexture");
+                    e.texture = FbxModel::decodeTexture(path, job->io.get());
+                }
+                ++job->texturesDone;
+                push(std::move(e));
+                finishOne(job);
+            });
+        }
+    }
+
+    static void collectInstances(const aiScene *scene, const aiNode *node, const QMatrix4x4& accumulated,
+                                 std::vector<std::pair<const aiMesh *, QMatrix4x4>>& out) {
+        const QMatrix4x4 transform = accumulated * utils::to_qmatrix4x4(node->mTransformation);
+        for (unsigned i = 0; i < node->mNumMeshes; ++i)
+            out.emplace_back(scene->mMeshes[node->mMeshes[i]], transform);
+        for (unsigned i = 0; i < node->mNumChildren; ++i)
+            collectInstances(scene, node->mChildren[i], transform, out);
+    }
+
+    void finishOne(const std::shared_ptr<Job>& job) {
+        if (--job->remaining != 0)
+            return;
+        setStage(*job, Progress::Finished);
+        job->io->dump(qPrintable(job->path));
+        push({ job->id, Event::Finished });
+    }
+
+    void fail(Job& job, const QString& error) {
+        qWarning() << "AssetImporter:" << job.path << error;
+        {
+            QMutexLocker lock(&job.mutex);
+            job.progress.stage = Progress::Failed;
+            job.progress.error = error;
+        }
+        push({ job.id, Event::Failed });
+    }
+
+    static void setStage(Job& job, Progress::Stage stage) {
+        QMutexLocker lock(&job.mutex);
+        job.progress.stage = stage;
+    }
+
+    void push(Event&& e) {
+        QMutexLocker lock(&queueMutex_);
+        queue_.push_back(std::move(e));
+    }
+
+    QThreadPool pool_;
+    int lastJobId_ = 0;
+    std::unordered_map<int, std::shared_ptr<Job>> jobs_;
+    QMutex queueMutex_;
+    std::deque<Event> queue_;
+};
+
+#endif // ASSETIMPORTER_H
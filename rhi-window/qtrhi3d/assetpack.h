@@ -0,0 +1,328 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <QByteArrayView>
+#include <QDir>
+#include <QFile>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Asset pack (.qpak), written offline by tools/qpack, so shaders and textures
+// ship next to the executable instead of inside it:
+//
+//   Header
+//   Entry[entryCount]   sorted by name
+//   quint32[slotCount]  open addressed hash index, entry + 1 or 0 when empty
+//   names               UTF-8, not terminated
+//   blobs               each ALIGNMENT aligned
+//
+// Names are resource paths without the ":/" ("shaders/prebuild/pbr.vert.qsb").
+// A Pack maps the whole file; stored blobs are handed out as views into the
+// mapping, deflated ones (flag Compressed) are inflated on every read.
+//
+// Packs are mounted once at startup with mount(). read() then serves ":/x",
+// "qrc:/x" and relative "x" paths from the newest pack that has them, and
+// falls back to the file itself (compiled in resource or disk) otherwise.
+
+namespace qpak {
+
+constexpr quint32 MAGIC = 0x4b415051; // "QPAK"
+constexpr quint32 VERSION = 1;
+constexpr quint32 ALIGNMENT = 64;
+
+enum EntryFlags : quint32 {
+    Compressed = 1, // qCompress()ed; size is the stored, rawSize the inflated byte count
+};
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    quint32 entryCount;
+    quint32 slotCount; // power of two
+    quint64 namesOffset;
+    quint64 namesSize;
+};
+
+struct Entry {
+    quint64 hash; // hashName() of the name
+    quint64 offset;
+    quint64 size;
+    quint64 rawSize;
+    quint32 nameOffset; // from namesOffset
+    quint32 nameLength;
+    quint32 flags;
+    quint32 reserved;
+};
+
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) % 16 == 0);
+static_assert(sizeof(Entry) % 16 == 0);
+
+// 64-bit FNV-1a
+inline quint64 hashName(QByteArrayView name) {
+    quint64 h = 0xcbf29ce484222325ull;
+    for (char c : name) {
+        h ^= quint8(c);
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+// Pack name of a path, or empty for absolute file system paths.
+inline QByteArray nameOf(const QString &path) {
+    QString name = path;
+    if (name.startsWith(QLatin1String("qrc:")))
+        name.remove(0, 3);
+    if (name.startsWith(QLatin1Char(':'))) {
+        qsizetype i = 1;
+        while (i < name.size() && name[i] == QLatin1Char('/'))
+            ++i;
+        name = name.mid(i);
+    } else if (QDir::isAbsolutePath(name)) {
+        return {};
+    }
+    return QDir::cleanPath(name).toUtf8();
+}
+
+struct Stats {
+    std::atomic<qint64> hits{0};
+    std::atomic<qint64> misses{0};       // read() fell back to the file
+    std::atomic<qint64> mappedBytes{0};  // handed out as views
+    std::atomic<qint64> inflatedBytes{0};
+};
+
+inline Stats &stats() {
+    static Stats s;
+    return s;
+}
+
+class Pack {
+public:
+    static std::unique_ptr<Pack> open(const QString &path) {
+        std::unique_ptr<Pack> p(new Pack(path));
+        if (!p->file_.open(QIODevice::ReadOnly))
+            return {};
+        p->size_ = quint64(p->file_.size());
+        if (p->size_ < sizeof(Header))
+            return {};
+        p->data_ = p->file_.map(0, qint64(p->size_));
+        if (!p->data_ || !p->validate()) {
+            qWarning() << "qpak: not a valid pack:" << path;
+            return {};
+        }
+        return p;
+    }
+
+    const Header &header() const { return *reinterpret_cast<const Header *>(data_); }
+    const Entry &entry(quint32 i) const { return reinterpret_cast<const Entry *>(data_ + sizeof(Header))[i]; }
+    QString fileName() const { return file_.fileName(); }
+
+    QByteArrayView name(const Entry &e) const {
+        return QByteArrayView(data_ + header().namesOffset + e.nameOffset, e.nameLength);
+    }
+
+    const Entry *find(QByteArrayView name) const {
+        const Header &h = header();
+        const quint64 hash = hashName(name);
+        const quint32 mask = h.slotCount - 1;
+        for (quint32 i = quint32(hash) & mask, probes = 0; probes < h.slotCount; i = (i + 1) & mask, ++probes) {
+            const quint32 slot = slots()[i];
+            if (!slot)
+                return nullptr;
+            const Entry &e = entry(slot - 1);
+            if (e.hash == hash && this->name(e) == name)
+                return &e;
+        }
+        return nullptr;
+    }
+
+    // The stored bytes, deflated for Compressed entries.
+    QByteArrayView span(const Entry &e) const { return QByteArrayView(data_ + e.offset, qsizetype(e.size)); }
+
+    // Contents without copying when stored, inflated otherwise; views stay
+    // valid as long as the pack is open.
+    QByteArray data(const Entry &e) const {
+        if (!(e.flags & Compressed)) {
+            stats().mappedBytes += qint64(e.size);
+            return QByteArray::fromRawData(reinterpret_cast<const char *>(data_ + e.offset), qsizetype(e.size));
+        }
+        QByteArray raw = qUncompress(data_ + e.offset, qsizetype(e.size));
+        if (quint64(raw.size()) != e.rawSize) {
+            qWarning() << "qpak: corrupt entry" << name(e) << "in" << fileName();
+            return {};
+        }
+        stats().inflatedBytes += raw.size();
+        return raw;
+    }
+
+private:
+    explicit Pack(const QString &path) : file_(path) {}
+
+    const quint32 *slots() const {
+        return reinterpret_cast<const quint32 *>(data_ + sizeof(Header) + quint64(header().entryCount) * sizeof(Entry));
+    }
+
+    bool validate() const {
+        const Header &h = header();
+        if (h.magic != MAGIC || h.version != VERSION || !h.slotCount || (h.slotCount & (h.slotCount - 1))
+            || h.slotCount < h.entryCount)
+            return false;
+        const quint64 tables = sizeof(Header) + quint64(h.entryCount) * sizeof(Entry) + quint64(h.slotCount) * 4;
+        if (tables > size_ || h.namesOffset < tables || h.namesOffset > size_ || h.namesSize > size_ - h.namesOffset)
+            return false;
+        for (quint32 i = 0; i < h.entryCount; ++i) {
+            const Entry &e = entry(i);
+            if (e.offset % ALIGNMENT || e.offset > size_ || e.size > size_ - e.offset
+                || quint64(e.nameOffset) + e.nameLength > h.namesSize
+                || (!(e.flags & Compressed) && e.size != e.rawSize))
+                return false;
+        }
+        for (quint32 i = 0; i < h.slotCount; ++i)
+            if (slots()[i] > h.entryCount)
+                return false;
+        return true;
+    }
+
+    QFile file_;
+    const uchar *data_ = nullptr;
+    quint64 size_ = 0;
+};
+
+inline std::vector<std::unique_ptr<Pack>> &mounted() {
+    static std::vector<std::unique_ptr<Pack>> packs;
+    return packs;
+}
+
+// Not thread safe; mount before anything reads assets.
+inline bool mount(const QString &path) {
+    auto pack = Pack::open(path);
+    if (!pack)
+        return false;
+    qDebug() << "qpak: mounted" << path << "with" << pack->header().entryCount << "entries";
+    mounted().push_back(std::move(pack));
+    return true;
+}
+
+inline bool contains(const QString &path) {
+    const QByteArray name = nameOf(path);
+    return !name.isEmpty()
+        && std::any_of(mounted().begin(), mounted().end(), [&](const auto &pack) { return pack->find(name); });
+}
+
+// Contents of path from the mounted packs, null when none has it.
+inline QByteArray packed(const QString &path) {
+    const QByteArray name = nameOf(path);
+    if (name.isEmpty())
+        return {};
+    for (auto it = mounted().rbegin(); it != mounted().rend(); ++it) {
+        if (const Entry *e = (*it)->find(name)) {
+            ++stats().hits;
+            return (*it)->data(*e);
+        }
+    }
+    return {};
+}
+
+// packed(), or the whole file when no pack has it.
+inline QByteArray read(const QString &path) {
+    QByteArray data = packed(path);
+    if (!data.isNull())
+        return data;
+    if (!mounted().empty())
+        ++stats().misses;
+    QFile f(path);
+    return f.open(QIODevice::ReadOnly) ? f.readAll() : QByteArray();
+}
+
+inline void dumpStats() {
+    const Stats &s = stats();
+    qDebug() << "qpak:" << mounted().size() << "packs," << s.hits.load() << "hits," << s.misses.load()
+             << "misses," << s.mappedBytes.load() << "bytes mapped," << s.inflatedBytes.load() << "inflated";
+}
+
+struct Input {
+    QByteArray name; // nameOf() form
+    QByteArray data;
+};
+
+// Serializes inputs; used by tools/qpack. With compress each blob is deflated
+// at level, and kept only when it saves at least a tenth of its size.
+inline bool write(const QString &path, std::vector<Input> inputs, bool compress, int level = 9) {
+    std::sort(inputs.begin(), inputs.end(), [](const Input &a, const Input &b) { return a.name < b.name; });
+    for (size_t i = 1; i < inputs.size(); ++i) {
+        if (inputs[i].name == inputs[i - 1].name) {
+            qWarning() << "qpak: duplicate name" << inputs[i].name;
+            return false;
+        }
+    }
+
+    Header h{};
+    h.magic = MAGIC;
+    h.version = VERSION;
+    h.entryCount = quint32(inputs.size());
+    h.slotCount = 1;
+    while (h.slotCount < h.entryCount * 2)
+        h.slotCount *= 2;
+
+    std::vector<Entry> entries(inputs.size());
+    std::vector<quint32> slots(h.slotCount, 0);
+    QByteArray names;
+    std::vector<QByteArray> stored(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        Entry &e = entries[i];
+        e = {};
+        e.hash = hashName(inputs[i].name);
+        e.rawSize = quint64(inputs[i].data.size());
+        e.nameOffset = quint32(names.size());
+        e.nameLength = quint32(inputs[i].name.size());
+        names.append(inputs[i].name);
+        stored[i] = inputs[i].data;
+        if (compress) {
+            QByteArray deflated = qCompress(inputs[i].data, level);
+            if (deflated.size() < inputs[i].data.size() - inputs[i].data.size() / 10) {
+                stored[i] = std::move(deflated);
+                e.flags |= Compressed;
+            }
+        }
+        e.size = quint64(stored[i].size());
+        quint32 slot = quint32(e.hash) & (h.slotCount - 1);
+        while (slots[slot])
+            slot = (slot + 1) & (h.slotCount - 1);
+        slots[slot] = quint32(i + 1);
+    }
+    h.namesOffset = sizeof(Header) + entries.size() * sizeof(Entry) + slots.size() * sizeof(quint32);
+    h.namesSize = quint64(names.size());
+
+    quint64 offset = h.namesOffset + h.namesSize;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        entries[i].offset = offset;
+        offset += entries[i].size;
+    }
+
+    QByteArray out;
+    out.reserve(qsizetype(offset));
+    out.append(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.append(reinterpret_cast<const char *>(entries.data()), qsizetype(entries.size() * sizeof(Entry)));
+    out.append(reinterpret_cast<const char *>(slots.data()), qsizetype(slots.size() * sizeof(quint32)));
+    out.append(names);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        out.append(QByteArray(qsizetype(entries[i].offset) - out.size(), '\0'));
+        out.append(stored[i]);
+    }
+
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(out) != out.size()) {
+        qWarning() << "qpak: cannot write" << path << f.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace qpak
+
+#endif // ASSETPACK_H
@@ -0,0 +1,493 @@
+#ifndef BCN_H
+#define BCN_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block compression used by cooked textures (.qtex):
+//
+//   BC4  one channel, 8 bytes per 4x4 block     (masks: metallic, roughness, ao, height)
+//   BC5  two BC4 blocks for R and G, 16 bytes   (tangent space normals, z rebuilt in the shader)
+//   BC7  mode 6 only, RGBA, 16 bytes            (colour)
+//
+// R8 and RG8 are the uncompressed counterparts of BC4 and BC5, for masks and
+// normal maps loaded without a cooked file.
+//
+// Encoders aim for offline use; decoders exist for backends without BC
+// support and for re-orienting the small, unaligned tail mips at load time.
+
+namespace bcn {
+
+enum class Format : uint32_t {
+    RGBA8 = 0,
+    BC4 = 1,
+    BC5 = 2,
+    BC7 = 3,
+    R8 = 4,
+    RG8 = 5,
+};
+
+inline bool isCompressed(Format f) { return f == Format::BC4 || f == Format::BC5 || f == Format::BC7; }
+
+// bytes per pixel of the uncompressed formats
+inline uint32_t pixelBytes(Format f) { return f == Format::R8 ? 1 : f == Format::RG8 ? 2 : 4; }
+
+inline uint32_t blockBytes(Format f) { return f == Format::BC4 ? 8 : 16; }
+
+// the unit planes and rotations work on: a block, or a pixel
+inline uint32_t unitBytes(Format f) { return isCompressed(f) ? blockBytes(f) : pixelBytes(f); }
+
+inline uint32_t levelBytes(Format f, uint32_t w, uint32_t h) {
+    if (!isCompressed(f))
+        return w * h * pixelBytes(f);
+    return ((w + 3) / 4) * ((h + 3) / 4) * blockBytes(f);
+}
+
+namespace detail {
+
+// ---------------------------------------------------------------- BC4
+
+inline void bc4Palette(uint8_t r0, uint8_t r1, uint8_t pal[8]) {
+    pal[0] = r0;
+    pal[1] = r1;
+    if (r0 > r1) {
+        for (int i = 1; i < 7; ++i)
+            pal[i + 1] = uint8_t(((7 - i) * r0 + i * r1 + 3) / 7);
+    } else {
+        for (int i = 1; i < 5; ++i)
+            pal[i + 1] = uint8_t(((5 - i) * r0 + i * r1 + 2) / 5);
+        pal[6] = 0;
+        pal[7] = 255;
+    }
+}
+
+// px: 16 values, stride apart
+inline void encodeBC4(const uint8_t *px, int stride, uint8_t out[8]) {
+    uint8_t lo = 255, hi = 0;
+    for (int i = 0; i < 16; ++i) {
+        lo = std::min(lo, px[i * stride]);
+        hi = std::max(hi, px[i * stride]);
+    }
+    out[0] = hi;
+    out[1] = lo;
+    uint8_t pal[8];
+    bc4Palette(hi, lo, pal);
+
+    uint64_t bits = 0;
+    for (int i = 0; i < 16; ++i) {
+        const int v = px[i * stride];
+        int best = 0, bestErr = 1 << 30;
+        for (int p = 0; p < 8; ++p) {
+            const int err = std::abs(v - pal[p]);
+            if (err < bestErr) {
+                bestErr = err;
+                best = p;
+            }
+        }
+        bits |= uint64_t(best) << (3 * i);
+    }
+    for (int i = 0; i < 6; ++i)
+        out[2 + i] = uint8_t(bits >> (8 * i));
+}
+
+inline void decodeBC4(const uint8_t in[8], uint8_t *px, int stride) {
+    uint8_t pal[8];
+    bc4Palette(in[0], in[1], pal);
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i)
+        bits |= uint64_t(in[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        px[i * stride] = pal[(bits >> (3 * i)) & 7];
+}
+
+// Reverses the pixel order of a block (180 degree rotation).
+inline void rotateBC4(uint8_t b[8]) {
+    uint64_t bits = 0, out = 0;
+    for (int i = 0; i < 6; ++i)
+        bits |= uint64_t(b[2 + i]) << (8 * i);
+    for (int i = 0; i < 16; ++i)
+        out |= ((bits >> (3 * i)) & 7) << (3 * (15 - i));
+    for (int i = 0; i < 6; ++i)
+        b[2 + i] = uint8_t(out >> (8 * i));
+}
+
+// ---------------------------------------------------------------- BC7 mode 6
+
+constexpr int BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+struct BitWriter {
+    uint8_t *data;
+    int pos = 0;
+    void put(uint32_t value, int count) {
+        for (int i = 0; i < count; ++i, ++pos)
+            if (value >> i & 1)
+                data[pos >> 3] |= uint8_t(1 << (pos & 7));
+    }
+};
+
+struct BitReader {
+    const uint8_t *data;
+    int pos = 0;
+    uint32_t get(int count) {
+        uint32_t v = 0;
+        for (int i = 0; i < count; ++i, ++pos)
+            v |= uint32_t(data[pos >> 3] >> (pos & 7) & 1) << i;
+        return v;
+    }
+};
+
+struct Mode6 {
+    uint8_t e[2][4]; // 7 bit endpoint components
+    uint8_t p[2];
+    uint8_t idx[16];
+};
+
+inline int bc7Interp(int a, int b, int w) { return ((64 - w) * a + w * b + 32) >> 6; }
+
+inline void mode6Endpoints(const Mode6 &m, int out[2][4]) {
+    for (int e = 0; e < 2; ++e)
+        for (int c = 0; c < 4; ++c)
+            out[e][c] = (m.e[e][c] << 1) | m.p[e];
+}
+
+// Chooses the best 4 bit index per pixel; returns the squared error.
+inline int mode6Indices(Mode6 &m, const uint8_t *px) {
+    int ep[2][4];
+    mode6Endpoints(m, ep);
+    int pal[16][4];
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+            pal[i][c] = bc7Interp(ep[0][c], ep[1][c], BC7_WEIGHTS4[i]);
+    int total = 0;
+    for (int i = 0; i < 16; ++i) {
+        int best = 0, bestErr = 1 << 30;
+        for (int p = 0; p < 16; ++p) {
+            int err = 0;
+            for (int c = 0; c < 4; ++c) {
+                const int d = int(px[i * 4 + c]) - pal[p][c];
+                err += d * d;
+            }
+            if (err < bestErr) {
+                bestErr = err;
+                best = p;
+            }
+        }
+        m.idx[i] = uint8_t(best);
+        total += bestErr;
+    }
+    return total;
+}
+
+// Quantizes two float endpoints to 7 bits plus a p-bit each.
+inline void mode6Quantize(const float a[4], const float b[4], Mode6 &m) {
+    const float *src[2] = { a, b };
+    for (int e = 0; e < 2; ++e) {
+        float bestErr = 1e30f;
+        for (int p = 0; p < 2; ++p) {
+            float err = 0;
+            uint8_t q[4];
+            for (int c = 0; c < 4; ++c) {
+                const int v = std::clamp(int(std::lround((src[e][c] - p) / 2.0f)), 0, 127);
+                q[c] = uint8_t(v);
+                const float d = float((v << 1) | p) - src[e][c];
+                err += d * d;
+            }
+            if (err < bestErr) {
+                bestErr = err;
+                m.p[e] = uint8_t(p);
+                std::memcpy(m.e[e], q, 4);
+            }
+        }
+    }
+}
+
+inline void writeMode6(const Mode6 &m, uint8_t out[16]) {
+    std::memset(out, 0, 16);
+    BitWriter w{ out };
+    w.put(1u << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        w.put(m.e[0][c], 7);
+        w.put(m.e[1][c], 7);
+    }
+    w.put(m.p[0], 1);
+    w.put(m.p[1], 1);
+    w.put(m.idx[0], 3);
+    for (int i = 1; i < 16; ++i)
+        w.put(m.idx[i], 4);
+}
+
+inline void encodeBC7(const uint8_t *px, uint8_t out[16]) {
+    // principal axis through the block
+    float mean[4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+            mean[c] += px[i * 4 + c] / 16.0f;
+    float cov[4][4] = {};
+    for (int i = 0; i < 16; ++i)
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c)
+                cov[r][c] += (px[i * 4 + r] - mean[r]) * (px[i * 4 + c] - mean[c]);
+    float axis[4] = { 1, 1, 1, 1 };
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[4] = {};
+        for (int r = 0; r < 4; ++r)
+            for (int c = 0; c < 4; ++c)
+                next[r] += cov[r][c] * axis[c];
+        const float len = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+        if (len < 1e-6f)
+            break;
+        for (int c = 0; c < 4; ++c)
+            axis[c] = next[c] / len;
+    }
+    float tMin = 1e30f, tMax = -1e30f;
+    for (int i = 0; i < 16; ++i) {
+        float t = 0;
+        for (int c = 0; c < 4; ++c)
+            t += (px[i * 4 + c] - mean[c]) * axis[c];
+        tMin = std::min(tMin, t);
+        tMax = std::max(tMax, t);
+    }
+    float a[4], b[4];
+    for (int c = 0; c < 4; ++c) {
+        a[c] = std::clamp(mean[c] + axis[c] * tMin, 0.0f, 255.0f);
+        b[c] = std::clamp(mean[c] + axis[c] * tMax, 0.0f, 255.0f);
+    }
+
+    Mode6 best{};
+    mode6Quantize(a, b, best);
+    int bestErr = mode6Indices(best, px);
+
+    // least squares refinement of the endpoints for the chosen indices
+    for (int iter = 0; iter < 2 && bestErr > 0; ++iter) {
+        float aa = 0, bb = 0, ab = 0, ax[4] = {}, bx[4] = {};
+        for (int i = 0; i < 16; ++i) {
+            const float w = BC7_WEIGHTS4[best.idx[i]] / 64.0f;
+            aa += (1 - w) * (1 - w);
+            bb += w * w;
+            ab += (1 - w) * w;
+            for (int c = 0; c < 4; ++c) {
+                ax[c] += (1 - w) * px[i * 4 + c];
+                bx[c] += w * px[i * 4 + c];
+            }
+        }
+        const float det = aa * bb - ab * ab;
+        if (std::fabs(det) < 1e-6f)
+            break;
+        for (int c = 0; c < 4; ++c) {
+            a[c] = std::clamp((ax[c] * bb - bx[c] * ab) / det, 0.0f, 255.0f);
+            b[c] = std::clamp((bx[c] * aa - ax[c] * ab) / det, 0.0f, 255.0f);
+        }
+        Mode6 candidate{};
+        mode6Quantize(a, b, candidate);
+        const int err = mode6Indices(candidate, px);
+        if (err >= bestErr)
+            break;
+        best = candidate;
+        bestErr = err;
+    }
+
+    // the anchor (pixel 0) index is stored with an implicit zero top bit
+    if (best.idx[0] & 8) {
+        std::swap(best.e[0], best.e[1]);
+        std::swap(best.p[0], best.p[1]);
+        for (uint8_t &i : best.idx)
+            i = uint8_t(15 - i);
+    }
+
+    writeMode6(best, out);
+}
+
+inline bool readMode6(const uint8_t in[16], Mode6 &m) {
+    BitReader r{ in };
+    if (r.get(7) != (1u << 6))
+        return false;
+    for (int c = 0; c < 4; ++c) {
+        m.e[0][c] = uint8_t(r.get(7));
+        m.e[1][c] = uint8_t(r.get(7));
+    }
+    m.p[0] = uint8_t(r.get(1));
+    m.p[1] = uint8_t(r.get(1));
+    m.idx[0] = uint8_t(r.get(3));
+    for (int i = 1; i < 16; ++i)
+        m.idx[i] = uint8_t(r.get(4));
+    return true;
+}
+
+inline void decodeBC7(const uint8_t in[16], uint8_t *px) {
+    Mode6 m;
+    if (!readMode6(in, m)) {
+        std::memset(px, 0, 64); // only mode 6 is ever written
+        return;
+    }
+    int ep[2][4];
+    mode6Endpoints(m, ep);
+    for (int i = 0; i < 16; ++i)
+        for (int c = 0; c < 4; ++c)
+            px[i * 4 + c] = uint8_t(bc7Interp(ep[0][c], ep[1][c], BC7_WEIGHTS4[m.idx[i]]));
+}
+
+inline void rotateBC7(uint8_t b[16]) {
+    Mode6 m;
+    if (!readMode6(b, m))
+        return;
+    std::reverse(m.idx, m.idx + 16);
+    if (m.idx[0] & 8) {
+        std::swap(m.e[0], m.e[1]);
+        std::swap(m.p[0], m.p[1]);
+        for (uint8_t &i : m.idx)
+            i = uint8_t(15 - i);
+    }
+    writeMode6(m, b);
+}
+
+// Copies the 4x4 block at (bx, by) out of an RGBA8 image, clamping at the edges.
+inline void fetchBlock(const uint8_t *rgba, uint32_t w, uint32_t h, uint32_t bx, uint32_t by, uint8_t out[64]) {
+    for (uint32_t y = 0; y < 4; ++y)
+        for (uint32_t x = 0; x < 4; ++x) {
+            const uint32_t sx = std::min(bx * 4 + x, w - 1);
+            const uint32_t sy = std::min(by * 4 + y, h - 1);
+            std::memcpy(out + (y * 4 + x) * 4, rgba + (size_t(sy) * w + sx) * 4, 4);
+        }
+}
+
+} // namespace detail
+
+// Compresses a tightly packed RGBA8 image.
+inline std::vector<uint8_t> encode(Format f, const uint8_t *rgba, uint32_t w, uint32_t h) {
+    std::vector<uint8_t> out(levelBytes(f, w, h));
+    if (!isCompressed(f)) {
+        const uint32_t n = pixelBytes(f);
+        for (size_t i = 0; i < size_t(w) * h; ++i)
+            std::memcpy(out.data() + i * n, rgba + i * 4, n);
+        return out;
+    }
+    const uint32_t bw = (w + 3) / 4, bh = (h + 3) / 4;
+    uint8_t block[64];
+    uint8_t *dst = out.data();
+    for (uint32_t by = 0; by < bh; ++by)
+        for (uint32_t bx = 0; bx < bw; ++bx, dst += blockBytes(f)) {
+            detail::fetchBlock(rgba, w, h, bx, by, block);
+            switch (f) {
+            case Format::BC4:
+                detail::encodeBC4(block, 4, dst);
+                break;
+            case Format::BC5:
+                detail::encodeBC4(block, 4, dst);
+                detail::encodeBC4(block + 1, 4, dst + 8);
+                break;
+            case Format::BC7:
+                detail::encodeBC7(block, dst);
+                break;
+            default:
+                break;
+            }
+        }
+    return out;
+}
+
+// Expands data back to tightly packed RGBA8. BC4 and R8 are replicated
+// into RGB, BC5 and RG8 leave blue at zero like the GPU does.
+inline std::vector<uint8_t> decode(Format f, const uint8_t *data, uint32_t w, uint32_t h) {
+    std::vector<uint8_t> out(size_t(w) * h * 4);
+    if (f == Format::RGBA8) {
+        std::memcpy(out.data(), data, out.size());
+        return out;
+    }
+    if (!isCompressed(f)) {
+        for (size_t i = 0; i < size_t(w) * h; ++i) {
+            uint8_t *px = out.data() + i * 4;
+            px[0] = data[i * pixelBytes(f)];
+            px[1] = f == Format::R8 ? px[0] : data[i * 2 + 1];
+            px[2] = f == Format::R8 ? px[0] : 0;
+            px[3] = 255;
+        }
+        return out;
+    }
+    const uint32_t bw = (w + 3) / 4, bh = (h + 3) / 4;
+    uint8_t block[64];
+    const uint8_t *src = data;
+    for (uint32_t by = 0; by < bh; ++by)
+        for (uint32_t bx = 0; bx < bw; ++bx, src += blockBytes(f)) {
+            std::memset(block, 0, sizeof(block));
+            switch (f) {
+            case Format::BC4:
+                detail::decodeBC4(src, block, 4);
+                for (int i = 0; i < 16; ++i)
+                    block[i * 4 + 1] = block[i * 4 + 2] = block[i * 4];
+                break;
+            case Format::BC5:
+                detail::decodeBC4(src, block, 4);
+                detail::decodeBC4(src + 8, block + 1, 4);
+                break;
+            case Format::BC7:
+                detail::decodeBC7(src, block);
+                break;
+            default:
+                break;
+            }
+            for (int i = 0; i < 16; ++i) {
+                if (f != Format::BC7)
+                    block[i * 4 + 3] = 255;
+                const uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+                if (x < w && y < h)
+                    std::memcpy(out.data() + (size_t(y) * w + x) * 4, block + i * 4, 4);
+            }
+        }
+    return out;
+}
+
+// Rotates a level by 180 degrees in place. Compressed data is shuffled
+// block-wise without loss when both sides are multiples of 4; other levels
+// are decoded, rotated and encoded again.
+inline void rotate180(Format f, std::vector<uint8_t> &data, uint32_t w, uint32_t h) {
+    if (f == Format::RGBA8) {
+        auto *px = reinterpret_cast<uint32_t *>(data.data());
+        std::reverse(px, px + size_t(w) * h);
+        return;
+    }
+    if (f == Format::R8) {
+        std::reverse(data.begin(), data.end());
+        return;
+    }
+    if (f == Format::RG8) {
+        auto *px = reinterpret_cast<uint16_t *>(data.data());
+        std::reverse(px, px + size_t(w) * h);
+        return;
+    }
+    if (w % 4 || h % 4) {
+        std::vector<uint8_t> rgba = decode(f, data.data(), w, h);
+        auto *px = reinterpret_cast<uint32_t *>(rgba.data());
+        std::reverse(px, px + size_t(w) * h);
+        data = encode(f, rgba.data(), w, h);
+        return;
+    }
+    const uint32_t bytes = blockBytes(f);
+    const size_t blocks = data.size() / bytes;
+    for (size_t i = 0; i < blocks / 2; ++i)
+        std::swap_ranges(data.begin() + i * bytes, data.begin() + (i + 1) * bytes,
+                         data.begin() + (blocks - 1 - i) * bytes);
+    for (size_t i = 0; i < blocks; ++i) {
+        uint8_t *b = data.data() + i * bytes;
+        switch (f) {
+        case Format::BC4:
+            detail::rotateBC4(b);
+            break;
+        case Format::BC5:
+            detail::rotateBC4(b);
+            detail::rotateBC4(b + 8);
+            break;
+        case Format::BC7:
+            detail::rotateBC7(b);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+} // namespace bcn
+
+#endif // BCN_H
@@ -0,0 +1,277 @@
+#ifndef BRDFLUT_H
+#define BRDFLUT_H
+
+#include "assetpack.h"
+#include "envmap.h"
+#include "parallel.h"
+#include "rhicache.h"
+#include "startupprofiler.h"
+
+#include <rhi/qrhi.h>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QDebug>
+#include <memory>
+
+// The split-sum BRDF table of specular IBL, SIZE^2 texels of (F0 scale, bias)
+// over (n.v, roughness). It is the same for every scene, so it is made once and
+// kept in the cache directory (cacheDirectory()). Later runs load it with a
+// single upload. Without a cache file, prepare() draws it with
+// shaders/brdflut.frag at the start of the next frame and reads it back into
+// the file. The Null backend computes it on the CPU pool with
+// envmap::brdfLutRow() instead.
+// QRhi has no RG16F, so the table is RG16 (the values are in [0, 1]), or
+// RGBA16F where RG16 is unsupported. setVerify(true) skips the cache file
+// and compares the GPU table with the CPU one when the readback arrives.
+
+class BrdfLut {
+public:
+    static constexpr int SIZE = 256;         // SIZE in brdflut.frag
+    static constexpr quint32 VERSION = 1;    // bump when the table changes
+    static constexpr int BINDING = 9;        // pbr*.frag tex_brdf
+
+    struct Stats {
+        const char *source = "none"; // cache, gpu or cpu
+        qint64 prepareUs = 0;
+        float verifyMaxError = -1.0f; // GPU against CPU, -1 when not checked
+    };
+
+    static BrdfLut *instance(QRhi *rhi) {
+        static QHash<QRhi *, BrdfLut *> luts;
+        if (BrdfLut *l = luts.value(rhi))
+            return l;
+        auto *l = new BrdfLut(rhi);
+        luts.insert(rhi, l);
+        rhi->addCleanupCallback([](QRhi *r) { delete luts.take(r); });
+        return l;
+    }
+
+    static void setVerify(bool verify) { verifyFlag() = verify; }
+
+    // Shared with the pipeline and IBL caches.
+    static QString cacheDirectory() {
+        return QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    }
+
+    // Creates the texture and queues its contents on u (cache hit, CPU) or
+    // for recordPasses() (GPU). The texture can be bound right away.
+    void prepare(QRhiResourceUpdateBatch *u, QThreadPool *pool = QThreadPool::globalInstance()) {
+        if (texture_ || !u)
+            return;
+        QElapsedTimer timer;
+        timer.start();
+        format_ = rhi_->isTextureFormatSupported(QRhiTexture::RG16) ? QRhiTexture::RG16 : QRhiTexture::RGBA16F;
+        const bool gpu = rhi_->backend() != QRhi::Null;
+
+        const QByteArray cached = verifyFlag() ? QByteArray() : readCache();
+        QRhiTexture::Flags flags;
+        if (cached.isEmpty() && gpu)
+            flags |= QRhiTexture::RenderTarget | QRhiTexture::UsedAsTransferSource;
+        texture_.reset(rhi_->newTexture(format_, QSize(SIZE, SIZE), 1, flags));
+        texture_->create();
+
+        if (!cached.isEmpty()) {
+            u->uploadTexture(texture_.get(), QRhiTextureUploadDescription(QRhiTextureUploadEntry(
+                                                 0, 0, QRhiTextureSubresourceUploadDescription(cached))));
+            stats_.source = "cache";
+        } else if (gpu) {
+            prepareGpu();
+            stats_.source = "gpu";
+        } else {
+            const QByteArray pixels = compute(format_, pool);
+            u->uploadTexture(texture_.get(), QRhiTextureUploadDescription(QRhiTextureUploadEntry(
+                                                 0, 0, QRhiTextureSubresourceUploadDescription(pixels))));
+            writeCache(pixels);
+            stats_.source = "cpu";
+        }
+        stats_.prepareUs = timer.nsecsElapsed() / 1000;
+    }
+
+    // Records the table pass prepared by prepare(); call once per frame
+    // before the first pass.
+    void recordPasses(QRhiCommandBuffer *cb) {
+        if (!gpu_)
+            return;
+        if (gpu_->recorded) {
+            if (gpu_->readbackDone)
+                gpu_.reset();
+            return;
+        }
+        QRhiResourceUpdateBatch *readback = rhi_->nextResourceUpdateBatch();
+        readback->readBackTexture(QRhiReadbackDescription(texture_.get()), &gpu_->readback);
+        cb->beginPass(gpu_->rt.get(), Qt::black, { 1.0f, 0 });
+        cb->setGraphicsPipeline(gpu_->pipeline.get());
+        cb->setViewport(QRhiViewport(0, 0, SIZE, SIZE));
+        cb->setShaderResources(gpu_->srb.get());
+        cb->draw(3);
+        cb->endPass(readback);
+        gpu_->recorded = true;
+    }
+
+    QRhiTexture *texture() const { return texture_.get(); }
+
+    QRhiSampler *sampler() const {
+        SamplerKey key;
+        key.mipmapMode = QRhiSampler::None;
+        key.addressU = key.addressV = key.addressW = QRhiSampler::ClampToEdge;
+        return RhiResourceCache::instance(rhi_)->sampler(key);
+    }
+
+    QRhiShaderResourceBinding binding() const {
+        return QRhiShaderResourceBinding::sampledTexture(BINDING, QRhiShaderResourceBinding::FragmentStage,
+                                                         texture_.get(), sampler());
+    }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "BrdfLut:" << SIZE << "x" << SIZE << format_ << "from" << stats_.source << "in"
+                 << stats_.prepareUs << "us";
+    }
+
+    // The table in format, rows of roughness, on the pool.
+    static QByteArray compute(QRhiTexture::Format format, QThreadPool *pool = QThreadPool::globalInstance()) {
+        const int texelBytes = format == QRhiTexture::RG16 ? 4 : 8;
+        QByteArray pixels(qsizetype(SIZE) * SIZE * texelBytes, Qt::Uninitialized);
+        uchar *dst = reinterpret_cast<uchar *>(pixels.data());
+        parallelForChunked(pool, SIZE, 8, [&](int begin, int end) {
+            float row[SIZE * 2];
+            for (int y = begin; y < end; ++y) {
+                envmap::brdfLutRow(SIZE, envmap::BRDF_SAMPLES, y, row);
+                quint16 *out = reinterpret_cast<quint16 *>(dst + qsizetype(y) * SIZE * texelBytes);
+                for (int x = 0; x < SIZE; ++x) {
+                    if (format == QRhiTexture::RG16) {
+                        out[x * 2] = quint16(qBound(0.0f, row[x * 2], 1.0f) * 65535.0f + 0.5f);
+                        out[x * 2 + 1] = quint16(qBound(0.0f, row[x * 2 + 1], 1.0f) * 65535.0f + 0.5f);
+                    } else {
+                        out[x * 4] = rgbe::floatToHalf(row[x * 2]);
+                        out[x * 4 + 1] = rgbe::floatToHalf(row[x * 2 + 1]);
+                        out[x * 4 + 2] = 0;
+                        out[x * 4 + 3] = 0x3c00;
+                    }
+                }
+            }
+        });
+        return pixels;
+    }
+
+private:
+    struct CacheHeader {
+        char magic[4];
+        quint32 version;
+        quint32 size;
+        quint32 format;
+        quint32 samples;
+    };
+
+    struct GpuInit {
+        std::unique_ptr<QRhiRenderPassDescriptor> rp;
+        std::unique_ptr<QRhiTextureRenderTarget> rt;
+        std::unique_ptr<QRhiShaderResourceBindings> srb;
+        std::unique_ptr<QRhiGraphicsPipeline> pipeline;
+        QRhiReadbackResult readback;
+        bool recorded = false;
+        bool readbackDone = false;
+    };
+
+    explicit BrdfLut(QRhi *rhi) : rhi_(rhi) {}
+
+    static bool &verifyFlag() {
+        static bool verify = false;
+        return verify;
+    }
+
+    static QShader loadShader(const QString &name) {
+        startup::Scope scope("shader load");
+        const QByteArray data = qpak::read(name);
+        return data.isEmpty() ? QShader() : QShader::fromSerialized(data);
+    }
+
+    void prepareGpu() {
+        auto gpu = std::make_unique<GpuInit>();
+        gpu->rt.reset(rhi_->newTextureRenderTarget(QRhiTextureRenderTargetDescription(QRhiColorAttachment(texture_.get()))));
+        gpu->rp.reset(gpu->rt->newCompatibleRenderPassDescriptor());
+        gpu->rt->setRenderPassDescriptor(gpu->rp.get());
+        gpu->rt->create();
+        gpu->srb.reset(rhi_->newShaderResourceBindings());
+        gpu->srb->create();
+        gpu->pipeline.reset(rhi_->newGraphicsPipeline());
+        gpu->pipeline->setShaderStages({ { QRhiShaderStage::Vertex, loadShader(":/shaders/prebuild/equirect2cube.vert.qsb") },
+                                         { QRhiShaderStage::Fragment, loadShader(":/shaders/prebuild/brdflut.frag.qsb") } });
+        gpu->pipeline->setVertexInputLayout({});
+        gpu->pipeline->setShaderResourceBindings(gpu->srb.get());
+        gpu->pipeline->setRenderPassDescriptor(gpu->rp.get());
+        gpu->pipeline->create();
+        GpuInit *g = gpu.get();
+        gpu->readback.completed = [this, g] {
+            g->readbackDone = true;
+            finishReadback(g->readback.data);
+        };
+        gpu_ = std::move(gpu);
+    }
+
+    void finishReadback(const QByteArray &pixels) {
+        if (pixels.size() != qsizetype(SIZE) * SIZE * (format_ == QRhiTexture::RG16 ? 4 : 8)) {
+            qWarning() << "BrdfLut: unexpected readback of" << pixels.size() << "bytes";
+            return;
+        }
+        writeCache(pixels);
+        if (!verifyFlag())
+            return;
+        // GPU against the CPU reference, in table units
+        const QByteArray reference = compute(format_);
+        const auto *a = reinterpret_cast<const quint16 *>(pixels.constData());
+        const auto *b = reinterpret_cast<const quint16 *>(reference.constData());
+        const int stride = format_ == QRhiTexture::RG16 ? 2 : 4;
+        auto value = [&](const quint16 *p, qsizetype i) {
+            return format_ == QRhiTexture::RG16 ? p[i] / 65535.0f : rgbe::halfToFloat(p[i]);
+        };
+        float maxError = 0.0f;
+        for (qsizetype t = 0; t < qsizetype(SIZE) * SIZE; ++t)
+            for (int c = 0; c < 2; ++c)
+                maxError = qMax(maxError, qAbs(value(a, t * stride + c) - value(b, t * stride + c)));
+        stats_.verifyMaxError = maxError;
+        qDebug() << "BrdfLut: GPU and CPU tables differ by at most" << maxError;
+    }
+
+    static QString cachePath() { return cacheDirectory() + QStringLiteral("/brdf-lut.bin"); }
+
+    QByteArray readCache() const {
+        QFile f(cachePath());
+        if (!f.open(QIODevice::ReadOnly))
+            return {};
+        CacheHeader h;
+        const qsizetype bytes = qsizetype(SIZE) * SIZE * (format_ == QRhiTexture::RG16 ? 4 : 8);
+        if (f.read(reinterpret_cast<char *>(&h), sizeof(h)) != sizeof(h) || memcmp(h.magic, "BRDF", 4) != 0
+            || h.version != VERSION || h.size != quint32(SIZE) || h.format != quint32(format_)
+            || h.samples != quint32(envmap::BRDF_SAMPLES))
+            return {};
+        QByteArray pixels = f.read(bytes);
+        return pixels.size() == bytes ? pixels : QByteArray();
+    }
+
+    void writeCache(const QByteArray &pixels) const {
+        QDir().mkpath(cacheDirectory());
+        QSaveFile f(cachePath());
+        if (!f.open(QIODevice::WriteOnly))
+            return;
+        const CacheHeader h{ { 'B', 'R', 'D', 'F' }, VERSION, quint32(SIZE), quint32(format_),
+                             quint32(envmap::BRDF_SAMPLES) };
+        f.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        f.write(pixels);
+        if (!f.commit())
+            qWarning() << "BrdfLut: cannot write" << cachePath();
+    }
+
+    QRhi *rhi_;
+    QRhiTexture::Format format_ = QRhiTexture::RG16;
+    std::unique_ptr<QRhiTexture> texture_;
+    std::unique_ptr<GpuInit> gpu_;
+    Stats stats_;
+};
+
+#endif // BRDFLUT_H
@@ -0,0 +1,217 @@
+#ifndef CASCADEDSHADOWS_H
+#define CASCADEDSHADOWS_H
+
+#include "drawlist.h"
+
+#include <rhi/qrhi.h>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include <QDebug>
+#include <array>
+#include <cmath>
+
+// Cascaded shadow maps for the scene light. The camera frustum up to the
+// shadow distance is cut into slices by the practical split scheme (lambda
+// blends logarithmic and uniform splits) and each slice gets an orthographic
+// light projection of its own, drawn into one tile of a 2x2 depth atlas.
+// A cascade is fitted to the bounding sphere of its slice, so its size does
+// not change as the camera turns, and its origin is snapped to whole texels
+// in light space, so shadow edges stay put while the camera moves.
+// cull() drops casters outside a cascade from that cascade's draws.
+
+class CascadedShadows {
+public:
+    static constexpr int MAX_CASCADES = 4;
+
+    struct Cascade {
+        QMatrix4x4 lightView;
+        QMatrix4x4 lightSpace; // world to the tile's clip space, clipSpaceCorrMatrix() applied
+        float splitFar = 0;    // view distance where the next cascade takes over
+        QVector3D sliceCenter; // bounding sphere of the frustum slice
+        float sliceRadius = 0;
+        float texelWorld = 0;  // world units per shadow texel
+        QRhiViewport viewport; // tile in the atlas render target
+        QVector4D tile;        // the same tile as uv offset (xy) and scale (zw)
+        // light view space box the cascade covers
+        float minX = 0, maxX = 0, minY = 0, maxY = 0, farZ = 0;
+    };
+
+    struct Stats {
+        int casters = 0; // shadow packets tested by the last cull()
+        int culled = 0;
+    };
+
+    // Depth texture the tiles are laid out in.
+    void setAtlasSize(const QSize &size) { atlasSize_ = size; }
+    QSize atlasSize() const { return atlasSize_; }
+
+    void setCascadeCount(int count) { count_ = qBound(1, count, MAX_CASCADES); }
+    int cascadeCount() const { return count_; }
+
+    // Beyond this view distance nothing is shadowed.
+    void setShadowDistance(float distance) { distance_ = distance; }
+    float shadowDistance() const { return distance_; }
+
+    // 0 uniform, 1 logarithmic splits.
+    void setSplitLambda(float lambda) { lambda_ = qBound(0.0f, lambda, 1.0f); }
+
+    const Cascade &cascade(int i) const { return cascades_[size_t(i)]; }
+
+    // view and projection of the camera, cameraNear its near plane. The light
+    // sits at lightPos and shines along lightDir; casters behind it are clipped
+    // like those behind the single shadow map's near plane were.
+    void update(QRhi *rhi, const QMatrix4x4 &view, const QMatrix4x4 &projection, float cameraNear,
+                const QVector3D &lightPos, const QVector3D &lightDir) {
+        fitCamera(rhi, view, projection, cameraNear);
+        for (int i = 0; i < count_; ++i)
+            cascades_[size_t(i)] = fit(i, lightPos, lightDir);
+    }
+
+    // The camera half of update(): splits, slice spheres and tiles.
+    void fitCamera(QRhi *rhi, const QMatrix4x4 &view, const QMatrix4x4 &projection, float cameraNear) {
+        const QMatrix4x4 invView = view.inverted();
+        const QVector3D eye = invView.map(QVector3D(0, 0, 0));
+        const QVector3D forward = invView.mapVector(QVector3D(0, 0, -1)).normalized();
+        // distance from the axis to a frustum corner per unit of depth
+        const float tanX = 1.0f / qAbs(projection(0, 0));
+        const float tanY = 1.0f / qAbs(projection(1, 1));
+        const float k2 = tanX * tanX + tanY * tanY;
+        clipSpaceCorr_ = rhi->clipSpaceCorrMatrix();
+
+        const int tileSize = qMin(atlasSize_.width(), atlasSize_.height()) / 2;
+        float splitNear = cameraNear;
+        for (int i = 0; i < count_; ++i) {
+            Cascade &c = cascades_[size_t(i)];
+            const float s = float(i + 1) / float(count_);
+            const float logSplit = cameraNear * std::pow(distance_ / cameraNear, s);
+            const float uniformSplit = cameraNear + (distance_ - cameraNear) * s;
+            c.splitFar = lambda_ * logSplit + (1.0f - lambda_) * uniformSplit;
+
+            // smallest sphere around the slice; its center is on the view axis
+            const float n = splitNear;
+            const float f = c.splitFar;
+            const float z = qMin(f, 0.5f * (f + n) * (1.0f + k2));
+            c.sliceCenter = eye + forward * z;
+            c.sliceRadius = std::ceil(std::sqrt((f - z) * (f - z) + f * f * k2) * 16.0f) / 16.0f; // no float noise
+            c.texelWorld = 2.0f * c.sliceRadius / float(tileSize);
+
+            // QRhi viewports start bottom left; the uv tile follows where that
+            // lands in the texture on this backend
+            const int col = i % 2;
+            const int row = i / 2;
+            c.viewport = QRhiViewport(float(col * tileSize), float(row * tileSize), float(tileSize), float(tileSize));
+            const float scaleX = float(tileSize) / float(atlasSize_.width());
+            const float scaleY = float(tileSize) / float(atlasSize_.height());
+            const float v = rhi->isYUpInFramebuffer() ? row * scaleY : 1.0f - (row + 1) * scaleY;
+            c.tile = QVector4D(col * scaleX, v, scaleX, scaleY);
+
+            splitNear = c.splitFar;
+        }
+    }
+
+    // Cascade i of the last fitCamera() lit from lightPos. update() takes it
+    // as is; a ShadowCache fits its tiles margin world units wider than the
+    // slice and keeps them, reused(), while they still cover() it.
+    Cascade fit(int i, const QVector3D &lightPos, const QVector3D &lightDir, float margin = 0.0f) const {
+        Cascade c = cascades_[size_t(i)];
+        const QVector3D dir = lightDir.normalized();
+        const QVector3D up = qAbs(dir.y()) > 0.99f ? QVector3D(0, 0, 1) : QVector3D(0, 1, 0);
+        c.lightView.setToIdentity();
+        c.lightView.lookAt(lightPos, lightPos + dir, up);
+
+        const float extent = c.sliceRadius + margin;
+        c.texelWorld *= extent / c.sliceRadius;
+        QVector3D center = c.lightView.map(c.sliceCenter);
+        center.setX(std::floor(center.x() / c.texelWorld) * c.texelWorld);
+        center.setY(std::floor(center.y() / c.texelWorld) * c.texelWorld);
+        // depth too, so the matrix only changes when the snapped box moves
+        center.setZ(std::floor(center.z() / c.texelWorld) * c.texelWorld);
+        c.minX = center.x() - extent;
+        c.maxX = center.x() + extent;
+        c.minY = center.y() - extent;
+        c.maxY = center.y() + extent;
+        c.farZ = qMax(NEAR_PLANE * 2.0f, -center.z() + extent + c.texelWorld);
+
+        QMatrix4x4 ortho;
+        ortho.ortho(c.minX, c.maxX, c.minY, c.maxY, NEAR_PLANE, c.farZ);
+        c.lightSpace = clipSpaceCorr_ * ortho * c.lightView;
+        return c;
+    }
+
+    void setCascade(int i, const Cascade &cascade) { cascades_[size_t(i)] = cascade; }
+
+    // Whether drawn, an earlier fit() of cascade i, still holds the slice of
+    // the last fitCamera() at the same resolution.
+    bool covers(int i, const Cascade &drawn) const {
+        const Cascade &c = cascades_[size_t(i)];
+        if (drawn.sliceRadius != c.sliceRadius)
+            return false;
+        const QVector3D p = drawn.lightView.map(c.sliceCenter);
+        const float r = c.sliceRadius;
+        return p.x() - r >= drawn.minX && p.x() + r <= drawn.maxX && p.y() - r >= drawn.minY && p.y() + r <= drawn.maxY
+            && -p.z() + r <= drawn.farZ;
+    }
+
+    // Cascade i of the last fitCamera() with the light projection of drawn.
+    Cascade reused(int i, const Cascade &drawn) const {
+        Cascade c = cascades_[size_t(i)];
+        c.lightView = drawn.lightView;
+        c.lightSpace = drawn.lightSpace;
+        c.texelWorld = drawn.texelWorld;
+        c.minX = drawn.minX;
+        c.maxX = drawn.maxX;
+        c.minY = drawn.minY;
+        c.maxY = drawn.maxY;
+        c.farZ = drawn.farZ;
+        return c;
+    }
+
+    // Whether a caster with this bounding sphere can throw a shadow into cascade i.
+    bool casts(int i, const QVector3D &center, float radius) const {
+        const Cascade &c = cascades_[size_t(i)];
+        const QVector3D p = c.lightView.map(center);
+        return p.x() + radius >= c.minX && p.x() - radius <= c.maxX
+            && p.y() + radius >= c.minY && p.y() - radius <= c.maxY
+            && -p.z() + radius >= NEAR_PLANE && -p.z() - radius <= c.farZ;
+    }
+
+    // Hides each cascade's shadow packets (DrawPacket::view is the cascade)
+    // whose bounds miss it; call after update().
+    void cull(DrawList &list) {
+        stats_ = {};
+        for (int i = 0; i < count_; ++i) {
+            for (DrawPass pass : { DrawPass::Shadow, DrawPass::StaticShadow }) {
+                list.cull(pass, i, [&](const QVector3D &center, float radius) {
+                    const bool visible = casts(i, center, radius);
+                    ++stats_.casters;
+                    stats_.culled += visible ? 0 : 1;
+                    return visible;
+                });
+            }
+        }
+    }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        QDebug d = qDebug().nospace();
+        d << "CascadedShadows: " << count_ << " cascades,";
+        for (int i = 0; i < count_; ++i)
+            d << " " << cascades_[size_t(i)].splitFar << " (" << cascades_[size_t(i)].texelWorld << "/texel)";
+        d << ", " << stats_.casters - stats_.culled << " of " << stats_.casters << " casters drawn";
+    }
+
+private:
+    static constexpr float NEAR_PLANE = 0.1f;
+
+    QSize atlasSize_ = QSize(2048, 2048);
+    int count_ = 3;
+    float distance_ = 60.0f;
+    float lambda_ = 0.75f;
+    QMatrix4x4 clipSpaceCorr_;
+    std::array<Cascade, MAX_CASCADES> cascades_;
+    Stats stats_;
+};
+
+#endif // CASCADEDSHADOWS_H
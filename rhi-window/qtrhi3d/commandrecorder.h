@@ -0,0 +1,202 @@
+#ifndef COMMANDRECORDER_H
+#define COMMANDRECORDER_H
+
+#include <rhi/qrhi.h>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+
+// Thin layer over QRhiCommandBuffer that remembers the bound pipeline, SRB
+// (with dynamic offsets), vertex/index input, viewport and scissor, and drops
+// calls that would not change any of them. All state is forgotten at pass
+// boundaries. A pipeline change also forgets the SRB and vertex input, since
+// not every backend keeps them across pipelines.
+
+class CommandRecorder {
+public:
+    struct Stats {
+        int pipelines = 0;
+        int shaderResources = 0;
+        int vertexInputs = 0;
+        int viewports = 0;
+        int scissors = 0;
+        int draws = 0;
+        int elidedPipelines = 0;
+        int elidedShaderResources = 0;
+        int elidedVertexInputs = 0;
+        int elidedViewports = 0;
+        int elidedScissors = 0;
+
+        int elided() const {
+            return elidedPipelines + elidedShaderResources + elidedVertexInputs + elidedViewports + elidedScissors;
+        }
+    };
+
+    static constexpr int MAX_VERTEX_BINDINGS = 4;
+    static constexpr int MAX_DYNAMIC_OFFSETS = 4;
+
+    explicit CommandRecorder(QRhiCommandBuffer *cb = nullptr) : cb_(cb) {}
+
+    // Starts a new frame on cb; the stats of the previous frame are kept in lastFrameStats().
+    void begin(QRhiCommandBuffer *cb) {
+        cb_ = cb;
+        lastStats_ = stats_;
+        stats_ = {};
+        invalidate();
+    }
+
+    QRhiCommandBuffer *commandBuffer() const { return cb_; }
+
+    void beginPass(QRhiRenderTarget *rt, const QColor &colorClearValue, const QRhiDepthStencilClearValue &depthStencilClearValue,
+                   QRhiResourceUpdateBatch *resourceUpdates = nullptr) {
+        cb_->beginPass(rt, colorClearValue, depthStencilClearValue, resourceUpdates);
+        invalidate();
+    }
+
+    void endPass(QRhiResourceUpdateBatch *resourceUpdates = nullptr) {
+        cb_->endPass(resourceUpdates);
+        invalidate();
+    }
+
+    void setGraphicsPipeline(QRhiGraphicsPipeline *ps) {
+        if (ps == pipeline_) {
+            ++stats_.elidedPipelines;
+            return;
+        }
+        cb_->setGraphicsPipeline(ps);
+        pipeline_ = ps;
+        srb_ = nullptr;
+        vertexInputValid_ = false;
+        ++stats_.pipelines;
+    }
+
+    void setShaderResources(QRhiShaderResourceBindings *srb = nullptr, int dynamicOffsetCount = 0,
+                            const QRhiCommandBuffer::DynamicOffset *dynamicOffsets = nullptr) {
+        if (!srb && pipeline_)
+            srb = pipeline_->shaderResourceBindings();
+        // more offsets than fit the cache go through as they are, and the next call binds again
+        if (dynamicOffsetCount > MAX_DYNAMIC_OFFSETS) {
+            cb_->setShaderResources(srb, dynamicOffsetCount, dynamicOffsets);
+            srb_ = nullptr;
+            ++stats_.shaderResources;
+            return;
+        }
+
+        if (srb && srb == srb_ && dynamicOffsetCount == offsetCount_
+            && std::equal(dynamicOffsets, dynamicOffsets + dynamicOffsetCount, offsets_.begin())) {
+            ++stats_.elidedShaderResources;
+            return;
+        }
+        cb_->setShaderResources(srb, dynamicOffsetCount, dynamicOffsets);
+        srb_ = srb;
+        offsetCount_ = dynamicOffsetCount;
+        std::copy(dynamicOffsets, dynamicOffsets + dynamicOffsetCount, offsets_.begin());
+        ++stats_.shaderResources;
+    }
+
+    void setVertexInput(int startBinding, int bindingCount, const QRhiCommandBuffer::VertexInput *bindings,
+                        QRhiBuffer *indexBuf = nullptr, quint32 indexOffset = 0,
+                        QRhiCommandBuffer::IndexFormat indexFormat = QRhiCommandBuffer::IndexUInt16) {
+        const bool cacheable = startBinding == 0 && bindingCount <= MAX_VERTEX_BINDINGS;
+        if (cacheable && vertexInputValid_ && bindingCount == vertexBindingCount_
+            && std::equal(bindings, bindings + bindingCount, vertexBindings_.begin())
+            && indexBuf == indexBuf_ && (!indexBuf || (indexOffset == indexOffset_ && indexFormat == indexFormat_))) {
+            ++stats_.elidedVertexInputs;
+            return;
+        }
+        cb_->setVertexInput(startBinding, bindingCount, bindings, indexBuf, indexOffset, indexFormat);
+        vertexInputValid_ = cacheable;
+        if (cacheable) {
+            vertexBindingCount_ = bindingCount;
+            std::copy(bindings, bindings + bindingCount, vertexBindings_.begin());
+            indexBuf_ = indexBuf;
+            indexOffset_ = indexOffset;
+            indexFormat_ = indexFormat;
+        }
+        ++stats_.vertexInputs;
+    }
+
+    void setViewport(const QRhiViewport &viewport) {
+        if (viewportValid_ && viewport == viewport_) {
+            ++stats_.elidedViewports;
+            return;
+        }
+        cb_->setViewport(viewport);
+        viewport_ = viewport;
+        viewportValid_ = true;
+        ++stats_.viewports;
+    }
+
+    void setScissor(const QRhiScissor &scissor) {
+        if (scissorValid_ && scissor == scissor_) {
+            ++stats_.elidedScissors;
+            return;
+        }
+        cb_->setScissor(scissor);
+        scissor_ = scissor;
+        scissorValid_ = true;
+        ++stats_.scissors;
+    }
+
+    void draw(quint32 vertexCount, quint32 instanceCount = 1, quint32 firstVertex = 0, quint32 firstInstance = 0) {
+        cb_->draw(vertexCount, instanceCount, firstVertex, firstInstance);
+        ++stats_.draws;
+    }
+
+    void drawIndexed(quint32 indexCount, quint32 instanceCount = 1, quint32 firstIndex = 0,
+                     qint32 vertexOffset = 0, quint32 firstInstance = 0) {
+        cb_->drawIndexed(indexCount, instanceCount, firstIndex, vertexOffset, firstInstance);
+        ++stats_.draws;
+    }
+
+    void debugMarkBegin(const QByteArray &name) { cb_->debugMarkBegin(name); }
+    void debugMarkEnd() { cb_->debugMarkEnd(); }
+
+    // Forgets all tracked state, e.g. after recording directly into the command buffer.
+    void invalidate() {
+        pipeline_ = nullptr;
+        srb_ = nullptr;
+        offsetCount_ = 0;
+        vertexInputValid_ = false;
+        viewportValid_ = false;
+        scissorValid_ = false;
+    }
+
+    const Stats &stats() const { return stats_; }
+    const Stats &lastFrameStats() const { return lastStats_; }
+
+    void dumpStats() const {
+        const Stats &s = lastStats_;
+        qDebug() << "CommandRecorder:" << s.draws << "draws;"
+                 << "pipeline" << s.pipelines << "/" << s.elidedPipelines << "elided,"
+                 << "srb" << s.shaderResources << "/" << s.elidedShaderResources << "elided,"
+                 << "vertex" << s.vertexInputs << "/" << s.elidedVertexInputs << "elided,"
+                 << "viewport" << s.viewports << "/" << s.elidedViewports << "elided,"
+                 << "scissor" << s.scissors << "/" << s.elidedScissors << "elided";
+    }
+
+private:
+    QRhiCommandBuffer *cb_ = nullptr;
+
+    QRhiGraphicsPipeline *pipeline_ = nullptr;
+    QRhiShaderResourceBindings *srb_ = nullptr;
+    int offsetCount_ = 0;
+    std::array<QRhiCommandBuffer::DynamicOffset, MAX_DYNAMIC_OFFSETS> offsets_{};
+
+    bool vertexInputValid_ = false;
+    int vertexBindingCount_ = 0;
+    std::array<QRhiCommandBuffer::VertexInput, MAX_VERTEX_BINDINGS> vertexBindings_{};
+    QRhiBuffer *indexBuf_ = nullptr;
+    quint32 indexOffset_ = 0;
+    QRhiCommandBuffer::IndexFormat indexFormat_ = QRhiCommandBuffer::IndexUInt16;
+
+    bool viewportValid_ = false;
+    QRhiViewport viewport_;
+    bool scissorValid_ = false;
+    QRhiScissor scissor_;
+
+    Stats stats_;
+    Stats lastStats_;
+};
+
+#endif // COMMANDRECORDER_H
@@ -0,0 +1,211 @@
+#ifndef DRAWLIST_H
+#define DRAWLIST_H
+
+#include "commandrecorder.h"
+
+#include <rhi/qrhi.h>
+#include <QHash>
+#include <QVector3D>
+#include <QDebug>
+#include <array>
+#include <cstring>
+#include <vector>
+
+// Draw packets sorted by a 64-bit key:
+//
+//   63..60  pass        (shadow, opaque, sky, overlay, static shadow)
+//   59..48  pipeline id
+//   47..32  srb id
+//   31..0   view depth  (float bits, front-to-back)
+//
+// The packet list is compiled once and reused while the scene revision is
+// unchanged; per frame only the depth bits are refreshed and the list is
+// re-sorted when the previous order no longer holds. Replay goes through a
+// CommandRecorder, which drops binds that do not change state. A pass drawn
+// into several views (shadow cascades) has one packet per view, and cull()
+// can hide packets per view until the next cull.
+
+enum class DrawPass : quint8 {
+    Shadow = 0,
+    Opaque = 1,
+    Sky = 2,
+    Overlay = 3,
+    StaticShadow = 4 // casters that never move, drawn only when a ShadowCache tile is refreshed
+};
+
+struct DrawPacket {
+    quint64 key = 0;
+    DrawPass pass = DrawPass::Opaque;
+
+    QRhiGraphicsPipeline *pipeline = nullptr;
+    QRhiShaderResourceBindings *srb = nullptr;
+    bool hasDynamicOffset = false;
+    quint32 dynamicOffset = 0;
+
+    QRhiBuffer *vbuf = nullptr;
+    QRhiBuffer *ibuf = nullptr;
+    QRhiCommandBuffer::IndexFormat indexFormat = QRhiCommandBuffer::IndexUInt16;
+    quint32 count = 0; // index count with ibuf, vertex count without
+
+    // world position used for depth sorting; null keeps the packet at the back of its pass
+    const QVector3D *origin = nullptr;
+    QVector3D originOffset;
+    float radius = 0; // bounding sphere around the origin; 0 is never culled
+
+    quint8 view = 0; // e.g. the shadow cascade
+    bool culled = false;
+};
+
+class DrawList {
+public:
+    struct Stats {
+        int packets = 0;
+        int compiles = 0;
+        int sorts = 0;
+    };
+
+    // Structural revision of the scene; a different value recompiles the packet list.
+    bool needsCompile(quint64 sceneRevision) const { return !compiled_ || sceneRevision != revision_; }
+
+    void beginCompile() {
+        packets_.clear();
+    }
+
+    void add(const DrawPacket &packet) {
+        packets_.push_back(packet);
+    }
+
+    void endCompile(quint64 sceneRevision) {
+        pipelineIds_.clear();
+        srbIds_.clear();
+        for (DrawPacket &p : packets_) {
+            const quint64 pipelineId = idFor(pipelineIds_, p.pipeline, 0xFFF);
+            const quint64 srbId = idFor(srbIds_, p.srb, 0xFFFF);
+            p.key = (quint64(p.pass) << 60) | (pipelineId << 48) | (srbId << 32) | 0xFFFFFFFFu;
+        }
+        order_.resize(packets_.size());
+        for (quint32 i = 0; i < order_.size(); ++i)
+            order_[i] = i;
+        revision_ = sceneRevision;
+        compiled_ = true;
+        ++stats_.compiles;
+        stats_.packets = int(packets_.size());
+    }
+
+    // Refreshes the depth bits of one pass relative to eye.
+    void updateDepth(DrawPass pass, const QVector3D &eye) {
+        for (DrawPacket &p : packets_) {
+            if (p.pass != pass || !p.origin)
+                continue;
+            const float d = (*p.origin + p.originOffset - eye).lengthSquared();
+            quint32 bits;
+            std::memcpy(&bits, &d, sizeof(bits)); // positive floats order like their bit patterns
+            p.key = (p.key & ~quint64(0xFFFFFFFFu)) | bits;
+        }
+    }
+
+    // Hides the packets of one pass and view for which visible(center, radius)
+    // is false; submit() skips them. Packets without bounds stay visible.
+    template<typename Visible>
+    void cull(DrawPass pass, int view, Visible &&visible) {
+        for (DrawPacket &p : packets_) {
+            if (p.pass != pass || p.view != view)
+                continue;
+            p.culled = p.origin && p.radius > 0 && !visible(*p.origin + p.originOffset, p.radius);
+        }
+    }
+
+    void sort() {
+        bool sorted = true;
+        for (size_t i = 1; i < order_.size() && sorted; ++i)
+            sorted = packets_[order_[i - 1]].key <= packets_[order_[i]].key;
+        if (sorted)
+            return;
+        radixSort();
+        ++stats_.sorts;
+    }
+
+    // Replays the packets of one pass, of one view when view >= 0; redundant
+    // binds between consecutive packets are dropped by the recorder.
+    void submit(CommandRecorder &rec, DrawPass pass, int view = -1) const {
+        for (quint32 idx : order_) {
+            const DrawPacket &p = packets_[idx];
+            if (p.pass != pass || p.culled || (view >= 0 && p.view != view))
+                continue;
+
+            rec.setGraphicsPipeline(p.pipeline);
+            if (p.hasDynamicOffset) {
+                const QRhiCommandBuffer::DynamicOffset dynOffset(0, p.dynamicOffset);
+                rec.setShaderResources(p.srb, 1, &dynOffset);
+            } else {
+                rec.setShaderResources(p.srb);
+            }
+            if (p.vbuf) {
+                const QRhiCommandBuffer::VertexInput input(p.vbuf, 0);
+                rec.setVertexInput(0, 1, &input, p.ibuf, 0, p.indexFormat);
+            }
+
+            if (p.ibuf)
+                rec.drawIndexed(p.count);
+            else
+                rec.draw(p.count);
+        }
+    }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "DrawList:" << stats_.packets << "packets," << stats_.compiles << "compiles," << stats_.sorts << "sorts";
+    }
+
+private:
+    template<typename T>
+    static quint64 idFor(QHash<const T *, quint32> &ids, const T *ptr, quint32 mask) {
+        auto it = ids.constFind(ptr);
+        if (it != ids.constEnd())
+            return *it;
+        const quint32 id = quint32(ids.size()) & mask;
+        ids.insert(ptr, id);
+        return id;
+    }
+
+    // LSD radix sort of order_ by packet key, 8 bits per pass; passes where
+    // every key has the same byte are skipped.
+    void radixSort() {
+        const size_t n = order_.size();
+        scratch_.resize(n);
+        std::array<std::array<quint32, 256>, 8> histograms{};
+        for (quint32 idx : order_) {
+            const quint64 key = packets_[idx].key;
+            for (int b = 0; b < 8; ++b)
+                ++histograms[b][(key >> (b * 8)) & 0xFF];
+        }
+
+        for (int b = 0; b < 8; ++b) {
+            std::array<quint32, 256> &h = histograms[b];
+            const quint64 firstByte = (packets_[order_[0]].key >> (b * 8)) & 0xFF;
+            if (h[firstByte] == n)
+                continue;
+            quint32 sum = 0;
+            for (quint32 &c : h) {
+                const quint32 c0 = c;
+                c = sum;
+                sum += c0;
+            }
+            for (quint32 idx : order_)
+                scratch_[h[(packets_[idx].key >> (b * 8)) & 0xFF]++] = idx;
+            order_.swap(scratch_);
+        }
+    }
+
+    std::vector<DrawPacket> packets_;
+    std::vector<quint32> order_;
+    std::vector<quint32> scratch_;
+    QHash<const QRhiGraphicsPipeline *, quint32> pipelineIds_;
+    QHash<const QRhiShaderResourceBindings *, quint32> srbIds_;
+    quint64 revision_ = 0;
+    bool compiled_ = false;
+    Stats stats_;
+};
+
+#endif // DRAWLIST_H
@@ -0,0 +1,475 @@
+#ifndef ENVMAP_H
+#define ENVMAP_H
+
+#include "rgbe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// CPU side of environment lighting: equirectangular RGBA16F images (bottom
+// row first, as hdr::load() returns them) resampled into cube map faces in
+// QRhi order (+X, -X, +Y, -Y, +Z, -Z, rows top down).
+// Rows are independent, so callers split faces and rows over threads; within
+// a row directions go through atan2 as a polynomial, four pixels per SSE2
+// step, and are sampled bilinearly.
+//
+// prefilterFaceRows() is the reference for shaders/prefilter.frag: the same
+// GGX importance sampling with the same sample sequence and source mip
+// selection, for backends that cannot render (Null) and for checking the GPU
+// result. brdfLutRow() is the same for shaders/brdflut.frag.
+
+namespace envmap {
+
+constexpr float PI = 3.14159265358979f;
+constexpr int PREFILTER_SAMPLES = 128; // SAMPLE_COUNT in prefilter.frag
+constexpr int BRDF_SAMPLES = 512;      // SAMPLE_COUNT in brdflut.frag
+
+struct Source {
+    const uint16_t *pixels = nullptr; // RGBA16F
+    int width = 0;
+    int height = 0;
+};
+
+// Direction of face pixel (nx, ny) in [-1, 1]^2: origin + nx * right + ny * down.
+struct FaceBasis {
+    float origin[3];
+    float right[3];
+    float down[3];
+};
+
+inline const FaceBasis &faceBasis(int face)
+{
+    static const FaceBasis bases[6] = {
+        { { 1, 0, 0 }, { 0, 0, -1 }, { 0, -1, 0 } },  // +X
+        { { -1, 0, 0 }, { 0, 0, 1 }, { 0, -1, 0 } },  // -X
+        { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },    // +Y
+        { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },  // -Y
+        { { 0, 0, 1 }, { 1, 0, 0 }, { 0, -1, 0 } },   // +Z
+        { { 0, 0, -1 }, { -1, 0, 0 }, { 0, -1, 0 } }, // -Z
+    };
+    return bases[face];
+}
+
+// Every half as a float, 256 KiB built once.
+inline const float *halfTable()
+{
+    static const std::vector<float> table = [] {
+        std::vector<float> t(65536);
+        for (uint32_t h = 0; h < 65536; ++h)
+            t[h] = rgbe::halfToFloat(uint16_t(h));
+        return t;
+    }();
+    return table.data();
+}
+
+// atan2 from a minimax polynomial for atan on [0, 1], error below 1e-5 rad.
+inline float atan2Approx(float y, float x)
+{
+    const float ax = std::fabs(x), ay = std::fabs(y);
+    const float hi = std::max(ax, ay), lo = std::min(ax, ay);
+    const float a = hi > 0.0f ? lo / hi : 0.0f;
+    const float s = a * a;
+    float r = (((((-0.01172120f * s + 0.05265332f) * s - 0.11643287f) * s + 0.19354346f) * s - 0.33262347f) * s
+               + 0.99997726f) * a;
+    if (ay > ax)
+        r = PI * 0.5f - r;
+    if (x < 0.0f)
+        r = PI - r;
+    return y < 0.0f ? -r : r;
+}
+
+#if RGBE_SSE2
+inline __m128 blend(__m128 mask, __m128 a, __m128 b)
+{
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+inline __m128 atan2Approx(__m128 y, __m128 x)
+{
+    const __m128 signBit = _mm_set1_ps(-0.0f);
+    const __m128 ax = _mm_andnot_ps(signBit, x), ay = _mm_andnot_ps(signBit, y);
+    const __m128 a = _mm_div_ps(_mm_min_ps(ax, ay), _mm_max_ps(_mm_max_ps(ax, ay), _mm_set1_ps(1e-30f)));
+    const __m128 s = _mm_mul_ps(a, a);
+    __m128 r = _mm_set1_ps(-0.01172120f);
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.05265332f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.11643287f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.19354346f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(-0.33262347f));
+    r = _mm_add_ps(_mm_mul_ps(r, s), _mm_set1_ps(0.99997726f));
+    r = _mm_mul_ps(r, a);
+    r = blend(_mm_cmpgt_ps(ay, ax), _mm_sub_ps(_mm_set1_ps(PI * 0.5f), r), r);
+    r = blend(_mm_cmplt_ps(x, _mm_setzero_ps()), _mm_sub_ps(_mm_set1_ps(PI), r), r);
+    return _mm_or_ps(r, _mm_and_ps(y, signBit));
+}
+#endif
+
+// Texel offsets and weights of the bilinear lookup at (u, v) in [0, 1]:
+// u wraps around, v clamps at the poles.
+struct Taps {
+    size_t offset[4];
+    float weight[4];
+};
+
+inline Taps bilinearTaps(const Source &src, float u, float v)
+{
+    const float fx = u * float(src.width) - 0.5f, fy = v * float(src.height) - 0.5f;
+    // floor() by truncation, both are above -1
+    const int ix = int(fx + 1.0f) - 1, iy = int(fy + 1.0f) - 1;
+    const float tx = fx - float(ix), ty = fy - float(iy);
+    int x0 = ix; // u is within [0, 1] give or take rounding
+    if (x0 < 0)
+        x0 += src.width;
+    else if (x0 >= src.width)
+        x0 -= src.width;
+    const int x1 = x0 + 1 == src.width ? 0 : x0 + 1;
+    const size_t r0 = size_t(std::clamp(iy, 0, src.height - 1)) * src.width;
+    const size_t r1 = size_t(std::clamp(iy + 1, 0, src.height - 1)) * src.width;
+    return { { (r0 + x0) * 4, (r0 + x1) * 4, (r1 + x0) * 4, (r1 + x1) * 4 },
+             { (1 - tx) * (1 - ty), tx * (1 - ty), (1 - tx) * ty, tx * ty } };
+}
+
+inline void sampleBilinear(const Source &src, const float *table, float u, float v, float rgb[3])
+{
+    const Taps t = bilinearTaps(src, u, v);
+    for (int c = 0; c < 3; ++c) {
+        rgb[c] = 0.0f;
+        for (int i = 0; i < 4; ++i)
+            rgb[c] += t.weight[i] * table[src.pixels[t.offset[i] + c]];
+    }
+}
+
+#if RGBE_SSE2
+// bilinearTaps() for four lookups.
+inline void bilinearTaps(const Source &src, __m128 u, __m128 v, Taps taps[4])
+{
+    const __m128i one = _mm_set1_epi32(1);
+    const __m128i width = _mm_set1_epi32(src.width), lastRow = _mm_set1_epi32(src.height - 1);
+    const __m128 fx = _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps(float(src.width))), _mm_set1_ps(0.5f));
+    const __m128 fy = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(float(src.height))), _mm_set1_ps(0.5f));
+    const __m128i ix = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(fx, _mm_set1_ps(1.0f))), one);
+    const __m128i iy = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(fy, _mm_set1_ps(1.0f))), one);
+    const __m128 tx = _mm_sub_ps(fx, _mm_cvtepi32_ps(ix)), ty = _mm_sub_ps(fy, _mm_cvtepi32_ps(iy));
+
+    __m128i x0 = _mm_add_epi32(ix, _mm_and_si128(_mm_cmplt_epi32(ix, _mm_setzero_si128()), width));
+    x0 = _mm_sub_epi32(x0, _mm_and_si128(_mm_cmpgt_epi32(x0, _mm_sub_epi32(width, one)), width));
+    __m128i x1 = _mm_add_epi32(x0, one);
+    x1 = _mm_andnot_si128(_mm_cmpeq_epi32(x1, width), x1);
+    auto clampRow = [&](__m128i y) {
+        y = _mm_andnot_si128(_mm_cmplt_epi32(y, _mm_setzero_si128()), y);
+        const __m128i over = _mm_cmpgt_epi32(y, lastRow);
+        return _mm_or_si128(_mm_and_si128(over, lastRow), _mm_andnot_si128(over, y));
+    };
+    alignas(16) int32_t c0[4], c1[4], r0[4], r1[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(c0), x0);
+    _mm_store_si128(reinterpret_cast<__m128i *>(c1), x1);
+    _mm_store_si128(reinterpret_cast<__m128i *>(r0), clampRow(iy));
+    _mm_store_si128(reinterpret_cast<__m128i *>(r1), clampRow(_mm_add_epi32(iy, one)));
+
+    const __m128 sx = _mm_sub_ps(_mm_set1_ps(1.0f), tx), sy = _mm_sub_ps(_mm_set1_ps(1.0f), ty);
+    alignas(16) float w[4][4];
+    _mm_store_ps(w[0], _mm_mul_ps(sx, sy));
+    _mm_store_ps(w[1], _mm_mul_ps(tx, sy));
+    _mm_store_ps(w[2], _mm_mul_ps(sx, ty));
+    _mm_store_ps(w[3], _mm_mul_ps(tx, ty));
+    for (int i = 0; i < 4; ++i) {
+        const size_t row0 = size_t(r0[i]) * src.width, row1 = size_t(r1[i]) * src.width;
+        taps[i] = { { (row0 + c0[i]) * 4, (row0 + c1[i]) * 4, (row1 + c0[i]) * 4, (row1 + c1[i]) * 4 },
+                    { w[0][i], w[1][i], w[2][i], w[3][i] } };
+    }
+}
+
+// RGB and an alpha of 1.
+inline __m128 sampleBilinear(const Source &src, const Taps &t)
+{
+    __m128 sum = _mm_setzero_ps();
+    for (int i = 0; i < 4; ++i) {
+        const __m128i texel = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(src.pixels + t.offset[i]));
+        const __m128 rgba = rgbe::floats(_mm_unpacklo_epi16(texel, _mm_setzero_si128()));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(t.weight[i]), rgba));
+    }
+    const __m128 rgbMask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    return _mm_or_ps(_mm_and_ps(sum, rgbMask), _mm_setr_ps(0.0f, 0.0f, 0.0f, 1.0f));
+}
+#endif
+
+// Rows [y0, y1) of face at faceSize^2 as RGBA16F, out pointing at row y0.
+inline void equirectToFaceRows(const Source &src, int face, int faceSize, int y0, int y1, uint16_t *out)
+{
+    const FaceBasis &b = faceBasis(face);
+    const float *table = halfTable();
+    const float step = 2.0f / float(faceSize);
+    const float inv2Pi = 0.5f / PI, invPi = 1.0f / PI;
+    for (int y = y0; y < y1; ++y) {
+        const float ny = (float(y) + 0.5f) * step - 1.0f;
+        float base[3];
+        for (int c = 0; c < 3; ++c)
+            base[c] = b.origin[c] + ny * b.down[c];
+        uint16_t *row = out + size_t(y - y0) * faceSize * 4;
+        int x = 0;
+#if RGBE_SSE2
+        const __m128 lane = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+        for (; x + 4 <= faceSize; x += 4) {
+            const __m128 nx = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_set1_ps(float(x)), lane), _mm_set1_ps(step)),
+                                         _mm_set1_ps(1.0f));
+            const __m128 dx = _mm_add_ps(_mm_set1_ps(base[0]), _mm_mul_ps(nx, _mm_set1_ps(b.right[0])));
+            const __m128 dy = _mm_add_ps(_mm_set1_ps(base[1]), _mm_mul_ps(nx, _mm_set1_ps(b.right[1])));
+            const __m128 dz = _mm_add_ps(_mm_set1_ps(base[2]), _mm_mul_ps(nx, _mm_set1_ps(b.right[2])));
+            const __m128 horizontal = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dz, dz)));
+            const __m128 half = _mm_set1_ps(0.5f);
+            const __m128 u = _mm_add_ps(_mm_mul_ps(atan2Approx(dz, dx), _mm_set1_ps(inv2Pi)), half);
+            const __m128 v = _mm_add_ps(_mm_mul_ps(atan2Approx(dy, horizontal), _mm_set1_ps(invPi)), half);
+            Taps taps[4];
+            bilinearTaps(src, u, v, taps);
+            __m128i px[4];
+            for (int i = 0; i < 4; ++i)
+                px[i] = rgbe::halves(sampleBilinear(src, taps[i]));
+            __m128i *dst = reinterpret_cast<__m128i *>(row + size_t(x) * 4);
+            _mm_storeu_si128(dst, _mm_packs_epi32(px[0], px[1]));
+            _mm_storeu_si128(dst + 1, _mm_packs_epi32(px[2], px[3]));
+        }
+#endif
+        for (; x < faceSize; ++x) {
+            const float nx = (float(x) + 0.5f) * step - 1.0f;
+            const float dx = base[0] + nx * b.right[0], dy = base[1] + nx * b.right[1], dz = base[2] + nx * b.right[2];
+            const float u = atan2Approx(dz, dx) * inv2Pi + 0.5f;
+            const float v = atan2Approx(dy, std::sqrt(dx * dx + dz * dz)) * invPi + 0.5f;
+            float rgb[3];
+            sampleBilinear(src, table, u, v, rgb);
+            uint16_t *px = row + size_t(x) * 4;
+            for (int c = 0; c < 3; ++c)
+                px[c] = rgbe::floatToHalf(rgb[c]);
+            px[3] = 0x3c00;
+        }
+    }
+}
+
+// Cube map level as float RGB per face, rows top down.
+struct CubeLevel {
+    int size = 0;
+    std::vector<float> faces[6];
+};
+
+// Levels from size down to 1x1, unfilled.
+inline std::vector<CubeLevel> allocateCube(int size)
+{
+    std::vector<CubeLevel> levels;
+    for (; size >= 1; size /= 2) {
+        CubeLevel level;
+        level.size = size;
+        for (auto &face : level.faces)
+            face.resize(size_t(size) * size * 3);
+        levels.push_back(std::move(level));
+    }
+    return levels;
+}
+
+// Level 0 of face from RGBA16F rows, the levels below by 2x2 box filtering.
+inline void fillFaceChain(std::vector<CubeLevel> &levels, int face, const uint16_t *rgba16f)
+{
+    std::vector<float> &top = levels[0].faces[face];
+    for (size_t i = 0; i < top.size() / 3; ++i)
+        for (int c = 0; c < 3; ++c)
+            top[i * 3 + c] = rgbe::halfToFloat(rgba16f[i * 4 + c]);
+    for (size_t l = 1; l < levels.size(); ++l) {
+        const std::vector<float> &src = levels[l - 1].faces[face];
+        std::vector<float> &dst = levels[l].faces[face];
+        const int size = levels[l].size, srcSize = levels[l - 1].size;
+        for (int y = 0; y < size; ++y)
+            for (int x = 0; x < size; ++x)
+                for (int c = 0; c < 3; ++c) {
+                    const size_t i = (size_t(y) * 2 * srcSize + size_t(x) * 2) * 3 + c;
+                    dst[(size_t(y) * size + x) * 3 + c] =
+                        0.25f * (src[i] + src[i + 3] + src[i + size_t(srcSize) * 3] + src[i + size_t(srcSize) * 3 + 3]);
+                }
+    }
+}
+
+// Face and face coordinates in [0, 1] that dir hits, the inverse of faceBasis().
+inline int faceCoordinates(const float dir[3], float &s, float &t)
+{
+    const float ax = std::fabs(dir[0]), ay = std::fabs(dir[1]), az = std::fabs(dir[2]);
+    const int axis = ax >= ay && ax >= az ? 0 : ay >= az ? 1 : 2;
+    const int face = axis * 2 + (dir[axis] < 0.0f ? 1 : 0);
+    const float inv = 1.0f / std::max(std::fabs(dir[axis]), 1e-30f);
+    const FaceBasis &b = faceBasis(face);
+    s = 0.5f * ((dir[0] * b.right[0] + dir[1] * b.right[1] + dir[2] * b.right[2]) * inv + 1.0f);
+    t = 0.5f * ((dir[0] * b.down[0] + dir[1] * b.down[1] + dir[2] * b.down[2]) * inv + 1.0f);
+    return face;
+}
+
+// Trilinear lookup; bilinear taps clamp at face edges instead of crossing to the neighbour.
+inline void sampleCube(const std::vector<CubeLevel> &cube, const float dir[3], float lod, float rgb[3])
+{
+    float s, t;
+    const int face = faceCoordinates(dir, s, t);
+    lod = std::clamp(lod, 0.0f, float(cube.size() - 1));
+    const int l0 = int(lod), l1 = std::min(l0 + 1, int(cube.size()) - 1);
+    const float f = lod - float(l0);
+    rgb[0] = rgb[1] = rgb[2] = 0.0f;
+    for (int l : { l0, l1 }) {
+        const float weight = l == l0 ? 1.0f - f : f;
+        if (weight <= 0.0f)
+            continue;
+        const CubeLevel &level = cube[size_t(l)];
+        const float fx = std::clamp(s * level.size - 0.5f, 0.0f, float(level.size - 1));
+        const float fy = std::clamp(t * level.size - 0.5f, 0.0f, float(level.size - 1));
+        const int x0 = int(fx), y0 = int(fy);
+        const int x1 = std::min(x0 + 1, level.size - 1), y1 = std::min(y0 + 1, level.size - 1);
+        const float tx = fx - float(x0), ty = fy - float(y0);
+        const float *p = level.faces[face].data();
+        auto at = [&](int x, int y, int c) { return p[(size_t(y) * level.size + x) * 3 + c]; };
+        for (int c = 0; c < 3; ++c)
+            rgb[c] += weight * ((1 - ty) * ((1 - tx) * at(x0, y0, c) + tx * at(x1, y0, c))
+                                + ty * ((1 - tx) * at(x0, y1, c) + tx * at(x1, y1, c)));
+    }
+}
+
+inline uint32_t reverseBits(uint32_t v)
+{
+    v = (v << 16) | (v >> 16);
+    v = ((v & 0x00ff00ffu) << 8) | ((v & 0xff00ff00u) >> 8);
+    v = ((v & 0x0f0f0f0fu) << 4) | ((v & 0xf0f0f0f0u) >> 4);
+    v = ((v & 0x33333333u) << 2) | ((v & 0xccccccccu) >> 2);
+    return ((v & 0x55555555u) << 1) | ((v & 0xaaaaaaaau) >> 1);
+}
+
+// Rows [y0, y1) of face of a size^2 level prefiltered for roughness, as
+// RGBA16F; out points at row y0. Light is assumed to arrive along the normal
+// (N = V = R), sampleCount GGX half vectors come from a Hammersley sequence
+// and every sample reads the env mip whose texels cover its solid angle.
+inline void prefilterFaceRows(const std::vector<CubeLevel> &env, float roughness, int sampleCount, int face, int size,
+                              int y0, int y1, uint16_t *out)
+{
+    const FaceBasis &b = faceBasis(face);
+    const float a = roughness * roughness, a2 = a * a;
+    const float texelSolidAngle = 4.0f * PI / (6.0f * float(env[0].size) * float(env[0].size));
+    for (int y = y0; y < y1; ++y) {
+        for (int x = 0; x < size; ++x) {
+            const float nx = (float(x) + 0.5f) / float(size) * 2.0f - 1.0f;
+            const float ny = (float(y) + 0.5f) / float(size) * 2.0f - 1.0f;
+            float n[3];
+            for (int c = 0; c < 3; ++c)
+                n[c] = b.origin[c] + nx * b.right[c] + ny * b.down[c];
+            const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (float &c : n)
+                c /= len;
+
+            float rgb[3] = { 0.0f, 0.0f, 0.0f };
+            if (roughness <= 0.0f) {
+                sampleCube(env, n, 0.0f, rgb);
+            } else {
+                const float up[3] = { std::fabs(n[2]) < 0.999f ? 0.0f : 1.0f, 0.0f, std::fabs(n[2]) < 0.999f ? 1.0f : 0.0f };
+                float tangent[3] = { up[1] * n[2] - up[2] * n[1], up[2] * n[0] - up[0] * n[2], up[0] * n[1] - up[1] * n[0] };
+                const float tl = std::sqrt(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+                for (float &c : tangent)
+                    c /= tl;
+                const float bitangent[3] = { n[1] * tangent[2] - n[2] * tangent[1], n[2] * tangent[0] - n[0] * tangent[2],
+                                             n[0] * tangent[1] - n[1] * tangent[0] };
+                float weight = 0.0f;
+                for (int i = 0; i < sampleCount; ++i) {
+                    const float xi0 = float(i) / float(sampleCount);
+                    const float xi1 = float(reverseBits(uint32_t(i))) * 2.3283064365386963e-10f;
+                    const float phi = 2.0f * PI * xi0;
+                    const float cosTheta = std::sqrt((1.0f - xi1) / (1.0f + (a2 - 1.0f) * xi1));
+                    const float sinTheta = std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+                    const float hx = std::cos(phi) * sinTheta, hy = std::sin(phi) * sinTheta;
+                    float h[3];
+                    for (int c = 0; c < 3; ++c)
+                        h[c] = tangent[c] * hx + bitangent[c] * hy + n[c] * cosTheta;
+                    const float nDotH = std::max(n[0] * h[0] + n[1] * h[1] + n[2] * h[2], 0.0f);
+                    float l[3];
+                    for (int c = 0; c < 3; ++c)
+                        l[c] = 2.0f * nDotH * h[c] - n[c];
+                    const float nDotL = n[0] * l[0] + n[1] * l[1] + n[2] * l[2];
+                    if (nDotL <= 0.0f)
+                        continue;
+                    // D * NdotH / (4 * HdotV) with V = N
+                    const float d = nDotH * nDotH * (a2 - 1.0f) + 1.0f;
+                    const float pdf = a2 / (PI * d * d) * 0.25f + 0.0001f;
+                    const float sampleSolidAngle = 1.0f / (float(sampleCount) * pdf);
+                    const float lod = std::max(0.5f * std::log2(sampleSolidAngle / texelSolidAngle), 0.0f);
+                    float c[3];
+                    sampleCube(env, l, lod, c);
+                    for (int k = 0; k < 3; ++k)
+                        rgb[k] += c[k] * nDotL;
+                    weight += nDotL;
+                }
+                for (float &c : rgb)
+                    c /= std::max(weight, 0.0001f);
+            }
+            uint16_t *px = out + (size_t(y - y0) * size + x) * 4;
+            for (int c = 0; c < 3; ++c)
+                px[c] = rgbe::floatToHalf(rgb[c]);
+            px[3] = 0x3c00;
+        }
+    }
+}
+
+// Row y of the split-sum BRDF table, size^2 texels over (n.v, roughness) =
+// ((x + 0.5) / size, (y + 0.5) / size): the scale and bias of F0, as RG pairs
+// into out. The GGX half vectors only depend on roughness, so they are made
+// once per row and every texel sums them four per SSE2 step.
+inline void brdfLutRow(int size, int sampleCount, int y, float *out)
+{
+    const float roughness = (float(y) + 0.5f) / float(size);
+    const float a = roughness * roughness, a2 = a * a;
+    const float k = a / 2.0f; // Schlick-GGX k for IBL: roughness^2 / 2
+    const int padded = (sampleCount + 3) & ~3;
+    std::vector<float> hx(size_t(padded), 0.0f), hz(size_t(padded), 1.0f);
+    for (int i = 0; i < sampleCount; ++i) {
+        const float xi0 = float(i) / float(sampleCount);
+        const float xi1 = float(reverseBits(uint32_t(i))) * 2.3283064365386963e-10f;
+        const float cosTheta = std::sqrt((1.0f - xi1) / (1.0f + (a2 - 1.0f) * xi1));
+        hx[size_t(i)] = std::cos(2.0f * PI * xi0) * std::sqrt(std::max(0.0f, 1.0f - cosTheta * cosTheta));
+        hz[size_t(i)] = cosTheta;
+    }
+    for (int x = 0; x < size; ++x) {
+        // V = (sin, 0, cos) in the tangent frame of N = +Z
+        const float nDotV = (float(x) + 0.5f) / float(size);
+        const float vx = std::sqrt(1.0f - nDotV * nDotV);
+        const float g1v = nDotV / (nDotV * (1.0f - k) + k);
+        float scale = 0.0f, bias = 0.0f;
+        int i = 0;
+#if RGBE_SSE2
+        const __m128 one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps(), kk = _mm_set1_ps(k);
+        const __m128 oneMinusK = _mm_set1_ps(1.0f - k), nv = _mm_set1_ps(nDotV), vxs = _mm_set1_ps(vx);
+        const __m128 gv = _mm_set1_ps(g1v);
+        __m128 accScale = zero, accBias = zero;
+        for (; i + 4 <= sampleCount; i += 4) {
+            const __m128 h0 = _mm_loadu_ps(&hx[size_t(i)]), h2 = _mm_loadu_ps(&hz[size_t(i)]);
+            const __m128 vDotH = _mm_max_ps(_mm_add_ps(_mm_mul_ps(vxs, h0), _mm_mul_ps(nv, h2)), zero);
+            const __m128 nDotL = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(vDotH, vDotH), h2), nv);
+            const __m128 lit = _mm_cmpgt_ps(nDotL, zero);
+            const __m128 g1l = _mm_div_ps(nDotL, _mm_add_ps(_mm_mul_ps(nDotL, oneMinusK), kk));
+            const __m128 gVis = _mm_and_ps(lit, _mm_div_ps(_mm_mul_ps(_mm_mul_ps(gv, g1l), vDotH), _mm_mul_ps(h2, nv)));
+            const __m128 f1 = _mm_sub_ps(one, vDotH), f2 = _mm_mul_ps(f1, f1);
+            const __m128 fc = _mm_mul_ps(_mm_mul_ps(f2, f2), f1);
+            accScale = _mm_add_ps(accScale, _mm_mul_ps(_mm_sub_ps(one, fc), gVis));
+            accBias = _mm_add_ps(accBias, _mm_mul_ps(fc, gVis));
+        }
+        alignas(16) float lanes[2][4];
+        _mm_store_ps(lanes[0], accScale);
+        _mm_store_ps(lanes[1], accBias);
+        scale = (lanes[0][0] + lanes[0][1]) + (lanes[0][2] + lanes[0][3]);
+        bias = (lanes[1][0] + lanes[1][1]) + (lanes[1][2] + lanes[1][3]);
+#endif
+        for (; i < sampleCount; ++i) {
+            const float vDotH = std::max(vx * hx[size_t(i)] + nDotV * hz[size_t(i)], 0.0f);
+            const float nDotL = 2.0f * vDotH * hz[size_t(i)] - nDotV;
+            if (nDotL <= 0.0f)
+                continue;
+            const float gVis = g1v * (nDotL / (nDotL * (1.0f - k) + k)) * vDotH / (hz[size_t(i)] * nDotV);
+            const float fc = std::pow(1.0f - vDotH, 5.0f);
+            scale += (1.0f - fc) * gVis;
+            bias += fc * gVis;
+        }
+        out[x * 2] = scale / float(sampleCount);
+        out[x * 2 + 1] = bias / float(sampleCount);
+    }
+}
+
+} // namespace envmap
+
+#endif // ENVMAP_H
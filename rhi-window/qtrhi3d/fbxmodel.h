@@ -15,8 +15,18 @@
 #include <map>
 #include <memory>
 #include <array>
+#include <algorithm>
 #include <logger.h>
 #include "assimputils.h"
+#include "rhicache.h"
+#include "drawlist.h"
+#include "commandrecorder.h"
+#include "transform.h"
+#include "qmesh.h"
+#include "texturestreamer.h"
+#include "qtiosystem.h"
+#include "assetpack.h"
+#include "startupprofiler.h"
 
 struct MVertex {
     QVector3D position{};
@@ -33,6 +43,19 @@ struct Material {
         : type(t), texture(tex), path(std::move(p)) {}
 };
 
+static_assert(sizeof(MVertex) == qmesh::vertexStride(qmesh::VertexLayout::Static));
+
+// CPU-side result of converting one aiMesh, ready to become a Mesh. Cooked
+// meshes leave the vectors empty and point into the mapped .qmesh instead.
+struct MeshData {
+    std::vector<MVertex> vertices;
+    std::vector<uint32_t> indices;
+    std::vector<std::string> texturePaths;
+    QMatrix4x4 transform;
+    std::shared_ptr<qmesh::File> cooked;
+    quint32 submesh = 0;
+};
+
 class Mesh {
 
 
@@ -44,101 +67,148 @@ public:
 private:
     QMatrix4x4 transform_;
     QRhi *rhi_{nullptr};
-    std::unique_ptr<QRhiGraphicsPipeline> pipeline_;
+    QRhiGraphicsPipeline *pipeline_{nullptr};
     std::unique_ptr<QRhiBuffer> vbuf_;
     std::unique_ptr<QRhiBuffer> ibuf_;
-    std::unique_ptr<QRhiBuffer> ubuf_;
-    std::unique_ptr<QRhiSampler> sampler_;
-    std::unique_ptr<QRhiShaderResourceBindings> srb_;
+    UniformBufferPool *uniforms_{nullptr};
+    quint32 uboOffset_{0};
+    QRhiSampler *sampler_{nullptr};
+    QRhiShaderResourceBindings *srb_{nullptr};
     bool uploaded_{false};
 
+    // geometry to upload: the vectors above or a mapped .qmesh kept alive until uploaded
+    std::shared_ptr<qmesh::File> cooked_;
+    const void *vertexData_{nullptr};
+    quint32 vertexCount_{0};
+    const quint32 *indexData_{nullptr};
+    quint32 indexCount_{0};
+
 public:
 
     Mesh(std::vector<MVertex> verts, std::vector<uint32_t> inds, std::vector<Material> mats, const QMatrix4x4& t)
         : vertices(std::move(verts)), indices(std::move(inds)), materials(std::move(mats)), transform_(t) {
 
-
+        vertexData_ = vertices.data();
+        vertexCount_ = static_cast<quint32>(vertices.size());
+        indexData_ = indices.data();
+        indexCount_ = static_cast<quint32>(indices.size());
         //qDebug() << "Assimp runtime:"<< aiGetVersionMajor() << "."<< aiGetVersionMinor() << "."<< aiGetVersionRevision();
 
 
     }
 
+    Mesh(std::shared_ptr<qmesh::File> file, quint32 submesh, std::vector<Material> mats)
+        : materials(std::move(mats)), cooked_(std::move(file)) {
+        const qmesh::Submesh& s = cooked_->submesh(submesh);
+        transform_ = qmesh::toMatrix(s.transform);
+        vertexData_ = cooked_->vertices(s);
+        vertexCount_ = s.vertexCount;
+        indexData_ = cooked_->indices(s);
+        indexCount_ = s.indexCount;
+    }
+
+    quint32 vertexCount() const { return vertexCount_; }
+    quint32 indexCount() const { return indexCount_; }
+
     void create(QRhi *rhi, QRhiRenderTarget *rt,QRhiRenderPassDescriptor *rp) {
-        if (rhi_ != rhi) pipeline_.reset(), rhi_ = rhi;
+        if (rhi_ != rhi) pipeline_ = nullptr, rhi_ = rhi;
         if (!pipeline_) {
             vbuf_.reset(rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::VertexBuffer,
-                                       static_cast<quint32>(vertices.size() * sizeof(MVertex))));
+                                       vertexCount_ * static_cast<quint32>(sizeof(MVertex))));
             vbuf_->create();
             ibuf_.reset(rhi->newBuffer(QRhiBuffer::Immutable, QRhiBuffer::IndexBuffer,
-                                       static_cast<quint32>(indices.size() * sizeof(uint32_t))));
+                                       indexCount_ * static_cast<quint32>(sizeof(uint32_t))));
             ibuf_->create();
-            ubuf_.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, 64));
-            ubuf_->create();
+            RhiResourceCache *cache = RhiResourceCache::instance(rhi);
+            uniforms_ = cache->uniformPool(64);
+            uboOffset_ = uniforms_->allocate();
 
-            sampler_.reset(rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
-                                           QRhiSampler::Repeat, QRhiSampler::Repeat));
-            sampler_->create();
+            SamplerKey samplerKey;
+            samplerKey.mipmapMode = QRhiSampler::None;
+            sampler_ = cache->sampler(samplerKey);
 
-            std::vector<QRhiShaderResourceBinding> bindings;
-            bindings.emplace_back(QRhiShaderResourceBinding::uniformBuffer(
-                0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage, ubuf_.get()));
+            // meshes sharing the same textures share one SRB
+            QVector<QRhiShaderResourceBinding> bindings;
+            bindings.append(QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(
+                0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage, uniforms_->buffer(), 64));
 
             int binding_idx = 1;
             for (auto& mat : materials) {
                 if (mat.texture)
-                    bindings.emplace_back(QRhiShaderResourceBinding::sampledTexture(
-                        binding_idx++, QRhiShaderResourceBinding::FragmentStage, mat.texture.get(), sampler_.get()));
+                    bindings.append(QRhiShaderResourceBinding::sampledTexture(
+                        binding_idx++, QRhiShaderResourceBinding::FragmentStage, mat.texture.get(), sampler_));
             }
-
-            srb_.reset(rhi->newShaderResourceBindings());
-            srb_->setBindings(bindings.begin(), bindings.end());
-            srb_->create();
-
-            pipeline_.reset(rhi->newGraphicsPipeline());
-            pipeline_->setTopology(QRhiGraphicsPipeline::Triangles);
-            pipeline_->setShaderStages({
-                { QRhiShaderStage::Vertex, LoadShader(":/shaders/prebuild/model.vert.qsb") },
-                { QRhiShaderStage::Fragment, LoadShader(":/shaders/prebuild/model.frag.qsb") }
-            });
-            QRhiVertexInputLayout layout{};
-            layout.setBindings({ 8 * sizeof(float) });
-            layout.setAttributes({
-                {0, 0, QRhiVertexInputAttribute::Float3, 0},
-                {0, 1, QRhiVertexInputAttribute::Float3, 3*sizeof(float)},
-                {0, 2, QRhiVertexInputAttribute::Float2, 6*sizeof(float)}
+            srb_ = cache->srb(bindings);
+
+            static const QShader vs = LoadShader(":/shaders/prebuild/model.vert.qsb");
+            static const QShader fs = LoadShader(":/shaders/prebuild/model.frag.qsb");
+            // the textured materials fill bindings 1..n, so n alone tells SRB
+            // layouts apart; a pipeline is only shared with compatible SRBs
+            const quint32 layout = quint32(binding_idx - 1);
+            pipeline_ = cache->pipeline({ vs, fs, rp, layout }, [this](QRhiGraphicsPipeline *ps) {
+                ps->setTopology(QRhiGraphicsPipeline::Triangles);
+                QRhiVertexInputLayout layout{};
+                layout.setBindings({ 8 * sizeof(float) });
+                layout.setAttributes({
+                    {0, 0, QRhiVertexInputAttribute::Float3, 0},
+                    {0, 1, QRhiVertexInputAttribute::Float3, 3*sizeof(float)},
+                    {0, 2, QRhiVertexInputAttribute::Float2, 6*sizeof(float)}
+                });
+                ps->setVertexInputLayout(layout);
+                ps->setShaderResourceBindings(srb_);
+                ps->setDepthTest(true);
+                ps->setDepthWrite(true);
+                ps->setCullMode(QRhiGraphicsPipeline::Back);
             });
-            pipeline_->setVertexInputLayout(layout);
-            pipeline_->setShaderResourceBindings(srb_.get());
-            pipeline_->setRenderPassDescriptor(rp);
-            pipeline_->setDepthTest(true);
-            pipeline_->setDepthWrite(true);
-            pipeline_->setCullMode(QRhiGraphicsPipeline::Back);
-            pipeline_->create();
         }
     }
 
     void updateUbo(QRhiResourceUpdateBatch *rub, const QMatrix4x4& mvp) {
         if (!uploaded_) {
-            rub->uploadStaticBuffer(vbuf_.get(), vertices.data());
-            rub->uploadStaticBuffer(ibuf_.get(), indices.data());
+            // the batch copies the data, so the mapping can go right away
+            rub->uploadStaticBuffer(vbuf_.get(), vertexData_);
+            rub->uploadStaticBuffer(ibuf_.get(), indexData_);
+            cooked_.reset();
+            vertexData_ = nullptr;
+            indexData_ = nullptr;
             uploaded_ = true;
         }
-        rub->updateDynamicBuffer(ubuf_.get(), 0, 64, (mvp * transform_).constData());
+        rub->updateDynamicBuffer(uniforms_->buffer(), uboOffset_, 64, (mvp * transform_).constData());
     }
 
-    void draw(QRhiCommandBuffer *cb, const QRhiViewport& viewport) {
-        cb->setGraphicsPipeline(pipeline_.get());
-        cb->setViewport(viewport);
-        cb->setShaderResources();
+    void draw(CommandRecorder &cb, const QRhiViewport& viewport) {
+        cb.setGraphicsPipeline(pipeline_);
+        cb.setViewport(viewport);
+        const QRhiCommandBuffer::DynamicOffset ubufOffset(0, uboOffset_);
+        cb.setShaderResources(srb_, 1, &ubufOffset);
         const QRhiCommandBuffer::VertexInput input{vbuf_.get(), 0};
-        cb->setVertexInput(0, 1, &input, ibuf_.get(), 0, QRhiCommandBuffer::IndexUInt32);
-        cb->drawIndexed(static_cast<quint32>(indices.size()));
+        cb.setVertexInput(0, 1, &input, ibuf_.get(), 0, QRhiCommandBuffer::IndexUInt32);
+        cb.drawIndexed(indexCount_);
     }
 
 
+    bool isCreated() const { return pipeline_ != nullptr; }
+
+    void collectPackets(DrawList &list, const QVector3D *origin) const {
+        DrawPacket packet;
+        packet.pass = DrawPass::Opaque;
+        packet.pipeline = pipeline_;
+        packet.srb = srb_;
+        packet.hasDynamicOffset = true;
+        packet.dynamicOffset = uboOffset_;
+        packet.vbuf = vbuf_.get();
+        packet.ibuf = ibuf_.get();
+        packet.indexFormat = QRhiCommandBuffer::IndexUInt32;
+        packet.count = indexCount_;
+        packet.origin = origin;
+        packet.originOffset = transform_.map(QVector3D());
+        list.add(packet);
+    }
+
     static inline QShader LoadShader(const QString& name) {
-        QFile f(name);
-        return f.open(QIODevice::ReadOnly) ? QShader::fromSerialized(f.readAll()) : QShader();
+        startup::Scope scope("shader load");
+        const QByteArray data = qpak::read(name);
+        return data.isEmpty() ? QShader() : QShader::fromSerialized(data);
     }
 };
 
@@ -149,22 +219,48 @@ class FbxModel {
 
 private:
     std::string dir_;
-    bool created_{false};
-    bool uploaded_{false};
     std::vector<std::unique_ptr<Mesh>> meshes_;
+    // decoded textures by path; a null texture means the file could not be read
     std::map<std::string, std::shared_ptr<QRhiTexture>> textures_;
+    // decoded but not yet uploaded
+    std::map<std::string, qtex::Payload> pendingImages_;
+    QVector3D boundsMin_;
+    QVector3D boundsMax_;
+    bool hasBounds_{false};
+    quint64 revision_{0};
 public:
+    Transform transform;
+
+    static constexpr unsigned IMPORT_FLAGS = aiProcess_Triangulate |
+                                             aiProcess_GenSmoothNormals |
+                                             aiProcess_FlipUVs |
+                                             aiProcess_CalcTangentSpace |
+                                             aiProcess_GenUVCoords;
+
+    // Empty model filled progressively through addMesh()/addTexture(), e.g. by AssetImporter.
+    FbxModel() = default;
     explicit FbxModel(const QString& path) { load(path); }
 
+    // Uses the cooked .qmesh next to resource when it is up to date, assimp otherwise.
     bool load(const QString& resource) {
-        dir_ = QFileInfo(resource).dir().absolutePath().toStdString();
+        dir_ = QFileInfo(QtIOSystem::normalize(resource)).dir().absolutePath().toStdString();
+        if (auto cooked = openCooked(resource)) {
+            meshes_.clear();
+            textures_.clear();
+            pendingImages_.clear();
+            for (quint32 i = 0; i < cooked->header().submeshCount; ++i)
+                addMesh(cookedMesh(cooked, i, dir_));
+            setBounds(cooked->boundsMin(), cooked->boundsMax());
+            decodeMissingTextures();
+            ++revision_;
+            return true;
+        }
+
         Assimp::Importer importer;
-        const auto scene = importer.ReadFile(resource.toStdString(),
-                                             aiProcess_Triangulate |
-                                                 aiProcess_GenSmoothNormals |
-                                                 aiProcess_FlipUVs |
-                                                 aiProcess_CalcTangentSpace |
-                                                 aiProcess_GenUVCoords);
+        auto *io = new QtIOSystem;
+        const auto counters = io->counters();
+        importer.SetIOHandler(io);
+        const auto scene = importer.ReadFile(resource.toStdString(), IMPORT_FLAGS);
         if (!scene || !scene->mRootNode || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE) {
             qDebug() << "Assimp error:" << importer.GetErrorString();
             return false;
@@ -175,12 +271,39 @@ public:
         }
         meshes_.clear();
         textures_.clear();
+        pendingImages_.clear();
         load_node(scene, scene->mRootNode, {});
-        created_ = false;
-        uploaded_ = false;
+        decodeMissingTextures(counters.get());
+        counters->dump(qPrintable(resource));
+        ++revision_;
         return true;
     }
 
+    static std::shared_ptr<qmesh::File> openCooked(const QString& resource) {
+        return qmesh::File::open(qmesh::cookedPath(resource, qmesh::VertexLayout::Static),
+                                 qmesh::VertexLayout::Static, resource);
+    }
+
+    static MeshData cookedMesh(const std::shared_ptr<qmesh::File>& file, quint32 submesh, const std::string& dir) {
+        MeshData data;
+        const qmesh::Submesh& s = file->submesh(submesh);
+        for (quint32 t = s.firstTexture; t < s.firstTexture + s.textureCount; ++t) {
+            const qmesh::Texture& tex = file->texture(t);
+            if (tex.type == aiTextureType_DIFFUSE)
+                data.texturePaths.push_back(QtIOSystem::resolve(dir, std::string(file->string(tex.pathOffset, tex.pathLength))));
+        }
+        data.cooked = file;
+        data.submesh = submesh;
+        return data;
+    }
+
+    void decodeMissingTextures(QtIOSystem::Counters *counters = nullptr) {
+        for (const auto& mesh : meshes_)
+            for (const auto& mat : mesh->materials)
+                if (!textures_.count(mat.path))
+                    addTexture(mat.path, decodeTexture(mat.path, counters));
+    }
+
     void load_node(const aiScene *scene, const aiNode *node, const QMatrix4x4& accumulated) {
         QMatrix4x4 transform = accumulated * utils::to_qmatrix4x4(node->mTransformation);
         for (uint32_t i = 0; i < node->mNumMeshes; ++i)
@@ -190,60 +313,149 @@ public:
     }
 
     void load_mesh(const aiScene *scene, const aiMesh *mesh, const QMatrix4x4& transform) {
-        std::vector<MVertex> vertices(mesh->mNumVertices);
+        addMesh(convertMesh(scene, mesh, dir_, transform));
+    }
+
+    // Pure CPU work, safe to run on any thread.
+    static MeshData convertMesh(const aiScene *scene, const aiMesh *mesh, const std::string& dir, const QMatrix4x4& transform) {
+        MeshData data;
+        data.transform = transform;
+        data.vertices.resize(mesh->mNumVertices);
         for (unsigned i = 0; i < mesh->mNumVertices; ++i) {
-            vertices[i].position = { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z };
-            if (mesh->HasNormals()) vertices[i].normal = { mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z };
-            if (mesh->mTextureCoords[0]) vertices[i].coords = { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y };
+            MVertex& v = data.vertices[i];
+            v.position = { mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z };
+            if (mesh->HasNormals()) v.normal = { mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z };
+            if (mesh->mTextureCoords[0]) v.coords = { mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y };
         }
 
-        std::vector<uint32_t> indices;
+        data.indices.reserve(size_t(mesh->mNumFaces) * 3);
         for (unsigned i = 0; i < mesh->mNumFaces; ++i)
             for (unsigned j = 0; j < mesh->mFaces[i].mNumIndices; ++j)
-                indices.push_back(mesh->mFaces[i].mIndices[j]);
+                data.indices.push_back(mesh->mFaces[i].mIndices[j]);
 
-        std::vector<Material> materials;
         const auto aimat = scene->mMaterials[mesh->mMaterialIndex];
-        for (int t = 0; t < aimat->GetTextureCount(aiTextureType_DIFFUSE); ++t) {
+        for (unsigned t = 0; t < aimat->GetTextureCount(aiTextureType_DIFFUSE); ++t) {
             aiString path;
             aimat->GetTexture(aiTextureType_DIFFUSE, t, &path);
-            std::string full = dir_ + "/" + std::string(path.data, path.length);
-            materials.emplace_back(aiTextureType_DIFFUSE, nullptr, full);
-            textures_[full].reset();
+            data.texturePaths.push_back(QtIOSystem::resolve(dir, std::string(path.data, path.length)));
         }
        // printMeshInfo(mesh, scene->mMaterials[mesh->mMaterialIndex]);
-        meshes_.emplace_back(std::make_unique<Mesh>(vertices, indices, materials, transform));
+        return data;
     }
 
+    // Prefers a cooked .qtex next to the image, transcoded for the last queried targets.
+    static qtex::Payload decodeTexture(const std::string& path, QtIOSystem::Counters *counters = nullptr) {
+        const QString source = QString::fromStdString(path);
+        // cooked files are streamed from the render thread, nothing to decode here
+        if (auto cooked = qtex::File::open(qtex::cookedPath(source), source)) {
+            qtex::Payload payload;
+            payload.stream = std::move(cooked);
+            return payload;
+        }
+        const QImage img = QtIOSystem::readImage(source, counters);
+        if (img.isNull())
+            return {};
+        return qtex::Payload::fromImage(img);
+    }
+
+    void addMesh(MeshData&& data) {
+        std::vector<Material> materials;
+        for (auto& path : data.texturePaths)
+            materials.emplace_back(aiTextureType_DIFFUSE, nullptr, std::move(path));
+        if (data.cooked) {
+            meshes_.emplace_back(std::make_unique<Mesh>(std::move(data.cooked), data.submesh, std::move(materials)));
+            return;
+        }
+        meshes_.emplace_back(std::make_unique<Mesh>(std::move(data.vertices), std::move(data.indices),
+                                                    std::move(materials), data.transform));
+    }
+
+    void addTexture(const std::string& path, qtex::Payload image) {
+        textures_[path].reset();
+        if (!image.isNull())
+            pendingImages_[path] = std::move(image);
+    }
+
+    void setBounds(const QVector3D& min, const QVector3D& max) {
+        boundsMin_ = min;
+        boundsMax_ = max;
+        hasBounds_ = true;
+    }
+    bool hasBounds() const { return hasBounds_; }
+    QVector3D boundsMin() const { return boundsMin_; }
+    QVector3D boundsMax() const { return boundsMax_; }
+
+    // Creates GPU resources for everything that became available since the
+    // last call; a mesh is created once all of its textures are decoded.
     void create(QRhi *rhi, QRhiRenderTarget *rt,QRhiRenderPassDescriptor *rp) {
-        if (!created_) {
-            for (auto& [path, tex] : textures_) {
-                QImage img;
-                if (!img.load(QString::fromStdString(path))) continue;
-                tex.reset(rhi->newTexture(QRhiTexture::RGBA8, img.size()));
-                tex->create();
+        // files other models already uploaded are shared through the cache
+        TextureCache *cache = TextureCache::instance(rhi);
+        for (auto it = pendingImages_.begin(); it != pendingImages_.end();) {
+            auto& tex = textures_[it->first];
+            if (tex) { ++it; continue; }
+            const QString source = QString::fromStdString(it->first);
+            if (it->second.stream) {
+                tex = TextureStreamer::instance(rhi)->adopt(source, it->second.stream, { false, true, false });
+                it = pendingImages_.erase(it);
+                continue;
             }
-            for (auto& mesh : meshes_)
-                for (auto& mat : mesh->materials)
-                    mat.texture = textures_[mat.path];
-            created_ = true;
+            const TextureOptions options{ false, it->second.levels.size() > 1, false };
+            if ((tex = cache->find(source, options))) {
+                it = pendingImages_.erase(it);
+                continue;
+            }
+            tex = cache->insert(source, options, it->second.createTexture(rhi), TextureCache::payloadBytes(it->second));
+            ++it;
+        }
+        bool added = false;
+        for (auto& mesh : meshes_) {
+            if (mesh->isCreated()) continue;
+            const bool ready = std::all_of(mesh->materials.begin(), mesh->materials.end(),
+                                           [this](const Material& mat) { return textures_.count(mat.path) != 0; });
+            if (!ready) continue;
+            for (auto& mat : mesh->materials)
+                mat.texture = textures_[mat.path];
+            mesh->create(rhi, rt,rp);
+            added = true;
         }
-        for (auto& mesh : meshes_) mesh->create(rhi, rt,rp);
+        if (added)
+            ++revision_;
+    }
+
+    void collectPackets(DrawList &list) const {
+        for (auto& mesh : meshes_)
+            if (mesh->isCreated()) mesh->collectPackets(list, &transform.position);
+    }
+
+    quint64 revision() const { return revision_; }
+
+    // Streamed textures are sized as if their UVs spanned the model once.
+    void requestTextureDetail(TextureStreamer *streamer, const QVector3D& eye, float focalPixels) const {
+        if (!hasBounds_)
+            return;
+        const float scale = qMax(transform.scale.x(), qMax(transform.scale.y(), transform.scale.z()));
+        const float radius = qMax(0.001f, 0.5f * (boundsMax_ - boundsMin_).length() * scale);
+        const QVector3D center = transform.getModelMatrix().map(0.5f * (boundsMin_ + boundsMax_));
+        const float distance = qMax(0.1f, (eye - center).length() - radius);
+        for (const auto& [path, tex] : textures_)
+            if (tex)
+                streamer->request(tex.get(), 1.0f / (2.0f * radius), focalPixels / distance);
     }
 
     void updateUbo(QRhiResourceUpdateBatch *rub, const QMatrix4x4& mvp) {
-        if (!uploaded_) {
-            for (auto& [path, tex] : textures_) {
-                QImage img;
-                if (img.load(QString::fromStdString(path))) rub->uploadTexture(tex.get(), img);
-            }
-            uploaded_ = true;
+        for (auto it = pendingImages_.begin(); it != pendingImages_.end();) {
+            const auto& tex = textures_[it->first];
+            if (!tex) { ++it; continue; }
+            it->second.upload(rub, tex.get());
+            it = pendingImages_.erase(it);
         }
-        for (auto& mesh : meshes_) mesh->updateUbo(rub, mvp);
+        for (auto& mesh : meshes_)
+            if (mesh->isCreated()) mesh->updateUbo(rub, mvp);
     }
 
-    void draw(QRhiCommandBuffer *cb, const QRhiViewport& vp) {
-        for (auto& mesh : meshes_) mesh->draw(cb, vp);
+    void draw(CommandRecorder &cb, const QRhiViewport& vp) {
+        for (auto& mesh : meshes_)
+            if (mesh->isCreated()) mesh->draw(cb, vp);
     }
 
      //=============================================================================================================================
@@ -260,8 +472,8 @@ public:
         int meshIndex = 0;
         for (const auto& mesh : meshes_) {
             qDebug() << "Mesh" << meshIndex++;
-            qDebug() << "  Vertices:" << mesh->vertices.size();
-            qDebug() << "  Indices:" << mesh->indices.size();
+            qDebug() << "  Vertices:" << mesh->vertexCount();
+            qDebug() << "  Indices:" << mesh->indexCount();
             qDebug() << "  Materials:" << mesh->materials.size();
             for (const auto& mat : mesh->materials) {
                 QString typeName;
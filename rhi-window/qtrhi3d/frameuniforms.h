@@ -0,0 +1,136 @@
+#ifndef FRAMEUNIFORMS_H
+#define FRAMEUNIFORMS_H
+
+#include "shirradiance.h"
+#include "brdflut.h"
+#include "cascadedshadows.h"
+#include "shadowatlas.h"
+
+#include <rhi/qrhi.h>
+#include <QHash>
+#include <memory>
+
+// Data shared by every object of a frame: the uniform block at binding 8 (the
+// Frame block of the pbr*.frag shaders), the BRDF table at 9, the specular
+// IBL cube at 10 and the local light shadow atlas at 11, appended to the
+// model SRBs by bindings(). Setters only mark the block dirty; update()
+// uploads it into the next batch.
+struct alignas(16) GpuFrameUbo {
+    float irradiance[9][4]; // sh::Irradiance
+    float ibl[4];           // x specular IBL strength, y last specular mip
+    float shadowMatrix[CascadedShadows::MAX_CASCADES][16];
+    float shadowSplits[CascadedShadows::MAX_CASCADES]; // view distance where each cascade ends
+    float shadowTiles[CascadedShadows::MAX_CASCADES][4]; // atlas uv offset xy, scale zw
+    float shadow[4];        // x cascade count, 0 without shadows
+    ShadowAtlas::GpuLight lights[ShadowAtlas::MAX_LIGHTS];
+    float lightCount[4];    // x
+    ShadowAtlas::GpuTile lightTiles[ShadowAtlas::MAX_TILES];
+};
+
+class FrameUniforms {
+public:
+    static constexpr int BINDING = 8;
+    static constexpr int SPECULAR_BINDING = 10;
+
+    static FrameUniforms *instance(QRhi *rhi) {
+        static QHash<QRhi *, FrameUniforms *> frames;
+        if (FrameUniforms *f = frames.value(rhi))
+            return f;
+        auto *f = new FrameUniforms(rhi);
+        frames.insert(rhi, f);
+        rhi->addCleanupCallback([](QRhi *r) { delete frames.take(r); });
+        return f;
+    }
+
+    QRhiBuffer *buffer() const { return buf_.get(); }
+
+    // Must be set before the SRBs are made; models created earlier keep the black fallback cube.
+    void setSpecular(QRhiTexture *cube, int levels) {
+        specular_ = cube;
+        data_.ibl[0] = cube ? 1.0f : 0.0f;
+        data_.ibl[1] = float(qMax(levels - 1, 0));
+        dirty_ = true;
+    }
+
+    void setIrradiance(const sh::Irradiance &irr) {
+        memcpy(data_.irradiance, irr.c, sizeof(data_.irradiance));
+        dirty_ = true;
+    }
+
+    QVector<QRhiShaderResourceBinding> bindings() {
+        const auto stage = QRhiShaderResourceBinding::FragmentStage;
+        SamplerKey specularKey;
+        specularKey.addressU = specularKey.addressV = specularKey.addressW = QRhiSampler::ClampToEdge;
+        return { QRhiShaderResourceBinding::uniformBuffer(BINDING, stage, buf_.get()),
+                 BrdfLut::instance(rhi_)->binding(),
+                 QRhiShaderResourceBinding::sampledTexture(SPECULAR_BINDING, stage, specular_ ? specular_ : blackCube(),
+                                                           RhiResourceCache::instance(rhi_)->sampler(specularKey)),
+                 ShadowAtlas::instance(rhi_)->binding() };
+    }
+
+    void setShadowCascades(const CascadedShadows &shadows) {
+        const int count = shadows.cascadeCount();
+        for (int i = 0; i < count; ++i) {
+            const CascadedShadows::Cascade &c = shadows.cascade(i);
+            memcpy(data_.shadowMatrix[i], c.lightSpace.constData(), 64);
+            data_.shadowSplits[i] = c.splitFar;
+            data_.shadowTiles[i][0] = c.tile.x();
+            data_.shadowTiles[i][1] = c.tile.y();
+            data_.shadowTiles[i][2] = c.tile.z();
+            data_.shadowTiles[i][3] = c.tile.w();
+        }
+        data_.shadow[0] = float(count);
+        dirty_ = true;
+    }
+
+    void setLocalLights(const ShadowAtlas &atlas) {
+        atlas.fill(data_.lights, data_.lightCount, data_.lightTiles);
+        dirty_ = true;
+    }
+
+    void update(QRhiResourceUpdateBatch *u) {
+        if (!u)
+            return;
+        if (blackCube_ && !blackUploaded_) {
+            const QByteArray zero(8, 0);
+            QList<QRhiTextureUploadEntry> entries;
+            for (int face = 0; face < 6; ++face)
+                entries.append(QRhiTextureUploadEntry(face, 0, QRhiTextureSubresourceUploadDescription(zero)));
+            QRhiTextureUploadDescription desc;
+            desc.setEntries(entries.cbegin(), entries.cend());
+            u->uploadTexture(blackCube_.get(), desc);
+            blackUploaded_ = true;
+        }
+        if (!dirty_)
+            return;
+        u->updateDynamicBuffer(buf_.get(), 0, sizeof(GpuFrameUbo), &data_);
+        dirty_ = false;
+    }
+
+private:
+    explicit FrameUniforms(QRhi *rhi) : rhi_(rhi) {
+        buf_.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, sizeof(GpuFrameUbo)));
+        buf_->create();
+        // until a sky is loaded: the constant ambient the shaders used before
+        memset(&data_, 0, sizeof(data_));
+        data_.irradiance[0][0] = data_.irradiance[0][1] = data_.irradiance[0][2] = 0.1f;
+    }
+
+    QRhiTexture *blackCube() {
+        if (!blackCube_) {
+            blackCube_.reset(rhi_->newTexture(QRhiTexture::RGBA16F, QSize(1, 1), 1, QRhiTexture::CubeMap));
+            blackCube_->create();
+        }
+        return blackCube_.get();
+    }
+
+    QRhi *rhi_;
+    std::unique_ptr<QRhiBuffer> buf_;
+    std::unique_ptr<QRhiTexture> blackCube_;
+    bool blackUploaded_ = false;
+    QRhiTexture *specular_ = nullptr;
+    GpuFrameUbo data_;
+    bool dirty_ = true;
+};
+
+#endif // FRAMEUNIFORMS_H
@@ -0,0 +1,81 @@
+#ifndef HDRIMAGE_H
+#define HDRIMAGE_H
+
+#include "assetpack.h"
+#include "rgbe.h"
+#include "parallel.h"
+
+#include <QByteArray>
+#include <QFile>
+#include <QSize>
+#include <QDebug>
+#include <atomic>
+
+// Radiance .hdr files as RGBA16F (8 bytes per pixel, alpha 1), decoded in
+// row chunks on a thread pool. load() maps the file and returns a QByteArray
+// that goes to QRhiTextureSubresourceUploadDescription as is; decode() writes
+// into memory the caller owns, e.g. a preallocated staging buffer.
+
+namespace hdr {
+
+struct Image {
+    QSize size;
+    QByteArray pixels;
+
+    bool isNull() const { return pixels.isEmpty(); }
+};
+
+// Decodes file (the whole .hdr) into dst with rows of stride bytes, bottom row first when bottomUp.
+inline bool decode(const uchar *file, qsizetype fileSize, const rgbe::Info &info, uchar *dst, qsizetype stride,
+                   bool bottomUp, QThreadPool *pool = QThreadPool::globalInstance())
+{
+    std::vector<size_t> offsets;
+    if (!rgbe::scanOffsets(file, size_t(fileSize), info, offsets))
+        return false;
+    std::atomic<bool> ok{ true };
+    parallelForChunked(pool, int(info.height), 16, [&](int begin, int end) {
+        if (!rgbe::decodeRows(file, info, offsets, quint32(begin), quint32(end), dst, size_t(stride), bottomUp))
+            ok = false;
+    });
+    return ok;
+}
+
+// bottomUp matches stbi_set_flip_vertically_on_load(true), the orientation
+// equirectangular lookups in this repo expect.
+inline Image load(const QString &path, bool bottomUp = true, QThreadPool *pool = QThreadPool::globalInstance())
+{
+    // a pack entry is a view of the mapped pack unless it was deflated
+    QByteArray contents = qpak::packed(path);
+    QFile f(path);
+    if (contents.isNull() && !f.open(QIODevice::ReadOnly)) {
+        qWarning() << "hdr: cannot open" << path;
+        return {};
+    }
+    // resources and some file systems cannot be mapped
+    const uchar *data = contents.isNull() ? f.map(0, f.size()) : nullptr;
+    if (!data) {
+        if (contents.isNull())
+            contents = f.readAll();
+        data = reinterpret_cast<const uchar *>(contents.constData());
+    }
+    const qsizetype size = contents.isNull() ? f.size() : contents.size();
+
+    rgbe::Info info;
+    if (!rgbe::parseHeader(data, size_t(size), info)) {
+        qWarning() << "hdr: not a 32-bit_rle_rgbe file with a -Y/+Y +X layout:" << path;
+        return {};
+    }
+    Image image;
+    image.size = QSize(int(info.width), int(info.height));
+    image.pixels.resize(qsizetype(info.width) * info.height * 8);
+    if (!decode(data, size, info, reinterpret_cast<uchar *>(image.pixels.data()), qsizetype(info.width) * 8, bottomUp,
+                pool)) {
+        qWarning() << "hdr: corrupt scanline data in" << path;
+        return {};
+    }
+    return image;
+}
+
+} // namespace hdr
+
+#endif // HDRIMAGE_H
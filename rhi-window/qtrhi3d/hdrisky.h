@@ -11,10 +11,17 @@
 #include <vector>
 #include <array>
 #include <QFile>
+#include <QElapsedTimer>
 
 #include <rhi/qrhi.h>
-
-#include "stb/stb_image.h"
+#include "rhicache.h"
+#include "drawlist.h"
+#include "commandrecorder.h"
+#include "hdrimage.h"
+#include "envmap.h"
+#include "shirradiance.h"
+#include "iblcache.h"
+#include "startupprofiler.h"
 
 struct HdriVertex {
     QVector3D pos;
@@ -27,9 +34,14 @@ struct alignas(16) SkyUbo {
 
 class HdriSky {
 public:
-    explicit HdriSky(const QString &equirectPath = {}) : eqPath_(equirectPath) {}
+    explicit HdriSky(const QString &equirectPath = {}, int faceSize = CUBEMAP_RESOLUTION)
+        : eqPath_(equirectPath), faceSize_(faceSize) {}
+
+    void setEquirectangular(const QString &path) { eqPath_ = path; uploaded_ = false; hasIrradiance_ = false; prepared_.reset(); }
 
-    void setEquirectangular(const QString &path) { eqPath_ = path; uploaded_ = false; }
+    // Cube face edge in pixels; takes effect on the next create().
+    void setFaceSize(int size) { if (size != faceSize_) { faceSize_ = size; created_ = false; uploaded_ = false; prepared_.reset(); } }
+    int faceSize() const { return faceSize_; }
 
     void create(QRhi *rhi, QRhiRenderPassDescriptor *rp, QRhiResourceUpdateBatch *rub) {
         if (!rhi || !rub) return;
@@ -38,14 +50,18 @@ public:
             vbuf_.reset();
             ubuf_.reset();
             srbSky_.reset();
-            sampler_.reset();
+            sampler_ = nullptr;
             envCubemap_.reset();
-            equirectTex_.reset();
+            specularCubemap_.reset();
+            gpuInit_.reset();
+            prepared_.reset();
             rhi_ = rhi;
             created_ = false;
             uploaded_ = false;
         }
         if (created_) return;
+        gpuInitSupported_ = rhi->backend() != QRhi::Null && rhi->isTextureFormatSupported(QRhiTexture::RGBA16F)
+                            && rhi->isFeatureSupported(QRhi::RenderToNonBaseMipLevel);
 
         // vertex data (unit cube)
         std::vector<HdriVertex> vertices = cubeVertices();
@@ -59,18 +75,19 @@ public:
         ubuf_.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, sizeof(SkyUbo)));
         ubuf_->create();
 
-        sampler_.reset(rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::Linear,
-                                       QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge));
-        sampler_->create();
+        sampler_ = RhiResourceCache::instance(rhi)->sampler(clampSamplerKey());
 
-        // empty cubemap texture (RGBA8 used for simplicity; change to RGBA16F if you want FP)
-        envCubemap_.reset(rhi->newTexture(QRhiTexture::RGBA8, QSize(CUBEMAP_RESOLUTION, CUBEMAP_RESOLUTION),
-                                          1, QRhiTexture::CubeMap | QRhiTexture::RenderTarget));
+        // HDR cubemap, the skybox shader tonemaps; its mips feed the prefilter
+        envCubemap_.reset(rhi->newTexture(QRhiTexture::RGBA16F, QSize(faceSize_, faceSize_), 1,
+                                          QRhiTexture::CubeMap | QRhiTexture::RenderTarget | QRhiTexture::MipMapped
+                                              | QRhiTexture::UsedWithGenerateMips | QRhiTexture::UsedAsTransferSource));
         envCubemap_->create();
 
-        // placeholder equirect texture (we upload actual pixels later)
-        equirectTex_.reset(rhi->newTexture(QRhiTexture::RGBA8, QSize(1,1), 1, QRhiTexture::Flag()));
-        equirectTex_->create();
+        // specular IBL: mip i prefiltered for roughness i / (SPECULAR_LEVELS - 1)
+        specularCubemap_.reset(rhi->newTexture(QRhiTexture::RGBA16F, QSize(SPECULAR_SIZE, SPECULAR_SIZE), 1,
+                                               QRhiTexture::CubeMap | QRhiTexture::RenderTarget | QRhiTexture::MipMapped
+                                                   | QRhiTexture::UsedAsTransferSource));
+        specularCubemap_->create();
 
         // pipeline (skybox). Requires prebuilt QSB shaders in resources or adapt to create from source.
         pipelineSky_.reset(rhi->newGraphicsPipeline());
@@ -89,7 +106,7 @@ public:
         bindingsSky.emplace_back(QRhiShaderResourceBinding::uniformBuffer(
             0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage, ubuf_.get()));
         bindingsSky.emplace_back(QRhiShaderResourceBinding::sampledTexture(
-            1, QRhiShaderResourceBinding::FragmentStage, envCubemap_.get(), sampler_.get()));
+            1, QRhiShaderResourceBinding::FragmentStage, envCubemap_.get(), sampler_));
         srbSky_.reset(rhi->newShaderResourceBindings());
         srbSky_->setBindings(bindingsSky.begin(), bindingsSky.end());
         srbSky_->create();
@@ -98,346 +115,217 @@ public:
         pipelineSky_->setRenderPassDescriptor(rp);
         pipelineSky_->setDepthTest(true);
         pipelineSky_->setDepthWrite(false);
+        pipelineSky_->setDepthOp(QRhiGraphicsPipeline::LessOrEqual);
         pipelineSky_->setCullMode(QRhiGraphicsPipeline::None);
         pipelineSky_->create();
 
         created_ = true;
     }
 
-    // initCubemap: jednorázové načtení HDR (stb), CPU-konverze -> 6 QImage + upload do cubemap pomocí rub.
-    void initCubemap(QRhiResourceUpdateBatch *rub) {
+    // Worker side of both init paths, callable any time after create(): looks
+    // the IBL up in the cache, or decodes the HDR and projects its irradiance
+    // and, when the RHI takes the CPU path, converts and prefilters the cubes
+    // as well. The init call that follows then only uploads.
+    void prepare(QThreadPool *pool = QThreadPool::globalInstance()) {
+        if (!created_ || uploaded_ || prepared_ || eqPath_.isEmpty()) return;
+        prepared_ = bake(!gpuInitSupported(), pool);
+    }
+
+    // initCubemap: HDR load, equirect -> cube conversion and the specular
+    // prefilter on the CPU (the reference for the GPU path), faces and rows
+    // split over the pool, uploaded as RGBA16F so IBL keeps the range.
+    // Both paths start from the IblCache file of the HDR when there is one
+    // and write it when there is not.
+    void initCubemap(QRhiResourceUpdateBatch *rub, QThreadPool *pool = QThreadPool::globalInstance()) {
         if (!rhi_ || !rub || !created_) return;
         if (uploaded_) return;
         if (eqPath_.isEmpty()) { qWarning() << "HdriSky: no eq path"; return; }
+        startup::Scope scope("HdriSky::initCubemap");
+        std::unique_ptr<Prepared> p = takePrepared(true, pool);
+        if (useCache(rub, *p)) return;
+        if (p->image.isNull()) { qWarning() << "HdriSky: failed to load HDR:" << eqPath_; return; }
+
+        irradiance_ = p->irradiance;
+        hasIrradiance_ = true;
+        upload(rub, envCubemap_.get(), p->env);
+        upload(rub, specularCubemap_.get(), p->specular);
+        if (!IblCache::save(cacheKey_, iblParams(), irradiance_, p->env, p->specular))
+            qWarning() << "HdriSky: IBL cache not written";
 
-        int width=0, height=0, comps=0;
-        stbi_set_flip_vertically_on_load(true);
-        float *data = stbi_loadf(eqPath_.toUtf8().constData(), &width, &height, &comps, 0);
-        if (!data) { qWarning() << "HdriSky: failed to load HDR:" << eqPath_; return; }
-        if (comps < 3) { stbi_image_free(data); qWarning() << "HdriSky: unexpected components"; return; }
-
-        std::array<QImage,6> faces;
-        for (int f=0; f<6; ++f){
-            faces[f] = QImage(CUBEMAP_RESOLUTION, CUBEMAP_RESOLUTION, QImage::Format_ARGB32);
-            //faces[f].fill(Qt::transparent );
-        }
-        auto sample = [&](const QVector3D &dir)->QVector3D {
-            const float invAtanX = 0.1591f, invAtanY = 0.3183f;
-            float u = atan2f(dir.z(), dir.x()) * invAtanX + 0.5f;
-            float v = asinf(qBound(-1.0f, dir.y(), 1.0f)) * invAtanY + 0.5f;
-            int sx = qBound(0, int(u * width), width-1);
-            int sy = qBound(0, int(v * height), height-1);
-            int idx = (sy * width + sx) * comps;
-            return QVector3D(data[idx+0], data[idx+1], data[idx+2]);
-        };
-
-        for (int face=0; face<6; ++face) {
-            for (int y=0; y<CUBEMAP_RESOLUTION; ++y) {
-                QRgb *scanline = reinterpret_cast<QRgb*>(faces[face].scanLine(y));
-                for (int x=0; x<CUBEMAP_RESOLUTION; ++x) {
-                    float nx = (2.0f * (x + 0.5f) / float(CUBEMAP_RESOLUTION)) - 1.0f;
-                    float ny = (2.0f * (y + 0.5f) / float(CUBEMAP_RESOLUTION)) - 1.0f;
-                    QVector3D dir;
-                    switch(face) {
-                    case 0: dir = QVector3D( 1.0f,    -ny,   -nx); break; // +X
-                    case 1: dir = QVector3D(-1.0f,    -ny,    nx); break; // -X
-                    case 2: dir = QVector3D( nx,      1.0f,   ny); break; // +Y
-                    case 3: dir = QVector3D( nx,     -1.0f,  -ny); break; // -Y
-                    case 4: dir = QVector3D( nx,     -ny,    1.0f); break; // +Z
-                    default:dir = QVector3D(-nx,    -ny,   -1.0f); break; // -Z
-                    }
-                    dir.normalize();
-                    QVector3D col = sample(dir);
-                    // tonemap + gamma to fit into RGBA8 (simple solution)
-                    QVector3D mapped = col / (col + QVector3D(1.0f,1.0f,1.0f));
-                    mapped.setX(powf(mapped.x(), 1.0f/2.2f));
-                    mapped.setY(powf(mapped.y(), 1.0f/2.2f));
-                    mapped.setZ(powf(mapped.z(), 1.0f/2.2f));
-                    int ir = qBound(0, int(mapped.x()*255.0f), 255);
-                    int ig = qBound(0, int(mapped.y()*255.0f), 255);
-                    int ib = qBound(0, int(mapped.z()*255.0f), 255);
-                   // scanline[x] = qRgba(ir, ig, ib, 255);
-                    scanline[x] = qRgba(ib, ig, ir, 255);
-                }
-            }
-        }
-
-        stbi_image_free(data);
-
-        // --- SPRÁVNÉ VOLÁNÍ: uploadTexture(texture, image, arrayLayer, level) ---
-        for (int face = 0; face < 6; ++face) {
-            // Připravíme popis subresource uploadu
-            QRhiTextureSubresourceUploadDescription subresDesc(faces[face]);
-            // Face index se určuje přes sliceDesc (arrayLayer = face)
-            QRhiTextureUploadDescription uploadDesc({ { face, 0, subresDesc } });
-            rub->uploadTexture(envCubemap_.get(), uploadDesc);
-        }
         uploaded_ = true;
+        qDebug() << "HdriSky:" << p->image.size << "HDR loaded in" << p->loadUs << "us, 6 x" << faceSize_
+                 << "faces in" << p->facesUs << "us, specular prefiltered on the CPU in" << p->prefilterUs << "us";
     }
 
-    void initCubemapOnGPU(QRhiResourceUpdateBatch *rub, QRhiCommandBuffer *cb) {
-        if (!rhi_ || !created_ || uploaded_) return;
+    // GPU path: the equirect image goes up as RGBA16F, six passes render it
+    // into the environment cube, its mips are generated and SPECULAR_LEVELS x 6
+    // passes GGX-prefilter them into the specular cube. Resources are made and
+    // uploads queued here; recordInitPasses() records every pass into the first
+    // frame's command buffer. The Null backend and RHIs without RGBA16F render
+    // targets take the CPU path (initCubemap) into rub instead.
+    void initCubemapOnGPU(QRhiResourceUpdateBatch *rub) {
+        if (!rhi_ || !rub || !created_ || uploaded_ || gpuInit_) return;
         if (eqPath_.isEmpty()) { qWarning() << "HdriSky: no eq path"; return; }
-
-        int width = 0, height = 0, comps = 0;
-        stbi_set_flip_vertically_on_load(true);
-        float *data = stbi_loadf(eqPath_.toUtf8().constData(), &width, &height, &comps, 0);
-        if (!data) { qWarning() << "HdriSky: failed to load HDR:" << eqPath_; return; }
-
-        hdrTex_ = std::unique_ptr<QRhiTexture>(rhi_->newTexture(QRhiTexture::RGBA32F, QSize(width,height), 1));
-        hdrTex_->create();
-
-        QByteArray byteData(reinterpret_cast<const char*>(data), width * height * comps * sizeof(float));
-        stbi_image_free(data);
-
-        QRhiTextureSubresourceUploadDescription subresDesc(byteData);
-        subresDesc.setSourceSize(QSize(width, height));
-        QRhiTextureUploadDescription uploadDesc({ { 0, 0, subresDesc } });
-        rub->uploadTexture(hdrTex_.get(), uploadDesc);
-
-        envCubemap_ = std::unique_ptr<QRhiTexture>(
-            rhi_->newTexture(QRhiTexture::RGBA16F, QSize(CUBEMAP_RESOLUTION, CUBEMAP_RESOLUTION), 1,
-                             QRhiTexture::CubeMap | QRhiTexture::RenderTarget)
-            );
-        envCubemap_->create();
-
-        initSampler_ = std::unique_ptr<QRhiSampler>(
-            rhi_->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::Linear,
-                             QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge)
-            );
-        initSampler_->create();
-
-        // shader bindings
-        QRhiTextureRenderTargetDescription rtDesc;
-        QList<QRhiColorAttachment> colorAttachments;
-        for (int face = 0; face < 6; ++face) {
-            QRhiColorAttachment ca(envCubemap_.get());
-            ca.setLayer(face);
-            ca.setLevel(0);
-            colorAttachments.append(ca);
+        if (!gpuInitSupported()) {
+            initCubemap(rub);
+            return;
         }
-        // správně: nastavení přes metodu
-        rtDesc.setColorAttachments(colorAttachments.begin(), colorAttachments.end());
-
-        initRt_.reset(rhi_->newTextureRenderTarget(rtDesc));
-        initSrb_->create();
-
-        // pipeline
-        initPipeline_ = std::unique_ptr<QRhiGraphicsPipeline>(rhi_->newGraphicsPipeline());
-        QRhiVertexInputLayout layout;
-        layout.setBindings({ sizeof(HdriVertex) });
-        layout.setAttributes({ {0, 0, QRhiVertexInputAttribute::Float3, 0} });
-        initPipeline_->setVertexInputLayout(layout);
-        initPipeline_->setShaderStages({
-            {QRhiShaderStage::Vertex, LoadShader(":/shaders/prebuild/equirect2cube.vert.qsb")},
-            {QRhiShaderStage::Fragment, LoadShader(":/shaders/prebuild/equirect2cube.frag.qsb")}
-        });
-        initPipeline_->setShaderResourceBindings(initSrb_.get());
-        initPipeline_->setTopology(QRhiGraphicsPipeline::Triangles);
-        initPipeline_->setCullMode(QRhiGraphicsPipeline::None);
-        initPipeline_->setDepthTest(false);
-        initPipeline_->setDepthWrite(false);
-        initPipeline_->create();
-
-        // draw faces
-        for (int face = 0; face < 6; ++face) {
-            QRhiColorAttachment ca(envCubemap_.get());
+        startup::Scope scope("HdriSky::initCubemapOnGPU");
+        std::unique_ptr<Prepared> p = takePrepared(false, QThreadPool::globalInstance());
+        if (useCache(rub, *p)) return;
+
+        const hdr::Image &hdrImage = p->image;
+        if (hdrImage.isNull()) { qWarning() << "HdriSky: failed to load HDR:" << eqPath_; return; }
+        irradiance_ = p->irradiance;
+        hasIrradiance_ = true;
+
+        auto init = std::make_unique<GpuInit>();
+        init->updates = rhi_->nextResourceUpdateBatch();
+
+        init->equirect.reset(rhi_->newTexture(QRhiTexture::RGBA16F, hdrImage.size, 1));
+        init->equirect->create();
+        init->updates->uploadTexture(init->equirect.get(), QRhiTextureUploadDescription(QRhiTextureUploadEntry(
+                                                               0, 0, QRhiTextureSubresourceUploadDescription(hdrImage.pixels))));
+
+        // one vec4 per pass: face, target size, roughness, environment size
+        const int passes = 6 + 6 * SPECULAR_LEVELS;
+        init->stride = rhi_->ubufAligned(sizeof(float) * 4);
+        init->ubuf.reset(rhi_->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, init->stride * passes));
+        init->ubuf->create();
+        QByteArray params(init->stride * passes, 0);
+        for (int pass = 0; pass < passes; ++pass) {
+            const int face = pass % 6, level = pass / 6 - 1;
+            const float p[4] = { float(face), float(level < 0 ? faceSize_ : SPECULAR_SIZE >> level),
+                                 level < 0 ? 0.0f : specularRoughness(level), float(faceSize_) };
+            memcpy(params.data() + pass * init->stride, p, sizeof(p));
+        }
+        init->updates->updateDynamicBuffer(init->ubuf.get(), 0, quint32(params.size()), params.constData());
+
+        SamplerKey equirectKey;
+        equirectKey.mipmapMode = QRhiSampler::None;
+        equirectKey.addressV = QRhiSampler::ClampToEdge; // u wraps around the seam
+        SamplerKey envKey = clampSamplerKey();
+        envKey.addressW = QRhiSampler::ClampToEdge;
+        RhiResourceCache *cache = RhiResourceCache::instance(rhi_);
+        const auto params0 = QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(
+            0, QRhiShaderResourceBinding::FragmentStage, init->ubuf.get(), sizeof(float) * 4);
+        init->equirectSrb.reset(rhi_->newShaderResourceBindings());
+        init->equirectSrb->setBindings({ params0, QRhiShaderResourceBinding::sampledTexture(
+                                                      1, QRhiShaderResourceBinding::FragmentStage, init->equirect.get(),
+                                                      cache->sampler(equirectKey)) });
+        init->equirectSrb->create();
+        init->prefilterSrb.reset(rhi_->newShaderResourceBindings());
+        init->prefilterSrb->setBindings({ params0, QRhiShaderResourceBinding::sampledTexture(
+                                                       1, QRhiShaderResourceBinding::FragmentStage, envCubemap_.get(),
+                                                       cache->sampler(envKey)) });
+        init->prefilterSrb->create();
+
+        // one target per (level, face); all share a compatible render pass
+        for (int pass = 0; pass < passes; ++pass) {
+            const int face = pass % 6, level = pass / 6 - 1;
+            QRhiColorAttachment ca(level < 0 ? envCubemap_.get() : specularCubemap_.get());
             ca.setLayer(face);
-            ca.setLevel(0);
-            QRhiTextureRenderTargetDescription rtDesc(ca);
-            auto rt = std::unique_ptr<QRhiTextureRenderTarget>(rhi_->newTextureRenderTarget(rtDesc));
-            auto rp = std::unique_ptr<QRhiRenderPassDescriptor>(rt->newCompatibleRenderPassDescriptor());
+            ca.setLevel(qMax(level, 0));
+            std::unique_ptr<QRhiTextureRenderTarget> rt(rhi_->newTextureRenderTarget(QRhiTextureRenderTargetDescription(ca)));
+            std::unique_ptr<QRhiRenderPassDescriptor> rp(rt->newCompatibleRenderPassDescriptor());
             rt->setRenderPassDescriptor(rp.get());
-            rt->create();
-
-            cb->beginPass(rt.get(), QColor(0,0,0,255), {1.0f, 0});
-            cb->setGraphicsPipeline(initPipeline_.get());
-            cb->setShaderResources(initSrb_.get());
-            const QRhiCommandBuffer::VertexInput in{vbuf_.get(), 0};
-            cb->setVertexInput(0, 1, &in);
-            cb->draw(36);
-            cb->endPass();
+            if (!rt->create()) {
+                qWarning() << "HdriSky: cannot render into cube level" << qMax(level, 0) << "- using the CPU path";
+                initCubemap(rub);
+                return;
+            }
+            init->targets.push_back(std::move(rt));
+            init->passes.push_back(std::move(rp));
         }
 
-        uploaded_ = true;
-    }
-
-    void initCubemapOnGPU2(QRhiResourceUpdateBatch *rub, QRhiCommandBuffer *cb) {
-        if (!rhi_ || !created_ || uploaded_ || !rub || !cb) return; // Kontrola cb
-        if (eqPath_.isEmpty()) { qWarning() << "HdriSky: no eq path"; return; }
-
-        // --- 1. Načtení HDR textury ---
-        int width=0, height=0, comps=0;
-        stbi_set_flip_vertically_on_load(true);
-        float *data = stbi_loadf(eqPath_.toUtf8().constData(), &width, &height, &comps, 0);
-        if (!data) { qWarning() << "HdriSky: failed to load HDR:" << eqPath_; return; }
-        if (comps < 3) { stbi_image_free(data); qWarning() << "HdriSky: HDR needs 3+ components"; return; }
-
-        // Zvolíme správný formát podle počtu komponent
-        QRhiTexture::Format hdrFormat = QRhiTexture::RGBA32F;
-        int bytesPerPixel = 4 * sizeof(float);
-        if (comps == 3) {
-            hdrFormat = QRhiTexture::RGBA32F;
-            bytesPerPixel = 3 * sizeof(float);
-        }
+        auto pipeline = [&](const char *fragment, QRhiShaderResourceBindings *srb) {
+            std::unique_ptr<QRhiGraphicsPipeline> ps(rhi_->newGraphicsPipeline());
+            ps->setShaderStages({ { QRhiShaderStage::Vertex, LoadShader(":/shaders/prebuild/equirect2cube.vert.qsb") },
+                                  { QRhiShaderStage::Fragment, LoadShader(QLatin1String(fragment)) } });
+            ps->setVertexInputLayout({});
+            ps->setShaderResourceBindings(srb);
+            ps->setRenderPassDescriptor(init->passes.front().get());
+            ps->setCullMode(QRhiGraphicsPipeline::None);
+            ps->create();
+            return ps;
+        };
+        init->equirectPipeline = pipeline(":/shaders/prebuild/equirect2cube.frag.qsb", init->equirectSrb.get());
+        init->prefilterPipeline = pipeline(":/shaders/prebuild/prefilter.frag.qsb", init->prefilterSrb.get());
 
-        hdrTex_ = std::unique_ptr<QRhiTexture>(rhi_->newTexture(hdrFormat, QSize(width, height), 1));
-        hdrTex_->create();
-
-        QByteArray byteData(reinterpret_cast<const char*>(data), width * height * bytesPerPixel);
-        QRhiTextureSubresourceUploadDescription subresDesc;
-        subresDesc.setData(byteData);
-        subresDesc.setSourceSize(QSize(width, height));
-        QRhiTextureUploadDescription uploadDesc({ { 0, 0, subresDesc } });
-        rub->uploadTexture(hdrTex_.get(), uploadDesc);
-        stbi_image_free(data);
-
-        // --- 2. Cílová Cubemap textura ---
-        // Vytvoříme novou cubemapu s vyšší přesností (RGBA16F) a jako RenderTarget
-        envCubemap_.reset(rhi_->newTexture(QRhiTexture::RGBA16F, QSize(CUBEMAP_RESOLUTION, CUBEMAP_RESOLUTION), 1,
-                                           QRhiTexture::CubeMap | QRhiTexture::RenderTarget));
-        envCubemap_->create();
+        gpuInit_ = std::move(init);
+    }
 
-        // --- 3. Sampler pro HDR texturu ---
-        initSampler_ = std::unique_ptr<QRhiSampler>(rhi_->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::Linear,
-                                                                         QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge));
-        initSampler_->create();
-
-        // --- 4. Lokální UBO pro matice ---
-        // Vytvoříme UBO pro 6 sad matic (jedna pro každou stranu)
-        // Musíme respektovat zarovnání pro dynamické offsety
-         qint32 uboStride = sizeof(SkyUbo);
-        // const qint32 minAlign = rhi_->ubo;
-        // if (uboStride % minAlign != 0) {
-        //     uboStride = (uboStride + minAlign - 1) / minAlign * minAlign;
-        // }
-        int blockSize = sizeof(SkyUbo);
-        // zarovnaná velikost bloku
-        int alignedBlockSize = rhi_->ubufAligned(blockSize);
-
-        // když vypočítáš offset pro instanci i:
-       // int offset = i * alignedBlockSize;
-        auto initUbuf = std::unique_ptr<QRhiBuffer>(rhi_->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, uboStride * 6));
-        initUbuf->create();
-
-        // Připravíme data matic
-        QMatrix4x4 captureProjection;
-        captureProjection.perspective(90.0f, 1.0f, 0.1f, 10.0f); // 90° FOV, poměr stran 1:1
-        std::array<QMatrix4x4, 6> captureViews;
-        captureViews[0].lookAt(QVector3D(0,0,0), QVector3D( 1, 0, 0), QVector3D(0,-1, 0)); // +X
-        captureViews[1].lookAt(QVector3D(0,0,0), QVector3D(-1, 0, 0), QVector3D(0,-1, 0)); // -X
-        captureViews[2].lookAt(QVector3D(0,0,0), QVector3D( 0, 1, 0), QVector3D(0, 0, 1)); // +Y
-        captureViews[3].lookAt(QVector3D(0,0,0), QVector3D( 0,-1, 0), QVector3D(0, 0,-1)); // -Y
-        captureViews[4].lookAt(QVector3D(0,0,0), QVector3D( 0, 0, 1), QVector3D(0,-1, 0)); // +Z
-        captureViews[5].lookAt(QVector3D(0,0,0), QVector3D( 0, 0,-1), QVector3D(0,-1, 0)); // -Z
-
-        // Nahrajeme všech 6 matic do bufferu najednou
-        QByteArray uboData(uboStride * 6, 0); // Vynulujeme paměť
-        for (int face = 0; face < 6; ++face) {
-            SkyUbo gpuUbo{};
-            memcpy(gpuUbo.projection, captureProjection.constData(), 16*sizeof(float));
-            memcpy(gpuUbo.view, captureViews[face].constData(), 16*sizeof(float));
-            // Zkopírujeme data na správný offset
-            memcpy(uboData.data() + face * uboStride, &gpuUbo, sizeof(SkyUbo));
+    // Records the passes initCubemapOnGPU() prepared; call once per frame
+    // before the first pass. Both cubes are read back for the IBL cache
+    // and the scratch resources go once the readbacks arrived.
+    void recordInitPasses(QRhiCommandBuffer *cb) {
+        // a cache hit's uploads are recorded in the first frame
+        if (cacheMapping_ && ++cacheMappingFrames_ > 1)
+            cacheMapping_.reset();
+        if (!gpuInit_)
+            return;
+        GpuInit &init = *gpuInit_;
+        if (init.recorded) {
+            if (init.pendingReadbacks == 0)
+                gpuInit_.reset();
+            return;
         }
-        rub->updateDynamicBuffer(initUbuf.get(), 0, uboData.size(), uboData.constData());
-
-
-        // --- 5. Lokální SRB pro inicializaci ---
-        std::vector<QRhiShaderResourceBinding> bindings;
-        // Binding 0: Náš nový UBO s dynamickým offsetem
-        bindings.emplace_back(QRhiShaderResourceBinding::uniformBuffer(
-            0, QRhiShaderResourceBinding::VertexStage,
-            initUbuf.get(), 0, uboStride)); // uboStride udává velikost jedné sekce
-        // Binding 1: Vstupní HDR textura
-        bindings.emplace_back(QRhiShaderResourceBinding::sampledTexture(
-            1, QRhiShaderResourceBinding::FragmentStage, hdrTex_.get(), initSampler_.get()));
-
-        auto initSrb = std::unique_ptr<QRhiShaderResourceBindings>(rhi_->newShaderResourceBindings());
-        initSrb->setBindings(bindings.begin(), bindings.end());
-        initSrb->create();
-
-        // --- 6. Pipeline a Render Targety (6x) ---
-        // Potřebujeme 6 render targetů a 6 render passů, jeden pro každou stranu
-        std::array<std::unique_ptr<QRhiTextureRenderTarget>, 6> faceRenderTargets;
-        std::array<std::unique_ptr<QRhiRenderPassDescriptor>, 6> faceRenderPasses;
-        std::unique_ptr<QRhiGraphicsPipeline> initPipeline;
-
-        QRhiViewport viewport(0, 0, CUBEMAP_RESOLUTION, CUBEMAP_RESOLUTION);
-
-        for (int face = 0; face < 6; ++face) {
-            // Nastavíme render target pro danou stranu (layer)
-            QRhiColorAttachment ca;
-            ca.setLayer(face);
-            ca.setTexture(envCubemap_.get());
-           // ca.setLoadOp(QRhiRenderPassDescriptor::DontCare); // Nepotřebujeme čistit, přepisujeme vše
-           // ca.setStoreOp(QRhiRenderPassDescriptor::Store);  // Chceme uložit výsledek
-
-            QRhiTextureRenderTargetDescription rtDesc({ca});
-            faceRenderTargets[face].reset(rhi_->newTextureRenderTarget(rtDesc));
-            faceRenderPasses[face].reset(faceRenderTargets[face]->newCompatibleRenderPassDescriptor());
-            faceRenderTargets[face]->setRenderPassDescriptor(faceRenderPasses[face].get());
-            faceRenderTargets[face]->create();
-
-            // Pipeline vytvoříme jen jednou (všechny passy jsou kompatibilní)
-            if (face == 0) {
-                initPipeline.reset(rhi_->newGraphicsPipeline());
-                QRhiVertexInputLayout layout{};
-                layout.setBindings({ sizeof(HdriVertex) });
-                layout.setAttributes({ {0, 0, QRhiVertexInputAttribute::Float3, 0} });
-                initPipeline->setVertexInputLayout(layout);
-                initPipeline->setShaderStages({
-                    {QRhiShaderStage::Vertex, LoadShader(":/shaders/prebuild/equirect2cube.vert.qsb")},
-                    {QRhiShaderStage::Fragment, LoadShader(":/shaders/prebuild/equirect2cube.frag.qsb")}
-                });
-                initPipeline->setShaderResourceBindings(initSrb.get());
-                initPipeline->setRenderPassDescriptor(faceRenderPasses[0].get()); // Váže se na první RP
-                initPipeline->setTopology(QRhiGraphicsPipeline::Triangles);
-                initPipeline->setCullMode(QRhiGraphicsPipeline::None);
-                initPipeline->setDepthTest(false);
-
-                initPipeline->setDepthWrite(false);
-                initPipeline->create();
+        // every level and face of both cubes, in IblCache order
+        QRhiResourceUpdateBatch *readbacks = nullptr;
+        if (!cacheKey_.isEmpty()) {
+            readbacks = rhi_->nextResourceUpdateBatch();
+            const int envLevels = int(iblParams().envLevels);
+            init.readbacks = std::vector<QRhiReadbackResult>(size_t(6 * (envLevels + SPECULAR_LEVELS)));
+            init.pendingReadbacks = int(init.readbacks.size());
+            for (size_t i = 0; i < init.readbacks.size(); ++i) {
+                const bool env = i < size_t(envLevels) * 6;
+                const int sub = env ? int(i) : int(i) - envLevels * 6;
+                QRhiReadbackDescription rb(env ? envCubemap_.get() : specularCubemap_.get());
+                rb.setLayer(sub % 6);
+                rb.setLevel(sub / 6);
+                init.readbacks[i].completed = [this] {
+                    if (--gpuInit_->pendingReadbacks == 0)
+                        saveReadbacks();
+                };
+                readbacks->readBackTexture(rb, &init.readbacks[i]);
             }
         }
-
-        // --- 7. Vykreslení 6 stran ---
-        // Nyní máme 6 platných render targetů a pipeline
-        for (int face = 0; face < 6; face++) {
-            // Začneme pass pro konkrétní stranu
-            cb->beginPass(faceRenderTargets[face].get(), QColor(), {1.0f, 0});
-            cb->setGraphicsPipeline(initPipeline.get());
-            cb->setViewport(viewport); // Nastavíme viewport
-            quint32 dynamicOffset = face * alignedBlockSize;
-            // Nastavíme správný offset do UBO pro tuto stranu
-            QRhiCommandBuffer::DynamicOffset dyn;
-            dyn.first = face;
-            dyn.second = alignedBlockSize;
-
-            cb->setShaderResources(initSrb.get(), 1, &dyn); // 1 = počet offsetů
-
-            const QRhiCommandBuffer::VertexInput in{vbuf_.get(), 0};
-            cb->setVertexInput(0, 1, &in, nullptr, 0, QRhiCommandBuffer::IndexUInt32);
-            cb->draw(36);
-            cb->endPass();
+        cb->debugMarkBegin(QByteArrayLiteral("HdriSky init"));
+        for (int pass = 0; pass < int(init.targets.size()); ++pass) {
+            QRhiResourceUpdateBatch *updates = nullptr;
+            if (pass == 0) {
+                updates = init.updates;
+                init.updates = nullptr;
+            } else if (pass == 6) {
+                // environment mips, read by the prefilter
+                updates = rhi_->nextResourceUpdateBatch();
+                updates->generateMips(envCubemap_.get());
+            }
+            QRhiTextureRenderTarget *rt = init.targets[size_t(pass)].get();
+            const QSize size = rt->pixelSize();
+            cb->beginPass(rt, Qt::black, { 1.0f, 0 }, updates);
+            cb->setGraphicsPipeline(pass < 6 ? init.equirectPipeline.get() : init.prefilterPipeline.get());
+            cb->setViewport(QRhiViewport(0, 0, size.width(), size.height()));
+            const QRhiCommandBuffer::DynamicOffset offset(0, quint32(pass * init.stride));
+            cb->setShaderResources(pass < 6 ? init.equirectSrb.get() : init.prefilterSrb.get(), 1, &offset);
+            cb->draw(3);
+            cb->endPass(pass + 1 == int(init.targets.size()) ? readbacks : nullptr);
         }
+        cb->debugMarkEnd();
+        init.recorded = true;
+        uploaded_ = true;
+    }
 
-        // --- 8. Oprava hlavního SRB (ŘEŠÍ PÁD PŘI KRESLENÍ) ---
-        // Protože jsme resetovali envCubemap_, musíme aktualizovat srbSky_,
-        // aby ukazoval na novou texturu.
-        std::vector<QRhiShaderResourceBinding> bindingsSky;
-        bindingsSky.emplace_back(QRhiShaderResourceBinding::uniformBuffer(
-            0, QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage, ubuf_.get()));
-        bindingsSky.emplace_back(QRhiShaderResourceBinding::sampledTexture(
-            1, QRhiShaderResourceBinding::FragmentStage, envCubemap_.get(), sampler_.get())); // Zde použijeme novou mapu
+    QRhiTexture *environmentCubemap() const { return envCubemap_.get(); }
+    // mip i holds roughness specularRoughness(i)
+    QRhiTexture *specularCubemap() const { return specularCubemap_.get(); }
+    static float specularRoughness(int level) { return float(level) / float(SPECULAR_LEVELS - 1); }
+    static int specularLevels() { return SPECULAR_LEVELS; }
 
-        srbSky_.reset(rhi_->newShaderResourceBindings());
-        srbSky_->setBindings(bindingsSky.begin(), bindingsSky.end());
-        srbSky_->create();
+    // diffuse IBL, valid once either init path loaded the HDR
+    bool hasIrradiance() const { return hasIrradiance_; }
+    const sh::Irradiance &irradiance() const { return irradiance_; }
 
-        // Všechny lokální unique_ptr (initUbuf, initSrb, hdrTex, atd.) se zde automaticky uvolní
-        uploaded_ = true;
-    }
     void updateResources(QRhiResourceUpdateBatch *rub, const QMatrix4x4 &view, const QMatrix4x4 &proj) {
         if (!created_ || !rub) return;
         QMatrix4x4 viewNoTrans = view;
@@ -448,44 +336,242 @@ public:
         rub->updateDynamicBuffer(ubuf_.get(), 0, sizeof(SkyUbo), &gpuUbo);
     }
 
-    void draw(QRhiCommandBuffer *cb, QRhiViewport viewport = QRhiViewport()) {
+    void draw(CommandRecorder &cb, QRhiViewport viewport = QRhiViewport()) {
         if (!created_ || !uploaded_) return;
-        cb->setGraphicsPipeline(pipelineSky_.get());
-       // cb->setViewport(viewport);
-        cb->setShaderResources(srbSky_.get());
+        cb.setGraphicsPipeline(pipelineSky_.get());
+       // cb.setViewport(viewport);
+        cb.setShaderResources(srbSky_.get());
         const QRhiCommandBuffer::VertexInput in{vbuf_.get(), 0};
-        cb->setVertexInput(0, 1, &in, nullptr, 0, QRhiCommandBuffer::IndexUInt32);
-        cb->draw(36);
+        cb.setVertexInput(0, 1, &in, nullptr, 0, QRhiCommandBuffer::IndexUInt32);
+        cb.draw(36);
+    }
+
+    void collectPackets(DrawList &list) const {
+        if (!created_ || !uploaded_) return;
+        DrawPacket packet;
+        packet.pass = DrawPass::Sky;
+        packet.pipeline = pipelineSky_.get();
+        packet.srb = srbSky_.get();
+        packet.vbuf = vbuf_.get();
+        packet.count = 36;
+        list.add(packet);
     }
 
+    bool isReady() const { return created_ && uploaded_; }
+
     static inline QShader LoadShader(const QString &name) {
-        QFile f(name);
-        return f.open(QIODevice::ReadOnly) ? QShader::fromSerialized(f.readAll()) : QShader();
+        startup::Scope scope("shader load");
+        const QByteArray data = qpak::read(name);
+        return data.isEmpty() ? QShader() : QShader::fromSerialized(data);
     }
 
 private:
     QString eqPath_;
+    int faceSize_;
     QRhi *rhi_{nullptr};
     bool created_{false};
     bool uploaded_{false};
+    bool hasIrradiance_{false};
+    bool gpuInitSupported_{false};
+    sh::Irradiance irradiance_;
 
     std::unique_ptr<QRhiGraphicsPipeline> pipelineSky_;
     std::unique_ptr<QRhiBuffer> vbuf_;
     std::unique_ptr<QRhiBuffer> ubuf_;
-    std::unique_ptr<QRhiTexture> equirectTex_;
     std::unique_ptr<QRhiTexture> envCubemap_;
-    std::unique_ptr<QRhiSampler> sampler_;
+    std::unique_ptr<QRhiTexture> specularCubemap_;
+    QRhiSampler *sampler_ = nullptr;
     std::unique_ptr<QRhiShaderResourceBindings> srbSky_;
 
+    // scratch of the GPU path, alive until the frame that used it is recorded
+    struct GpuInit {
+        QRhiResourceUpdateBatch *updates = nullptr;
+        std::unique_ptr<QRhiTexture> equirect;
+        std::unique_ptr<QRhiBuffer> ubuf;
+        int stride = 0;
+        std::unique_ptr<QRhiShaderResourceBindings> equirectSrb;
+        std::unique_ptr<QRhiShaderResourceBindings> prefilterSrb;
+        std::unique_ptr<QRhiGraphicsPipeline> equirectPipeline;
+        std::unique_ptr<QRhiGraphicsPipeline> prefilterPipeline;
+        std::vector<std::unique_ptr<QRhiTextureRenderTarget>> targets;  // 6 environment faces, then specular levels
+        std::vector<std::unique_ptr<QRhiRenderPassDescriptor>> passes;
+        std::vector<QRhiReadbackResult> readbacks;
+        int pendingReadbacks = 0;
+        bool recorded = false;
+
+        ~GpuInit() { if (updates) updates->release(); }
+    };
+    std::unique_ptr<GpuInit> gpuInit_;
+
+    // what prepare() or an init call read or computed away from the QRhi
+    struct Prepared {
+        QByteArray key;
+        IblCache::Entry cache; // a hit when its file is set
+        hdr::Image image;
+        sh::Irradiance irradiance;
+        std::vector<QByteArray> env;      // CPU path, level * 6 + face
+        std::vector<QByteArray> specular; // CPU path, level * 6 + face
+        qint64 loadUs = 0;
+        qint64 facesUs = 0;
+        qint64 prefilterUs = 0;
+    };
+    std::unique_ptr<Prepared> prepared_;
+
+    QByteArray cacheKey_;
+    std::unique_ptr<QFile> cacheMapping_; // views of it are queued for upload
+    int cacheMappingFrames_ = 0;
+
+    IblParams iblParams() const {
+        IblParams p;
+        p.faceSize = quint32(faceSize_);
+        p.envLevels = quint32(rhi_->mipLevelsForSize(QSize(faceSize_, faceSize_)));
+        p.specularSize = SPECULAR_SIZE;
+        p.specularLevels = SPECULAR_LEVELS;
+        p.prefilterSamples = envmap::PREFILTER_SAMPLES;
+        p.format = QRhiTexture::RGBA16F;
+        p.texelBytes = 8;
+        return p;
+    }
+
+    // decided in create(), so prepare() does not query the QRhi from a worker
+    bool gpuInitSupported() const { return gpuInitSupported_; }
+
+    // The prepare() result, made here when nothing prepared it.
+    std::unique_ptr<Prepared> takePrepared(bool onCpu, QThreadPool *pool) {
+        std::unique_ptr<Prepared> p = std::move(prepared_);
+        if (!p || (onCpu && !p->cache.file && !p->image.isNull() && p->env.empty()))
+            p = bake(onCpu, pool);
+        cacheKey_ = p->key;
+        return p;
+    }
+
+    // Touches no QRhi state, so it can run on any thread.
+    std::unique_ptr<Prepared> bake(bool onCpu, QThreadPool *pool) const {
+        startup::Scope scope("HdriSky::bake (cache or HDR decode, SH, CPU cubes)");
+        auto p = std::make_unique<Prepared>();
+        QElapsedTimer timer;
+        timer.start();
+        p->key = IblCache::key(eqPath_, iblParams());
+        if (IblCache::load(p->key, iblParams(), p->cache)) {
+            p->loadUs = timer.nsecsElapsed() / 1000;
+            return p;
+        }
+        p->image = hdr::load(eqPath_, true, pool);
+        if (p->image.isNull())
+            return p;
+        p->loadUs = timer.nsecsElapsed() / 1000;
+
+        const envmap::Source src{ reinterpret_cast<const quint16 *>(p->image.pixels.constData()),
+                                  p->image.size.width(), p->image.size.height() };
+        p->irradiance = sh::project(src, pool);
+        if (!onCpu)
+            return p;
+
+        const qsizetype faceBytes = qsizetype(faceSize_) * faceSize_ * 8;
+        std::array<QByteArray, 6> faces;
+        std::array<quint16 *, 6> dst;
+        for (int face = 0; face < 6; ++face) {
+            faces[face].resize(faceBytes);
+            dst[face] = reinterpret_cast<quint16 *>(faces[face].data());
+        }
+        parallelForChunked(pool, 6 * faceSize_, 16, [&](int begin, int end) {
+            while (begin < end) {
+                const int face = begin / faceSize_, y = begin % faceSize_;
+                const int rows = qMin(end - begin, faceSize_ - y);
+                envmap::equirectToFaceRows(src, face, faceSize_, y, y + rows, dst[face] + qsizetype(y) * faceSize_ * 4);
+                begin += rows;
+            }
+        });
+        p->facesUs = timer.nsecsElapsed() / 1000 - p->loadUs;
+
+        // the mips the GPU would generate, kept as RGBA16F for the cache
+        std::vector<envmap::CubeLevel> env = envmap::allocateCube(faceSize_);
+        p->env.resize(env.size() * 6);
+        parallelFor(pool, 6, [&](int face) {
+            envmap::fillFaceChain(env, face, dst[face]);
+            p->env[size_t(face)] = faces[face];
+            for (size_t level = 1; level < env.size(); ++level)
+                p->env[level * 6 + size_t(face)] = toHalf(env[level].faces[face]);
+        });
+        for (int level = 0; level < SPECULAR_LEVELS; ++level) {
+            const int size = SPECULAR_SIZE >> level;
+            for (int face = 0; face < 6; ++face)
+                p->specular.emplace_back(qsizetype(size) * size * 8, Qt::Uninitialized);
+        }
+        parallelForChunked(pool, 6 * SPECULAR_SIZE, 4, [&](int begin, int end) {
+            for (int row = begin; row < end; ++row) {
+                const int face = row / SPECULAR_SIZE, y = row % SPECULAR_SIZE;
+                for (int level = 0; level < SPECULAR_LEVELS; ++level) {
+                    const int size = SPECULAR_SIZE >> level;
+                    if (y >= size)
+                        break;
+                    quint16 *out = reinterpret_cast<quint16 *>(p->specular[size_t(level * 6 + face)].data());
+                    envmap::prefilterFaceRows(env, specularRoughness(level), envmap::PREFILTER_SAMPLES, face, size, y,
+                                              y + 1, out + qsizetype(y) * size * 4);
+                }
+            }
+        });
+        p->prefilterUs = timer.nsecsElapsed() / 1000 - p->loadUs - p->facesUs;
+        return p;
+    }
+
+    // Uploads the cached cubes and irradiance when p found them.
+    bool useCache(QRhiResourceUpdateBatch *rub, Prepared &p) {
+        if (!p.cache.file)
+            return false;
+        upload(rub, envCubemap_.get(), p.cache.env);
+        upload(rub, specularCubemap_.get(), p.cache.specular);
+        irradiance_ = p.cache.irradiance;
+        hasIrradiance_ = true;
+        cacheMapping_ = std::move(p.cache.file);
+        cacheMappingFrames_ = 0;
+        uploaded_ = true;
+        qDebug() << "HdriSky: IBL of" << eqPath_ << "from the cache in" << p.loadUs << "us";
+        return true;
+    }
+
+    void saveReadbacks() {
+        const size_t envCount = size_t(iblParams().envLevels) * 6;
+        std::vector<QByteArray> env, specular;
+        for (size_t i = 0; i < gpuInit_->readbacks.size(); ++i)
+            (i < envCount ? env : specular).push_back(gpuInit_->readbacks[i].data);
+        if (!IblCache::save(cacheKey_, iblParams(), irradiance_, env, specular))
+            qWarning() << "HdriSky: IBL cache not written";
+    }
+
+    // faces in level * 6 + face order
+    static void upload(QRhiResourceUpdateBatch *rub, QRhiTexture *cube, const std::vector<QByteArray> &faces) {
+        QList<QRhiTextureUploadEntry> entries;
+        for (size_t i = 0; i < faces.size(); ++i)
+            entries.append(QRhiTextureUploadEntry(int(i % 6), int(i / 6), QRhiTextureSubresourceUploadDescription(faces[i])));
+        QRhiTextureUploadDescription desc;
+        desc.setEntries(entries.cbegin(), entries.cend());
+        rub->uploadTexture(cube, desc);
+    }
 
-    std::unique_ptr<QRhiTextureRenderTarget> initRt_;
-    std::unique_ptr<QRhiRenderPassDescriptor> initRp_;
-    std::unique_ptr<QRhiGraphicsPipeline> initPipeline_;
-    std::unique_ptr<QRhiShaderResourceBindings> initSrb_;
-    std::unique_ptr<QRhiSampler> initSampler_;
-    std::unique_ptr<QRhiTexture> hdrTex_;
+    // float RGB to RGBA16F
+    static QByteArray toHalf(const std::vector<float> &rgb) {
+        const size_t texels = rgb.size() / 3;
+        QByteArray out(qsizetype(texels) * 8, Qt::Uninitialized);
+        auto *h = reinterpret_cast<quint16 *>(out.data());
+        for (size_t i = 0; i < texels; ++i) {
+            for (int c = 0; c < 3; ++c)
+                h[i * 4 + size_t(c)] = rgbe::floatToHalf(rgb[i * 3 + size_t(c)]);
+            h[i * 4 + 3] = 0x3c00;
+        }
+        return out;
+    }
 
     static constexpr int CUBEMAP_RESOLUTION = 512;
+    static constexpr int SPECULAR_SIZE = 128;
+    static constexpr int SPECULAR_LEVELS = 5;
+
+    static SamplerKey clampSamplerKey() {
+        SamplerKey key;
+        key.addressU = QRhiSampler::ClampToEdge;
+        key.addressV = QRhiSampler::ClampToEdge;
+        return key;
+    }
 
     static std::vector<HdriVertex> cubeVertices() {
         static const float verts[] = {
@@ -503,6 +589,3 @@ private:
 };
 
 #endif // HDRI_SKY_QRHI_H
-
-
-
@@ -0,0 +1,152 @@
+#ifndef IBLCACHE_H
+#define IBLCACHE_H
+
+#include "assetpack.h"
+#include "brdflut.h"
+#include "shirradiance.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QDebug>
+#include <memory>
+#include <vector>
+
+// Everything HdriSky derives from an .hdr file, kept between runs: the
+// environment cube with all its mips, the prefiltered specular cube and the
+// SH irradiance. Files live in BrdfLut::cacheDirectory() and are named after
+// a hash of the HDR contents and the conversion parameters. An edited HDR,
+// or a different face size, level count, sample count or format, therefore
+// misses and gets rebuilt. Nothing is ever invalidated in place.
+// Subresources are stored level-major, six faces per level, as tightly packed
+// rows. load() maps the file and hands out views into the mapping; the
+// mapping must outlive the batch that uploads them.
+
+struct IblParams {
+    quint32 faceSize = 0;
+    quint32 envLevels = 0;
+    quint32 specularSize = 0;
+    quint32 specularLevels = 0;
+    quint32 prefilterSamples = 0;
+    quint32 format = 0; // QRhiTexture::Format of both cubes
+    quint32 texelBytes = 8;
+};
+
+class IblCache {
+public:
+    static constexpr quint32 VERSION = 1; // bump when the conversion changes
+
+    struct Entry {
+        std::unique_ptr<QFile> file; // owns the mapping
+        sh::Irradiance irradiance;
+        std::vector<QByteArray> env;      // level * 6 + face
+        std::vector<QByteArray> specular; // level * 6 + face
+    };
+
+    // Hash of the file at hdrPath and p; empty when the file cannot be read.
+    static QByteArray key(const QString &hdrPath, const IblParams &p) {
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        const QByteArray packed = qpak::packed(hdrPath);
+        QFile f(hdrPath);
+        if (!packed.isNull())
+            hash.addData(packed);
+        else if (!f.open(QIODevice::ReadOnly))
+            return {};
+        else if (const uchar *data = f.map(0, f.size()))
+            hash.addData(QByteArrayView(data, f.size()));
+        else if (!hash.addData(&f))
+            return {};
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(&p), sizeof(p)));
+        hash.addData(QByteArrayView(reinterpret_cast<const char *>(&VERSION), sizeof(VERSION)));
+        return hash.result().toHex();
+    }
+
+    static QString path(const QByteArray &key) {
+        return BrdfLut::cacheDirectory() + QStringLiteral("/ibl-") + QString::fromLatin1(key) + QStringLiteral(".bin");
+    }
+
+    static qsizetype faceBytes(const IblParams &p, quint32 size, quint32 level) {
+        const qsizetype s = qMax<qsizetype>(1, size >> level);
+        return s * s * p.texelBytes;
+    }
+
+    static bool load(const QByteArray &key, const IblParams &p, Entry &out) {
+        auto file = std::make_unique<QFile>(path(key));
+        if (key.isEmpty() || !file->open(QIODevice::ReadOnly))
+            return false;
+        const uchar *data = file->map(0, file->size());
+        if (!data || size_t(file->size()) < sizeof(Header))
+            return false;
+        Header h;
+        memcpy(&h, data, sizeof(h));
+        if (memcmp(h.magic, "IBLC", 4) != 0 || h.version != VERSION || memcmp(&h.params, &p, sizeof(p)) != 0)
+            return false;
+        qsizetype offset = sizeof(Header);
+        auto take = [&](quint32 size, quint32 levels, std::vector<QByteArray> &faces) {
+            for (quint32 level = 0; level < levels; ++level) {
+                const qsizetype bytes = faceBytes(p, size, level);
+                for (int face = 0; face < 6; ++face) {
+                    if (offset + bytes > file->size())
+                        return false;
+                    faces.push_back(QByteArray::fromRawData(reinterpret_cast<const char *>(data + offset), bytes));
+                    offset += bytes;
+                }
+            }
+            return true;
+        };
+        if (!take(p.faceSize, p.envLevels, out.env) || !take(p.specularSize, p.specularLevels, out.specular)) {
+            out.env.clear();
+            out.specular.clear();
+            return false;
+        }
+        out.irradiance = h.irradiance;
+        out.file = std::move(file);
+        return true;
+    }
+
+    static bool save(const QByteArray &key, const IblParams &p, const sh::Irradiance &irradiance,
+                     const std::vector<QByteArray> &env, const std::vector<QByteArray> &specular) {
+        if (key.isEmpty() || env.size() != size_t(p.envLevels) * 6 || specular.size() != size_t(p.specularLevels) * 6)
+            return false;
+        QDir().mkpath(BrdfLut::cacheDirectory());
+        QSaveFile f(path(key));
+        if (!f.open(QIODevice::WriteOnly))
+            return false;
+        Header h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, "IBLC", 4);
+        h.version = VERSION;
+        h.params = p;
+        h.irradiance = irradiance;
+        f.write(reinterpret_cast<const char *>(&h), sizeof(h));
+        auto put = [&](quint32 size, const std::vector<QByteArray> &faces) {
+            for (size_t i = 0; i < faces.size(); ++i) {
+                if (faces[i].size() != faceBytes(p, size, quint32(i / 6)))
+                    return false;
+                f.write(faces[i]);
+            }
+            return true;
+        };
+        if (!put(p.faceSize, env) || !put(p.specularSize, specular)) {
+            qWarning() << "IblCache: subresource sizes do not match the parameters";
+            f.cancelWriting();
+            return false;
+        }
+        if (!f.commit()) {
+            qWarning() << "IblCache: cannot write" << path(key);
+            return false;
+        }
+        return true;
+    }
+
+private:
+    struct Header {
+        char magic[4];
+        quint32 version;
+        IblParams params;
+        sh::Irradiance irradiance;
+    };
+};
+
+#endif // IBLCACHE_H
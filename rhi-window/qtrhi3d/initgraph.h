@@ -0,0 +1,210 @@
+#ifndef INITGRAPH_H
+#define INITGRAPH_H
+
+#include "startupprofiler.h"
+
+#include <rhi/qrhi.h>
+#include <QThread>
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+
+// Startup work as a dependency graph, so loading overlaps and frames are
+// presented with whatever is already there. Worker tasks run on the graph's
+// own pool; they may block on parallelFor() or a TextureLoader over the
+// global pool without starving it. Render tasks touch the QRhi and run in
+// pump(), which the render loop calls once per frame with that frame's
+// update batch; a step task (addSteps()) runs in every pump() until it
+// reports that it is done, for work handed over a little per frame. A task
+// becomes ready when all its dependencies finished.
+// Every task's ready, start and end times are kept for dumpTimeline().
+
+class InitGraph {
+public:
+    enum Thread { Worker, Render };
+    using Task = std::function<void(QRhiResourceUpdateBatch *u)>; // u is null on workers
+    using Step = std::function<bool(QRhiResourceUpdateBatch *u)>; // true when done
+
+    struct Record {
+        QString name;
+        Thread thread = Worker;
+        qint64 readyUs = -1; // since the graph was made
+        qint64 startUs = -1;
+        qint64 endUs = -1;
+    };
+
+    explicit InitGraph(int workers = qMax(2, QThread::idealThreadCount() / 2)) {
+        pool_.setMaxThreadCount(workers);
+        clock_.start();
+    }
+
+    // Tasks not started yet are dropped; running workers are waited for.
+    ~InitGraph() {
+        {
+            QMutexLocker lock(&mutex_);
+            cancelled_ = true;
+        }
+        pool_.waitForDone();
+    }
+
+    InitGraph(const InitGraph &) = delete;
+    InitGraph &operator=(const InitGraph &) = delete;
+
+    // Returns the task's id for later dependencies; add everything before start().
+    int add(const QString &name, Thread thread, Task fn, std::initializer_list<int> deps = {}) {
+        const int id = int(nodes_.size());
+        Node n;
+        n.record.name = name;
+        n.record.thread = thread;
+        n.fn = std::move(fn);
+        for (int d : deps) {
+            if (d < 0 || d >= id)
+                continue;
+            nodes_[size_t(d)].dependents.push_back(id);
+            ++n.waiting;
+        }
+        nodes_.push_back(std::move(n));
+        return id;
+    }
+
+    // A render task that runs once per pump() until fn returns true; its
+    // dependents wait for that.
+    int addSteps(const QString &name, Step fn, std::initializer_list<int> deps = {}) {
+        const int id = add(name, Render, nullptr, deps);
+        nodes_[size_t(id)].step = std::move(fn);
+        return id;
+    }
+
+    void start() {
+        QMutexLocker lock(&mutex_);
+        remaining_ = int(nodes_.size());
+        for (int i = 0; i < int(nodes_.size()); ++i)
+            if (nodes_[size_t(i)].waiting == 0)
+                makeReady(i);
+    }
+
+    // Render thread: runs ready render tasks into u until budgetUs is spent,
+    // at least one when any is ready. Returns how many ran.
+    int pump(QRhiResourceUpdateBatch *u, qint64 budgetUs = 4000) {
+        QElapsedTimer budget;
+        budget.start();
+        int ran = 0;
+        std::vector<int> again; // step tasks, next frame
+        for (;;) {
+            int i;
+            {
+                QMutexLocker lock(&mutex_);
+                if (renderReady_.empty() || cancelled_)
+                    break;
+                i = renderReady_.front();
+                renderReady_.pop_front();
+            }
+            if (!run(i, u))
+                again.push_back(i);
+            ++ran;
+            if (budget.nsecsElapsed() / 1000 >= budgetUs)
+                break;
+        }
+        QMutexLocker lock(&mutex_);
+        renderReady_.insert(renderReady_.end(), again.begin(), again.end());
+        return ran;
+    }
+
+    bool isFinished() const {
+        QMutexLocker lock(&mutex_);
+        return remaining_ == 0;
+    }
+
+    qint64 elapsedUs() const { return clock_.nsecsElapsed() / 1000; }
+
+    std::vector<Record> records() const {
+        QMutexLocker lock(&mutex_);
+        std::vector<Record> out;
+        for (const Node &n : nodes_)
+            out.push_back(n.record);
+        return out;
+    }
+
+    // One line per task in start order; "waited" is the time spent ready
+    // but not started, i.e. waiting for a worker or the next frame.
+    void dumpTimeline() const {
+        std::vector<Record> r = records();
+        std::sort(r.begin(), r.end(), [](const Record &a, const Record &b) { return a.startUs < b.startUs; });
+        qint64 end = 0;
+        for (const Record &t : r) {
+            qDebug().noquote() << QStringLiteral("InitGraph: %1 %2 start %3 us, %4 us, waited %5 us")
+                                      .arg(t.name, -24)
+                                      .arg(t.thread == Render ? QLatin1String("render") : QLatin1String("worker"))
+                                      .arg(t.startUs, 8)
+                                      .arg(t.endUs - t.startUs, 8)
+                                      .arg(t.startUs - t.readyUs, 8);
+            end = qMax(end, t.endUs);
+        }
+        qDebug() << "InitGraph:" << r.size() << "tasks done after" << end << "us";
+    }
+
+private:
+    struct Node {
+        Record record;
+        Task fn;
+        Step step;
+        std::vector<int> dependents;
+        int waiting = 0;
+    };
+
+    // mutex_ held
+    void makeReady(int i) {
+        nodes_[size_t(i)].record.readyUs = elapsedUs();
+        if (nodes_[size_t(i)].record.thread == Render)
+            renderReady_.push_back(i);
+        else
+            pool_.start([this, i] { run(i, nullptr); });
+    }
+
+    // Returns false for a step task that is not done yet.
+    bool run(int i, QRhiResourceUpdateBatch *u) {
+        Node &n = nodes_[size_t(i)];
+        {
+            QMutexLocker lock(&mutex_);
+            if (cancelled_)
+                return true;
+            if (n.record.startUs < 0)
+                n.record.startUs = elapsedUs();
+        }
+        bool done = true;
+        {
+            startup::Scope scope(n.record.name, "task");
+            if (n.step)
+                done = n.step(u);
+            else
+                n.fn(u);
+        }
+        if (!done)
+            return false;
+        QMutexLocker lock(&mutex_);
+        n.record.endUs = elapsedUs();
+        n.fn = nullptr;
+        n.step = nullptr;
+        --remaining_;
+        for (int d : n.dependents)
+            if (--nodes_[size_t(d)].waiting == 0)
+                makeReady(d);
+        return true;
+    }
+
+    QThreadPool pool_;
+    QElapsedTimer clock_;
+    mutable QMutex mutex_;
+    std::vector<Node> nodes_;
+    std::deque<int> renderReady_;
+    int remaining_ = -1;
+    bool cancelled_ = false;
+};
+
+#endif // INITGRAPH_H
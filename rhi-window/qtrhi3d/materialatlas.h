@@ -0,0 +1,291 @@
+#ifndef MATERIALATLAS_H
+#define MATERIALATLAS_H
+
+#include "types.h"
+#include "texturecache.h"
+
+#include <rhi/qrhi.h>
+#include <QHash>
+#include <QImage>
+#include <QDebug>
+#include <array>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Material textures packed into texture arrays, one array per PBR binding
+// (1 albedo, 2 normal, 3 ORM: ao, roughness, metallic, height). A material
+// is one layer index per binding, written into the per-object uniforms, so
+// every PBR model binds the same SRB and the pipeline stays bound across the
+// models of a pass.
+// All layers of an array share size and format. When every file of a binding
+// already agrees (e.g. cooked files of one size) its levels go in unchanged,
+// otherwise the layers are resampled to the largest size, uncompressed, and
+// the GPU generates the mips. build() fails without texture array support or when
+// a binding needs more layers than TextureArraySizeMax; models then keep
+// their own textures and the non-array shaders.
+// Opt-in with setEnabled(true): atlas layers are not streamed, so by default
+// models keep per-texture sets that TextureStreamer can refine.
+
+class MaterialAtlas {
+public:
+    static constexpr int SLOTS = 3;
+    static constexpr int MAX_LAYER_SIZE = 2048;
+
+    struct Stats {
+        int materials = 0;
+        int layers = 0;
+        int resampled = 0; // layers converted to their array's size and format
+        quint64 bytes = 0;
+    };
+
+    static MaterialAtlas *instance(QRhi *rhi) {
+        static QHash<QRhi *, MaterialAtlas *> atlases;
+        if (MaterialAtlas *a = atlases.value(rhi))
+            return a;
+        auto *a = new MaterialAtlas(rhi);
+        atlases.insert(rhi, a);
+        rhi->addCleanupCallback([](QRhi *r) { delete atlases.take(r); });
+        return a;
+    }
+
+    static void setEnabled(bool enabled) { enabledFlag() = enabled; }
+    static bool isEnabled() { return enabledFlag(); }
+
+    static QString ormPath(const TextureSet &set) {
+        return TextureLoader::ormPath(set.ao, set.rougness, set.metallic, set.height);
+    }
+
+    // In binding order.
+    static QStringList slotPaths(const TextureSet &set) { return { set.albedo, set.normal, ormPath(set) }; }
+
+    static TextureOptions slotOptions(int slot) { return slot == 1 ? TextureOptions::normalMap() : TextureOptions(); }
+
+    // Registers set before build(); materials sharing a file share its layer.
+    int add(const TextureSet &set) {
+        const int existing = find(set);
+        if (existing >= 0 || ready_)
+            return existing;
+        const QStringList paths = slotPaths(set);
+        Material m;
+        m.paths = paths;
+        for (int s = 0; s < SLOTS; ++s) {
+            Slot &slot = slots_[s];
+            const QString k = TextureCache::canonicalPath(paths[s]);
+            auto it = slot.layerOf.constFind(k);
+            if (it == slot.layerOf.constEnd()) {
+                it = slot.layerOf.insert(k, int(slot.paths.size()));
+                slot.paths << paths[s];
+            }
+            m.layers[s] = *it;
+        }
+        materials_.push_back(m);
+        return int(materials_.size()) - 1;
+    }
+
+    int find(const TextureSet &set) const {
+        const QStringList paths = slotPaths(set);
+        for (size_t i = 0; i < materials_.size(); ++i)
+            if (materials_[i].paths == paths)
+                return int(i);
+        return -1;
+    }
+
+    // Decodes every registered file on pool and uploads the arrays on u.
+    bool build(QRhiResourceUpdateBatch *u, QThreadPool *pool = QThreadPool::globalInstance()) {
+        if (ready_ || materials_.empty())
+            return ready_;
+        if (!isSupported())
+            return false;
+        decode(qtex::Targets::query(rhi_), pool);
+        return upload(u);
+    }
+
+    // build() in three steps, for callers that decode away from the render
+    // thread: isSupported() and upload() on the render thread, decode() on
+    // any thread in between.
+    bool isSupported() const {
+        if (!rhi_->isFeatureSupported(QRhi::TextureArrays)) {
+            qWarning() << "MaterialAtlas: no texture arrays, models keep separate textures";
+            return false;
+        }
+        const int maxLayers = rhi_->resourceLimit(QRhi::TextureArraySizeMax);
+        for (const Slot &slot : slots_) {
+            if (slot.paths.size() > maxLayers) {
+                qWarning() << "MaterialAtlas:" << slot.paths.size() << "layers exceed TextureArraySizeMax" << maxLayers
+                           << "- models keep separate textures";
+                return false;
+            }
+        }
+        return !materials_.empty();
+    }
+
+    // targets as queried on the render thread; touches no QRhi.
+    void decode(const qtex::Targets &targets, QThreadPool *pool = QThreadPool::globalInstance()) {
+        TextureLoader loader(pool);
+        for (int s = 0; s < SLOTS; ++s) {
+            for (const QString &path : slots_[s].paths) {
+                if (decoded_.emplace(key(path, slotOptions(s)), qtex::Payload()).second)
+                    loader.submit(path, slotOptions(s), targets);
+            }
+        }
+        while (loader.pending() > 0) {
+            loader.waitForResult();
+            for (TextureLoader::Result &r : loader.take())
+                decoded_[key(r.path, r.options)] = std::move(r.payload);
+        }
+    }
+
+    bool upload(QRhiResourceUpdateBatch *u) {
+        if (ready_)
+            return true;
+        for (int s = 0; s < SLOTS; ++s) {
+            if (!buildSlot(s, decoded_, u)) {
+                for (Slot &s : slots_)
+                    s.texture.reset();
+                stats_.layers = stats_.resampled = 0;
+                stats_.bytes = 0;
+                decoded_.clear();
+                return false;
+            }
+        }
+        decoded_.clear();
+        stats_.materials = int(materials_.size());
+        ready_ = true;
+        return true;
+    }
+
+    bool isReady() const { return ready_; }
+
+    QRhiTexture *texture(int slot) const { return slots_[slot].texture.get(); }
+    int layer(int material, int slot) const { return materials_[material].layers[slot]; }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "MaterialAtlas:" << stats_.materials << "materials," << stats_.layers << "layers,"
+                 << stats_.resampled << "resampled," << stats_.bytes / 1024 << "KiB";
+    }
+
+private:
+    static bool &enabledFlag() {
+        static bool enabled = false;
+        return enabled;
+    }
+
+    struct Material {
+        QStringList paths;
+        std::array<int, SLOTS> layers{};
+    };
+
+    struct Slot {
+        QStringList paths; // one per layer
+        QHash<QString, int> layerOf;
+        std::unique_ptr<QRhiTexture> texture;
+    };
+
+    explicit MaterialAtlas(QRhi *rhi) : rhi_(rhi) {}
+
+    static QString key(const QString &path, const TextureOptions &options) {
+        return TextureCache::canonicalPath(path) + QLatin1Char('#') + QString::number(options.bits());
+    }
+
+    bool buildSlot(int s, std::unordered_map<QString, qtex::Payload> &decoded, QRhiResourceUpdateBatch *u) {
+        Slot &slot = slots_[s];
+        std::vector<qtex::Payload *> layers;
+        for (const QString &path : slot.paths) {
+            qtex::Payload &p = decoded[key(path, slotOptions(s))];
+            if (p.levels.empty())
+                return false;
+            p.prepare(rhi_);
+            layers.push_back(&p);
+        }
+
+        const qtex::Payload &first = *layers.front();
+        QSize size;
+        bool same = true;
+        for (const qtex::Payload *p : layers) {
+            size = size.expandedTo(p->size());
+            same = same && p->format == first.format && p->size() == first.size()
+                   && p->levels.size() == first.levels.size() && p->generateMips == first.generateMips;
+        }
+        same = same && size.width() <= MAX_LAYER_SIZE && size.height() <= MAX_LAYER_SIZE;
+        size = size.boundedTo(QSize(MAX_LAYER_SIZE, MAX_LAYER_SIZE));
+
+        // resampled layers own their pixels here until the upload is queued
+        std::vector<std::vector<uint8_t>> resampled;
+        bcn::Format format = first.format;
+        bool generateMips = first.generateMips;
+        if (!same) {
+            const int channels = slotOptions(s).channels;
+            format = channels == 1 ? bcn::Format::R8 : channels == 2 ? bcn::Format::RG8 : bcn::Format::RGBA8;
+            generateMips = true;
+            resampled.reserve(layers.size());
+            for (const qtex::Payload *p : layers) {
+                resampled.push_back(bcn::encode(format, resample(*p, size).data(), quint32(size.width()), quint32(size.height())));
+                ++stats_.resampled;
+            }
+        }
+
+        QRhiTexture::Flags flags;
+        if (same && first.levels.size() > 1)
+            flags |= QRhiTexture::MipMapped;
+        if (generateMips && !bcn::isCompressed(format))
+            flags |= QRhiTexture::MipMapped | QRhiTexture::UsedWithGenerateMips;
+        std::unique_ptr<QRhiTexture> tex(rhi_->newTextureArray(qtex::rhiFormat(format), int(layers.size()), size, 1, flags));
+        if (!tex->create()) {
+            qWarning() << "MaterialAtlas: failed to create" << layers.size() << "layer array of" << size;
+            return false;
+        }
+
+        QList<QRhiTextureUploadEntry> entries;
+        for (int layer = 0; layer < int(layers.size()); ++layer) {
+            if (!same) {
+                const std::vector<uint8_t> &data = resampled[size_t(layer)];
+                entries.append(QRhiTextureUploadEntry(layer, 0, QRhiTextureSubresourceUploadDescription(
+                                                                    data.data(), quint32(data.size()))));
+                stats_.bytes += data.size() * 4 / 3;
+                continue;
+            }
+            const qtex::Payload &p = *layers[size_t(layer)];
+            for (size_t level = 0; level < p.levels.size(); ++level) {
+                entries.append(QRhiTextureUploadEntry(layer, int(level), QRhiTextureSubresourceUploadDescription(
+                                                          p.levels[level].data(), quint32(p.levels[level].size()))));
+                stats_.bytes += p.levels[level].size();
+            }
+        }
+        QRhiTextureUploadDescription desc;
+        desc.setEntries(entries.cbegin(), entries.cend());
+        u->uploadTexture(tex.get(), desc);
+        if (flags.testFlag(QRhiTexture::UsedWithGenerateMips))
+            u->generateMips(tex.get());
+
+        stats_.layers += int(layers.size());
+        slot.texture = std::move(tex);
+        return true;
+    }
+
+    // Base level of p as RGBA8 at size; the orientation prepare() chose is kept.
+    static std::vector<uint8_t> resample(const qtex::Payload &p, const QSize &size) {
+        std::vector<uint8_t> rgba = p.format == bcn::Format::RGBA8
+                                        ? p.levels.front()
+                                        : bcn::decode(p.format, p.levels.front().data(), p.width, p.height);
+        QImage image(rgba.data(), int(p.width), int(p.height), int(p.width) * 4, QImage::Format_RGBA8888);
+        if (image.size() != size)
+            image = image.scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+        std::vector<uint8_t> out(size_t(size.width()) * size.height() * 4);
+        for (int y = 0; y < size.height(); ++y)
+            memcpy(out.data() + size_t(y) * size.width() * 4, image.constScanLine(y), size_t(size.width()) * 4);
+        return out;
+    }
+
+    QRhi *rhi_;
+    bool ready_ = false;
+    Stats stats_;
+    std::vector<Material> materials_;
+    std::array<Slot, SLOTS> slots_;
+    std::unordered_map<QString, qtex::Payload> decoded_; // by key(), from decode() until upload()
+};
+
+#endif // MATERIALATLAS_H
@@ -4,9 +4,17 @@
 
 #include "types.h"
 #include "transform.h"
+#include "rhicache.h"
+#include "drawlist.h"
+#include "commandrecorder.h"
+#include "texturestreamer.h"
+#include "materialatlas.h"
+#include "frameuniforms.h"
+#include "startupprofiler.h"
 
 #include <rhi/qrhi.h>
 #include <memory>
+#include <utility>
 #include <QMatrix4x4>
 #include <QMatrix4x4>
 #include <QVector4D>
@@ -23,34 +31,47 @@ public:
     int m_indexCount = 0;
     float m_opacity = 1;
     int m_opacityDir = -1;
+    // never moves once in the scene; its shadow is drawn into the ShadowCache
+    bool staticCaster = false;
 private:
 
     std::unique_ptr<QRhiBuffer> m_vbuf;
     std::unique_ptr<QRhiBuffer> m_ibuf;
-    std::unique_ptr<QRhiBuffer> m_ubuf;
 
-    std::unique_ptr<QRhiShaderResourceBindings> m_srb;
-    std::unique_ptr<QRhiGraphicsPipeline> m_pipeline;
+    // Uniforms live in the shared GpuUbo pool, SRBs and the sampler are owned by RhiResourceCache.
+    UniformBufferPool *m_uniforms = nullptr;
+    quint32 m_uboOffset = 0;
+    // one block per cascade, then one per ShadowAtlas update
+    static constexpr int SHADOW_VIEWS = ShadowAtlas::FIRST_VIEW + ShadowAtlas::MAX_UPDATES;
+    quint32 m_shadowUboOffsets[SHADOW_VIEWS] = {};
 
-    std::unique_ptr<QRhiBuffer> m_shadowUbo;
-    std::unique_ptr<QRhiShaderResourceBindings> m_shadowSrb;
+    QRhiShaderResourceBindings *m_srb = nullptr;
+    QRhiGraphicsPipeline *m_pipeline = nullptr;
 
-    std::unique_ptr<QRhiTexture> m_texture;
-    std::unique_ptr<QRhiSampler> m_sampler;
-    std::unique_ptr<QRhiTexture> m_tex_norm;
-    std::unique_ptr<QRhiSampler> m_sampler_norm;
-    std::unique_ptr<QRhiTexture> m_texture_met;
-    std::unique_ptr<QRhiSampler> m_sampler_met;
-    std::unique_ptr<QRhiTexture> m_texture_rough;
-    std::unique_ptr<QRhiSampler> m_sampler_rough;
-    std::unique_ptr<QRhiTexture> m_texture_ao;
-    std::unique_ptr<QRhiSampler> m_sampler_ao;
-    std::unique_ptr<QRhiTexture> m_texture_height;
-    std::unique_ptr<QRhiSampler> m_sampler_height;
+    QRhiShaderResourceBindings *m_shadowSrb = nullptr;
+
+    QRhiSampler *m_sampler = nullptr;
+    TextureCache::Handle m_texture;
+    TextureCache::Handle m_tex_norm;
+    TextureCache::Handle m_texture_orm; // ao, roughness, metallic, height packed into RGBA
+    // layers in the MaterialAtlas arrays when the model uses them instead of its own textures
+    int m_material = -1;
+    float m_layers[4] = {};
+
+    quint64 m_revision = 0;
+
+    // object space size and UV extent, for picking streamed mip levels
+    float m_radius = 1.0f;
+    float m_uvSpan = 1.0f;
+
+    QVector<float> m_prepared; // prepare() output, pos normal uv tangent bitangent
 
 
 public:
     void addVertAndInd(const QVector<float> &vertices, const QVector<quint16> &indices);
+    // CPU half of init(): tangents and bounds of the added geometry. Touches
+    // no QRhi, so startup can run it on a worker; init() does it otherwise.
+    void prepare();
     void init(QRhi *rhi,QRhiRenderPassDescriptor *rp,const QShader &vs,const QShader &fs,
               QRhiResourceUpdateBatch *u,QRhiTexture *shadowmap,QRhiSampler *shadowsampler,const TextureSet &set);
     void updateGeometry(QRhi *rhi, QRhiResourceUpdateBatch *u,
@@ -58,15 +79,22 @@ public:
                         const QVector<quint16> &indices);
 
     void updateUbo(Ubo ubo,QRhiResourceUpdateBatch *u);
-    void updateShadowUbo(Ubo ubo, QRhiResourceUpdateBatch *u);
-    void draw(QRhiCommandBuffer *cb);
-    void DrawForShadow(QRhiCommandBuffer *cb,QRhiGraphicsPipeline *shadowPipeline,
+    // ubo.lightSpace is the projection of that cascade
+    // view: the cascade, or ShadowAtlas::FIRST_VIEW + an atlas update
+    void updateShadowUbo(Ubo ubo, QRhiResourceUpdateBatch *u, int view = 0);
+    void draw(CommandRecorder &cb);
+    void DrawForShadow(CommandRecorder &cb,QRhiGraphicsPipeline *shadowPipeline,
                        Ubo ubo,QRhiResourceUpdateBatch *u)  ;
+    void collectPackets(DrawList &list, QRhiGraphicsPipeline *shadowPipeline) const;
+    // bumped whenever buffers or draw counts change, so cached draw lists get recompiled
+    quint64 revision() const { return m_revision; }
 
     QVector<float> computeTangents(const QVector<float>& vertices, const QVector<quint16>& indices);
     void loadTexture(QRhi *m_rhi,const QSize &, QRhiResourceUpdateBatch *u,QString tex_name,
-                     std::unique_ptr<QRhiTexture> &texture,
-                     std::unique_ptr<QRhiSampler> &sampler);
+                     TextureCache::Handle &texture, const TextureOptions &options = {});
+    static QRhiShaderResourceBindings *shadowSrb(QRhi *rhi);
+    // focalPixels: pixels covered by one world unit at distance 1
+    void requestTextureDetail(TextureStreamer *streamer, const QVector3D &eye, float focalPixels) const;
     Transform &getTransform() {
         return transform;
     }
@@ -88,6 +116,8 @@ inline void Model::updateGeometry(QRhi *rhi, QRhiResourceUpdateBatch *u,
         return;
     m_vert = vertices;
     m_ind = indices;
+    if (m_indexCount != indices.size())
+        ++m_revision;
     m_indexCount = indices.size();
 
     QVector<float> newVerts = computeTangents(vertices, indices);
@@ -98,6 +128,9 @@ inline void Model::updateGeometry(QRhi *rhi, QRhiResourceUpdateBatch *u,
     bool recreateVBuf = !m_vbuf || m_vbuf->size() < vSize;
     bool recreateIBuf = !m_ibuf || m_ibuf->size() < iSize;
 
+    if (recreateVBuf || recreateIBuf)
+        ++m_revision;
+
     if (recreateVBuf) {
         m_vbuf.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, vSize));
         m_vbuf->create();
@@ -112,11 +145,32 @@ inline void Model::updateGeometry(QRhi *rhi, QRhiResourceUpdateBatch *u,
     u->updateDynamicBuffer(m_ibuf.get(), 0, iSize, indices.constData());
 }
 
+inline void Model::prepare()
+{
+    startup::Scope scope("Model::prepare (computeTangents)");
+    m_prepared = computeTangents(m_vert, m_ind);
+
+    // vertices are pos3 normal3 uv2
+    float uMin = 0, uMax = 0, vMin = 0, vMax = 0;
+    m_radius = 0.0f;
+    for (qsizetype i = 0; i + 8 <= m_vert.size(); i += 8) {
+        m_radius = qMax(m_radius, QVector3D(m_vert[i], m_vert[i + 1], m_vert[i + 2]).length());
+        uMin = i ? qMin(uMin, m_vert[i + 6]) : m_vert[i + 6];
+        uMax = i ? qMax(uMax, m_vert[i + 6]) : m_vert[i + 6];
+        vMin = i ? qMin(vMin, m_vert[i + 7]) : m_vert[i + 7];
+        vMax = i ? qMax(vMax, m_vert[i + 7]) : m_vert[i + 7];
+    }
+    m_radius = qMax(m_radius, 0.001f);
+    m_uvSpan = qMax(0.001f, qMax(uMax - uMin, vMax - vMin));
+}
+
 inline void Model::init(QRhi *rhi,QRhiRenderPassDescriptor *rp,const QShader &vs,const QShader &fs,
                  QRhiResourceUpdateBatch *u,QRhiTexture *shadowmap,QRhiSampler *shadowsampler,const TextureSet &set)
 {
-
-    QVector<float>  m_vert1= computeTangents( m_vert,m_ind);
+    startup::Scope scope("Model::init");
+    if (m_prepared.isEmpty())
+        prepare();
+    const QVector<float> m_vert1 = std::exchange(m_prepared, {});
 
     m_vbuf.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::VertexBuffer, m_vert1.size() * sizeof(float)));
     m_vbuf->create();
@@ -130,18 +184,13 @@ inline void Model::init(QRhi *rhi,QRhiRenderPassDescriptor *rp,const QShader &vs
     u->updateDynamicBuffer(m_ibuf.get(), 0, m_ind.size() * sizeof(quint16), m_ind.constData());
     m_indexCount = m_ind.size();
 
-    const quint32 UBUF_SIZE = 512;
-    m_ubuf.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer,UBUF_SIZE ));
-    m_ubuf->create();
-
-    m_shadowUbo.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, sizeof(GpuUbo)));
-    m_shadowUbo->create();
-
-    m_shadowSrb.reset(rhi->newShaderResourceBindings());
-    m_shadowSrb->setBindings({
-        QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::VertexStage, m_shadowUbo.get())
-    });
-    m_shadowSrb->create();
+    RhiResourceCache *cache = RhiResourceCache::instance(rhi);
+    m_uniforms = cache->uniformPool(sizeof(GpuUbo));
+    m_uboOffset = m_uniforms->allocate();
+    for (quint32 &offset : m_shadowUboOffsets)
+        offset = m_uniforms->allocate();
+    m_shadowSrb = shadowSrb(rhi);
+    m_sampler = cache->sampler({});
 
     // TextureSet set;
     // set.albedo = ":/assets/textures/brick/victorian-brick_albedo.png";
@@ -152,63 +201,69 @@ inline void Model::init(QRhi *rhi,QRhiRenderPassDescriptor *rp,const QShader &vs
     // set.ao = ":/assets/textures/brick/victorian-brick_ao.png";
 
 
-    loadTexture(rhi,QSize(), u,set.albedo,m_texture,m_sampler);
-    loadTexture(rhi,QSize(), u,set.normal,m_tex_norm,m_sampler_norm);
-    loadTexture(rhi,QSize(), u,set.metallic,m_texture_met,m_sampler_met);
-    loadTexture(rhi,QSize(), u,set.rougness,m_texture_rough,m_sampler_rough);
-    loadTexture(rhi,QSize(), u,set.height,m_texture_height,m_sampler_height);
-    loadTexture(rhi,QSize(), u,set.ao,m_texture_ao,m_sampler_ao);
-
     Q_ASSERT(shadowmap);
     Q_ASSERT(shadowsampler);
 
-    m_srb.reset(rhi->newShaderResourceBindings());
-    m_srb->setBindings({
-        QRhiShaderResourceBinding::uniformBuffer(0,QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage , m_ubuf.get()),
-        QRhiShaderResourceBinding::sampledTexture(1,QRhiShaderResourceBinding::FragmentStage, m_texture.get(), m_sampler.get()),
-        QRhiShaderResourceBinding::sampledTexture(2,QRhiShaderResourceBinding::FragmentStage, m_tex_norm.get(), m_sampler.get()),
-        QRhiShaderResourceBinding::sampledTexture(3,QRhiShaderResourceBinding::FragmentStage, m_texture_met.get(), m_sampler.get()),
-        QRhiShaderResourceBinding::sampledTexture(4,QRhiShaderResourceBinding::FragmentStage, m_texture_rough.get(), m_sampler.get()),
-        QRhiShaderResourceBinding::sampledTexture(5,QRhiShaderResourceBinding::FragmentStage, m_texture_ao.get(), m_sampler.get()),
-        QRhiShaderResourceBinding::sampledTexture(6,QRhiShaderResourceBinding::FragmentStage, m_texture_height.get(), m_sampler.get()),
-        QRhiShaderResourceBinding::sampledTexture(7,QRhiShaderResourceBinding::FragmentStage, shadowmap, shadowsampler)
-    });
-
-    m_srb->create();
-
-    m_pipeline.reset(rhi->newGraphicsPipeline());
-    m_pipeline->setDepthTest(true);
-    m_pipeline->setDepthWrite(true);
-
-    // D3D12
-    m_pipeline->setTopology(QRhiGraphicsPipeline::Triangles);
-
-    m_pipeline->setShaderStages({
-        { QRhiShaderStage::Vertex, vs },
-        { QRhiShaderStage::Fragment, fs }
-    });
-
-    QRhiVertexInputLayout inputLayout;
-
-    inputLayout.setBindings({
-        { 14 * sizeof(float) }
-    });
+    // With a built MaterialAtlas every model binds the same arrays and only
+    // its layers differ, so all of them share one SRB. Otherwise models with
+    // the same textures end up with the same SRB. Either way the per-model
+    // uniforms are selected with a dynamic offset at bind time.
+    MaterialAtlas *atlas = MaterialAtlas::instance(rhi);
+    m_material = atlas->isReady() ? atlas->find(set) : -1;
+    if (atlas->isReady() && m_material < 0)
+        qWarning() << "Model: texture set not in the material atlas, the array shaders will sample layer 0";
+
+    if (atlas->isReady()) {
+        for (int s = 0; s < MaterialAtlas::SLOTS; ++s)
+            m_layers[s] = m_material < 0 ? 0.0f : float(atlas->layer(m_material, s));
+        m_srb = cache->srb(QVector<QRhiShaderResourceBinding>{
+            QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(0,QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage , m_uniforms->buffer(), sizeof(GpuUbo)),
+            QRhiShaderResourceBinding::sampledTexture(1,QRhiShaderResourceBinding::FragmentStage, atlas->texture(0), m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(2,QRhiShaderResourceBinding::FragmentStage, atlas->texture(1), m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(3,QRhiShaderResourceBinding::FragmentStage, atlas->texture(2), m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(7,QRhiShaderResourceBinding::FragmentStage, shadowmap, shadowsampler)
+        } + FrameUniforms::instance(rhi)->bindings());
+    } else {
+        loadTexture(rhi,QSize(), u,set.albedo,m_texture);
+        loadTexture(rhi,QSize(), u,set.normal,m_tex_norm,TextureOptions::normalMap());
+        loadTexture(rhi,QSize(), u,MaterialAtlas::ormPath(set),m_texture_orm);
+
+        m_srb = cache->srb(QVector<QRhiShaderResourceBinding>{
+            QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(0,QRhiShaderResourceBinding::VertexStage | QRhiShaderResourceBinding::FragmentStage , m_uniforms->buffer(), sizeof(GpuUbo)),
+            QRhiShaderResourceBinding::sampledTexture(1,QRhiShaderResourceBinding::FragmentStage, m_texture.get(), m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(2,QRhiShaderResourceBinding::FragmentStage, m_tex_norm.get(), m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(3,QRhiShaderResourceBinding::FragmentStage, m_texture_orm.get(), m_sampler),
+            QRhiShaderResourceBinding::sampledTexture(7,QRhiShaderResourceBinding::FragmentStage, shadowmap, shadowsampler)
+        } + FrameUniforms::instance(rhi)->bindings());
+    }
 
-    inputLayout.setAttributes({
-        { 0, 0, QRhiVertexInputAttribute::Float3, 0 },                    // pos
-        { 0, 1, QRhiVertexInputAttribute::Float3, 3 * sizeof(float) },    // normal
-        { 0, 2, QRhiVertexInputAttribute::Float2, 6 * sizeof(float) },    // uv
-        { 0, 3, QRhiVertexInputAttribute::Float3, 8 * sizeof(float) },    // tangent
-        { 0, 4, QRhiVertexInputAttribute::Float3, 11 * sizeof(float) }    // bitangent
+    // models using the same shaders share one pipeline, which lets sorted draws skip pipeline switches
+    m_pipeline = cache->pipeline({ vs, fs, rp, 0 }, [this](QRhiGraphicsPipeline *ps) {
+        ps->setDepthTest(true);
+        ps->setDepthWrite(true);
+
+        // D3D12
+        ps->setTopology(QRhiGraphicsPipeline::Triangles);
+
+        QRhiVertexInputLayout inputLayout;
+
+        inputLayout.setBindings({
+            { 14 * sizeof(float) }
+        });
+
+        inputLayout.setAttributes({
+            { 0, 0, QRhiVertexInputAttribute::Float3, 0 },                    // pos
+            { 0, 1, QRhiVertexInputAttribute::Float3, 3 * sizeof(float) },    // normal
+            { 0, 2, QRhiVertexInputAttribute::Float2, 6 * sizeof(float) },    // uv
+            { 0, 3, QRhiVertexInputAttribute::Float3, 8 * sizeof(float) },    // tangent
+            { 0, 4, QRhiVertexInputAttribute::Float3, 11 * sizeof(float) }    // bitangent
+        });
+        //ps->setCullMode(QRhiGraphicsPipeline::Back);
+        //ps->setDepthOp(QRhiGraphicsPipeline::LessOrEqual);
+        ps->setVertexInputLayout(inputLayout);
+        ps->setShaderResourceBindings(m_srb);
     });
-    //m_pipeline->setCullMode(QRhiGraphicsPipeline::Back);
-    m_pipeline->setDepthTest(true);
-    m_pipeline->setDepthWrite(true);
-    //m_pipeline->setDepthOp(QRhiGraphicsPipeline::LessOrEqual);
-    m_pipeline->setVertexInputLayout(inputLayout);
-    m_pipeline->setShaderResourceBindings(m_srb.get());
-    m_pipeline->setRenderPassDescriptor(rp);
-    m_pipeline->create();
+    ++m_revision;
 }
 
 inline void Model::updateUbo(Ubo ubo,QRhiResourceUpdateBatch *u)
@@ -246,7 +301,9 @@ inline void Model::updateUbo(Ubo ubo,QRhiResourceUpdateBatch *u)
     gpuUbo.misc[2] = ubo.misc.z();
     gpuUbo.misc[3] = ubo.misc.w();
 
-    u->updateDynamicBuffer(m_ubuf.get(), 0, sizeof(GpuUbo), &gpuUbo);
+    memcpy(gpuUbo.material, m_layers, sizeof(m_layers));
+
+    u->updateDynamicBuffer(m_uniforms->buffer(), m_uboOffset, sizeof(GpuUbo), &gpuUbo);
 
     //by offset
 
@@ -262,16 +319,17 @@ inline void Model::updateUbo(Ubo ubo,QRhiResourceUpdateBatch *u)
 
 }
 
-inline void Model::draw(QRhiCommandBuffer *cb)
+inline void Model::draw(CommandRecorder &cb)
 {
-    cb->setGraphicsPipeline(m_pipeline.get());
-    cb->setShaderResources(m_srb.get());
+    cb.setGraphicsPipeline(m_pipeline);
+    const QRhiCommandBuffer::DynamicOffset ubufOffset(0, m_uboOffset);
+    cb.setShaderResources(m_srb, 1, &ubufOffset);
     const QRhiCommandBuffer::VertexInput vbufBinding(m_vbuf.get(), 0);
-    cb->setVertexInput(0, 1, &vbufBinding, m_ibuf.get(), 0, QRhiCommandBuffer::IndexUInt16);
-    cb->drawIndexed(m_indexCount);
+    cb.setVertexInput(0, 1, &vbufBinding, m_ibuf.get(), 0, QRhiCommandBuffer::IndexUInt16);
+    cb.drawIndexed(m_indexCount);
 }
 
-inline void Model::updateShadowUbo(Ubo ubo, QRhiResourceUpdateBatch *u) {
+inline void Model::updateShadowUbo(Ubo ubo, QRhiResourceUpdateBatch *u, int view) {
 
     GpuUbo gpuUbo{};
     memcpy(gpuUbo.model, transform.getModelMatrix().constData(), 64);
@@ -284,58 +342,83 @@ inline void Model::updateShadowUbo(Ubo ubo, QRhiResourceUpdateBatch *u) {
     gpuUbo.lightPos[3] = 1.0f;
 
 
-    u->updateDynamicBuffer(m_shadowUbo.get(), 0, sizeof(GpuUbo), &gpuUbo);
+    u->updateDynamicBuffer(m_uniforms->buffer(), m_shadowUboOffsets[view], sizeof(GpuUbo), &gpuUbo);
 }
 
-inline void Model::DrawForShadow(QRhiCommandBuffer *cb,
+inline void Model::DrawForShadow(CommandRecorder &cb,
                           QRhiGraphicsPipeline *shadowPipeline,
                           Ubo ubo,
                           QRhiResourceUpdateBatch *u)
 {
 
-    cb->setGraphicsPipeline(shadowPipeline);
-    cb->setShaderResources(m_shadowSrb.get());
+    cb.setGraphicsPipeline(shadowPipeline);
+    const QRhiCommandBuffer::DynamicOffset ubufOffset(0, m_shadowUboOffsets[0]);
+    cb.setShaderResources(m_shadowSrb, 1, &ubufOffset);
     const QRhiCommandBuffer::VertexInput vbufBinding(m_vbuf.get(), 0);
-    cb->setVertexInput(0, 1, &vbufBinding, m_ibuf.get(), 0, QRhiCommandBuffer::IndexUInt16);
-    cb->drawIndexed(m_indexCount);
+    cb.setVertexInput(0, 1, &vbufBinding, m_ibuf.get(), 0, QRhiCommandBuffer::IndexUInt16);
+    cb.drawIndexed(m_indexCount);
 }
 
-inline void Model::loadTexture(QRhi *m_rhi,const QSize &, QRhiResourceUpdateBatch *u,QString tex_name,std::unique_ptr<QRhiTexture> &texture,
-                        std::unique_ptr<QRhiSampler> &sampler)
+inline void Model::collectPackets(DrawList &list, QRhiGraphicsPipeline *shadowPipeline) const
 {
-    if (texture)
-        return;
-
-    QImage image(tex_name);
-    if (image.isNull()) {
-        qWarning("Failed to texture. Using 64x64 checker fallback.");
-        image = QImage(64, 64, QImage::Format_RGBA8888);
-        image.fill(Qt::white);
-        for (int y = 0; y < 64; ++y)
-            for (int x = 0; x < 64; ++x)
-                if (((x / 8) + (y / 8)) & 1)
-                    image.setPixelColor(x, y, QColor(50, 50, 50));
-    } else {
-        image = image.convertToFormat(QImage::Format_RGBA8888);
+    DrawPacket packet;
+    packet.srb = m_srb;
+    packet.hasDynamicOffset = true;
+    packet.vbuf = m_vbuf.get();
+    packet.ibuf = m_ibuf.get();
+    packet.indexFormat = QRhiCommandBuffer::IndexUInt16;
+    packet.count = m_indexCount;
+    packet.origin = &transform.position;
+    packet.radius = m_radius * qMax(transform.scale.x(), qMax(transform.scale.y(), transform.scale.z()));
+
+    packet.pass = DrawPass::Opaque;
+    packet.pipeline = m_pipeline;
+    packet.dynamicOffset = m_uboOffset;
+    list.add(packet);
+
+    // one per shadow view, so each can be culled on its own
+    packet.pass = staticCaster ? DrawPass::StaticShadow : DrawPass::Shadow;
+    packet.pipeline = shadowPipeline;
+    packet.srb = m_shadowSrb;
+    for (int i = 0; i < SHADOW_VIEWS; ++i) {
+        packet.view = quint8(i);
+        packet.dynamicOffset = m_shadowUboOffsets[i];
+        list.add(packet);
     }
+}
 
-    if (m_rhi->isYUpInNDC())
-        image = image.flipped(Qt::Horizontal | Qt::Vertical); // UV invert
-    // .mirrored();
+inline void Model::loadTexture(QRhi *m_rhi,const QSize &, QRhiResourceUpdateBatch *u,QString tex_name,TextureCache::Handle &texture,
+                               const TextureOptions &options)
+{
+    if (texture)
+        return;
+    startup::Scope scope("Model::loadTexture");
 
-    int mipLevels = static_cast<int>(floor(log2(qMax(image.width(), image.height())))) + 1;
+    // cooked textures stream their mips, the rest is loaded whole; either way
+    // models sharing a TextureSet get the same textures
+    texture = TextureStreamer::instance(m_rhi)->load(tex_name, options);
+    if (!texture)
+        texture = TextureCache::instance(m_rhi)->load(tex_name, options, u);
+}
 
-    texture.reset(m_rhi->newTexture(QRhiTexture::RGBA8,
-                                    image.size(),
-                                    1,
-                                    QRhiTexture::Flags(QRhiTexture::MipMapped | QRhiTexture::UsedWithGenerateMips)));
-    texture->create();
-    u->uploadTexture(texture.get(), image);
-    u->generateMips(texture.get());
+inline void Model::requestTextureDetail(TextureStreamer *streamer, const QVector3D &eye, float focalPixels) const
+{
+    const float scale = qMax(transform.scale.x(), qMax(transform.scale.y(), transform.scale.z()));
+    const float radius = m_radius * scale;
+    const float distance = qMax(0.1f, (eye - transform.position).length() - radius);
+    const float uvPerUnit = m_uvSpan / (2.0f * radius);
+    for (const auto &tex : { m_texture, m_tex_norm, m_texture_orm })
+        streamer->request(tex.get(), uvPerUnit, focalPixels / distance);
+}
 
-    sampler.reset(m_rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::Linear,
-                                    QRhiSampler::Repeat, QRhiSampler::Repeat));
-    sampler->create();
+// All models share one shadow SRB; the depth pass selects each model's block by dynamic offset.
+inline QRhiShaderResourceBindings *Model::shadowSrb(QRhi *rhi)
+{
+    RhiResourceCache *cache = RhiResourceCache::instance(rhi);
+    return cache->srb({
+        QRhiShaderResourceBinding::uniformBufferWithDynamicOffset(0, QRhiShaderResourceBinding::VertexStage,
+                                                                  cache->uniformPool(sizeof(GpuUbo))->buffer(), sizeof(GpuUbo))
+    });
 }
 
 inline QVector<float> Model::computeTangents(const QVector<float>& vertices, const QVector<quint16>& indices)
@@ -0,0 +1,72 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Runs fn(i) for i in [0, count) on the pool. The calling thread takes part
+// in the work and only waits for items that helpers already claimed, so it is
+// safe to call from a task running on the same (possibly saturated) pool.
+template<typename Fn>
+inline void parallelFor(QThreadPool *pool, int count, Fn &&fn)
+{
+    if (count <= 0)
+        return;
+    if (count == 1 || !pool || pool->maxThreadCount() <= 1) {
+        for (int i = 0; i < count; ++i)
+            fn(i);
+        return;
+    }
+
+    struct State {
+        std::atomic<int> next{0};
+        std::atomic<int> done{0};
+        QMutex mutex;
+        QWaitCondition finished;
+    };
+    auto state = std::make_shared<State>();
+
+    // helpers never touch fn once every index is claimed, so a helper that
+    // starts after this function returned just exits
+    auto work = [state, count, &fn]() {
+        int i;
+        while ((i = state->next.fetch_add(1)) < count) {
+            fn(i);
+            if (state->done.fetch_add(1) + 1 == count) {
+                QMutexLocker lock(&state->mutex);
+                state->finished.wakeAll();
+            }
+        }
+    };
+
+    const int helpers = std::min(pool->maxThreadCount(), count) - 1;
+    for (int h = 0; h < helpers; ++h)
+        pool->start(work);
+    work();
+
+    QMutexLocker lock(&state->mutex);
+    while (state->done.load() < count)
+        state->finished.wait(&state->mutex);
+}
+
+// Splits [0, count) into contiguous chunks of at least minChunk items.
+template<typename Fn>
+inline void parallelForChunked(QThreadPool *pool, int count, int minChunk, Fn &&fn)
+{
+    if (count <= 0)
+        return;
+    const int workers = pool ? std::max(1, pool->maxThreadCount()) : 1;
+    const int chunk = std::max(minChunk, (count + workers * 4 - 1) / (workers * 4));
+    const int chunks = (count + chunk - 1) / chunk;
+    parallelFor(pool, chunks, [&](int c) {
+        const int begin = c * chunk;
+        fn(begin, std::min(count, begin + chunk));
+    });
+}
+
+#endif // PARALLEL_H
@@ -3,6 +3,9 @@
 
 
 #include <rhi/qrhi.h>
+#include "commandrecorder.h"
+#include "assetpack.h"
+#include "startupprofiler.h"
 #include <QVector4D>
 #include <memory> // Pro std::unique_ptr
 #include <QMatrix4x4>
@@ -78,9 +81,10 @@ public:
     }
     static QShader getShader(const QString &name)
     {
-        QFile f(name);
-        if (f.open(QIODevice::ReadOnly))
-            return QShader::fromSerialized(f.readAll());
+        startup::Scope scope("shader load");
+        const QByteArray data = qpak::read(name);
+        if (!data.isEmpty())
+            return QShader::fromSerialized(data);
         return QShader();
     }
 
@@ -109,12 +113,12 @@ public:
 
         batch->updateDynamicBuffer(m_ubo.get(), 0, sizeof(SkyUniforms), &gpuUbo);
     }
-    void draw(QRhiCommandBuffer *cb) {
+    void draw(CommandRecorder &cb) {
         if (!m_pipeline) return;
 
-        cb->setGraphicsPipeline(m_pipeline.get());
-        cb->setShaderResources(m_srb.get());
-        cb->draw(3);
+        cb.setGraphicsPipeline(m_pipeline.get());
+        cb.setShaderResources(m_srb.get());
+        cb.draw(3);
     }
 
 
@@ -0,0 +1 @@
+#include "qmesh.h"
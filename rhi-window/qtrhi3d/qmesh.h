@@ -0,0 +1,405 @@
+#ifndef QMESH_H
+#define QMESH_H
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QDebug>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Cooked mesh file (.qmesh), written offline by tools/qmeshcook and mapped
+// read-only at runtime. Little-endian, every section starts on a 16 byte
+// boundary:
+//
+//   Header
+//   Submesh[submeshCount]   vertex/index ranges, texture range, node transform
+//   Texture[textureCount]   material texture type + path relative to the file
+//   Node[nodeCount]         hierarchy in depth-first order, parent before child
+//   Bone[boneCount]         skin bones, id matches the vertex bone indices
+//   Channel[channelCount]   keyframe ranges per animated node, first animation only
+//   Key[keyCount]           keyframes of all channels
+//   strings                 names and paths, not null-terminated
+//   vertices                in GPU layout (see VertexLayout)
+//   indices                 uint32
+//
+// The header records size and modification time of the source file; a cooked
+// file that no longer matches its source is treated as missing.
+
+namespace qmesh {
+
+constexpr quint32 MAGIC = 0x48534D51; // "QMSH"
+constexpr quint32 VERSION = 2;
+constexpr quint32 ALIGNMENT = 16;
+
+enum class VertexLayout : quint32 {
+    Static = 0,  // position3, normal3, uv2                     (32 bytes)
+    Skinned = 1, // position3, normal3, uv2, int4 bones, float4 weights (64 bytes)
+};
+
+constexpr quint32 vertexStride(VertexLayout layout) { return layout == VertexLayout::Skinned ? 64 : 32; }
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    VertexLayout layout;
+    quint32 vertexStride;
+    quint64 sourceSize;
+    qint64 sourceModified; // ms since epoch
+    float boundsMin[3];
+    float boundsMax[3];
+    quint32 reserved[2];
+    quint32 submeshCount;
+    quint32 textureCount;
+    quint32 nodeCount;
+    quint32 boneCount;
+    quint64 submeshOffset;
+    quint64 textureOffset;
+    quint64 nodeOffset;
+    quint64 boneOffset;
+    quint64 stringOffset;
+    quint64 stringBytes;
+    quint64 vertexOffset;
+    quint64 vertexBytes;
+    quint64 indexOffset;
+    quint64 indexBytes;
+    double animationDuration; // ticks
+    double ticksPerSecond;
+    quint32 channelCount;
+    quint32 keyCount;
+    quint64 channelOffset;
+    quint64 keyOffset;
+    quint64 padding;
+};
+
+struct Submesh {
+    quint32 firstVertex;
+    quint32 vertexCount;
+    quint32 firstIndex;
+    quint32 indexCount;
+    quint32 firstTexture;
+    quint32 textureCount;
+    qint32 node;
+    quint32 reserved;
+    float transform[16]; // row-major, accumulated node transform
+    float boundsMin[3];
+    float boundsMax[3];
+    quint32 padding[2];
+};
+
+struct Texture {
+    quint32 type; // aiTextureType
+    quint32 pathOffset;
+    quint32 pathLength;
+    quint32 reserved;
+};
+
+struct Node {
+    quint32 nameOffset;
+    quint32 nameLength;
+    qint32 parent;
+    quint32 reserved;
+    float transform[16]; // row-major, local
+};
+
+struct Bone {
+    quint32 nameOffset;
+    quint32 nameLength;
+    qint32 id;
+    quint32 reserved;
+    float offset[16]; // row-major
+};
+
+// Keys of one node, as ranges of the Key table.
+struct Channel {
+    quint32 nameOffset;
+    quint32 nameLength;
+    quint32 firstPosition;
+    quint32 positionCount;
+    quint32 firstRotation;
+    quint32 rotationCount;
+    quint32 firstScale;
+    quint32 scaleCount;
+};
+
+struct Key {
+    double time;    // ticks
+    float value[4]; // position or scale xyz, rotation as w x y z
+    quint32 padding[2];
+};
+
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) % ALIGNMENT == 0);
+static_assert(sizeof(Submesh) % ALIGNMENT == 0 && sizeof(Texture) % ALIGNMENT == 0);
+static_assert(sizeof(Node) % ALIGNMENT == 0 && sizeof(Bone) % ALIGNMENT == 0);
+static_assert(sizeof(Channel) % ALIGNMENT == 0 && sizeof(Key) % ALIGNMENT == 0);
+
+inline QMatrix4x4 toMatrix(const float *m) { return QMatrix4x4(m); }
+inline void fromMatrix(const QMatrix4x4 &m, float *out) { m.copyDataTo(out); }
+
+// model.fbx -> model.qmesh / model.skinned.qmesh
+inline QString cookedPath(const QString &source, VertexLayout layout) {
+    const QFileInfo fi(source);
+    const QString suffix = layout == VertexLayout::Skinned ? QStringLiteral(".skinned.qmesh") : QStringLiteral(".qmesh");
+    return fi.dir().filePath(fi.completeBaseName() + suffix);
+}
+
+// Read-only mapping of a cooked file. Pointers returned by the accessors stay
+// valid for the lifetime of the object.
+class File {
+public:
+    // Returns null if the file is missing, malformed, of another version or
+    // layout, or older than source (when source exists).
+    static std::shared_ptr<File> open(const QString &path, VertexLayout layout, const QString &source = {}) {
+        auto f = std::shared_ptr<File>(new File(path));
+        if (!f->file_.open(QIODevice::ReadOnly))
+            return nullptr;
+        f->size_ = quint64(f->file_.size());
+        if (f->size_ < sizeof(Header))
+            return nullptr;
+        f->data_ = f->file_.map(0, qint64(f->size_));
+        if (!f->data_) {
+            qWarning() << "qmesh: cannot map" << path;
+            return nullptr;
+        }
+        if (!f->validate(layout)) {
+            qWarning() << "qmesh: invalid or outdated format" << path;
+            return nullptr;
+        }
+        if (!source.isEmpty() && !f->matchesSource(source))
+            return nullptr;
+        return f;
+    }
+
+    const Header &header() const { return *reinterpret_cast<const Header *>(data_); }
+    QString path() const { return file_.fileName(); }
+
+    const Submesh &submesh(quint32 i) const { return table<Submesh>(header().submeshOffset)[i]; }
+    const Texture &texture(quint32 i) const { return table<Texture>(header().textureOffset)[i]; }
+    const Node &node(quint32 i) const { return table<Node>(header().nodeOffset)[i]; }
+    const Bone &bone(quint32 i) const { return table<Bone>(header().boneOffset)[i]; }
+    const Channel &channel(quint32 i) const { return table<Channel>(header().channelOffset)[i]; }
+    const Key &key(quint32 i) const { return table<Key>(header().keyOffset)[i]; }
+
+    std::string_view string(quint32 offset, quint32 length) const {
+        return { reinterpret_cast<const char *>(data_ + header().stringOffset + offset), length };
+    }
+
+    const uchar *vertices(const Submesh &s) const {
+        return data_ + header().vertexOffset + quint64(s.firstVertex) * header().vertexStride;
+    }
+    const quint32 *indices(const Submesh &s) const {
+        return reinterpret_cast<const quint32 *>(data_ + header().indexOffset) + s.firstIndex;
+    }
+    quint32 vertexBytes(const Submesh &s) const { return s.vertexCount * header().vertexStride; }
+
+    QVector3D boundsMin() const { return { header().boundsMin[0], header().boundsMin[1], header().boundsMin[2] }; }
+    QVector3D boundsMax() const { return { header().boundsMax[0], header().boundsMax[1], header().boundsMax[2] }; }
+
+private:
+    explicit File(const QString &path) : file_(path) {}
+
+    template<typename T>
+    const T *table(quint64 offset) const { return reinterpret_cast<const T *>(data_ + offset); }
+
+    bool inRange(quint64 offset, quint64 bytes) const {
+        return offset % ALIGNMENT == 0 && offset <= size_ && bytes <= size_ - offset;
+    }
+
+    bool validate(VertexLayout layout) const {
+        const Header &h = header();
+        if (h.magic != MAGIC || h.version != VERSION || h.layout != layout || h.vertexStride != vertexStride(layout))
+            return false;
+        if (!inRange(h.submeshOffset, quint64(h.submeshCount) * sizeof(Submesh))
+            || !inRange(h.textureOffset, quint64(h.textureCount) * sizeof(Texture))
+            || !inRange(h.nodeOffset, quint64(h.nodeCount) * sizeof(Node))
+            || !inRange(h.boneOffset, quint64(h.boneCount) * sizeof(Bone))
+            || !inRange(h.channelOffset, quint64(h.channelCount) * sizeof(Channel))
+            || !inRange(h.keyOffset, quint64(h.keyCount) * sizeof(Key))
+            || !inRange(h.stringOffset, h.stringBytes)
+            || !inRange(h.vertexOffset, h.vertexBytes)
+            || !inRange(h.indexOffset, h.indexBytes))
+            return false;
+        for (quint32 i = 0; i < h.submeshCount; ++i) {
+            const Submesh &s = submesh(i);
+            if ((quint64(s.firstVertex) + s.vertexCount) * h.vertexStride > h.vertexBytes
+                || (quint64(s.firstIndex) + s.indexCount) * sizeof(quint32) > h.indexBytes
+                || quint64(s.firstTexture) + s.textureCount > h.textureCount)
+                return false;
+        }
+        for (quint32 i = 0; i < h.textureCount; ++i)
+            if (quint64(texture(i).pathOffset) + texture(i).pathLength > h.stringBytes)
+                return false;
+        for (quint32 i = 0; i < h.nodeCount; ++i)
+            if (quint64(node(i).nameOffset) + node(i).nameLength > h.stringBytes)
+                return false;
+        for (quint32 i = 0; i < h.boneCount; ++i)
+            if (quint64(bone(i).nameOffset) + bone(i).nameLength > h.stringBytes)
+                return false;
+        for (quint32 i = 0; i < h.channelCount; ++i) {
+            const Channel &c = channel(i);
+            if (quint64(c.nameOffset) + c.nameLength > h.stringBytes
+                || quint64(c.firstPosition) + c.positionCount > h.keyCount
+                || quint64(c.firstRotation) + c.rotationCount > h.keyCount
+                || quint64(c.firstScale) + c.scaleCount > h.keyCount)
+                return false;
+        }
+        return true;
+    }
+
+    bool matchesSource(const QString &source) const {
+        const QFileInfo fi(source);
+        if (!fi.exists())
+            return true; // shipped without the source asset
+        return quint64(fi.size()) == header().sourceSize
+               && fi.lastModified().toMSecsSinceEpoch() == header().sourceModified;
+    }
+
+    QFile file_;
+    uchar *data_ = nullptr;
+    quint64 size_ = 0;
+};
+
+// Builds a cooked file in memory; used by the offline cooker.
+class Writer {
+public:
+    explicit Writer(VertexLayout layout) : layout_(layout) {}
+
+    quint32 addString(std::string_view s) {
+        const quint32 offset = quint32(strings_.size());
+        strings_.insert(strings_.end(), s.begin(), s.end());
+        return offset;
+    }
+
+    // vertices must be in the writer's layout
+    void addSubmesh(Submesh submesh, const void *vertices, const std::vector<quint32> &indices) {
+        submesh.firstVertex = quint32(vertices_.size() / vertexStride(layout_));
+        submesh.firstIndex = quint32(indices_.size());
+        submesh.indexCount = quint32(indices.size());
+        const uchar *v = static_cast<const uchar *>(vertices);
+        vertices_.insert(vertices_.end(), v, v + quint64(submesh.vertexCount) * vertexStride(layout_));
+        indices_.insert(indices_.end(), indices.begin(), indices.end());
+        submeshes_.push_back(submesh);
+    }
+
+    quint32 addTexture(quint32 type, std::string_view path) {
+        textures_.push_back({ type, addString(path), quint32(path.size()), 0 });
+        return quint32(textures_.size() - 1);
+    }
+
+    qint32 addNode(std::string_view name, qint32 parent, const QMatrix4x4 &transform) {
+        Node n{ addString(name), quint32(name.size()), parent, 0, {} };
+        fromMatrix(transform, n.transform);
+        nodes_.push_back(n);
+        return qint32(nodes_.size() - 1);
+    }
+
+    void addBone(std::string_view name, qint32 id, const QMatrix4x4 &offset) {
+        Bone b{ addString(name), quint32(name.size()), id, 0, {} };
+        fromMatrix(offset, b.offset);
+        bones_.push_back(b);
+    }
+
+    void setAnimation(double duration, double ticksPerSecond) {
+        animationDuration_ = duration;
+        ticksPerSecond_ = ticksPerSecond;
+    }
+
+    void addChannel(std::string_view name, const std::vector<Key> &positions, const std::vector<Key> &rotations,
+                    const std::vector<Key> &scales) {
+        Channel c{ addString(name), quint32(name.size()), 0, 0, 0, 0, 0, 0 };
+        auto append = [this](const std::vector<Key> &keys, quint32 &first, quint32 &count) {
+            first = quint32(keys_.size());
+            count = quint32(keys.size());
+            keys_.insert(keys_.end(), keys.begin(), keys.end());
+        };
+        append(positions, c.firstPosition, c.positionCount);
+        append(rotations, c.firstRotation, c.rotationCount);
+        append(scales, c.firstScale, c.scaleCount);
+        channels_.push_back(c);
+    }
+
+    quint32 textureCount() const { return quint32(textures_.size()); }
+
+    void setBounds(const QVector3D &min, const QVector3D &max) {
+        for (int i = 0; i < 3; ++i) {
+            boundsMin_[i] = min[i];
+            boundsMax_[i] = max[i];
+        }
+    }
+
+    bool write(const QString &path, const QString &source) const {
+        Header h{};
+        h.magic = MAGIC;
+        h.version = VERSION;
+        h.layout = layout_;
+        h.vertexStride = vertexStride(layout_);
+        const QFileInfo fi(source);
+        h.sourceSize = quint64(fi.size());
+        h.sourceModified = fi.lastModified().toMSecsSinceEpoch();
+        std::memcpy(h.boundsMin, boundsMin_, sizeof(boundsMin_));
+        std::memcpy(h.boundsMax, boundsMax_, sizeof(boundsMax_));
+        h.submeshCount = quint32(submeshes_.size());
+        h.textureCount = quint32(textures_.size());
+        h.nodeCount = quint32(nodes_.size());
+        h.boneCount = quint32(bones_.size());
+        h.animationDuration = animationDuration_;
+        h.ticksPerSecond = ticksPerSecond_;
+        h.channelCount = quint32(channels_.size());
+        h.keyCount = quint32(keys_.size());
+
+        QByteArray out(sizeof(Header), '\0');
+        auto section = [&out](const void *data, quint64 bytes) {
+            out.append(QByteArray((ALIGNMENT - out.size() % ALIGNMENT) % ALIGNMENT, '\0'));
+            const quint64 offset = quint64(out.size());
+            out.append(static_cast<const char *>(data), qsizetype(bytes));
+            return offset;
+        };
+        h.submeshOffset = section(submeshes_.data(), submeshes_.size() * sizeof(Submesh));
+        h.textureOffset = section(textures_.data(), textures_.size() * sizeof(Texture));
+        h.nodeOffset = section(nodes_.data(), nodes_.size() * sizeof(Node));
+        h.boneOffset = section(bones_.data(), bones_.size() * sizeof(Bone));
+        h.channelOffset = section(channels_.data(), channels_.size() * sizeof(Channel));
+        h.keyOffset = section(keys_.data(), keys_.size() * sizeof(Key));
+        h.stringBytes = strings_.size();
+        h.stringOffset = section(strings_.data(), h.stringBytes);
+        h.vertexBytes = vertices_.size();
+        h.vertexOffset = section(vertices_.data(), h.vertexBytes);
+        h.indexBytes = indices_.size() * sizeof(quint32);
+        h.indexOffset = section(indices_.data(), h.indexBytes);
+        std::memcpy(out.data(), &h, sizeof(h));
+
+        QFile f(path);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(out) != out.size()) {
+            qWarning() << "qmesh: cannot write" << path << f.errorString();
+            return false;
+        }
+        return true;
+    }
+
+private:
+    VertexLayout layout_;
+    std::vector<Submesh> submeshes_;
+    std::vector<Texture> textures_;
+    std::vector<Node> nodes_;
+    std::vector<Bone> bones_;
+    std::vector<Channel> channels_;
+    std::vector<Key> keys_;
+    double animationDuration_ = 0;
+    double ticksPerSecond_ = 0;
+    std::vector<char> strings_;
+    std::vector<uchar> vertices_;
+    std::vector<quint32> indices_;
+    float boundsMin_[3] = {};
+    float boundsMax_[3] = {};
+};
+
+} // namespace qmesh
+
+#endif // QMESH_H
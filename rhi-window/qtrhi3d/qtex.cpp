@@ -0,0 +1 @@
+#include "qtex.h"
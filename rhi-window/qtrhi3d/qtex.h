@@ -0,0 +1,439 @@
+#ifndef QTEX_H
+#define QTEX_H
+
+#include "bcn.h"
+#include "parallel.h"
+
+#include <rhi/qrhi.h>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QStringList>
+#include <QDebug>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+// Cooked texture file (.qtex), written offline by tools/qtexcook:
+//
+//   Header
+//   Level[levelCount]   largest first, each level 16 byte aligned
+//   level data          bcn::Format blocks or R8/RG8/RGBA8 rows
+//
+// The whole mip chain is precomputed and the image is stored already turned
+// for backends with isYUpInNDC() (flag FlippedForYUp), matching what
+// Model::loadTexture does for PNGs. Other backends get the levels rotated on
+// load, which is a lossless block shuffle for all but the last few tiny mips.
+//
+// Supercompressed files (flag Supercompressed) store each level deflated,
+// with the block bytes split into planes first so endpoints and indices
+// compress separately. One such file serves every backend: File::transcode()
+// inflates the levels on worker threads and hands out blocks in the format
+// the GPU supports, or RGBA8 when it supports none of the BC formats.
+
+namespace qtex {
+
+constexpr quint32 MAGIC = 0x58455451; // "QTEX"
+constexpr quint32 VERSION = 2;
+constexpr quint32 ALIGNMENT = 16;
+
+enum Flag : quint32 {
+    FlippedForYUp = 1 << 0,
+    SrgbContent = 1 << 1, // colour data, mips were filtered in linear space
+    NormalMap = 1 << 2,   // BC5 / RG: z has to be rebuilt
+    Supercompressed = 1 << 3,
+};
+
+struct Header {
+    quint32 magic;
+    quint32 version;
+    bcn::Format format;
+    quint32 flags;
+    quint32 width;
+    quint32 height;
+    quint32 levelCount;
+    quint32 reserved;
+    quint64 sourceSize;
+    qint64 sourceModified; // ms since epoch
+};
+
+struct Level {
+    quint64 offset;
+    quint32 size;     // bytes stored in the file
+    quint32 width;
+    quint32 height;
+    quint32 rawSize;  // bytes after inflating, bcn::levelBytes()
+    quint32 reserved[2];
+};
+
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) % ALIGNMENT == 0);
+static_assert(sizeof(Level) % ALIGNMENT == 0);
+
+// Resources are looked up next to the executable:
+//   :/assets/textures/floor.png -> <app dir>/assets/textures/floor.qtex
+//   /some/dir/floor.png         -> /some/dir/floor.qtex
+inline QString cookedPath(const QString &source) {
+    QString path = source;
+    if (path.startsWith(QLatin1String(":/")))
+        path = QCoreApplication::applicationDirPath() + path.mid(1);
+    const QFileInfo fi(path);
+    return fi.dir().filePath(fi.completeBaseName() + QStringLiteral(".qtex"));
+}
+
+// What a file was cooked from. One image keeps its size and time stamp;
+// several images packed into one texture (TextureLoader's ORM maps) fold
+// theirs, in order, into FNV-1a hashes, so any of them changing shows.
+struct SourceStamp {
+    quint64 size = 0;
+    qint64 modified = 0;
+    bool found = false;    // some source exists
+    bool resource = false; // some source is a resource, without a usable time stamp
+};
+
+inline SourceStamp sourceStamp(const QStringList &sources) {
+    SourceStamp s;
+    quint64 sizes = 14695981039346656037ull;
+    quint64 times = sizes;
+    auto mix = [](quint64 &hash, quint64 value) {
+        for (int i = 0; i < 8; ++i) {
+            hash ^= (value >> (8 * i)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    };
+    for (const QString &source : sources) {
+        const QFileInfo fi(source);
+        const bool exists = !source.isEmpty() && fi.exists();
+        s.found |= exists;
+        s.resource |= source.startsWith(QLatin1Char(':'));
+        s.size = quint64(fi.size());
+        s.modified = fi.lastModified().toMSecsSinceEpoch();
+        mix(sizes, exists ? s.size : ~0ull);
+        mix(times, exists ? quint64(s.modified) : 0);
+    }
+    if (sources.size() > 1) {
+        s.size = sizes;
+        s.modified = qint64(times);
+    }
+    return s;
+}
+
+inline QRhiTexture::Format rhiFormat(bcn::Format f) {
+    switch (f) {
+    case bcn::Format::BC4: return QRhiTexture::BC4;
+    case bcn::Format::BC5: return QRhiTexture::BC5;
+    case bcn::Format::BC7: return QRhiTexture::BC7;
+    case bcn::Format::R8: return QRhiTexture::R8;
+    case bcn::Format::RG8: return QRhiTexture::RG8;
+    case bcn::Format::RGBA8: break;
+    }
+    return QRhiTexture::RGBA8;
+}
+
+// Byte planes: byte k of every block (or pixel) is stored contiguously.
+inline QByteArray pack(bcn::Format format, const std::vector<uint8_t> &data, int level = 9) {
+    const size_t stride = bcn::unitBytes(format);
+    const size_t count = data.size() / stride;
+    QByteArray planes(qsizetype(data.size()), Qt::Uninitialized);
+    for (size_t k = 0; k < stride; ++k)
+        for (size_t i = 0; i < count; ++i)
+            planes[qsizetype(k * count + i)] = char(data[i * stride + k]);
+    return qCompress(planes, level);
+}
+
+inline bool unpack(bcn::Format format, const uchar *src, quint32 size, std::vector<uint8_t> &out) {
+    const QByteArray planes = qUncompress(src, qsizetype(size));
+    if (size_t(planes.size()) != out.size())
+        return false;
+    const size_t stride = bcn::unitBytes(format);
+    const size_t count = out.size() / stride;
+    const uchar *p = reinterpret_cast<const uchar *>(planes.constData());
+    for (size_t k = 0; k < stride; ++k)
+        for (size_t i = 0; i < count; ++i)
+            out[i * stride + k] = p[k * count + i];
+    return true;
+}
+
+// What a QRhi can sample. Queried on the render thread and then handed by
+// value to the workers that transcode.
+struct Targets {
+    bool bc4 = false;
+    bool bc5 = false;
+    bool bc7 = false;
+    bool yUp = true;
+
+    static Targets query(QRhi *rhi) {
+        Targets t;
+        t.bc4 = rhi->isTextureFormatSupported(QRhiTexture::BC4);
+        t.bc5 = rhi->isTextureFormatSupported(QRhiTexture::BC5);
+        t.bc7 = rhi->isTextureFormatSupported(QRhiTexture::BC7);
+        t.yUp = rhi->isYUpInNDC();
+        QMutexLocker lock(&lastMutex());
+        last() = t;
+        return t;
+    }
+
+    // Result of the latest query(), for loaders that run before or away from
+    // the QRhi. Payload::createTexture() corrects a wrong guess.
+    static Targets current() {
+        QMutexLocker lock(&lastMutex());
+        return last();
+    }
+
+    bool supports(bcn::Format f) const {
+        switch (f) {
+        case bcn::Format::BC4: return bc4;
+        case bcn::Format::BC5: return bc5;
+        case bcn::Format::BC7: return bc7;
+        default: break;
+        }
+        return true;
+    }
+
+private:
+    static Targets &last() { static Targets t; return t; }
+    static QMutex &lastMutex() { static QMutex m; return m; }
+};
+
+class File;
+
+// Texture levels ready for upload. Built on any thread; only createTexture()
+// and upload() need the QRhi.
+struct Payload {
+    bcn::Format format = bcn::Format::RGBA8;
+    quint32 width = 0;
+    quint32 height = 0;
+    bool turned = false;    // levels are rotated by 180 degrees relative to the source
+    bool turnOnYUp = false; // the consumer wants them rotated on isYUpInNDC() backends
+    bool generateMips = false; // only the base level is here, the GPU fills in the rest
+    std::vector<std::vector<uint8_t>> levels;
+    // instead of levels: the cooked file a TextureStreamer loads them from on demand
+    std::shared_ptr<const File> stream;
+
+    bool isNull() const { return levels.empty() && !stream; }
+    QSize size() const { return QSize(int(width), int(height)); }
+
+    static Payload fromImage(const QImage &source) {
+        Payload p;
+        if (source.isNull())
+            return p;
+        const QImage image = source.convertToFormat(QImage::Format_RGBA8888);
+        p.width = quint32(image.width());
+        p.height = quint32(image.height());
+        p.levels.emplace_back(size_t(p.width) * p.height * 4);
+        for (quint32 y = 0; y < p.height; ++y)
+            memcpy(p.levels[0].data() + size_t(y) * p.width * 4, image.constScanLine(int(y)), size_t(p.width) * 4);
+        return p;
+    }
+
+    // Fixes up levels that were transcoded for other Targets than rhi's.
+    void prepare(QRhi *rhi) {
+        const bool wantTurned = turnOnYUp && rhi->isYUpInNDC();
+        const bool decode = !rhi->isTextureFormatSupported(rhiFormat(format));
+        quint32 w = width, h = height;
+        for (auto &level : levels) {
+            if (turned != wantTurned)
+                bcn::rotate180(format, level, w, h);
+            if (decode)
+                level = bcn::decode(format, level.data(), w, h);
+            w = qMax(1u, w / 2);
+            h = qMax(1u, h / 2);
+        }
+        turned = wantTurned;
+        if (decode)
+            format = bcn::Format::RGBA8;
+    }
+
+    QRhiTexture *createTexture(QRhi *rhi, QRhiTexture::Flags flags = {}) {
+        if (levels.empty())
+            return nullptr;
+        prepare(rhi);
+        if (levels.size() > 1)
+            flags |= QRhiTexture::MipMapped;
+        if (generateMips && !bcn::isCompressed(format))
+            flags |= QRhiTexture::MipMapped | QRhiTexture::UsedWithGenerateMips;
+        QRhiTexture *tex = rhi->newTexture(rhiFormat(format), size(), 1, flags);
+        if (!tex->create()) {
+            delete tex;
+            return nullptr;
+        }
+        return tex;
+    }
+
+    void upload(QRhiResourceUpdateBatch *u, QRhiTexture *tex) const {
+        QList<QRhiTextureUploadEntry> entries;
+        for (size_t i = 0; i < levels.size(); ++i)
+            entries.append(QRhiTextureUploadEntry(0, int(i), QRhiTextureSubresourceUploadDescription(
+                                                      levels[i].data(), quint32(levels[i].size()))));
+        QRhiTextureUploadDescription desc;
+        desc.setEntries(entries.cbegin(), entries.cend());
+        u->uploadTexture(tex, desc);
+        if (tex->flags().testFlag(QRhiTexture::UsedWithGenerateMips))
+            u->generateMips(tex);
+    }
+};
+
+class File {
+public:
+    // Returns null when the file is missing, malformed or does not match source.
+    static std::shared_ptr<File> open(const QString &path, const QString &source = {}) {
+        return open(path, source.isEmpty() ? QStringList() : QStringList{ source });
+    }
+
+    static std::shared_ptr<File> open(const QString &path, const QStringList &sources) {
+        auto f = std::shared_ptr<File>(new File(path));
+        if (!f->file_.open(QIODevice::ReadOnly) || f->file_.size() < qint64(sizeof(Header)))
+            return nullptr;
+        f->size_ = quint64(f->file_.size());
+        f->data_ = f->file_.map(0, f->file_.size());
+        if (!f->data_ || !f->validate()) {
+            qWarning() << "qtex: invalid or outdated format" << path;
+            return nullptr;
+        }
+        if (!sources.isEmpty() && !f->matchesSources(sources))
+            return nullptr;
+        return f;
+    }
+
+    const Header &header() const { return *reinterpret_cast<const Header *>(data_); }
+    const Level &level(quint32 i) const { return reinterpret_cast<const Level *>(data_ + sizeof(Header))[i]; }
+    const uchar *levelData(quint32 i) const { return data_ + level(i).offset; }
+    QSize size() const { return QSize(int(header().width), int(header().height)); }
+
+    // Inflates, rotates and, when targets lack the stored format, decodes
+    // every level; levels are processed in parallel on pool. turnOnYUp asks
+    // for the orientation Model::loadTexture uses, otherwise the source one.
+    // Levels finer than firstLevel are skipped.
+    Payload transcode(const Targets &targets, bool turnOnYUp, QThreadPool *pool = QThreadPool::globalInstance(),
+                      quint32 firstLevel = 0) const {
+        const Header &h = header();
+        firstLevel = qMin(firstLevel, h.levelCount - 1);
+        const bool stored = h.flags & FlippedForYUp;
+        const bool wanted = turnOnYUp && targets.yUp;
+        const bool decode = !targets.supports(h.format);
+
+        Payload p;
+        p.format = decode ? bcn::Format::RGBA8 : h.format;
+        p.width = level(firstLevel).width;
+        p.height = level(firstLevel).height;
+        p.turned = wanted;
+        p.turnOnYUp = turnOnYUp;
+        p.levels.resize(h.levelCount - firstLevel);
+        std::atomic<bool> ok{ true };
+        parallelFor(pool, int(h.levelCount - firstLevel), [&](int j) {
+            const quint32 i = firstLevel + quint32(j);
+            const Level &l = level(i);
+            std::vector<uint8_t> data(l.rawSize);
+            if (h.flags & Supercompressed) {
+                if (!unpack(h.format, levelData(i), l.size, data)) {
+                    ok = false;
+                    return;
+                }
+            } else {
+                memcpy(data.data(), levelData(i), l.size);
+            }
+            if (stored != wanted)
+                bcn::rotate180(h.format, data, l.width, l.height);
+            if (decode)
+                data = bcn::decode(h.format, data.data(), l.width, l.height);
+            p.levels[size_t(j)] = std::move(data);
+        });
+        if (!ok) {
+            qWarning() << "qtex: corrupt level data in" << file_.fileName();
+            return {};
+        }
+        return p;
+    }
+
+private:
+    explicit File(const QString &path) : file_(path) {}
+
+    bool validate() const {
+        const Header &h = header();
+        if (h.magic != MAGIC || h.version != VERSION || h.format > bcn::Format::RG8 || !h.width || !h.height
+            || !h.levelCount || h.levelCount > 32 || sizeof(Header) + quint64(h.levelCount) * sizeof(Level) > size_)
+            return false;
+        quint32 w = h.width, hh = h.height;
+        for (quint32 i = 0; i < h.levelCount; ++i) {
+            const Level &l = level(i);
+            if (l.width != w || l.height != hh || l.rawSize != bcn::levelBytes(h.format, w, hh)
+                || (!(h.flags & Supercompressed) && l.size != l.rawSize)
+                || l.offset % ALIGNMENT || l.offset > size_ || l.size > size_ - l.offset)
+                return false;
+            w = qMax(1u, w / 2);
+            hh = qMax(1u, hh / 2);
+        }
+        return true;
+    }
+
+    bool matchesSources(const QStringList &sources) const {
+        const SourceStamp stamp = sourceStamp(sources);
+        if (!stamp.found)
+            return true;
+        if (stamp.size != header().sourceSize)
+            return false;
+        // resources carry no usable time stamp, their size alone has to do
+        return stamp.resource || stamp.modified == header().sourceModified;
+    }
+
+    QFile file_;
+    uchar *data_ = nullptr;
+    quint64 size_ = 0;
+};
+
+// Serializes a finished mip chain; used by the offline cooker. With the
+// Supercompressed flag the levels are packed here.
+inline bool write(const QString &path, const QStringList &sources, bcn::Format format, quint32 flags,
+                  const std::vector<std::vector<uint8_t>> &levels, quint32 width, quint32 height) {
+    std::vector<QByteArray> stored(levels.size());
+    for (size_t i = 0; i < levels.size(); ++i)
+        stored[i] = flags & Supercompressed
+                        ? pack(format, levels[i])
+                        : QByteArray(reinterpret_cast<const char *>(levels[i].data()), qsizetype(levels[i].size()));
+
+    Header h{};
+    h.magic = MAGIC;
+    h.version = VERSION;
+    h.format = format;
+    h.flags = flags;
+    h.width = width;
+    h.height = height;
+    h.levelCount = quint32(levels.size());
+    const SourceStamp stamp = sourceStamp(sources);
+    h.sourceSize = stamp.size;
+    h.sourceModified = stamp.modified;
+
+    std::vector<Level> table(levels.size());
+    quint64 offset = sizeof(Header) + table.size() * sizeof(Level);
+    quint32 w = width, hh = height;
+    for (size_t i = 0; i < levels.size(); ++i) {
+        offset = (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+        table[i] = { offset, quint32(stored[i].size()), w, hh, quint32(levels[i].size()), {} };
+        offset += quint64(stored[i].size());
+        w = qMax(1u, w / 2);
+        hh = qMax(1u, hh / 2);
+    }
+
+    QByteArray out;
+    out.reserve(qsizetype(offset));
+    out.append(reinterpret_cast<const char *>(&h), sizeof(h));
+    out.append(reinterpret_cast<const char *>(table.data()), qsizetype(table.size() * sizeof(Level)));
+    for (size_t i = 0; i < levels.size(); ++i) {
+        out.append(QByteArray(qsizetype(table[i].offset) - out.size(), '\0'));
+        out.append(stored[i]);
+    }
+
+    QFile f(path);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || f.write(out) != out.size()) {
+        qWarning() << "qtex: cannot write" << path << f.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace qtex
+
+#endif // QTEX_H
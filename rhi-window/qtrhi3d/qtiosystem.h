@@ -0,0 +1,221 @@
+#ifndef QTIOSYSTEM_H
+#define QTIOSYSTEM_H
+
+#include "assetpack.h"
+
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <QBuffer>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QImageReader>
+#include <QResource>
+#include <QDebug>
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+// Assimp file access through Qt, so models and their textures can live in
+// .qrc, in a mounted asset pack (qpak) as well as on disk ("qrc:/x" and ":/x"
+// both name resources).
+// Files are memory mapped and resources use their registered data; assimp
+// reads straight from these without stdio buffering or copies. Only
+// compressed resources are inflated into memory first.
+// Install one per import with Importer::SetIOHandler(new QtIOSystem(...)).
+// The importer owns and deletes it. The Counters are shared, so the byte and
+// time totals survive the importer and can also include texture reads.
+
+class QtIOSystem : public Assimp::IOSystem {
+public:
+    struct Counters {
+        std::atomic<qint64> opens{0};
+        std::atomic<qint64> mappedBytes{0}; // served from a mapping or resource, no copy
+        std::atomic<qint64> copiedBytes{0}; // read or inflated into memory
+        std::atomic<qint64> readBytes{0};   // handed to the importer or decoder
+        std::atomic<qint64> ioUs{0};        // opening, mapping and reading
+
+        void dump(const char *what) const {
+            qDebug() << what << "I/O:" << opens.load() << "files," << mappedBytes.load() << "bytes mapped,"
+                     << copiedBytes.load() << "copied," << readBytes.load() << "read in" << ioUs.load() << "us";
+        }
+    };
+
+    // Read-only view of a whole file; keeps its QFile or inflated copy alive.
+    class Mapping {
+    public:
+        static std::shared_ptr<Mapping> open(const QString &path, Counters *counters = nullptr) {
+            QElapsedTimer timer;
+            timer.start();
+            auto m = std::shared_ptr<Mapping>(new Mapping);
+            const QString name = normalize(path);
+            const QByteArray packed = qpak::packed(name);
+            if (!packed.isNull()) {
+                m->packed_ = packed;
+                m->data_ = m->packed_.constData();
+                m->size_ = m->packed_.size();
+            } else if (name.startsWith(QLatin1Char(':'))) {
+                QResource resource(name);
+                if (!resource.isValid())
+                    return {};
+                if (resource.compressionAlgorithm() == QResource::NoCompression) {
+                    m->data_ = reinterpret_cast<const char *>(resource.data());
+                    m->size_ = resource.size();
+                } else {
+                    m->copy_ = resource.uncompressedData();
+                }
+            } else {
+                m->file_ = std::make_unique<QFile>(name);
+                if (!m->file_->open(QIODevice::ReadOnly))
+                    return {};
+                const qint64 size = m->file_->size();
+                if (const uchar *data = size ? m->file_->map(0, size) : nullptr) {
+                    m->data_ = reinterpret_cast<const char *>(data);
+                    m->size_ = size;
+                } else {
+                    m->copy_ = m->file_->readAll();
+                }
+            }
+            if (!m->copy_.isNull()) {
+                m->data_ = m->copy_.constData();
+                m->size_ = m->copy_.size();
+            }
+            if (counters) {
+                ++counters->opens;
+                (m->copy_.isNull() ? counters->mappedBytes : counters->copiedBytes) += m->size_;
+                counters->ioUs += timer.nsecsElapsed() / 1000;
+            }
+            return m;
+        }
+
+        const char *data() const { return data_; }
+        qint64 size() const { return size_; }
+        // no-copy QByteArray over the mapping, valid while this lives
+        QByteArray bytes() const { return QByteArray::fromRawData(data_, size_); }
+
+    private:
+        Mapping() = default;
+
+        std::unique_ptr<QFile> file_;
+        QByteArray packed_; // view of the pack, or inflated from it
+        QByteArray copy_;
+        const char *data_ = nullptr;
+        qint64 size_ = 0;
+    };
+
+    explicit QtIOSystem(std::shared_ptr<Counters> counters = std::make_shared<Counters>())
+        : counters_(std::move(counters)) {}
+
+    const std::shared_ptr<Counters> &counters() const { return counters_; }
+
+    bool Exists(const char *file) const override {
+        return exists(normalize(QString::fromUtf8(file)));
+    }
+
+    char getOsSeparator() const override { return '/'; }
+
+    Assimp::IOStream *Open(const char *file, const char *mode = "rb") override {
+        if (std::strchr(mode, 'w') || std::strchr(mode, 'a') || std::strchr(mode, '+'))
+            return nullptr; // importing only
+        auto mapping = Mapping::open(QString::fromUtf8(file), counters_.get());
+        return mapping ? new Stream(std::move(mapping), counters_.get()) : nullptr;
+    }
+
+    void Close(Assimp::IOStream *stream) override { delete stream; }
+
+    // "qrc:/x" as ":/x" and backslashes from Windows authored files as slashes.
+    static QString normalize(QString path) {
+        if (path.startsWith(QLatin1String("qrc:")))
+            path.remove(0, 3);
+        path.replace(QLatin1Char('\\'), QLatin1Char('/'));
+        return path;
+    }
+
+    // Texture path as found in a model under dir. Paths that do not exist,
+    // typically absolute ones from the authoring machine, fall back to the
+    // file name next to the model.
+    static std::string resolve(const std::string &dir, const std::string &texture) {
+        const QString name = normalize(QString::fromStdString(texture));
+        const QString base = normalize(QString::fromStdString(dir));
+        const bool absolute = name.startsWith(QLatin1Char(':')) || QFileInfo(name).isAbsolute();
+        QString path = absolute ? name : base + QLatin1Char('/') + name;
+        if (!exists(path)) {
+            const QString local = base + QLatin1Char('/') + name.section(QLatin1Char('/'), -1);
+            if (exists(local))
+                path = local;
+        }
+        return path.toStdString();
+    }
+
+    // Decodes an image from the same mappings assimp reads from.
+    static QImage readImage(const QString &path, Counters *counters = nullptr) {
+        const auto mapping = Mapping::open(path, counters);
+        if (!mapping)
+            return {};
+        QElapsedTimer timer;
+        timer.start();
+        QByteArray bytes = mapping->bytes();
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::ReadOnly);
+        QImageReader reader(&buffer, QFileInfo(path).suffix().toLatin1());
+        reader.setDecideFormatFromContent(true);
+        const QImage image = reader.read();
+        if (counters) {
+            counters->readBytes += mapping->size();
+            counters->ioUs += timer.nsecsElapsed() / 1000;
+        }
+        return image;
+    }
+
+private:
+    static bool exists(const QString &path) {
+        if (qpak::contains(path))
+            return true;
+        return path.startsWith(QLatin1Char(':')) ? QResource(path).isValid() : QFileInfo::exists(path);
+    }
+
+    class Stream : public Assimp::IOStream {
+    public:
+        Stream(std::shared_ptr<Mapping> mapping, Counters *counters)
+            : mapping_(std::move(mapping)), counters_(counters) {}
+
+        size_t Read(void *buffer, size_t size, size_t count) override {
+            if (!size || !count)
+                return 0;
+            const size_t available = size_t(mapping_->size()) - pos_;
+            const size_t items = qMin(count, available / size);
+            memcpy(buffer, mapping_->data() + pos_, items * size);
+            pos_ += items * size;
+            counters_->readBytes += qint64(items * size);
+            return items;
+        }
+
+        size_t Write(const void *, size_t, size_t) override { return 0; }
+
+        aiReturn Seek(size_t offset, aiOrigin origin) override {
+            const size_t size = size_t(mapping_->size());
+            size_t target = offset;
+            if (origin == aiOrigin_CUR)
+                target = pos_ + offset;
+            else if (origin == aiOrigin_END)
+                target = size - offset;
+            if (target > size)
+                return aiReturn_FAILURE;
+            pos_ = target;
+            return aiReturn_SUCCESS;
+        }
+
+        size_t Tell() const override { return pos_; }
+        size_t FileSize() const override { return size_t(mapping_->size()); }
+        void Flush() override {}
+
+    private:
+        std::shared_ptr<Mapping> mapping_;
+        Counters *counters_;
+        size_t pos_ = 0;
+    };
+
+    std::shared_ptr<Counters> counters_;
+};
+
+#endif // QTIOSYSTEM_H
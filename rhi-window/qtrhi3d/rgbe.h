@@ -0,0 +1,345 @@
+#ifndef RGBE_H
+#define RGBE_H
+
+#include <cstddef>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RGBE_SSE2 1
+#include <emmintrin.h>
+#if defined(__F16C__) || defined(__AVX2__)
+#define RGBE_F16C 1
+#include <immintrin.h>
+#endif
+#endif
+
+// Radiance .hdr (RGBE) decoding straight to RGBA16F.
+//
+// A file is a text header followed by one record per scanline: flat RGBE
+// pixels, old style RLE, or (almost always) new style RLE, where each of the
+// four channels is run length coded separately. Records carry no size, so
+// scanOffsets() walks the run headers once without producing pixels; after
+// that every row decodes on its own and callers spread row ranges over
+// threads. Rows are decoded into channel planes and converted 16 pixels per
+// SSE2 step (F16C when the compiler targets it), scalar elsewhere.
+
+namespace rgbe {
+
+struct Info {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    bool bottomUp = false; // "+Y h +X w": the first record is the bottom row
+    size_t dataOffset = 0;
+};
+
+// Parses the header and resolution line; only the two unrotated layouts are supported.
+inline bool parseHeader(const uint8_t *data, size_t size, Info &info)
+{
+    if (size < 2 || data[0] != '#' || data[1] != '?')
+        return false;
+    size_t p = 0;
+    auto line = [&](const char *&begin, size_t &length) {
+        begin = reinterpret_cast<const char *>(data + p);
+        const void *nl = memchr(data + p, '\n', size - p);
+        if (!nl)
+            return false;
+        length = size_t(static_cast<const uint8_t *>(nl) - (data + p));
+        p += length + 1;
+        return true;
+    };
+    const char *s;
+    size_t n;
+    for (;;) {
+        if (!line(s, n))
+            return false;
+        if (n == 0)
+            break;
+        static const char format[] = "FORMAT=";
+        if (n >= sizeof(format) - 1 && !memcmp(s, format, sizeof(format) - 1)) {
+            static const char rgbe[] = "32-bit_rle_rgbe";
+            if (n < sizeof(format) - 1 + sizeof(rgbe) - 1 || memcmp(s + sizeof(format) - 1, rgbe, sizeof(rgbe) - 1))
+                return false;
+        }
+    }
+    if (!line(s, n) || n < 4 || n > 64)
+        return false;
+    char res[65];
+    memcpy(res, s, n);
+    res[n] = 0;
+    char ySign = 0;
+    unsigned h = 0, w = 0;
+    if (sscanf(res, "%cY %u +X %u", &ySign, &h, &w) != 3 || (ySign != '-' && ySign != '+'))
+        return false;
+    if (w == 0 || h == 0 || w > 65536 || h > 65536)
+        return false;
+    info.width = w;
+    info.height = h;
+    info.bottomUp = ySign == '+';
+    info.dataOffset = p;
+    return true;
+}
+
+inline bool isNewRle(const uint8_t *p, const uint8_t *end, uint32_t width)
+{
+    return width >= 8 && width < 32768 && end - p >= 4 && p[0] == 2 && p[1] == 2 && !(p[2] & 0x80);
+}
+
+// Start of every record plus the end of the last one (height + 1 entries),
+// in file order. Fails on truncated or malformed data.
+inline bool scanOffsets(const uint8_t *data, size_t size, const Info &info, std::vector<size_t> &offsets)
+{
+    offsets.resize(size_t(info.height) + 1);
+    const uint8_t *p = data + info.dataOffset;
+    const uint8_t *end = data + size;
+    for (uint32_t y = 0; y < info.height; ++y) {
+        offsets[y] = size_t(p - data);
+        if (isNewRle(p, end, info.width)) {
+            if (((uint32_t(p[2]) << 8) | p[3]) != info.width)
+                return false;
+            p += 4;
+            for (int c = 0; c < 4; ++c) {
+                for (uint32_t x = 0; x < info.width;) {
+                    if (p >= end)
+                        return false;
+                    const uint8_t code = *p++;
+                    const uint32_t count = code > 128 ? code - 128u : code;
+                    if (count == 0 || x + count > info.width)
+                        return false;
+                    p += code > 128 ? 1 : count;
+                    x += count;
+                }
+            }
+            if (p > end)
+                return false;
+            continue;
+        }
+        // flat or old RLE: (1, 1, 1, n) repeats the previous pixel, consecutive runs scale by 256
+        int shift = 0;
+        for (uint32_t x = 0; x < info.width;) {
+            if (end - p < 4)
+                return false;
+            if (p[0] == 1 && p[1] == 1 && p[2] == 1) {
+                if (x == 0 || shift > 16)
+                    return false;
+                x += uint32_t(p[3]) << shift;
+                shift += 8;
+            } else {
+                ++x;
+                shift = 0;
+            }
+            p += 4;
+        }
+    }
+    offsets[info.height] = size_t(p - data);
+    return true;
+}
+
+// Decodes the record [p, end) into four planes of width bytes (r, g, b, e).
+inline bool decodeRecord(const uint8_t *p, const uint8_t *end, uint32_t width, uint8_t *planes)
+{
+    if (isNewRle(p, end, width)) {
+        p += 4;
+        for (int c = 0; c < 4; ++c) {
+            uint8_t *out = planes + size_t(c) * width;
+            for (uint32_t x = 0; x < width;) {
+                if (p >= end)
+                    return false;
+                const uint8_t code = *p++;
+                if (code > 128) {
+                    const uint32_t count = code - 128u;
+                    if (p >= end || x + count > width)
+                        return false;
+                    memset(out + x, *p++, count);
+                    x += count;
+                } else {
+                    if (code == 0 || x + code > width || size_t(end - p) < code)
+                        return false;
+                    memcpy(out + x, p, code);
+                    p += code;
+                    x += code;
+                }
+            }
+        }
+        return true;
+    }
+    int shift = 0;
+    for (uint32_t x = 0; x < width;) {
+        if (end - p < 4)
+            return false;
+        if (p[0] == 1 && p[1] == 1 && p[2] == 1) {
+            const uint32_t count = uint32_t(p[3]) << shift;
+            if (x == 0 || x + count > width)
+                return false;
+            for (int c = 0; c < 4; ++c)
+                memset(planes + size_t(c) * width + x, planes[size_t(c) * width + x - 1], count);
+            x += count;
+            shift += 8;
+        } else {
+            for (int c = 0; c < 4; ++c)
+                planes[size_t(c) * width + x] = p[c];
+            ++x;
+            shift = 0;
+        }
+        p += 4;
+    }
+    return true;
+}
+
+// Round to nearest even, like F16C; inputs are never negative or NaN.
+inline uint16_t floatToHalf(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, 4);
+    if (u >= (127u + 16) << 23) // rounds to infinity
+        return 0x7c00;
+    if (u < (127u - 14) << 23) { // subnormal half: let the float adder round the mantissa off
+        const uint32_t magicBits = ((127u - 15) + (23 - 10) + 1) << 23;
+        float magic;
+        memcpy(&magic, &magicBits, 4);
+        const float sum = f + magic;
+        memcpy(&u, &sum, 4);
+        return uint16_t(u - magicBits);
+    }
+    u += (uint32_t(15 - 127) << 23) + 0xfff + ((u >> 13) & 1);
+    return uint16_t(u >> 13);
+}
+
+inline float halfToFloat(uint16_t h)
+{
+    const uint32_t sign = uint32_t(h & 0x8000) << 16;
+    const uint32_t exponent = (h >> 10) & 0x1f;
+    const uint32_t mantissa = h & 0x3ff;
+    uint32_t u;
+    if (exponent == 0x1f) {
+        u = sign | 0x7f800000u | (mantissa << 13);
+    } else if (exponent == 0) {
+        const float f = float(mantissa) * 5.96046448e-8f; // 2^-24
+        memcpy(&u, &f, 4);
+        u |= sign;
+    } else {
+        u = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    }
+    float f;
+    memcpy(&f, &u, 4);
+    return f;
+}
+
+// m * 2^(e - 136), the value stb_image and the Radiance reference decoders produce.
+inline float toFloat(uint8_t m, uint8_t e)
+{
+    if (e <= 9) // below the smallest normal float, and far below half precision
+        return 0.0f;
+    const uint32_t bits = uint32_t(e - 9) << 23;
+    float scale;
+    memcpy(&scale, &bits, 4);
+    return float(m) * scale;
+}
+
+#if RGBE_SSE2
+// Four floats to halves in the low 16 bits of each 32-bit lane.
+inline __m128i halves(__m128 f)
+{
+#if RGBE_F16C
+    return _mm_unpacklo_epi16(_mm_cvtps_ph(f, _MM_FROUND_TO_NEAREST_INT), _mm_setzero_si128());
+#else
+    // same steps as floatToHalf()
+    const __m128i bits = _mm_castps_si128(f);
+    const __m128i magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+    const __m128i subnormal = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(f, _mm_castsi128_ps(magic))), magic);
+    const __m128i odd = _mm_srai_epi32(_mm_slli_epi32(bits, 31 - 13), 31);
+    const __m128i rounded = _mm_sub_epi32(_mm_add_epi32(bits, _mm_set1_epi32(0xfff - ((127 - 15) << 23))), odd);
+    const __m128i normal = _mm_srli_epi32(rounded, 13);
+    const __m128i isSubnormal = _mm_cmpgt_epi32(_mm_set1_epi32((127 - 14) << 23), bits);
+    const __m128i isFinite = _mm_cmpgt_epi32(_mm_set1_epi32((127 + 16) << 23), bits);
+    const __m128i h = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+    return _mm_or_si128(_mm_and_si128(isFinite, h), _mm_andnot_si128(isFinite, _mm_set1_epi32(0x7c00)));
+#endif
+}
+
+// Halves in the low 16 bits of each 32-bit lane to floats (not negative, as everywhere here).
+inline __m128 floats(__m128i h)
+{
+#if RGBE_F16C
+    return _mm_cvtph_ps(_mm_packs_epi32(h, h));
+#else
+    const __m128i expMantissa = _mm_and_si128(h, _mm_set1_epi32(0x7fff));
+    const __m128i sign = _mm_slli_epi32(_mm_xor_si128(h, expMantissa), 16);
+    // 2^112 rebiases the exponent, denormal halves come out as normal floats
+    const __m128 scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(expMantissa, 13)),
+                                     _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+    const __m128i infNan = _mm_and_si128(_mm_cmpgt_epi32(expMantissa, _mm_set1_epi32(0x7bff)), _mm_set1_epi32(255 << 23));
+    return _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan)));
+#endif
+}
+
+// 4 mantissas and their exponents (32-bit lanes) to halves.
+inline __m128i channelHalves(__m128i m, __m128i scale)
+{
+    return halves(_mm_mul_ps(_mm_cvtepi32_ps(m), _mm_castsi128_ps(scale)));
+}
+#endif
+
+// One row of planes to RGBA16F, alpha 1.
+inline void planesToHalf(const uint8_t *planes, uint32_t width, uint16_t *out)
+{
+    const uint8_t *r = planes, *g = planes + width, *b = planes + 2 * size_t(width), *e = planes + 3 * size_t(width);
+    uint32_t x = 0;
+#if RGBE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i nine = _mm_set1_epi32(9);
+    const __m128i alpha = _mm_set1_epi32(0x3c00 << 16);
+    auto widen = [&](const uint8_t *plane, __m128i lanes[4]) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(plane));
+        const __m128i lo = _mm_unpacklo_epi8(bytes, zero), hi = _mm_unpackhi_epi8(bytes, zero);
+        lanes[0] = _mm_unpacklo_epi16(lo, zero);
+        lanes[1] = _mm_unpackhi_epi16(lo, zero);
+        lanes[2] = _mm_unpacklo_epi16(hi, zero);
+        lanes[3] = _mm_unpackhi_epi16(hi, zero);
+    };
+    for (; x + 16 <= width; x += 16) {
+        __m128i rv[4], gv[4], bv[4], ev[4];
+        widen(r + x, rv);
+        widen(g + x, gv);
+        widen(b + x, bv);
+        widen(e + x, ev);
+        for (int q = 0; q < 4; ++q) {
+            const __m128i valid = _mm_cmpgt_epi32(ev[q], nine);
+            const __m128i scale = _mm_and_si128(_mm_slli_epi32(_mm_sub_epi32(ev[q], nine), 23), valid);
+            const __m128i rg = _mm_or_si128(channelHalves(rv[q], scale), _mm_slli_epi32(channelHalves(gv[q], scale), 16));
+            const __m128i ba = _mm_or_si128(channelHalves(bv[q], scale), alpha);
+            __m128i *dst = reinterpret_cast<__m128i *>(out + (size_t(x) + q * 4) * 4);
+            _mm_storeu_si128(dst, _mm_unpacklo_epi32(rg, ba));
+            _mm_storeu_si128(dst + 1, _mm_unpackhi_epi32(rg, ba));
+        }
+    }
+#endif
+    for (; x < width; ++x) {
+        uint16_t *px = out + size_t(x) * 4;
+        px[0] = floatToHalf(toFloat(r[x], e[x]));
+        px[1] = floatToHalf(toFloat(g[x], e[x]));
+        px[2] = floatToHalf(toFloat(b[x], e[x]));
+        px[3] = 0x3c00;
+    }
+}
+
+// Decodes records [first, last) (file order) as RGBA16F rows of stride bytes
+// into out, which holds the whole image, bottom row first when bottomUp.
+inline bool decodeRows(const uint8_t *data, const Info &info, const std::vector<size_t> &offsets, uint32_t first,
+                       uint32_t last, uint8_t *out, size_t stride, bool bottomUp)
+{
+    std::vector<uint8_t> planes(size_t(info.width) * 4);
+    for (uint32_t y = first; y < last; ++y) {
+        if (!decodeRecord(data + offsets[y], data + offsets[y + 1], info.width, planes.data()))
+            return false;
+        const uint32_t row = info.bottomUp == bottomUp ? y : info.height - 1 - y;
+        planesToHalf(planes.data(), info.width, reinterpret_cast<uint16_t *>(out + row * stride));
+    }
+    return true;
+}
+
+} // namespace rgbe
+
+#endif // RGBE_H
@@ -0,0 +1 @@
+#include "rhicache.h"
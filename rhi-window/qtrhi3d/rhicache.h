@@ -0,0 +1,241 @@
+#ifndef RHICACHE_H
+#define RHICACHE_H
+
+#include <rhi/qrhi.h>
+#include <QHash>
+#include <QDebug>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+// Deduplicates driver objects per QRhi: identical samplers, shader resource
+// bindings and graphics pipelines are created once and shared. The cache owns
+// everything it hands out and releases it from the QRhi cleanup callback,
+// so callers only keep raw pointers. SRBs are keyed on the raw resource
+// pointers they bind, so releaseTexture() must drop them when a texture goes.
+
+struct SamplerKey {
+    QRhiSampler::Filter magFilter = QRhiSampler::Linear;
+    QRhiSampler::Filter minFilter = QRhiSampler::Linear;
+    QRhiSampler::Filter mipmapMode = QRhiSampler::Linear;
+    QRhiSampler::AddressMode addressU = QRhiSampler::Repeat;
+    QRhiSampler::AddressMode addressV = QRhiSampler::Repeat;
+    QRhiSampler::AddressMode addressW = QRhiSampler::Repeat;
+    QRhiSampler::CompareOp compareOp = QRhiSampler::Never;
+
+    bool operator==(const SamplerKey &o) const {
+        return magFilter == o.magFilter && minFilter == o.minFilter && mipmapMode == o.mipmapMode
+               && addressU == o.addressU && addressV == o.addressV && addressW == o.addressW
+               && compareOp == o.compareOp;
+    }
+};
+
+struct SamplerKeyHash {
+    size_t operator()(const SamplerKey &k) const noexcept {
+        return qHashMulti(0, int(k.magFilter), int(k.minFilter), int(k.mipmapMode),
+                          int(k.addressU), int(k.addressV), int(k.addressW), int(k.compareOp));
+    }
+};
+
+struct SrbKeyHash {
+    size_t operator()(const QVector<QRhiShaderResourceBinding> &b) const noexcept {
+        return qHashRange(b.cbegin(), b.cend());
+    }
+};
+
+// Pipelines are keyed by their shaders and render pass; `variant` is a
+// caller-defined value that must differ whenever the fixed-function state
+// set up for the same shaders differs.
+struct PipelineKey {
+    QShader vertex;
+    QShader fragment;
+    QRhiRenderPassDescriptor *renderPass = nullptr;
+    quint32 variant = 0;
+
+    bool operator==(const PipelineKey &o) const {
+        return renderPass == o.renderPass && variant == o.variant && vertex == o.vertex && fragment == o.fragment;
+    }
+};
+
+struct PipelineKeyHash {
+    size_t operator()(const PipelineKey &k) const noexcept {
+        return qHashMulti(0, k.vertex, k.fragment, k.renderPass, k.variant);
+    }
+};
+
+// One dynamic uniform buffer split into equally sized, aligned blocks.
+// Objects get a block offset instead of their own QRhiBuffer, which lets
+// their SRBs reference the same buffer (through a dynamic offset) and be shared.
+class UniformBufferPool {
+public:
+    UniformBufferPool(QRhi *rhi, quint32 blockSize)
+        : blockSize_(blockSize), stride_(rhi->ubufAligned(blockSize)) {
+        buf_.reset(rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, capacity_ * stride_));
+        buf_->create();
+    }
+
+    // Blocks are never returned; objects using the pool live as long as the scene.
+    quint32 allocate() {
+        const quint32 offset = used_ * stride_;
+        if (++used_ > capacity_) {
+            capacity_ *= 2;
+            buf_->setSize(capacity_ * stride_); // SRBs pick up the rebuilt buffer on next bind
+            buf_->create();
+        }
+        return offset;
+    }
+
+    QRhiBuffer *buffer() const { return buf_.get(); }
+    quint32 blockSize() const { return blockSize_; }
+    quint32 stride() const { return stride_; }
+    quint32 blockCount() const { return used_; }
+
+private:
+    quint32 blockSize_;
+    quint32 stride_;
+    quint32 used_ = 0;
+    quint32 capacity_ = 64;
+    std::unique_ptr<QRhiBuffer> buf_;
+};
+
+class RhiResourceCache {
+public:
+    struct Stats {
+        int samplerHits = 0;
+        int samplerCreated = 0;
+        int srbHits = 0;
+        int srbCreated = 0;
+        int srbReleased = 0;
+        int pipelineHits = 0;
+        int pipelineCreated = 0;
+    };
+
+    static RhiResourceCache *instance(QRhi *rhi) {
+        if (RhiResourceCache *c = caches().value(rhi))
+            return c;
+        auto *c = new RhiResourceCache(rhi);
+        caches().insert(rhi, c);
+        rhi->addCleanupCallback([](QRhi *r) { delete caches().take(r); });
+        return c;
+    }
+
+    // Null once rhi was cleaned up; for texture deleters that may run later.
+    static RhiResourceCache *existing(QRhi *rhi) { return caches().value(rhi); }
+
+    QRhiSampler *sampler(const SamplerKey &key) {
+        auto it = samplers_.find(key);
+        if (it != samplers_.end()) {
+            ++stats_.samplerHits;
+            return it->second.get();
+        }
+        std::unique_ptr<QRhiSampler> s(rhi_->newSampler(key.magFilter, key.minFilter, key.mipmapMode,
+                                                         key.addressU, key.addressV, key.addressW));
+        s->setTextureCompareOp(key.compareOp);
+        if (!s->create())
+            qWarning("RhiResourceCache: failed to create sampler");
+        ++stats_.samplerCreated;
+        return samplers_.emplace(key, std::move(s)).first->second.get();
+    }
+
+    QRhiShaderResourceBindings *srb(const QVector<QRhiShaderResourceBinding> &bindings) {
+        auto it = srbs_.find(bindings);
+        if (it != srbs_.end()) {
+            ++stats_.srbHits;
+            return it->second.get();
+        }
+        std::unique_ptr<QRhiShaderResourceBindings> srb(rhi_->newShaderResourceBindings());
+        srb->setBindings(bindings.cbegin(), bindings.cend());
+        if (!srb->create())
+            qWarning("RhiResourceCache: failed to create shader resource bindings");
+        ++stats_.srbCreated;
+        return srbs_.emplace(bindings, std::move(srb)).first->second.get();
+    }
+
+    // Drops every SRB binding texture. Whoever still binds one of them holds
+    // the texture too, so call it when the texture is destroyed.
+    void releaseTexture(const QRhiTexture *texture) {
+        for (auto it = srbs_.begin(); it != srbs_.end();) {
+            if (binds(it->first, texture)) {
+                it = srbs_.erase(it);
+                ++stats_.srbReleased;
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    // setup is only called on a miss; it configures everything but the render pass.
+    QRhiGraphicsPipeline *pipeline(const PipelineKey &key, const std::function<void(QRhiGraphicsPipeline *)> &setup) {
+        auto it = pipelines_.find(key);
+        if (it != pipelines_.end()) {
+            ++stats_.pipelineHits;
+            return it->second.get();
+        }
+        std::unique_ptr<QRhiGraphicsPipeline> ps(rhi_->newGraphicsPipeline());
+        ps->setShaderStages({
+            { QRhiShaderStage::Vertex, key.vertex },
+            { QRhiShaderStage::Fragment, key.fragment }
+        });
+        ps->setRenderPassDescriptor(key.renderPass);
+        setup(ps.get());
+        if (!ps->create())
+            qWarning("RhiResourceCache: failed to create graphics pipeline");
+        ++stats_.pipelineCreated;
+        return pipelines_.emplace(key, std::move(ps)).first->second.get();
+    }
+
+    UniformBufferPool *uniformPool(quint32 blockSize) {
+        auto &pool = pools_[blockSize];
+        if (!pool)
+            pool = std::make_unique<UniformBufferPool>(rhi_, blockSize);
+        return pool.get();
+    }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "RhiResourceCache: samplers" << stats_.samplerCreated << "created," << stats_.samplerHits << "shared;"
+                 << "srbs" << stats_.srbCreated << "created," << stats_.srbHits << "shared," << stats_.srbReleased << "released;"
+                 << "pipelines" << stats_.pipelineCreated << "created," << stats_.pipelineHits << "shared";
+    }
+
+private:
+    explicit RhiResourceCache(QRhi *rhi) : rhi_(rhi) {}
+
+    static QHash<QRhi *, RhiResourceCache *> &caches() {
+        static QHash<QRhi *, RhiResourceCache *> c;
+        return c;
+    }
+
+    static bool binds(const QVector<QRhiShaderResourceBinding> &bindings, const QRhiTexture *texture) {
+        for (const QRhiShaderResourceBinding &b : bindings) {
+            const QRhiShaderResourceBinding::Data *d = b.data();
+            switch (d->type) {
+            case QRhiShaderResourceBinding::SampledTexture:
+            case QRhiShaderResourceBinding::Texture:
+                for (int i = 0; i < d->u.stex.count; ++i)
+                    if (d->u.stex.texSamplers[i].tex == texture)
+                        return true;
+                break;
+            case QRhiShaderResourceBinding::ImageLoad:
+            case QRhiShaderResourceBinding::ImageStore:
+            case QRhiShaderResourceBinding::ImageLoadStore:
+                if (d->u.simage.tex == texture)
+                    return true;
+                break;
+            default:
+                break;
+            }
+        }
+        return false;
+    }
+
+    QRhi *rhi_;
+    Stats stats_;
+    std::unordered_map<SamplerKey, std::unique_ptr<QRhiSampler>, SamplerKeyHash> samplers_;
+    std::unordered_map<QVector<QRhiShaderResourceBinding>, std::unique_ptr<QRhiShaderResourceBindings>, SrbKeyHash> srbs_;
+    std::unordered_map<PipelineKey, std::unique_ptr<QRhiGraphicsPipeline>, PipelineKeyHash> pipelines_;
+    std::unordered_map<quint32, std::unique_ptr<UniformBufferPool>> pools_;
+};
+
+#endif // RHICACHE_H
@@ -0,0 +1,535 @@
+#ifndef SHADOWATLAS_H
+#define SHADOWATLAS_H
+
+#include "assetpack.h"
+#include "cascadedshadows.h"
+#include "commandrecorder.h"
+#include "drawlist.h"
+#include "rhicache.h"
+#include "startupprofiler.h"
+
+#include <rhi/qrhi.h>
+#include <QHash>
+#include <QMatrix4x4>
+#include <QRect>
+#include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+// Square power of two tiles in a square area, kept as a quadtree. A tile is
+// a free leaf of its size; leaves in already split nodes are used before a
+// larger free leaf is split, and release() merges four free siblings back.
+class QuadTreeAllocator {
+public:
+    void reset(int size, int minSize) {
+        nodes_.clear();
+        freeBlocks_.clear();
+        minSize_ = minSize;
+        usedArea_ = 0;
+        nodes_.push_back({ 0, 0, size });
+    }
+
+    // An empty rect when no free square of that size is left.
+    QRect allocate(int size) {
+        if (nodes_.empty() || size < minSize_ || size > nodes_[0].size)
+            return {};
+        int n = find(0, size, false);
+        if (n < 0)
+            n = find(0, size, true);
+        if (n < 0)
+            return {};
+        nodes_[size_t(n)].used = true;
+        usedArea_ += qint64(size) * size;
+        return QRect(nodes_[size_t(n)].x, nodes_[size_t(n)].y, size, size);
+    }
+
+    void release(const QRect &rect) {
+        if (!nodes_.empty() && !rect.isEmpty())
+            release(0, rect);
+    }
+
+    qint64 usedArea() const { return usedArea_; }
+
+private:
+    struct Node {
+        int x = 0, y = 0, size = 0;
+        int children = -1; // first of four, -1 for a leaf
+        bool used = false;
+    };
+
+    // split: whether free leaves larger than size may be split
+    int find(int i, int size, bool split) {
+        if (nodes_[size_t(i)].used)
+            return -1;
+        if (nodes_[size_t(i)].size == size)
+            return nodes_[size_t(i)].children < 0 ? i : -1;
+        if (nodes_[size_t(i)].children < 0) {
+            if (!split)
+                return -1;
+            splitNode(i);
+        }
+        for (int c = 0; c < 4; ++c) {
+            const int r = find(nodes_[size_t(i)].children + c, size, split);
+            if (r >= 0)
+                return r;
+        }
+        return -1;
+    }
+
+    void splitNode(int i) {
+        int first;
+        if (!freeBlocks_.empty()) {
+            first = freeBlocks_.back();
+            freeBlocks_.pop_back();
+        } else {
+            first = int(nodes_.size());
+            nodes_.resize(nodes_.size() + 4);
+        }
+        const Node parent = nodes_[size_t(i)];
+        const int half = parent.size / 2;
+        for (int c = 0; c < 4; ++c)
+            nodes_[size_t(first + c)] = { parent.x + (c & 1) * half, parent.y + (c >> 1) * half, half };
+        nodes_[size_t(i)].children = first;
+    }
+
+    // Returns whether node i is a free leaf afterwards.
+    bool release(int i, const QRect &rect) {
+        Node &n = nodes_[size_t(i)];
+        if (n.children < 0) {
+            if (n.used && n.x == rect.x() && n.y == rect.y() && n.size == rect.width()) {
+                n.used = false;
+                usedArea_ -= qint64(n.size) * n.size;
+            }
+            return !n.used;
+        }
+        const int half = n.size / 2;
+        release(n.children + (rect.x() >= n.x + half ? 1 : 0) + (rect.y() >= n.y + half ? 2 : 0), rect);
+        for (int c = 0; c < 4; ++c) {
+            const Node &child = nodes_[size_t(n.children + c)];
+            if (child.used || child.children >= 0)
+                return false;
+        }
+        freeBlocks_.push_back(n.children);
+        n.children = -1;
+        return true;
+    }
+
+    std::vector<Node> nodes_;
+    std::vector<int> freeBlocks_;
+    int minSize_ = 1;
+    qint64 usedArea_ = 0;
+};
+
+// Shadows of the local spot and point lights, one per QRhi: every shadow is a
+// tile of a single SIZE^2 depth texture, so memory is fixed however many
+// lights there are. A spot light has one tile, a point light six (one per
+// cube face, +x -x +y -y +z -z). Tile sizes follow how large the light's
+// range appears on screen; lights off screen give their tiles back. At most
+// maxUpdatesPerFrame tiles are drawn a frame, in one pass: new tiles first,
+// then the rest by size times frames since their last draw. Each tile keeps
+// the matrix it was drawn with, so a tile waiting for its turn still matches
+// its depth. The pbr*.frag shaders read the light and tile tables from the
+// Frame block (FrameUniforms::setLocalLights()) and the atlas at BINDING.
+
+class ShadowAtlas {
+public:
+    static constexpr int SIZE = 2048;
+    static constexpr int BINDING = 11;    // pbr*.frag tex_lightShadows
+    static constexpr int MAX_LIGHTS = 8;  // LocalLight lights[] in the Frame block
+    static constexpr int MAX_TILES = 32;  // ShadowTile tiles[]
+    static constexpr int MAX_UPDATES = 8; // DrawPacket views FIRST_VIEW.. FIRST_VIEW + MAX_UPDATES - 1
+    static constexpr int FIRST_VIEW = CascadedShadows::MAX_CASCADES;
+    static constexpr int MIN_TILE = 64;
+    static constexpr int MAX_TILE = 1024;
+
+    enum class LightType { Spot = 0, Point = 1 };
+
+    struct Light {
+        LightType type = LightType::Point;
+        QVector3D position;
+        QVector3D direction = QVector3D(0, -1, 0); // spot axis
+        QVector3D color = QVector3D(1, 1, 1);
+        float intensity = 1.0f;
+        float range = 10.0f;      // no light and no shadow beyond
+        float outerAngle = 30.0f; // spot half angles in degrees
+        float innerAngle = 20.0f;
+        bool castsShadows = true;
+    };
+
+    // A tile drawn this frame, as DrawPacket view FIRST_VIEW + its index in updates().
+    struct Update {
+        QMatrix4x4 lightSpace; // world to clip space, clipSpaceCorrMatrix() applied
+        QRhiViewport viewport;
+        QVector3D lightPos;
+        float range = 0;
+    };
+
+    // std140 LocalLight and ShadowTile of the Frame block
+    struct alignas(16) GpuLight {
+        float position[4];  // xyz, w range
+        float color[4];     // rgb times intensity, w type
+        float direction[4]; // xyz spot axis, w cos outer angle
+        float shadow[4];    // x first tile or -1, y cos inner angle
+    };
+    struct alignas(16) GpuTile {
+        float matrix[16];   // world to atlas uv (xy) and depth (z)
+        float rect[4];      // uv min xy, max zw, half a texel inside
+    };
+
+    struct Stats {
+        int shadowed = 0;         // lights with tiles
+        int tiles = 0;
+        int updates = 0;          // tiles drawn
+        int deferred = 0;         // tiles that wanted a draw but were over the per-frame cap
+        int reallocations = 0;
+        int failedAllocations = 0;
+        qint64 usedTexels = 0;
+    };
+
+    static ShadowAtlas *instance(QRhi *rhi) {
+        static QHash<QRhi *, ShadowAtlas *> atlases;
+        if (ShadowAtlas *a = atlases.value(rhi))
+            return a;
+        auto *a = new ShadowAtlas(rhi);
+        atlases.insert(rhi, a);
+        rhi->addCleanupCallback([](QRhi *r) { delete atlases.take(r); });
+        return a;
+    }
+
+    // Returns the light's index, or -1 beyond MAX_LIGHTS.
+    int addLight(const Light &light) {
+        if (int(lights_.size()) >= MAX_LIGHTS) {
+            qWarning() << "ShadowAtlas: more than" << MAX_LIGHTS << "lights, ignoring one";
+            return -1;
+        }
+        lights_.push_back({ light });
+        return int(lights_.size()) - 1;
+    }
+    Light &light(int i) { return lights_[size_t(i)].light; }
+    int lightCount() const { return int(lights_.size()); }
+
+    void setMaxUpdatesPerFrame(int tiles) { maxUpdates_ = qBound(0, tiles, MAX_UPDATES); }
+
+    // Fits the tiles to the camera and picks this frame's updates().
+    void update(const QMatrix4x4 &view, const QMatrix4x4 &projection, int viewportHeight) {
+        ++frame_;
+        updates_.clear();
+        const QMatrix4x4 viewProjection = projection * view;
+        const QVector3D eye = view.inverted().map(QVector3D(0, 0, 0));
+        const float focalPixels = 0.5f * float(viewportHeight) * qAbs(projection(1, 1));
+
+        for (Slot &s : lights_) {
+            const Light &l = s.light;
+            int wanted = 0;
+            if (l.castsShadows && inFrustum(viewProjection, l.position, l.range)) {
+                const float distance = (l.position - eye).length();
+                const float pixels = distance <= l.range ? float(MAX_TILE) : focalPixels * l.range / distance;
+                const int maxTile = l.type == LightType::Point ? MAX_TILE / 2 : MAX_TILE;
+                wanted = qBound(MIN_TILE, int(qNextPowerOfTwo(quint32(qMax(pixels, 2.0f)) - 1)), maxTile);
+                // no reallocation for a size class up or down at the edge
+                if (s.tileSize > 0 && wanted <= s.tileSize && wanted * 4 > s.tileSize)
+                    wanted = s.tileSize;
+            }
+            if (wanted != s.tileSize)
+                reallocate(s, wanted);
+        }
+        schedule();
+
+        stats_.shadowed = 0;
+        stats_.tiles = 0;
+        for (const Slot &s : lights_) {
+            stats_.shadowed += s.tileSize > 0 ? 1 : 0;
+            stats_.tiles += s.tileSize > 0 ? faces(s.light) : 0;
+        }
+        stats_.usedTexels = allocator_.usedArea();
+    }
+
+    const std::vector<Update> &updates() const { return updates_; }
+
+    // Hides shadow packets of the updated views outside their light's range.
+    void cull(DrawList &list) const {
+        for (int k = 0; k < int(updates_.size()); ++k) {
+            const Update &u = updates_[size_t(k)];
+            for (DrawPass pass : { DrawPass::Shadow, DrawPass::StaticShadow }) {
+                list.cull(pass, FIRST_VIEW + k, [&u](const QVector3D &center, float radius) {
+                    return (center - u.lightPos).lengthSquared() < (u.range + radius) * (u.range + radius);
+                });
+            }
+        }
+    }
+
+    QRhiTextureRenderTarget *renderTarget() const { return rt_.get(); }
+
+    // In the pass on renderTarget(), with the update's viewport set: back to the far plane.
+    void recordClear(CommandRecorder &rec) const {
+        rec.setGraphicsPipeline(clearPipeline_.get());
+        rec.setShaderResources(clearSrb_.get());
+        rec.draw(3);
+    }
+
+    QRhiShaderResourceBinding binding() const {
+        SamplerKey key;
+        key.magFilter = key.minFilter = QRhiSampler::Nearest;
+        key.mipmapMode = QRhiSampler::None;
+        key.addressU = key.addressV = key.addressW = QRhiSampler::ClampToEdge;
+        return QRhiShaderResourceBinding::sampledTexture(BINDING, QRhiShaderResourceBinding::FragmentStage, texture_.get(),
+                                                         RhiResourceCache::instance(rhi_)->sampler(key));
+    }
+
+    // The light and tile tables; a light's tiles only count once all were drawn.
+    void fill(GpuLight *lights, float *count, GpuTile *tiles) const {
+        for (size_t i = 0; i < lights_.size(); ++i) {
+            const Slot &s = lights_[i];
+            const Light &l = s.light;
+            const QVector3D c = l.color * l.intensity;
+            const QVector3D d = l.direction.normalized();
+            bool drawn = s.tileSize > 0;
+            for (int f = 0; drawn && f < faces(l); ++f)
+                drawn = tiles_[size_t(s.firstTile + f)].drawnFrame >= 0;
+            lights[i] = { { l.position.x(), l.position.y(), l.position.z(), l.range },
+                          { c.x(), c.y(), c.z(), float(l.type) },
+                          { d.x(), d.y(), d.z(), std::cos(qDegreesToRadians(l.outerAngle)) },
+                          { drawn ? float(s.firstTile) : -1.0f, std::cos(qDegreesToRadians(l.innerAngle)), 0, 0 } };
+        }
+        count[0] = float(lights_.size());
+        for (int t = 0; t < MAX_TILES; ++t) {
+            const Tile &tile = tiles_[size_t(t)];
+            memcpy(tiles[t].matrix, tile.uvMatrix.constData(), 64);
+            memcpy(tiles[t].rect, tile.uvRect, sizeof(tile.uvRect));
+        }
+    }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "ShadowAtlas:" << lights_.size() << "lights," << stats_.shadowed << "shadowed in" << stats_.tiles
+                 << "tiles," << stats_.usedTexels * 100 / (qint64(SIZE) * SIZE) << "% used," << stats_.updates << "tile draws,"
+                 << stats_.deferred << "deferred," << stats_.reallocations << "reallocations," << stats_.failedAllocations
+                 << "failed";
+    }
+
+private:
+    struct Slot {
+        Light light;
+        int tileSize = 0;   // 0 without shadow
+        int firstTile = -1; // faces() consecutive entries of tiles_
+    };
+
+    struct Tile {
+        bool inUse = false;
+        QRect rect; // in the atlas, QRhi viewport coordinates
+        QMatrix4x4 uvMatrix;
+        float uvRect[4] = {};
+        int drawnFrame = -1;
+    };
+
+    explicit ShadowAtlas(QRhi *rhi) : rhi_(rhi) {
+        allocator_.reset(SIZE, MIN_TILE);
+        texture_.reset(rhi->newTexture(QRhiTexture::D32F, QSize(SIZE, SIZE), 1, QRhiTexture::RenderTarget));
+        texture_->create();
+        QRhiTextureRenderTargetDescription desc;
+        desc.setDepthTexture(texture_.get());
+        // tiles not drawn in a frame keep their depth
+        rt_.reset(rhi->newTextureRenderTarget(desc, QRhiTextureRenderTarget::PreserveDepthStencilContents));
+        rp_.reset(rt_->newCompatibleRenderPassDescriptor());
+        rt_->setRenderPassDescriptor(rp_.get());
+        rt_->create();
+
+        clearSrb_.reset(rhi->newShaderResourceBindings());
+        clearSrb_->create();
+        clearPipeline_.reset(rhi->newGraphicsPipeline());
+        clearPipeline_->setShaderStages({ { QRhiShaderStage::Vertex, loadShader(":/shaders/prebuild/depthblit.vert.qsb") },
+                                          { QRhiShaderStage::Fragment, loadShader(":/shaders/prebuild/depth.frag.qsb") } });
+        clearPipeline_->setVertexInputLayout({});
+        clearPipeline_->setShaderResourceBindings(clearSrb_.get());
+        clearPipeline_->setRenderPassDescriptor(rp_.get());
+        clearPipeline_->setDepthTest(true);
+        clearPipeline_->setDepthWrite(true);
+        clearPipeline_->setDepthOp(QRhiGraphicsPipeline::Always);
+        if (!clearPipeline_->create())
+            qWarning() << "ShadowAtlas: failed to create the clear pipeline";
+    }
+
+    static QShader loadShader(const QString &name) {
+        startup::Scope scope("shader load");
+        const QByteArray data = qpak::read(name);
+        return data.isEmpty() ? QShader() : QShader::fromSerialized(data);
+    }
+
+    static int faces(const Light &l) { return l.type == LightType::Point ? 6 : 1; }
+
+    static bool inFrustum(const QMatrix4x4 &viewProjection, const QVector3D &center, float radius) {
+        const QVector4D rows[4] = { viewProjection.row(0), viewProjection.row(1), viewProjection.row(2), viewProjection.row(3) };
+        const QVector4D planes[6] = { rows[3] + rows[0], rows[3] - rows[0], rows[3] + rows[1],
+                                      rows[3] - rows[1], rows[3] + rows[2], rows[3] - rows[2] };
+        for (const QVector4D &p : planes) {
+            const float length = p.toVector3D().length();
+            if (QVector3D::dotProduct(p.toVector3D(), center) + p.w() < -radius * length)
+                return false;
+        }
+        return true;
+    }
+
+    // New tiles of size for s (none for 0). When the atlas has no room for
+    // that size, a light that has tiles keeps them, one without tries smaller.
+    void reallocate(Slot &s, int size) {
+        const int count = faces(s.light);
+        std::vector<QRect> rects;
+        int first = -1;
+        for (int tileSize = size; tileSize >= MIN_TILE && rects.empty(); tileSize /= 2) {
+            first = findTileRange(count);
+            if (first < 0)
+                break;
+            for (int f = 0; f < count; ++f) {
+                const QRect r = allocator_.allocate(tileSize);
+                if (r.isEmpty())
+                    break;
+                rects.push_back(r);
+            }
+            if (int(rects.size()) < count) {
+                for (const QRect &r : rects)
+                    allocator_.release(r);
+                rects.clear();
+                ++stats_.failedAllocations;
+                if (s.tileSize > 0)
+                    return;
+            }
+        }
+        if (size > 0 && rects.empty() && s.tileSize > 0)
+            return;
+
+        freeTiles(s);
+        if (rects.empty())
+            return;
+        s.tileSize = rects.front().width();
+        s.firstTile = first;
+        for (int f = 0; f < count; ++f) {
+            Tile &t = tiles_[size_t(first + f)];
+            t = {};
+            t.inUse = true;
+            t.rect = rects[size_t(f)];
+        }
+        ++stats_.reallocations;
+    }
+
+    void freeTiles(Slot &s) {
+        if (s.tileSize > 0) {
+            for (int f = 0; f < faces(s.light); ++f) {
+                Tile &t = tiles_[size_t(s.firstTile + f)];
+                allocator_.release(t.rect);
+                t = {};
+            }
+        }
+        s.tileSize = 0;
+        s.firstTile = -1;
+    }
+
+    int findTileRange(int count) const {
+        for (int first = 0; first + count <= MAX_TILES; ++first) {
+            bool free = true;
+            for (int i = first; free && i < first + count; ++i)
+                free = !tiles_[size_t(i)].inUse;
+            if (free)
+                return first;
+        }
+        return -1;
+    }
+
+    void schedule() {
+        struct Candidate {
+            double priority;
+            int slot;
+            int face;
+        };
+        std::vector<Candidate> candidates;
+        for (int i = 0; i < int(lights_.size()); ++i) {
+            const Slot &s = lights_[size_t(i)];
+            if (s.tileSize <= 0)
+                continue;
+            for (int f = 0; f < faces(s.light); ++f) {
+                const Tile &t = tiles_[size_t(s.firstTile + f)];
+                const double priority = t.drawnFrame < 0 ? std::numeric_limits<double>::max()
+                                                         : double(s.tileSize) * double(frame_ - t.drawnFrame);
+                candidates.push_back({ priority, i, f });
+            }
+        }
+        std::sort(candidates.begin(), candidates.end(),
+                  [](const Candidate &a, const Candidate &b) { return a.priority > b.priority; });
+        const int n = qMin(int(candidates.size()), maxUpdates_);
+        stats_.deferred += int(candidates.size()) - n;
+        for (int k = 0; k < n; ++k) {
+            const Slot &s = lights_[size_t(candidates[size_t(k)].slot)];
+            Tile &t = tiles_[size_t(s.firstTile + candidates[size_t(k)].face)];
+            Update u;
+            u.lightSpace = lightSpace(s.light, candidates[size_t(k)].face);
+            u.viewport = QRhiViewport(float(t.rect.x()), float(t.rect.y()), float(t.rect.width()), float(t.rect.height()));
+            u.lightPos = s.light.position;
+            u.range = s.light.range;
+            setUv(t, u.lightSpace);
+            t.drawnFrame = frame_;
+            updates_.push_back(u);
+            ++stats_.updates;
+        }
+    }
+
+    QMatrix4x4 lightSpace(const Light &l, int face) const {
+        static const QVector3D faceDirs[6] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+        static const QVector3D faceUps[6] = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { 0, 0, 1 }, { 0, 1, 0 }, { 0, 1, 0 } };
+        QMatrix4x4 projection;
+        QMatrix4x4 view;
+        if (l.type == LightType::Point) {
+            projection.perspective(90.0f, 1.0f, NEAR_PLANE, l.range);
+            view.lookAt(l.position, l.position + faceDirs[face], faceUps[face]);
+        } else {
+            const QVector3D dir = l.direction.normalized();
+            projection.perspective(qMin(2.0f * l.outerAngle, 170.0f), 1.0f, NEAR_PLANE, l.range);
+            view.lookAt(l.position, l.position + dir, qAbs(dir.y()) > 0.99f ? QVector3D(0, 0, 1) : QVector3D(0, 1, 0));
+        }
+        return rhi_->clipSpaceCorrMatrix() * projection * view;
+    }
+
+    // Folds the remap from clip space to the tile's uv and stored depth into
+    // the matrix, so the shaders need no per backend code for it.
+    void setUv(Tile &t, const QMatrix4x4 &clip) const {
+        const float scale = float(t.rect.width()) / float(SIZE);
+        const float u0 = float(t.rect.x()) / float(SIZE);
+        const float v0 = rhi_->isYUpInFramebuffer() ? float(t.rect.y()) / float(SIZE)
+                                                    : 1.0f - float(t.rect.y() + t.rect.height()) / float(SIZE);
+        const float flip = rhi_->isYUpInNDC() == rhi_->isYUpInFramebuffer() ? 1.0f : -1.0f;
+        const bool zeroToOne = rhi_->isClipDepthZeroToOne();
+        const QMatrix4x4 remap(0.5f * scale, 0, 0, u0 + 0.5f * scale,
+                               0, flip * 0.5f * scale, 0, v0 + 0.5f * scale,
+                               0, 0, zeroToOne ? 1.0f : 0.5f, zeroToOne ? 0.0f : 0.5f,
+                               0, 0, 0, 1);
+        t.uvMatrix = remap * clip;
+        const float halfTexel = 0.5f / float(SIZE);
+        t.uvRect[0] = u0 + halfTexel;
+        t.uvRect[1] = v0 + halfTexel;
+        t.uvRect[2] = u0 + scale - halfTexel;
+        t.uvRect[3] = v0 + scale - halfTexel;
+    }
+
+    static constexpr float NEAR_PLANE = 0.05f;
+
+    QRhi *rhi_;
+    std::unique_ptr<QRhiTexture> texture_;
+    std::unique_ptr<QRhiRenderPassDescriptor> rp_;
+    std::unique_ptr<QRhiTextureRenderTarget> rt_;
+    std::unique_ptr<QRhiShaderResourceBindings> clearSrb_;
+    std::unique_ptr<QRhiGraphicsPipeline> clearPipeline_;
+    QuadTreeAllocator allocator_;
+    std::vector<Slot> lights_;
+    std::array<Tile, MAX_TILES> tiles_;
+    std::vector<Update> updates_;
+    int maxUpdates_ = 6;
+    int frame_ = 0;
+    Stats stats_;
+};
+
+#endif // SHADOWATLAS_H
@@ -0,0 +1,222 @@
+#ifndef SHADOWCACHE_H
+#define SHADOWCACHE_H
+
+#include "assetpack.h"
+#include "cascadedshadows.h"
+#include "commandrecorder.h"
+#include "rhicache.h"
+#include "startupprofiler.h"
+
+#include <rhi/qrhi.h>
+#include <QtMath>
+#include <QDebug>
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <vector>
+
+// Depth of the casters that never move (DrawPass::StaticShadow), kept per
+// cascade tile across frames in a texture laid out like the shadow atlas.
+// Tiles are fitted with slack around their slice (setSlack()), so the camera
+// can move within it on the cached depth. A tile is redrawn only when its
+// slice leaves it, when the light has turned further than the threshold
+// since it was drawn, or after the static casters changed. Refreshes for the
+// light are time sliced, at most refreshBudget tiles a frame, oldest first;
+// until its turn a cascade keeps the light its tile was drawn with, so
+// shading and the dynamic casters agree with the cached depth. Each frame
+// recordComposite() copies the tiles into the shadow atlas and only the
+// dynamic casters (DrawPass::Shadow) are drawn on top.
+
+class ShadowCache {
+public:
+    struct Stats {
+        int frames = 0;
+        int refreshes = 0;     // tiles redrawn
+        int deferred = 0;      // light refreshes left for a later frame
+        int reused = 0;        // tiles composited without a redraw
+        int invalidations = 0;
+    };
+
+    // atlasPass: the render pass of the shadow atlas the tiles are copied into.
+    void create(QRhi *rhi, const QSize &size, QRhiRenderPassDescriptor *atlasPass) {
+        release();
+        texture_.reset(rhi->newTexture(QRhiTexture::D32F, size, 1, QRhiTexture::RenderTarget));
+        texture_->create();
+        QRhiTextureRenderTargetDescription desc;
+        desc.setDepthTexture(texture_.get());
+        // tiles not refreshed in a pass keep their depth
+        rt_.reset(rhi->newTextureRenderTarget(desc, QRhiTextureRenderTarget::PreserveDepthStencilContents));
+        rp_.reset(rt_->newCompatibleRenderPassDescriptor());
+        rt_->setRenderPassDescriptor(rp_.get());
+        rt_->create();
+
+        SamplerKey key;
+        key.magFilter = key.minFilter = QRhiSampler::Nearest;
+        key.mipmapMode = QRhiSampler::None;
+        key.addressU = key.addressV = key.addressW = QRhiSampler::ClampToEdge;
+        compositeSrb_.reset(rhi->newShaderResourceBindings());
+        compositeSrb_->setBindings({ QRhiShaderResourceBinding::sampledTexture(
+            0, QRhiShaderResourceBinding::FragmentStage, texture_.get(), RhiResourceCache::instance(rhi)->sampler(key)) });
+        compositeSrb_->create();
+        // the clear pass renders into texture_, so it must not bind it
+        clearSrb_.reset(rhi->newShaderResourceBindings());
+        clearSrb_->create();
+
+        const QShader vs = loadShader(":/shaders/prebuild/depthblit.vert.qsb");
+        clearPipeline_.reset(newPipeline(rhi, vs, loadShader(":/shaders/prebuild/depth.frag.qsb"), clearSrb_.get(), rp_.get()));
+        compositePipeline_.reset(newPipeline(rhi, vs, loadShader(":/shaders/prebuild/depthblit.frag.qsb"),
+                                             compositeSrb_.get(), atlasPass));
+        tiles_ = {};
+    }
+
+    void release() {
+        clearPipeline_.reset();
+        compositePipeline_.reset();
+        clearSrb_.reset();
+        compositeSrb_.reset();
+        rt_.reset();
+        rp_.reset();
+        texture_.reset();
+    }
+
+    // Angle the light may turn before a tile is redrawn.
+    void setLightThreshold(float degrees) { cosThreshold_ = std::cos(qDegreesToRadians(degrees)); }
+    // Light refreshes per frame, 0 for no limit; refits to the camera are never deferred.
+    void setRefreshBudget(int tiles) { budget_ = qMax(0, tiles); }
+    // Margin around each slice as a fraction of its radius; wider tiles are
+    // redrawn less often as the camera moves, at a coarser texel size.
+    void setSlack(float fraction) { slack_ = qMax(0.0f, fraction); }
+
+    // Static casters moved; every tile is redrawn next frame.
+    void invalidate() {
+        for (Tile &t : tiles_)
+            t.valid = false;
+        ++stats_.invalidations;
+    }
+
+    // Picks each cascade of shadows (after its fitCamera()): the cached one, or
+    // a refit to the light at lightPos, shining along lightDir, whose tile is
+    // redrawn this frame. staticRevision changes with the static casters.
+    void update(CascadedShadows &shadows, const QVector3D &lightPos, const QVector3D &lightDir, quint64 staticRevision) {
+        ++stats_.frames;
+        if (staticRevision != revision_) {
+            revision_ = staticRevision;
+            invalidate();
+        }
+        const QVector3D dir = lightDir.normalized();
+        const int count = shadows.cascadeCount();
+        int budget = budget_ > 0 ? budget_ : count;
+        std::vector<int> turned;
+        for (int i = 0; i < CascadedShadows::MAX_CASCADES; ++i) {
+            refresh_[size_t(i)] = false;
+            if (i >= count)
+                continue;
+            const Tile &t = tiles_[size_t(i)];
+            if (t.valid && shadows.covers(i, t.cascade)) {
+                shadows.setCascade(i, shadows.reused(i, t.cascade));
+                if (QVector3D::dotProduct(t.lightDir, dir) < cosThreshold_)
+                    turned.push_back(i);
+                else
+                    ++stats_.reused;
+                continue;
+            }
+            refresh_[size_t(i)] = true; // empty, or no longer covers its slice
+            --budget;
+        }
+        std::sort(turned.begin(), turned.end(), [this](int a, int b) {
+            return tiles_[size_t(a)].drawnFrame < tiles_[size_t(b)].drawnFrame;
+        });
+        for (int i : turned) {
+            if (budget > 0) {
+                refresh_[size_t(i)] = true;
+                --budget;
+            } else {
+                ++stats_.deferred;
+                ++stats_.reused;
+            }
+        }
+
+        for (int i = 0; i < count; ++i) {
+            if (!refresh_[size_t(i)])
+                continue;
+            const CascadedShadows::Cascade c = shadows.fit(i, lightPos, dir, shadows.cascade(i).sliceRadius * slack_);
+            shadows.setCascade(i, c);
+            tiles_[size_t(i)] = { c, dir, stats_.frames, true };
+            ++stats_.refreshes;
+        }
+    }
+
+    bool needsRefresh(int i) const { return refresh_[size_t(i)]; }
+    bool hasRefresh() const { return std::any_of(refresh_.begin(), refresh_.end(), [](bool r) { return r; }); }
+
+    QRhiTextureRenderTarget *renderTarget() const { return rt_.get(); }
+
+    // In the pass on renderTarget(), with the tile's viewport set: back to the far plane.
+    void recordClear(CommandRecorder &rec) const {
+        rec.setGraphicsPipeline(clearPipeline_.get());
+        rec.setShaderResources(clearSrb_.get());
+        rec.draw(3);
+    }
+
+    // In the shadow atlas pass, with the tile's viewport set: copies the cached tile.
+    void recordComposite(CommandRecorder &rec) const {
+        rec.setGraphicsPipeline(compositePipeline_.get());
+        rec.setShaderResources(compositeSrb_.get());
+        rec.draw(3);
+    }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "ShadowCache:" << stats_.refreshes << "tiles redrawn," << stats_.reused << "reused,"
+                 << stats_.deferred << "deferred," << stats_.invalidations << "invalidations in" << stats_.frames << "frames";
+    }
+
+private:
+    struct Tile {
+        CascadedShadows::Cascade cascade; // the fit the depth was drawn with
+        QVector3D lightDir;
+        int drawnFrame = 0;
+        bool valid = false;
+    };
+
+    static QShader loadShader(const QString &name) {
+        startup::Scope scope("shader load");
+        const QByteArray data = qpak::read(name);
+        return data.isEmpty() ? QShader() : QShader::fromSerialized(data);
+    }
+
+    // Full screen triangle writing depth unconditionally, no color.
+    static QRhiGraphicsPipeline *newPipeline(QRhi *rhi, const QShader &vs, const QShader &fs,
+                                             QRhiShaderResourceBindings *srb, QRhiRenderPassDescriptor *rp) {
+        QRhiGraphicsPipeline *ps = rhi->newGraphicsPipeline();
+        ps->setShaderStages({ { QRhiShaderStage::Vertex, vs }, { QRhiShaderStage::Fragment, fs } });
+        ps->setVertexInputLayout({});
+        ps->setShaderResourceBindings(srb);
+        ps->setRenderPassDescriptor(rp);
+        ps->setDepthTest(true);
+        ps->setDepthWrite(true);
+        ps->setDepthOp(QRhiGraphicsPipeline::Always);
+        if (!ps->create())
+            qWarning() << "ShadowCache: failed to create pipeline";
+        return ps;
+    }
+
+    std::unique_ptr<QRhiTexture> texture_;
+    std::unique_ptr<QRhiRenderPassDescriptor> rp_;
+    std::unique_ptr<QRhiTextureRenderTarget> rt_;
+    std::unique_ptr<QRhiShaderResourceBindings> clearSrb_;
+    std::unique_ptr<QRhiShaderResourceBindings> compositeSrb_;
+    std::unique_ptr<QRhiGraphicsPipeline> clearPipeline_;
+    std::unique_ptr<QRhiGraphicsPipeline> compositePipeline_;
+
+    std::array<Tile, CascadedShadows::MAX_CASCADES> tiles_;
+    std::array<bool, CascadedShadows::MAX_CASCADES> refresh_ = {};
+    quint64 revision_ = ~quint64(0);
+    float cosThreshold_ = std::cos(qDegreesToRadians(1.0f));
+    float slack_ = 0.25f;
+    int budget_ = 1;
+    Stats stats_;
+};
+
+#endif // SHADOWCACHE_H
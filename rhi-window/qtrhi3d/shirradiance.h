@@ -0,0 +1,196 @@
+#ifndef SHIRRADIANCE_H
+#define SHIRRADIANCE_H
+
+#include "envmap.h"
+#include "parallel.h"
+
+#include <QMutex>
+#include <array>
+
+// Diffuse IBL as 9 L2 spherical harmonics coefficients per channel, projected
+// from the equirectangular RGBA16F sky on the CPU.
+// Every basis function is a polynomial of degree <= 2 in the direction
+// (x, y, z) = (cos lat cos phi, sin lat, cos lat sin phi). Within a row
+// latitude is fixed, so each row reduces to five moments of the radiance
+// (1, cos phi, sin phi, cos phi sin phi, cos 2 phi). These are summed four
+// pixels per SSE2 step and weighted by the row's solid angle afterwards.
+//
+// Irradiance::c already includes the basis constants and the cosine lobe
+// convolution divided by pi. evaluate() and the pbr*.frag shaders therefore
+// return the Lambert diffuse radiance (irradiance / pi) for normal n in a
+// few multiply-adds. irradianceReference() integrates the same quantity
+// directly over every pixel, which checks the projection.
+
+namespace sh {
+
+struct alignas(16) Irradiance {
+    // rgb and a zero pad each, laid out as std140 vec4[9]:
+    // 1, y, z, x, xy, yz, 3y^2 - 1, xz, x^2 - z^2
+    float c[9][4] = {};
+};
+
+namespace detail {
+
+// per column moments of the row sums; padded with zero weights to a multiple of 4
+struct Columns {
+    std::vector<float> cosPhi, sinPhi, cosSin, cos2Phi;
+};
+
+inline Columns columns(int width)
+{
+    Columns cols;
+    const size_t padded = (size_t(width) + 3) & ~size_t(3);
+    for (auto *v : { &cols.cosPhi, &cols.sinPhi, &cols.cosSin, &cols.cos2Phi })
+        v->assign(padded, 0.0f);
+    for (int x = 0; x < width; ++x) {
+        const double phi = ((x + 0.5) / width - 0.5) * 2.0 * envmap::PI;
+        cols.cosPhi[size_t(x)] = float(std::cos(phi));
+        cols.sinPhi[size_t(x)] = float(std::sin(phi));
+        cols.cosSin[size_t(x)] = float(std::cos(phi) * std::sin(phi));
+        cols.cos2Phi[size_t(x)] = float(std::cos(2.0 * phi));
+    }
+    return cols;
+}
+
+// moments[k][channel] of one row: sum over x of radiance * {1, cos, sin, cos sin, cos 2} phi
+inline void rowMoments(const uint16_t *row, int width, const Columns &cols, float moments[5][3])
+{
+    int x = 0;
+#if RGBE_SSE2
+    __m128 acc[5][3];
+    for (auto &m : acc)
+        for (__m128 &a : m)
+            a = _mm_setzero_ps();
+    const __m128i zero = _mm_setzero_si128();
+    for (; x + 4 <= width; x += 4) {
+        const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + size_t(x) * 4));
+        const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(row + size_t(x) * 4 + 8));
+        __m128 p0 = rgbe::floats(_mm_unpacklo_epi16(lo, zero)), p1 = rgbe::floats(_mm_unpackhi_epi16(lo, zero));
+        __m128 p2 = rgbe::floats(_mm_unpacklo_epi16(hi, zero)), p3 = rgbe::floats(_mm_unpackhi_epi16(hi, zero));
+        _MM_TRANSPOSE4_PS(p0, p1, p2, p3); // p0..p2 now r, g, b of the four pixels
+        const __m128 w[5] = { _mm_set1_ps(1.0f), _mm_loadu_ps(&cols.cosPhi[size_t(x)]),
+                              _mm_loadu_ps(&cols.sinPhi[size_t(x)]), _mm_loadu_ps(&cols.cosSin[size_t(x)]),
+                              _mm_loadu_ps(&cols.cos2Phi[size_t(x)]) };
+        const __m128 rgb[3] = { p0, p1, p2 };
+        for (int k = 0; k < 5; ++k)
+            for (int ch = 0; ch < 3; ++ch)
+                acc[k][ch] = _mm_add_ps(acc[k][ch], _mm_mul_ps(rgb[ch], w[k]));
+    }
+    for (int k = 0; k < 5; ++k) {
+        for (int ch = 0; ch < 3; ++ch) {
+            alignas(16) float lanes[4];
+            _mm_store_ps(lanes, acc[k][ch]);
+            moments[k][ch] = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+    }
+#else
+    for (auto &m : moments)
+        m[0] = m[1] = m[2] = 0.0f;
+#endif
+    for (; x < width; ++x) {
+        const size_t i = size_t(x);
+        const float w[5] = { 1.0f, cols.cosPhi[i], cols.sinPhi[i], cols.cosSin[i], cols.cos2Phi[i] };
+        for (int ch = 0; ch < 3; ++ch) {
+            const float v = rgbe::halfToFloat(row[i * 4 + size_t(ch)]);
+            for (int k = 0; k < 5; ++k)
+                moments[k][ch] += v * w[k];
+        }
+    }
+}
+
+} // namespace detail
+
+// Adds rows [y0, y1) of src projected onto the (unnormalised) basis to sum[9][3].
+inline void projectRows(const envmap::Source &src, const detail::Columns &cols, int y0, int y1, double sum[9][3])
+{
+    const double pixelArea = (2.0 * envmap::PI / src.width) * (envmap::PI / src.height);
+    for (int y = y0; y < y1; ++y) {
+        const double lat = ((y + 0.5) / src.height - 0.5) * envmap::PI;
+        const double cl = std::cos(lat), sl = std::sin(lat);
+        float m[5][3];
+        detail::rowMoments(src.pixels + size_t(y) * size_t(src.width) * 4, src.width, cols, m);
+        const double dA = cl * pixelArea;
+        for (int ch = 0; ch < 3; ++ch) {
+            sum[0][ch] += dA * m[0][ch];
+            sum[1][ch] += dA * sl * m[0][ch];
+            sum[2][ch] += dA * cl * m[2][ch];
+            sum[3][ch] += dA * cl * m[1][ch];
+            sum[4][ch] += dA * cl * sl * m[1][ch];
+            sum[5][ch] += dA * sl * cl * m[2][ch];
+            sum[6][ch] += dA * (3.0 * sl * sl - 1.0) * m[0][ch];
+            sum[7][ch] += dA * cl * cl * m[3][ch];
+            sum[8][ch] += dA * cl * cl * m[4][ch];
+        }
+    }
+}
+
+// Basis constants squared times the clamped cosine convolution over pi
+// (1, 2/3, 1/4 per band), applied to the raw projections.
+inline Irradiance irradianceFrom(const double sum[9][3])
+{
+    constexpr double k0 = 0.282094791773878, k1 = 0.488602511902920, k2 = 1.092548430592079,
+                     k3 = 0.315391565252520, k4 = 0.546274215296040;
+    constexpr double scale[9] = { k0 * k0,
+                                  k1 * k1 * 2.0 / 3.0, k1 * k1 * 2.0 / 3.0, k1 * k1 * 2.0 / 3.0,
+                                  k2 * k2 / 4.0, k2 * k2 / 4.0, k3 * k3 / 4.0, k2 * k2 / 4.0, k4 * k4 / 4.0 };
+    Irradiance irr;
+    for (int k = 0; k < 9; ++k)
+        for (int ch = 0; ch < 3; ++ch)
+            irr.c[k][ch] = float(sum[k][ch] * scale[k]);
+    return irr;
+}
+
+// Projects the whole image, rows split over pool.
+inline Irradiance project(const envmap::Source &src, QThreadPool *pool = QThreadPool::globalInstance())
+{
+    const detail::Columns cols = detail::columns(src.width);
+    double total[9][3] = {};
+    QMutex mutex;
+    parallelForChunked(pool, src.height, 32, [&](int begin, int end) {
+        double sum[9][3] = {};
+        projectRows(src, cols, begin, end, sum);
+        QMutexLocker lock(&mutex);
+        for (int k = 0; k < 9; ++k)
+            for (int ch = 0; ch < 3; ++ch)
+                total[k][ch] += sum[k][ch];
+    });
+    return irradianceFrom(total);
+}
+
+// Same polynomial as the pbr*.frag shaders.
+inline std::array<float, 3> evaluate(const Irradiance &irr, const float n[3])
+{
+    const float x = n[0], y = n[1], z = n[2];
+    const float basis[9] = { 1.0f, y, z, x, x * y, y * z, 3.0f * y * y - 1.0f, x * z, x * x - z * z };
+    std::array<float, 3> out{};
+    for (int k = 0; k < 9; ++k)
+        for (int ch = 0; ch < 3; ++ch)
+            out[size_t(ch)] += irr.c[k][ch] * basis[k];
+    return out;
+}
+
+// Brute-force (1 / pi) * integral of L(w) max(0, n . w) dw over every pixel.
+inline std::array<double, 3> irradianceReference(const envmap::Source &src, const float n[3])
+{
+    std::array<double, 3> out{};
+    const double pixelArea = (2.0 * envmap::PI / src.width) * (envmap::PI / src.height);
+    for (int y = 0; y < src.height; ++y) {
+        const double lat = ((y + 0.5) / src.height - 0.5) * envmap::PI;
+        const double cl = std::cos(lat), sl = std::sin(lat);
+        const uint16_t *row = src.pixels + size_t(y) * size_t(src.width) * 4;
+        for (int x = 0; x < src.width; ++x) {
+            const double phi = ((x + 0.5) / src.width - 0.5) * 2.0 * envmap::PI;
+            const double cosine = n[0] * cl * std::cos(phi) + n[1] * sl + n[2] * cl * std::sin(phi);
+            if (cosine <= 0.0)
+                continue;
+            const double w = cosine * cl * pixelArea / envmap::PI;
+            for (int ch = 0; ch < 3; ++ch)
+                out[size_t(ch)] += w * rgbe::halfToFloat(row[size_t(x) * 4 + size_t(ch)]);
+        }
+    }
+    return out;
+}
+
+} // namespace sh
+
+#endif // SHIRRADIANCE_H
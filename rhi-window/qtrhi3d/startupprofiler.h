@@ -0,0 +1,261 @@
+#ifndef STARTUPPROFILER_H
+#define STARTUPPROFILER_H
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QDebug>
+#include <algorithm>
+#include <atomic>
+#include <ctime>
+#include <vector>
+
+#ifdef Q_OS_WIN
+#include <qt_windows.h>
+#endif
+
+// Where the time before the first frame goes (--profile-startup). Scopes
+// record wall and CPU time of one step on the thread that runs it; CPU time
+// is the thread's own, so work a step hands to a pool shows up under the
+// pool's scopes. Events are kept until finish(), which logs them summed
+// by name, slowest first, and writes a Chrome trace (chrome://tracing or
+// ui.perfetto.dev). A disabled profiler costs one atomic load per scope.
+
+namespace startup {
+
+// CPU time of the calling thread, or -1 where it cannot be measured.
+inline qint64 threadCpuUs() {
+#if defined(Q_OS_WIN)
+    FILETIME created, exited, kernel, user;
+    if (!GetThreadTimes(GetCurrentThread(), &created, &exited, &kernel, &user))
+        return -1;
+    auto us = [](const FILETIME &t) { return ((qint64(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 10; };
+    return us(kernel) + us(user);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0)
+        return -1;
+    return qint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#else
+    return -1;
+#endif
+}
+
+// CPU time of the whole process, every thread.
+inline qint64 processCpuUs() {
+#if defined(Q_OS_WIN)
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+        return -1;
+    auto us = [](const FILETIME &t) { return ((qint64(t.dwHighDateTime) << 32) | t.dwLowDateTime) / 10; };
+    return us(kernel) + us(user);
+#else
+    return qint64(std::clock()) * 1000000 / CLOCKS_PER_SEC;
+#endif
+}
+
+class Profiler {
+public:
+    struct Event {
+        QString name;
+        const char *category;
+        qint64 startUs; // since instance() was first called
+        qint64 wallUs;
+        qint64 cpuUs;   // -1: unknown
+        int thread;     // 0 is the thread that enabled the profiler
+    };
+
+    // The first call starts the clock; main() makes it before anything else.
+    static Profiler &instance() {
+        static Profiler p;
+        return p;
+    }
+
+    static bool isEnabled() { return enabled().load(std::memory_order_relaxed); }
+
+    // Call on the render thread; finish() writes the trace to traceFile.
+    void enable(const QString &traceFile) {
+        QMutexLocker lock(&mutex_);
+        traceFile_ = traceFile;
+        threads_.insert(QThread::currentThreadId(), 0);
+        enabled().store(true);
+    }
+
+    qint64 nowUs() const { return clock_.nsecsElapsed() / 1000; }
+
+    void record(const QString &name, const char *category, qint64 startUs, qint64 wallUs, qint64 cpuUs = -1) {
+        if (!isEnabled())
+            return;
+        QMutexLocker lock(&mutex_);
+        const Qt::HANDLE id = QThread::currentThreadId();
+        auto it = threads_.constFind(id);
+        if (it == threads_.constEnd())
+            it = threads_.insert(id, int(threads_.size()));
+        events_.push_back({ name, category, startUs, wallUs, cpuUs, *it });
+    }
+
+    // Instant events, e.g. "first frame presented"; the first of each name counts.
+    void mark(const char *name) {
+        if (!isEnabled())
+            return;
+        const qint64 now = nowUs();
+        {
+            QMutexLocker lock(&mutex_);
+            const QString n = QString::fromLatin1(name);
+            if (std::any_of(marks_.begin(), marks_.end(), [&](const auto &m) { return m.first == n; }))
+                return;
+            marks_.emplace_back(n, now);
+        }
+        record(QString::fromLatin1(name), "mark", now, 0);
+    }
+
+    bool isFinished() const { return finished_; }
+
+    // Logs the report, writes the trace and stops recording.
+    void finish() {
+        if (!isEnabled() || finished_)
+            return;
+        enabled().store(false);
+        finished_ = true;
+        const qint64 cpu = processCpuUs();
+        QMutexLocker lock(&mutex_);
+
+        struct Total {
+            qint64 wallUs = 0;
+            qint64 cpuUs = 0;
+            int count = 0;
+            bool render = false;
+            bool worker = false;
+        };
+        QHash<QString, Total> totals;
+        for (const Event &e : events_) {
+            if (!qstrcmp(e.category, "mark"))
+                continue;
+            Total &t = totals[e.name];
+            t.wallUs += e.wallUs;
+            t.cpuUs += qMax<qint64>(e.cpuUs, 0);
+            ++t.count;
+            (e.thread == 0 ? t.render : t.worker) = true;
+        }
+        std::vector<std::pair<QString, Total>> sorted;
+        for (auto it = totals.cbegin(); it != totals.cend(); ++it)
+            sorted.emplace_back(it.key(), it.value());
+        std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.second.wallUs > b.second.wallUs; });
+
+        for (const auto &[name, at] : marks_)
+            qDebug().noquote() << QStringLiteral("startup: %1 after %2 ms").arg(name).arg(at / 1000.0, 0, 'f', 1);
+        qDebug().noquote() << QStringLiteral("startup: %1 ms process CPU, %2 threads").arg(cpu / 1000.0, 0, 'f', 1).arg(threads_.size());
+        qDebug().noquote() << QStringLiteral("startup: %1 %2 %3  %4  %5")
+                                  .arg(QStringLiteral("wall ms"), 9).arg(QStringLiteral("cpu ms"), 9)
+                                  .arg(QStringLiteral("count"), 5).arg(QStringLiteral("thread"), -6).arg(QStringLiteral("step"));
+        for (const auto &[name, t] : sorted) {
+            const QString thread = t.render && t.worker ? QStringLiteral("both") : t.render ? QStringLiteral("render") : QStringLiteral("worker");
+            qDebug().noquote() << QStringLiteral("startup: %1 %2 %3  %4  %5")
+                                      .arg(t.wallUs / 1000.0, 9, 'f', 2)
+                                      .arg(t.cpuUs / 1000.0, 9, 'f', 2)
+                                      .arg(t.count, 5)
+                                      .arg(thread, -6)
+                                      .arg(name);
+        }
+
+        if (!traceFile_.isEmpty())
+            writeTrace();
+    }
+
+private:
+    Profiler() { clock_.start(); }
+
+    static std::atomic<bool> &enabled() {
+        static std::atomic<bool> e{false};
+        return e;
+    }
+
+    // Trace Event Format: complete ("X") events per thread, "i" for marks.
+    void writeTrace() const {
+        QJsonArray events;
+        for (auto it = threads_.constBegin(); it != threads_.constEnd(); ++it) {
+            events.append(QJsonObject{
+                { "name", "thread_name" }, { "ph", "M" }, { "pid", 1 }, { "tid", *it },
+                { "args", QJsonObject{ { "name", *it == 0 ? QStringLiteral("render") : QStringLiteral("worker %1").arg(*it) } } } });
+        }
+        for (const Event &e : events_) {
+            QJsonObject o{ { "name", e.name }, { "cat", QLatin1String(e.category) }, { "pid", 1 }, { "tid", e.thread },
+                           { "ts", e.startUs } };
+            if (!qstrcmp(e.category, "mark")) {
+                o.insert("ph", "i");
+                o.insert("s", "g");
+            } else {
+                o.insert("ph", "X");
+                o.insert("dur", e.wallUs);
+                if (e.cpuUs >= 0)
+                    o.insert("args", QJsonObject{ { "cpu_us", e.cpuUs } });
+            }
+            events.append(o);
+        }
+        QFile f(traceFile_);
+        if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            qWarning() << "startup: cannot write" << traceFile_ << f.errorString();
+            return;
+        }
+        f.write(QJsonDocument(QJsonObject{ { "traceEvents", events }, { "displayTimeUnit", "ms" } }).toJson(QJsonDocument::Compact));
+        qDebug() << "startup: trace written to" << traceFile_;
+    }
+
+    QElapsedTimer clock_;
+    mutable QMutex mutex_;
+    QString traceFile_;
+    std::vector<Event> events_;
+    QHash<Qt::HANDLE, int> threads_;
+    std::vector<std::pair<QString, qint64>> marks_; // in the order they happened
+    bool finished_ = false;
+};
+
+// Records its lifetime, or the part up to end(), as one event.
+class Scope {
+public:
+    explicit Scope(const char *name, const char *category = "startup") : category_(category) {
+        if (name && Profiler::isEnabled())
+            begin(QString::fromLatin1(name));
+    }
+    Scope(const QString &name, const char *category) : category_(category) {
+        if (Profiler::isEnabled())
+            begin(name);
+    }
+    ~Scope() { end(); }
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+    void end() {
+        if (!active_)
+            return;
+        active_ = false;
+        Profiler &p = Profiler::instance();
+        const qint64 cpu = startCpuUs_ < 0 ? -1 : threadCpuUs() - startCpuUs_;
+        p.record(name_, category_, startUs_, p.nowUs() - startUs_, cpu);
+    }
+
+private:
+    void begin(const QString &name) {
+        name_ = name;
+        active_ = true;
+        startUs_ = Profiler::instance().nowUs();
+        startCpuUs_ = threadCpuUs();
+    }
+
+    QString name_;
+    const char *category_;
+    qint64 startUs_ = 0;
+    qint64 startCpuUs_ = -1;
+    bool active_ = false;
+};
+
+} // namespace startup
+
+#endif // STARTUPPROFILER_H
@@ -0,0 +1,207 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include "rhicache.h"
+#include "textureloader.h"
+
+#include <rhi/qrhi.h>
+#include <QHash>
+#include <QFileInfo>
+#include <QDebug>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+// Process-wide texture cache, one per QRhi. Textures are keyed by canonical
+// path and load options and handed out as shared handles, so every model
+// asking for the same file gets the same QRhiTexture and the file is decoded
+// and uploaded once. Textures nobody holds any more stay resident until the
+// cache exceeds its memory budget, then they go least recently used first.
+// A texture whose upload sits in a batch not yet recorded is never evicted:
+// upload() entries stay until uploadsRecorded().
+
+class TextureCache {
+public:
+    using Handle = std::shared_ptr<QRhiTexture>;
+
+    struct Stats {
+        int hits = 0;
+        int misses = 0;
+        int evictions = 0;
+        quint64 bytesSaved = 0;    // uploads avoided by hits
+        quint64 residentBytes = 0;
+    };
+
+    static TextureCache *instance(QRhi *rhi) {
+        static QHash<QRhi *, TextureCache *> caches;
+        if (TextureCache *c = caches.value(rhi))
+            return c;
+        auto *c = new TextureCache(rhi);
+        caches.insert(rhi, c);
+        rhi->addCleanupCallback([](QRhi *r) { delete caches.take(r); });
+        return c;
+    }
+
+    // Owns texture; destroying it also drops the cached SRBs that bind it.
+    static Handle handle(QRhi *rhi, QRhiTexture *texture) {
+        return Handle(texture, [rhi](QRhiTexture *t) {
+            if (RhiResourceCache *c = RhiResourceCache::existing(rhi))
+                c->releaseTexture(t);
+            delete t;
+        });
+    }
+
+    static QString canonicalPath(const QString &path) {
+        if (TextureLoader::isOrmPath(path)) {
+            const QStringList s = TextureLoader::ormSources(path);
+            auto source = [&](int i) { return s.value(i).isEmpty() ? QString() : canonicalPath(s.value(i)); };
+            return TextureLoader::ormPath(source(0), source(1), source(2), source(3));
+        }
+        const QFileInfo fi(path);
+        const QString canonical = fi.canonicalFilePath();
+        return canonical.isEmpty() ? fi.absoluteFilePath() : canonical;
+    }
+
+    // Returns the cached texture or null; a hit counts towards the stats.
+    Handle find(const QString &path, const TextureOptions &options) {
+        auto it = entries_.find(key(path, options));
+        if (it == entries_.end())
+            return nullptr;
+        // the first user of a preloaded texture is not sharing anything yet
+        if (it->second.claimed) {
+            ++stats_.hits;
+            stats_.bytesSaved += it->second.bytes;
+        }
+        it->second.claimed = true;
+        it->second.uploadPending = false; // the caller's handle keeps it now
+        lru_.splice(lru_.begin(), lru_, it->second.lru);
+        return it->second.texture;
+    }
+
+    // Registers a texture created elsewhere, e.g. from a payload decoded on a worker.
+    // An unclaimed texture counts as waiting for its upload.
+    Handle insert(const QString &path, const TextureOptions &options, QRhiTexture *texture, quint64 bytes,
+                  bool claimed = true) {
+        if (!texture)
+            return nullptr;
+        ++stats_.misses;
+        const QString k = key(path, options);
+        erase(k);
+        lru_.push_front(k);
+        Entry &e = entries_[k];
+        e.texture = handle(rhi_, texture);
+        e.bytes = bytes;
+        e.lru = lru_.begin();
+        e.claimed = claimed;
+        e.uploadPending = !claimed;
+        stats_.residentBytes += bytes;
+        // a copy: trim() may erase entries, and the new one must survive it
+        const Handle h = e.texture;
+        trim();
+        return h;
+    }
+
+    // Loads an image file (or its cooked .qtex) on the calling thread and
+    // queues the upload on u.
+    Handle load(const QString &path, const TextureOptions &options, QRhiResourceUpdateBatch *u) {
+        if (Handle h = find(path, options))
+            return h;
+        qtex::Payload p = TextureLoader::decode(path, options, qtex::Targets::query(rhi_));
+        return create(path, options, p, u, true);
+    }
+
+    // Render thread half of a decode that ran elsewhere (a TextureLoader fed
+    // by an init task): creates the texture and queues its upload on u. The
+    // texture is not counted as shared until someone loads it.
+    Handle upload(const QString &path, const TextureOptions &options, qtex::Payload &p, QRhiResourceUpdateBatch *u) {
+        return create(path, options, p, u, false);
+    }
+
+    // The batches passed to upload() so far were recorded on a
+    // command buffer; their textures may be evicted from now on.
+    void uploadsRecorded() {
+        for (auto &[k, e] : entries_)
+            e.uploadPending = false;
+        trim();
+    }
+
+    static quint64 payloadBytes(const qtex::Payload &p) {
+        quint64 bytes = 0;
+        for (const auto &level : p.levels)
+            bytes += level.size();
+        return bytes;
+    }
+
+    // Unused textures are released until the resident size fits.
+    void setBudget(quint64 bytes) {
+        budget_ = bytes;
+        trim();
+    }
+    quint64 budget() const { return budget_; }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "TextureCache:" << entries_.size() << "textures," << stats_.misses << "loaded,"
+                 << stats_.hits << "shared," << stats_.bytesSaved / 1024 << "KiB not uploaded,"
+                 << stats_.residentBytes / 1024 << "KiB resident," << stats_.evictions << "evicted";
+    }
+
+private:
+    struct Entry {
+        Handle texture;
+        quint64 bytes = 0;
+        std::list<QString>::iterator lru;
+        bool claimed = true;
+        bool uploadPending = false;
+    };
+
+    explicit TextureCache(QRhi *rhi) : rhi_(rhi) {}
+
+    Handle create(const QString &path, const TextureOptions &options, qtex::Payload &p,
+                  QRhiResourceUpdateBatch *u, bool claimed) {
+        QRhiTexture *tex = p.createTexture(rhi_, options.srgb ? QRhiTexture::sRGB : QRhiTexture::Flags());
+        if (!tex)
+            return nullptr;
+        p.upload(u, tex);
+        const quint64 bytes = payloadBytes(p);
+        return insert(path, options, tex, p.generateMips ? bytes * 4 / 3 : bytes, claimed);
+    }
+
+    static QString key(const QString &path, const TextureOptions &options) {
+        return canonicalPath(path) + QLatin1Char('#') + QString::number(options.bits());
+    }
+
+    void erase(const QString &k) {
+        auto it = entries_.find(k);
+        if (it == entries_.end())
+            return;
+        stats_.residentBytes -= it->second.bytes;
+        lru_.erase(it->second.lru);
+        entries_.erase(it);
+    }
+
+    // Handles still held by a model keep their texture alive either way, so
+    // only entries the cache alone references are worth dropping.
+    void trim() {
+        auto it = lru_.end();
+        while (it != lru_.begin() && stats_.residentBytes > budget_) {
+            const auto victim = std::prev(it);
+            const Entry &e = entries_.at(*victim);
+            if (e.texture.use_count() > 1 || e.uploadPending) {
+                it = victim;
+                continue;
+            }
+            ++stats_.evictions;
+            erase(QString(*victim));
+        }
+    }
+
+    QRhi *rhi_;
+    quint64 budget_ = 512ull * 1024 * 1024;
+    Stats stats_;
+    std::unordered_map<QString, Entry> entries_;
+    std::list<QString> lru_; // most recently used first
+};
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,232 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include "assetpack.h"
+#include "qtex.h"
+
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <QImage>
+#include <QDebug>
+#include <climits>
+#include <deque>
+#include <vector>
+
+struct TextureOptions {
+    bool srgb = false;
+    bool mips = true;
+    bool flip = true; // turned on isYUpInNDC() backends, as Model expects
+    quint8 channels = 4; // 1: R8 for masks, 2: RG8 for normal maps, when not block compressed
+
+    quint32 bits() const { return quint32(srgb) | quint32(mips) << 1 | quint32(flip) << 2 | quint32(channels) << 3; }
+
+    static TextureOptions normalMap() {
+        TextureOptions o;
+        o.channels = 2;
+        return o;
+    }
+};
+
+// Decodes image files on a thread pool. Each file is read once and converted
+// to its upload layout (qtex::Payload) in the worker; the render thread takes
+// finished payloads with take() and only creates and uploads textures.
+// The result queue is bounded: workers that finish while it is full wait, so
+// decoded images never pile up faster than the render thread uploads them.
+
+class TextureLoader {
+public:
+    struct Result {
+        QString path;
+        TextureOptions options;
+        qtex::Payload payload;
+    };
+
+    explicit TextureLoader(QThreadPool *pool = QThreadPool::globalInstance(), int capacity = 8)
+        : pool_(pool), capacity_(qMax(1, capacity)) {}
+
+    ~TextureLoader() {
+        QMutexLocker lock(&mutex_);
+        cancelled_ = true;
+        notFull_.wakeAll();
+        while (running_ > 0)
+            idle_.wait(&mutex_);
+    }
+
+    TextureLoader(const TextureLoader &) = delete;
+    TextureLoader &operator=(const TextureLoader &) = delete;
+
+    void submit(const QString &path, const TextureOptions &options, const qtex::Targets &targets) {
+        {
+            QMutexLocker lock(&mutex_);
+            ++pending_;
+            ++running_;
+        }
+        pool_->start([this, path, options, targets]() {
+            {
+                QMutexLocker lock(&mutex_);
+                if (cancelled_) {
+                    if (--running_ == 0)
+                        idle_.wakeAll();
+                    return;
+                }
+            }
+            Result r{ path, options, decode(path, options, targets) };
+            QMutexLocker lock(&mutex_);
+            while (int(ready_.size()) >= capacity_ && !cancelled_)
+                notFull_.wait(&mutex_);
+            ready_.push_back(std::move(r));
+            notEmpty_.wakeAll();
+            if (--running_ == 0)
+                idle_.wakeAll();
+        });
+    }
+
+    // Submitted files whose result has not been taken yet.
+    int pending() const {
+        QMutexLocker lock(&mutex_);
+        return pending_;
+    }
+
+    // Render thread: takes up to maxResults payloads in completion order.
+    std::vector<Result> take(int maxResults = INT_MAX) {
+        std::vector<Result> out;
+        QMutexLocker lock(&mutex_);
+        while (!ready_.empty() && int(out.size()) < maxResults) {
+            out.push_back(std::move(ready_.front()));
+            ready_.pop_front();
+            --pending_;
+        }
+        notFull_.wakeAll();
+        return out;
+    }
+
+    // Blocks until a result can be taken or nothing is pending.
+    void waitForResult() {
+        QMutexLocker lock(&mutex_);
+        while (ready_.empty() && pending_ > 0)
+            notEmpty_.wait(&mutex_);
+    }
+
+    // Occlusion, roughness and metallic packed into R, G and B and height into
+    // A, like glTF's ORM maps, so the shader reads four masks with one fetch.
+    // Such a texture has a synthetic path built from its sources; decode()
+    // reads the .orm.qtex qtexcook --orm writes next to the roughness map's
+    // cooked file, stamped with all four sources, or packs the files itself.
+    static QString ormPath(const QString &ao, const QString &roughness, const QString &metallic, const QString &height) {
+        return QStringLiteral("orm:") + QStringList{ ao, roughness, metallic, height }.join(QLatin1Char('|'));
+    }
+    static bool isOrmPath(const QString &path) { return path.startsWith(QLatin1String("orm:")); }
+    static QStringList ormSources(const QString &path) { return path.mid(4).split(QLatin1Char('|')); }
+
+    static QString cookedOrmPath(const QString &path) {
+        const QString cooked = qtex::cookedPath(ormSources(path).value(1));
+        return cooked.left(cooked.size() - 5) + QStringLiteral(".orm.qtex");
+    }
+
+    // Decodes straight from the mapped asset pack when it has path.
+    static QImage loadImage(const QString &path) {
+        const QByteArray packed = qpak::packed(path);
+        if (packed.isNull())
+            return QImage(path);
+        return QImage::fromData(packed, QFileInfo(path).suffix().toLatin1().constData());
+    }
+
+    // Packs the sources' grey levels at the largest of their sizes; missing
+    // maps leave the channel unoccluded, rough, dielectric and flat.
+    static QImage packOrm(const QStringList &sources) {
+        static const uchar defaults[4] = { 255, 255, 0, 0 };
+        QImage channels[4];
+        QSize size;
+        for (int i = 0; i < 4 && i < sources.size(); ++i) {
+            if (sources[i].isEmpty())
+                continue;
+            channels[i] = loadImage(sources[i]).convertToFormat(QImage::Format_Grayscale8);
+            if (channels[i].isNull())
+                qWarning() << "Failed to load texture" << sources[i] << "- packing its default value.";
+            else
+                size = size.expandedTo(channels[i].size());
+        }
+        if (!size.isValid())
+            size = QSize(4, 4);
+
+        QImage packed(size, QImage::Format_RGBA8888);
+        for (int i = 0; i < 4; ++i) {
+            if (!channels[i].isNull() && channels[i].size() != size)
+                channels[i] = channels[i].scaled(size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+            for (int y = 0; y < size.height(); ++y) {
+                uchar *dst = packed.scanLine(y) + i;
+                const uchar *src = channels[i].isNull() ? nullptr : channels[i].constScanLine(y);
+                for (int x = 0; x < size.width(); ++x)
+                    dst[x * 4] = src ? src[x] : defaults[i];
+            }
+        }
+        return packed;
+    }
+
+    // The up to date cooked file of path, an ORM path included, or null.
+    static std::shared_ptr<qtex::File> openCooked(const QString &path) {
+        if (isOrmPath(path))
+            return qtex::File::open(cookedOrmPath(path), ormSources(path));
+        return qtex::File::open(qtex::cookedPath(path), path);
+    }
+
+    // Worker side: cooked .qtex when present, the image file otherwise, with
+    // a checker standing in for files that cannot be read.
+    static qtex::Payload decode(const QString &path, const TextureOptions &options, const qtex::Targets &targets) {
+        if (auto cooked = openCooked(path)) {
+            qtex::Payload p = cooked->transcode(targets, options.flip, nullptr);
+            if (!p.isNull())
+                return narrow(std::move(p), options);
+        }
+
+        QImage image = isOrmPath(path) ? packOrm(ormSources(path)) : loadImage(path);
+        if (image.isNull()) {
+            qWarning() << "Failed to load texture" << path << "- using 64x64 checker fallback.";
+            image = QImage(64, 64, QImage::Format_RGBA8888);
+            image.fill(Qt::white);
+            for (int y = 0; y < 64; ++y)
+                for (int x = 0; x < 64; ++x)
+                    if (((x / 8) + (y / 8)) & 1)
+                        image.setPixelColor(x, y, QColor(50, 50, 50));
+        }
+
+        const bool turn = options.flip && targets.yUp;
+        if (turn)
+            image = image.flipped(Qt::Horizontal | Qt::Vertical); // UV invert
+        qtex::Payload p = qtex::Payload::fromImage(image);
+        p.turned = turn;
+        p.turnOnYUp = options.flip;
+        p.generateMips = options.mips;
+        return narrow(std::move(p), options);
+    }
+
+private:
+    // RGBA8 levels of a map with fewer channels are cut down to R8 or RG8.
+    static qtex::Payload narrow(qtex::Payload p, const TextureOptions &options) {
+        if (p.format != bcn::Format::RGBA8 || options.channels >= 4)
+            return p;
+        p.format = options.channels == 1 ? bcn::Format::R8 : bcn::Format::RG8;
+        quint32 w = p.width, h = p.height;
+        for (auto &level : p.levels) {
+            level = bcn::encode(p.format, level.data(), w, h);
+            w = qMax(1u, w / 2);
+            h = qMax(1u, h / 2);
+        }
+        return p;
+    }
+
+    QThreadPool *pool_;
+    const int capacity_;
+    mutable QMutex mutex_;
+    QWaitCondition notFull_;
+    QWaitCondition notEmpty_;
+    QWaitCondition idle_;
+    std::deque<Result> ready_;
+    int pending_ = 0;
+    int running_ = 0;
+    bool cancelled_ = false;
+};
+
+#endif // TEXTURELOADER_H
@@ -0,0 +1,283 @@
+#ifndef TEXTURESTREAMER_H
+#define TEXTURESTREAMER_H
+
+#include "texturecache.h"
+
+#include <QThreadPool>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// Mip streaming for cooked (.qtex) textures, one streamer per QRhi.
+// A texture starts with only its coarse tail resident (largest side at most
+// INITIAL_SIZE). Every frame the users report how large the texture appears
+// on screen through request(); update() then transcodes the finer chain on
+// the pool and, once it is ready, rebuilds the texture at the new size and
+// uploads it. QRhiSampler has no LOD clamp, so the texture never holds more
+// than its resident levels: SRBs pick up the rebuilt texture on their next
+// bind. A finished load is applied only when it still fits the budget, cut
+// to what is wanted by then. Above the budget, textures drop back to their
+// coarse tail, which stays in memory so no decode runs on the render thread,
+// starting with the ones holding more than they were asked for and then the
+// least recently used; the pool reloads them once they fit again. A texture
+// is rebuilt at most once a frame.
+
+class TextureStreamer {
+public:
+    using Handle = TextureCache::Handle;
+
+    static constexpr quint32 INITIAL_SIZE = 64;
+    static constexpr quint64 GRACE_FRAMES = 120; // a texture keeps its detail this long without requests
+
+    struct Stats {
+        int textures = 0;
+        int loads = 0;              // finer chains uploaded
+        int evictions = 0;          // chains dropped to fit the budget
+        quint64 residentBytes = 0;
+        quint64 requestedBytes = 0; // what the current requests need
+        quint64 fullBytes = 0;      // every texture at full resolution
+    };
+
+    static TextureStreamer *instance(QRhi *rhi) {
+        static QHash<QRhi *, TextureStreamer *> streamers;
+        if (TextureStreamer *s = streamers.value(rhi))
+            return s;
+        auto *s = new TextureStreamer(rhi);
+        streamers.insert(rhi, s);
+        rhi->addCleanupCallback([](QRhi *r) { delete streamers.take(r); });
+        return s;
+    }
+
+    // Streams path when it has an up to date cooked file, returns null otherwise.
+    Handle load(const QString &path, const TextureOptions &options) {
+        auto it = entries_.find(key(path, options));
+        if (it != entries_.end())
+            return it->second.texture;
+        auto file = TextureLoader::openCooked(path);
+        return file ? adopt(path, std::move(file), options) : nullptr;
+    }
+
+    // Streams an already opened cooked file, e.g. one found by a loader thread.
+    Handle adopt(const QString &path, std::shared_ptr<const qtex::File> file, const TextureOptions &options) {
+        const QString k = key(path, options);
+        auto it = entries_.find(k);
+        if (it != entries_.end())
+            return it->second.texture;
+
+        Entry e;
+        e.file = std::move(file);
+        e.options = options;
+        e.levelCount = int(e.file->header().levelCount);
+        e.initial = e.levelCount - 1;
+        while (e.initial > 0 && qMax(e.file->level(quint32(e.initial - 1)).width,
+                                     e.file->level(quint32(e.initial - 1)).height) <= INITIAL_SIZE)
+            --e.initial;
+        e.resident = e.initial;
+        e.want = e.initial;
+        e.asked = e.levelCount;
+        e.lastUsed = frame_;
+
+        qtex::Payload p = e.file->transcode(targets_, options.flip, nullptr, quint32(e.initial));
+        QRhiTexture *tex = p.createTexture(rhi_, options.srgb ? QRhiTexture::sRGB : QRhiTexture::Flags());
+        if (!tex)
+            return nullptr;
+        e.texture = TextureCache::handle(rhi_, tex);
+        e.tail = p;
+        e.fullBytes = bytesFrom(e, 0);
+        stats_.residentBytes += bytesFrom(e, e.resident);
+        stats_.fullBytes += e.fullBytes;
+        ++stats_.textures;
+        byTexture_[tex] = k;
+        initialUploads_.emplace_back(e.texture, std::move(p));
+        return entries_.emplace(k, std::move(e)).first->second.texture;
+    }
+
+    // Reports that texture is drawn with uvPerUnit texture repeats per world
+    // unit, where one world unit covers pixelsPerUnit pixels on screen.
+    void request(const QRhiTexture *texture, float uvPerUnit, float pixelsPerUnit) {
+        auto it = byTexture_.find(texture);
+        if (it == byTexture_.end() || pixelsPerUnit <= 0.0f)
+            return;
+        Entry &e = entries_.at(it->second);
+        const qtex::Header &h = e.file->header();
+        const float texelsPerPixel = float(qMax(h.width, h.height)) * uvPerUnit / pixelsPerUnit;
+        const int level = std::clamp(int(std::floor(std::log2(qMax(texelsPerPixel, 1.0f)))), 0, e.levelCount - 1);
+        e.asked = qMin(e.asked, level);
+        e.lastUsed = frame_;
+    }
+
+    // Render thread, once per frame before drawing: uploads what finished
+    // loading, starts loads for new requests and trims to the budget.
+    void update(QRhiResourceUpdateBatch *u) {
+        ++frame_;
+        for (auto &[tex, payload] : initialUploads_)
+            payload.upload(u, tex.get());
+        initialUploads_.clear();
+
+        stats_.requestedBytes = 0;
+        for (auto &[k, e] : entries_) {
+            if (e.asked < e.levelCount)
+                e.want = e.asked;
+            else if (frame_ - e.lastUsed > GRACE_FRAMES)
+                e.want = e.initial;
+            e.asked = e.levelCount;
+            stats_.requestedBytes += bytesFrom(e, e.want);
+        }
+
+        std::vector<Loaded> loaded;
+        {
+            QMutexLocker lock(&results_->mutex);
+            loaded.swap(results_->done);
+        }
+        for (Loaded &l : loaded) {
+            auto it = entries_.find(l.key);
+            if (it == entries_.end())
+                continue;
+            Entry &e = it->second;
+            e.loading = -1;
+            // no finer than wanted now, and only within the budget
+            const int level = qMax(l.level, e.want);
+            if (l.payload.isNull() || level >= e.resident || e.resizedFrame == frame_ || !fits(e, level))
+                continue;
+            l.payload.levels.erase(l.payload.levels.begin(), l.payload.levels.begin() + (level - l.level));
+            l.payload.width = e.file->level(quint32(level)).width;
+            l.payload.height = e.file->level(quint32(level)).height;
+            resize(e, level, l.payload, u);
+            ++stats_.loads;
+        }
+
+        for (auto &[k, e] : entries_)
+            if (e.want < e.resident && e.loading < 0 && fits(e, e.want))
+                startLoad(k, e);
+        trim(u);
+    }
+
+    void setBudget(quint64 bytes) { budget_ = bytes; }
+    quint64 budget() const { return budget_; }
+
+    const Stats &stats() const { return stats_; }
+
+    void dumpStats() const {
+        qDebug() << "TextureStreamer:" << stats_.textures << "textures," << stats_.residentBytes / 1024 << "KiB resident,"
+                 << stats_.requestedBytes / 1024 << "KiB requested," << stats_.fullBytes / 1024 << "KiB at full size,"
+                 << stats_.loads << "loads," << stats_.evictions << "evictions";
+    }
+
+private:
+    struct Entry {
+        std::shared_ptr<const qtex::File> file;
+        TextureOptions options;
+        Handle texture;
+        int levelCount = 0;
+        int initial = 0;  // coarse tail every texture keeps
+        int resident = 0; // finest level on the GPU
+        int want = 0;     // finest level the requests ask for
+        int asked = 0;    // finest level requested this frame, levelCount if none
+        int loading = -1; // level a pool task is transcoding
+        qtex::Payload tail; // the initial levels, kept to fall back to
+        quint64 lastUsed = 0;
+        quint64 resizedFrame = 0;
+        quint64 fullBytes = 0;
+    };
+
+    struct Loaded {
+        QString key;
+        int level;
+        qtex::Payload payload;
+    };
+
+    // shared with pool tasks, which may outlive the streamer
+    struct Results {
+        QMutex mutex;
+        std::vector<Loaded> done;
+    };
+
+    explicit TextureStreamer(QRhi *rhi) : rhi_(rhi), targets_(qtex::Targets::query(rhi)) {}
+
+    static QString key(const QString &path, const TextureOptions &options) {
+        return TextureCache::canonicalPath(path) + QLatin1Char('#') + QString::number(options.bits());
+    }
+
+    // GPU bytes of the chain from level down, in the format it is uploaded in.
+    quint64 bytesFrom(const Entry &e, int level) const {
+        const qtex::Header &h = e.file->header();
+        const bool native = targets_.supports(h.format);
+        quint64 bytes = 0;
+        for (int i = level; i < e.levelCount; ++i) {
+            const qtex::Level &l = e.file->level(quint32(i));
+            bytes += native ? l.rawSize : quint64(l.width) * l.height * 4;
+        }
+        return bytes;
+    }
+
+    // Whether e at level stays within the budget.
+    bool fits(const Entry &e, int level) const {
+        return stats_.residentBytes + bytesFrom(e, level) - bytesFrom(e, e.resident) <= budget_;
+    }
+
+    void startLoad(const QString &k, Entry &e) {
+        e.loading = e.want;
+        auto file = e.file;
+        auto results = results_;
+        const qtex::Targets targets = targets_;
+        const bool flip = e.options.flip;
+        const int level = e.want;
+        QThreadPool::globalInstance()->start([=]() {
+            Loaded l{ k, level, file->transcode(targets, flip, nullptr, quint32(level)) };
+            QMutexLocker lock(&results->mutex);
+            results->done.push_back(std::move(l));
+        });
+    }
+
+    void resize(Entry &e, int level, const qtex::Payload &p, QRhiResourceUpdateBatch *u) {
+        QRhiTexture *tex = e.texture.get();
+        tex->setPixelSize(p.size());
+        if (p.levels.size() > 1)
+            tex->setFlags(tex->flags() | QRhiTexture::MipMapped);
+        if (!tex->create()) {
+            qWarning() << "TextureStreamer: failed to rebuild texture at level" << level;
+            return;
+        }
+        p.upload(u, tex);
+        stats_.residentBytes = stats_.residentBytes - bytesFrom(e, e.resident) + bytesFrom(e, level);
+        e.resident = level;
+        e.resizedFrame = frame_;
+    }
+
+    void trim(QRhiResourceUpdateBatch *u) {
+        if (stats_.residentBytes <= budget_)
+            return;
+        std::vector<Entry *> order;
+        for (auto &[k, e] : entries_)
+            if (e.resident < e.initial && e.resizedFrame != frame_)
+                order.push_back(&e);
+        // more than asked for first, then least recently used
+        std::sort(order.begin(), order.end(), [](const Entry *a, const Entry *b) {
+            const bool aOver = a->resident < a->want, bOver = b->resident < b->want;
+            return aOver != bOver ? aOver : a->lastUsed < b->lastUsed;
+        });
+        for (Entry *e : order) {
+            resize(*e, e->initial, e->tail, u);
+            ++stats_.evictions;
+            if (stats_.residentBytes <= budget_)
+                break;
+        }
+    }
+
+    QRhi *rhi_;
+    qtex::Targets targets_;
+    quint64 budget_ = 256ull * 1024 * 1024;
+    quint64 frame_ = 0;
+    Stats stats_;
+    std::unordered_map<QString, Entry> entries_;
+    std::unordered_map<const QRhiTexture *, QString> byTexture_;
+    std::vector<std::pair<Handle, qtex::Payload>> initialUploads_;
+    std::shared_ptr<Results> results_ = std::make_shared<Results>();
+};
+
+#endif // TEXTURESTREAMER_H
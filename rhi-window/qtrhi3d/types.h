@@ -3,6 +3,7 @@
 #include <QMatrix4x4>
 #include <QMatrix4x4>
 #include <QVector4D>
+#include <QStringList>
 
 
 
@@ -22,6 +23,8 @@ struct TextureSet {
     QString rougness;
     QString height;
     QString ao;
+
+    QStringList paths() const { return { albedo, normal, metallic, rougness, height, ao }; }
 };
 
 struct Ubo {
@@ -46,7 +49,8 @@ struct alignas(16) GpuUbo {
     float color[4];        // offset 272 (16 B)
     float camPos[4];       // offset 288 (16 B)
     float opacity[4];      // offset 304 (16 B)
-    float misc[4];
+    float misc[4];         // offset 320 (16 B)
+    float material[4];     // offset 336 (16 B) MaterialAtlas layer of albedo, normal, orm
 };
 
 
@@ -9,6 +9,7 @@
 #include <QRandomGenerator>
 #include <rhi/qshader.h>
 #include "qtrhi3d/geometry.h"
+#include "qtrhi3d/assetpack.h"
 #include "qtrhi3d/apifuturesinfo.h"
 #include <rhi/qrhi_platform.h>
 
@@ -60,6 +61,7 @@ void RhiWindow::exposeEvent(QExposeEvent *)
 {
     if (isExposed() && !m_initialized) {
         init();
+        startup::Scope scope("swapchain createOrResize");
         resizeSwapChain();
         m_initialized = true;
     }
@@ -96,6 +98,7 @@ bool RhiWindow::event(QEvent *e)
 
 void RhiWindow::init()
 {
+    startup::Scope rhiScope("QRhi::create");
     QRhi::Flags rhiFlags = QRhi::EnableDebugMarkers;
     if (m_graphicsApi == QRhi::Null) {
         QRhiNullInitParams params;
@@ -148,14 +151,18 @@ void RhiWindow::init()
 
     if (!m_rhi)
         qFatal("Failed to create RHI backend");
+    rhiScope.end();
 
+    startup::Scope swapChainScope("swapchain setup");
     m_sc.reset(m_rhi->newSwapChain());
     m_ds.reset(m_rhi->newRenderBuffer(QRhiRenderBuffer::DepthStencil,QSize(),1,QRhiRenderBuffer::UsedWithSwapChainOnly));
     m_sc->setWindow(this);
     m_sc->setDepthStencil(m_ds.get());
     m_rp.reset(m_sc->newCompatibleRenderPassDescriptor());
     m_sc->setRenderPassDescriptor(m_rp.get());
+    swapChainScope.end();
 
+    startup::Scope initScope("customInit");
     customInit();
 }
 
@@ -222,8 +229,14 @@ void RhiWindow::render()
     }
 
 
+    startup::Scope frameScope(m_firstFramePresented ? nullptr : "first customRender");
     customRender();
+    frameScope.end();
     m_rhi->endFrame(m_sc.get());
+    if (!m_firstFramePresented) {
+        m_firstFramePresented = true;
+        startup::Profiler::instance().mark("first frame presented");
+    }
     requestUpdate();
 }
 
@@ -231,9 +244,10 @@ void RhiWindow::render()
 
 static QShader getShader(const QString &name)
 {
-    QFile f(name);
-    if (f.open(QIODevice::ReadOnly))
-        return QShader::fromSerialized(f.readAll());
+    startup::Scope scope("shader load");
+    const QByteArray data = qpak::read(name);
+    if (!data.isEmpty())
+        return QShader::fromSerialized(data);
     return QShader();
 }
 
@@ -257,20 +271,7 @@ HelloWindow::~HelloWindow()
         shadowPipeline = nullptr;
     }
 
-    if (shadowSRB) {
-       // m_shadowSRB->release();
-        delete shadowSRB;
-        shadowSRB = nullptr;
-    }
-
-    if (shadowUbo) {
-    //    m_shadowUbo->release();
-        delete shadowUbo;
-        shadowUbo = nullptr;
-    }
-
     delete shadowMapTexture;
-    delete shadowMapSampler;
     delete shadowMapRenderTarget;
     delete shadowMapRenderPassDesc;
 
@@ -281,6 +282,21 @@ void HelloWindow::customInit()
     //dumpApiFeatures(m_rhi.get());
 
     initialUpdateBatch = m_rhi->nextResourceUpdateBatch();
+    // the importer's and the init tasks' workers transcode cooked textures for these formats
+    const qtex::Targets targets = qtex::Targets::query(m_rhi.get());
+
+    // meshes and textures are added by the importer while frames keep
+    // rendering; it goes first so its parsing overlaps everything below
+    model = std::make_unique<FbxModel>();
+    model->transform.position = QVector3D(-5.0f, 0.0f, -28.0f);
+    QString url = QCoreApplication::applicationDirPath() + "/assets/models/jet/jet.fbx";
+    modelImportStartUs = startup::Profiler::instance().nowUs();
+    if (!QFile::exists(url) && !QFile::exists(qmesh::cookedPath(url, qmesh::VertexLayout::Static))) {
+        qWarning() << "url not exist:" << url;
+        modelImportDone = true;
+    } else {
+        modelImportJob = importer.load(url);
+    }
 
     initShadowMapResources(m_rhi.get());
 
@@ -289,9 +305,7 @@ void HelloWindow::customInit()
 
     hsky = std::make_unique<HdriSky>("assets/textures/sky.hdr");
     hsky->create(m_rhi.get(),m_rp.get(),initialUpdateBatch);
-    QRhiCommandBuffer *cb = m_sc->currentFrameCommandBuffer();
-    hsky->initCubemap(initialUpdateBatch);
-  //  hsky->initCubemapOnGPU(initialUpdateBatch,cb);
+    BrdfLut::instance(m_rhi.get())->prepare(initialUpdateBatch);
     const QSize outputSize = m_sc->currentPixelSize();
     m_projection = createProjection(m_rhi.get(), 45.0f, outputSize.width() / (float)outputSize.height(), 0.1f, 1000.0f);
 
@@ -311,39 +325,39 @@ void HelloWindow::customInit()
     set1.height = ":/assets/textures/panel/sci-fi-panel1-height.png";
     set1.ao = ":/assets/textures/panel/sci-fi-panel1-ao.png";
 
-    QShader vsWire = getShader(":/shaders/prebuild/mcolor.vert.qsb");
-    QShader fsWire = getShader(":/shaders/prebuild/mcolor.frag.qsb");
-    QShader vs = getShader(":/shaders/prebuild/texture.vert.qsb");
-    QShader fs = getShader(":/shaders/prebuild/texture.frag.qsb");
-    QShader vs1 = getShader(":/shaders/prebuild/light.vert.qsb");
-    QShader fs1 = getShader(":/shaders/prebuild/light.frag.qsb");
-    QShader vs2 ;
-    QShader fs2 ;
+    // each texture set keeps its own streamed textures; with --material-atlas
+    // all PBR models share one SRB over the atlas arrays when the device allows it
+    MaterialAtlas *atlas = MaterialAtlas::instance(m_rhi.get());
+    atlas->add(set);
+    atlas->add(set1);
+    const bool useAtlas = MaterialAtlas::isEnabled() && atlas->isSupported();
 
+    QString pbrVert;
+    QString pbrFrag; // without the .frag.qsb or .atlas.frag.qsb suffix
     switch (m_rhi->backend()) {
     case QRhi::Vulkan:
      //   qDebug() << "Vulkan";
-        vs2 = getShader(":/shaders/prebuild/pbrvk.vert.qsb");
-        fs2 = getShader(":/shaders/prebuild/pbrvk.frag.qsb");
+        pbrVert = ":/shaders/prebuild/pbrvk.vert.qsb";
+        pbrFrag = ":/shaders/prebuild/pbrvk";
         shaderapi = 3;
         break;
     case QRhi::OpenGLES2:
      //   qDebug() << "OpenGL / OpenGLES";
 
-         vs2 = getShader(":/shaders/prebuild/pbr.vert.qsb");
-         fs2 = getShader("://shaders/prebuild/pbr.frag.qsb");
+         pbrVert = ":/shaders/prebuild/pbr.vert.qsb";
+         pbrFrag = "://shaders/prebuild/pbr";
          shaderapi = 1;
         break;
     case QRhi::D3D11:
      //   qDebug() << "Direct3D11";
-        vs2 = getShader(":/shaders/prebuild/pbrd3d.vert.qsb");
-        fs2 = getShader(":/shaders/prebuild/pbrd3d.frag.qsb");
+        pbrVert = ":/shaders/prebuild/pbrd3d.vert.qsb";
+        pbrFrag = ":/shaders/prebuild/pbrd3d";
         break;
         shaderapi = 2;
     case QRhi::D3D12:
        // qDebug() << "Direct3D12";
-        vs2 = getShader(":/shaders/prebuild/pbrd3d.vert.qsb");
-        fs2 = getShader(":/shaders/prebuild/pbrd3d.frag.qsb");
+        pbrVert = ":/shaders/prebuild/pbrd3d.vert.qsb";
+        pbrFrag = ":/shaders/prebuild/pbrd3d";
         shaderapi = 2;
         break;
     case QRhi::Metal:      qDebug() << "Metal";
@@ -351,61 +365,175 @@ void HelloWindow::customInit()
     default:               qDebug() << "Null / Unknown"; break;
     }
 
-    QVector<float> sphereVertices;
-    QVector<quint16> sphereIndices;
-    generateSphere(0.5f, 32, 64, sphereVertices, sphereIndices);
-
-    QVector<float> cVertices;
-    QVector<quint16> cIndices;
-    generateCube(1.0f, cVertices, cIndices);
-
-    QVector<float> planeVertices;
-    QVector<quint16> planeIndices;
-    generatePlane(150.0f, 150.0f, 10, 10, 20.0f, 20.0f, planeVertices, planeIndices);
-
-    floor.addVertAndInd(planeVertices ,planeIndices );
-    floor.init(m_rhi.get(), m_rp.get(), vs2, fs2, initialUpdateBatch,shadowMapTexture,shadowMapSampler,set);
     floor.transform.position = QVector3D(0, -0.5f, 0);
     //floor.transform.scale = QVector3D(10, 10, 10);
     //floor.transform.rotation.setX( 270.0f);
-
-    cubeModel1.addVertAndInd(cVertices, cIndices);
-    cubeModel1.init(m_rhi.get(), m_rp.get(), vs2, fs2, initialUpdateBatch,shadowMapTexture,shadowMapSampler,set1);
     cubeModel1.transform.position = QVector3D(-6, 1.5, 0);
     cubeModel1.transform.scale = QVector3D(2, 2, 2);
-
-    cubeModel.addVertAndInd(planeVertices, planeIndices);
-    cubeModel.init(m_rhi.get(), m_rp.get(), vs2, fs2, initialUpdateBatch,shadowMapTexture,shadowMapSampler,set1);
     cubeModel.transform.position = QVector3D(6, 1.0, 0);
     cubeModel.transform.scale = QVector3D(2, 2, 2);
-
-    lightSphere.addVertAndInd(sphereVertices, sphereIndices);
-    lightSphere.init(m_rhi.get(),m_rp.get(), vsWire, fsWire, initialUpdateBatch,shadowMapTexture,shadowMapSampler,set);
     lightSphere.transform.position = QVector3D(6.0f,10.4f, 15.4f);
     lightSphere.transform.scale = QVector3D(0.2f,0.2f, 0.2f);
-
-    sphereModel.addVertAndInd(sphereVertices, sphereIndices);
-    sphereModel.init(m_rhi.get(),m_rp.get(), vs2, fs2, initialUpdateBatch,shadowMapTexture,shadowMapSampler,set);
     sphereModel.transform.position = QVector3D(2.0f,2.0f, -6.0f);
     sphereModel.transform.scale = QVector3D(3.0f,3.0f, 3.0f);
-
-    sphereModel1.addVertAndInd(sphereVertices, sphereIndices);
-    sphereModel1.init(m_rhi.get(),m_rp.get(), vs2, fs2, initialUpdateBatch,shadowMapTexture,shadowMapSampler,set1);
     sphereModel1.transform.position = QVector3D(-2.0f,1.0f, -6.0f);
     sphereModel1.transform.scale = QVector3D(3.0f,3.0f, 3.0f);
+    // only the light sphere and the two rotating models move; the rest is drawn into the shadow cache
+    floor.staticCaster = true;
+    cubeModel.staticCaster = true;
+    sphereModel.staticCaster = true;
+
+    // local lights, shadowed through the ShadowAtlas
+    ShadowAtlas *shadowAtlas = ShadowAtlas::instance(m_rhi.get());
+    if (shadowAtlas->lightCount() == 0) {
+        ShadowAtlas::Light lamp;
+        lamp.type = ShadowAtlas::LightType::Point;
+        lamp.position = QVector3D(0.0f, 4.5f, -3.0f);
+        lamp.color = QVector3D(1.0f, 0.7f, 0.4f);
+        lamp.intensity = 20.0f;
+        lamp.range = 12.0f;
+        shadowAtlas->addLight(lamp);
+
+        ShadowAtlas::Light spot;
+        spot.type = ShadowAtlas::LightType::Spot;
+        spot.position = QVector3D(-8.0f, 7.0f, 6.0f);
+        spot.direction = cubeModel1.transform.position - spot.position;
+        spot.color = QVector3D(0.5f, 0.7f, 1.0f);
+        spot.intensity = 60.0f;
+        spot.range = 20.0f;
+        spot.outerAngle = 25.0f;
+        spot.innerAngle = 18.0f;
+        shadowAtlas->addLight(spot);
+
+        spot.position = QVector3D(8.0f, 6.0f, 6.0f);
+        spot.direction = cubeModel.transform.position - spot.position;
+        spot.color = QVector3D(1.0f, 0.9f, 0.8f);
+        spot.intensity = 40.0f;
+        spot.range = 18.0f;
+        spot.outerAngle = 30.0f;
+        spot.innerAngle = 22.0f;
+        shadowAtlas->addLight(spot);
+    }
 
-    QString url = QCoreApplication::applicationDirPath() + "/assets/models/jet/jet.fbx";
-    if (!QFile::exists(url)) {qWarning() << "url not exist:" << url; return;} 
-    model = std::make_unique<FbxModel>(url);
-    model->create(m_rhi.get(),m_sc->currentFrameRenderTarget(),m_rp.get());
-   // model->modelInfo();
-
-    models.append(&floor);
-    models.append(&cubeModel1);
-    models.append(&cubeModel);
-    models.append(&lightSphere);
-    models.append(&sphereModel);
-    models.append(&sphereModel1);
+    // The rest loads as a task graph while frames are presented: decoding and
+    // geometry on workers, uploads and pipelines in customRender(). Models
+    // show up as soon as everything they bind is there.
+    initGraph = std::make_unique<InitGraph>();
+
+    struct Shaders {
+        QShader wireVs, wireFs, pbrVs, pbrFs, pbrAtlasFs;
+    };
+    auto shaders = std::make_shared<Shaders>();
+    const int shaderTask = initGraph->add(QStringLiteral("shaders"), InitGraph::Worker,
+                                          [shaders, pbrVert, pbrFrag, useAtlas](QRhiResourceUpdateBatch *) {
+        shaders->wireVs = getShader(":/shaders/prebuild/mcolor.vert.qsb");
+        shaders->wireFs = getShader(":/shaders/prebuild/mcolor.frag.qsb");
+        if (pbrVert.isEmpty())
+            return;
+        shaders->pbrVs = getShader(pbrVert);
+        // the plain variant also covers an atlas that fails to upload
+        shaders->pbrFs = getShader(pbrFrag + QStringLiteral(".frag.qsb"));
+        if (useAtlas)
+            shaders->pbrAtlasFs = getShader(pbrFrag + QStringLiteral(".atlas.frag.qsb"));
+    });
+
+    const int geometryTask = initGraph->add(QStringLiteral("geometry"), InitGraph::Worker, [this](QRhiResourceUpdateBatch *) {
+        QVector<float> sphereVertices;
+        QVector<quint16> sphereIndices;
+        generateSphere(0.5f, 32, 64, sphereVertices, sphereIndices);
+
+        QVector<float> cVertices;
+        QVector<quint16> cIndices;
+        generateCube(1.0f, cVertices, cIndices);
+
+        QVector<float> planeVertices;
+        QVector<quint16> planeIndices;
+        generatePlane(150.0f, 150.0f, 10, 10, 20.0f, 20.0f, planeVertices, planeIndices);
+
+        floor.addVertAndInd(planeVertices ,planeIndices );
+        cubeModel1.addVertAndInd(cVertices, cIndices);
+        cubeModel.addVertAndInd(planeVertices, planeIndices);
+        lightSphere.addVertAndInd(sphereVertices, sphereIndices);
+        sphereModel.addVertAndInd(sphereVertices, sphereIndices);
+        sphereModel1.addVertAndInd(sphereVertices, sphereIndices);
+        for (Model *m : { &floor, &cubeModel1, &cubeModel, &lightSphere, &sphereModel, &sphereModel1 })
+            m->prepare();
+    });
+
+    // the GPU path's passes are recorded at the start of the next frame, see customRender()
+    const int hdrTask = initGraph->add(QStringLiteral("sky HDR"), InitGraph::Worker,
+                                       [this](QRhiResourceUpdateBatch *) { hsky->prepare(); });
+    const int skyTask = initGraph->add(QStringLiteral("sky IBL"), InitGraph::Render, [this](QRhiResourceUpdateBatch *u) {
+        hsky->initCubemapOnGPU(u);
+        if (hsky->hasIrradiance()) {
+            FrameUniforms::instance(m_rhi.get())->setIrradiance(hsky->irradiance());
+            FrameUniforms::instance(m_rhi.get())->setSpecular(hsky->specularCubemap(), hsky->specularLevels());
+        }
+    }, { hdrTask });
+
+    int textureTask;
+    if (useAtlas) {
+        const int decodeTask = initGraph->add(QStringLiteral("atlas decode"), InitGraph::Worker,
+                                              [atlas, targets](QRhiResourceUpdateBatch *) { atlas->decode(targets); });
+        textureTask = initGraph->add(QStringLiteral("atlas upload"), InitGraph::Render, [atlas](QRhiResourceUpdateBatch *u) {
+            if (!atlas->upload(u))
+                qWarning() << "MaterialAtlas: upload failed, models load separate textures";
+        }, { decodeTask });
+    } else {
+        // without the atlas, cooked textures start streaming from their coarse
+        // mips and the others are decoded on the pool; a few decoded images
+        // are uploaded per frame, so the loader's bounded queue throttles the
+        // decodes. The models' init() then shares them
+        struct PendingTexture {
+            QString path;
+            TextureOptions options;
+            std::shared_ptr<qtex::File> cooked;
+        };
+        struct PendingTextures {
+            std::vector<PendingTexture> textures;
+            TextureLoader loader;
+        };
+        auto pending = std::make_shared<PendingTextures>();
+        for (const TextureSet *s : { &set, &set1 }) {
+            pending->textures.push_back({ s->albedo, {}, nullptr });
+            pending->textures.push_back({ MaterialAtlas::ormPath(*s), {}, nullptr });
+            pending->textures.push_back({ s->normal, TextureOptions::normalMap(), nullptr });
+        }
+        const int decodeTask = initGraph->add(QStringLiteral("texture decode"), InitGraph::Worker,
+                                              [pending, targets](QRhiResourceUpdateBatch *) {
+            for (PendingTexture &t : pending->textures) {
+                t.cooked = TextureLoader::openCooked(t.path);
+                if (!t.cooked)
+                    pending->loader.submit(t.path, t.options, targets);
+            }
+        });
+        textureTask = initGraph->addSteps(QStringLiteral("texture upload"), [this, pending](QRhiResourceUpdateBatch *u) {
+            for (PendingTexture &t : pending->textures)
+                if (t.cooked)
+                    TextureStreamer::instance(m_rhi.get())->adopt(t.path, std::move(t.cooked), t.options);
+            pending->textures.clear();
+            for (TextureLoader::Result &r : pending->loader.take(TEXTURE_UPLOADS_PER_FRAME))
+                TextureCache::instance(m_rhi.get())->upload(r.path, r.options, r.payload, u);
+            return pending->loader.pending() == 0;
+        }, { decodeTask });
+    }
+
+    // the SRBs bind the specular cube, so models wait for the sky as well
+    auto addModel = [&](const QString &name, Model *m, bool wire, const TextureSet &s) {
+        initGraph->add(name, InitGraph::Render, [this, m, wire, s, shaders, atlas](QRhiResourceUpdateBatch *u) {
+            const QShader &vs = wire ? shaders->wireVs : shaders->pbrVs;
+            const QShader &fs = wire ? shaders->wireFs : atlas->isReady() ? shaders->pbrAtlasFs : shaders->pbrFs;
+            m->init(m_rhi.get(), m_rp.get(), vs, fs, u, shadowMapTexture, shadowMapSampler, s);
+            models.append(m);
+        }, { shaderTask, geometryTask, textureTask, skyTask });
+    };
+    addModel(QStringLiteral("floor"), &floor, false, set);
+    addModel(QStringLiteral("cubeModel1"), &cubeModel1, false, set1);
+    addModel(QStringLiteral("cubeModel"), &cubeModel, false, set1);
+    addModel(QStringLiteral("lightSphere"), &lightSphere, true, set);
+    addModel(QStringLiteral("sphereModel"), &sphereModel, false, set);
+    addModel(QStringLiteral("sphereModel1"), &sphereModel1, false, set1);
+    initGraph->start();
 
     mainCamera.Position = QVector3D(-0.5f,5.5f, 15.5f);
     mainTimer.start();
@@ -430,6 +558,26 @@ void HelloWindow::customRender()
     }
 
     QRhiCommandBuffer *cb = m_sc->currentFrameCommandBuffer();
+    // startup tasks that touch the QRhi; their uploads go ahead of both passes
+    if (initGraph) {
+        QRhiResourceUpdateBatch *initUpdates = m_rhi->nextResourceUpdateBatch();
+        initGraph->pump(initUpdates);
+        cb->resourceUpdate(initUpdates);
+        TextureCache::instance(m_rhi.get())->uploadsRecorded();
+        if (initGraph->isFinished()) {
+            initGraph->dumpTimeline();
+            initGraph.reset();
+            RhiResourceCache::instance(m_rhi.get())->dumpStats();
+            TextureCache::instance(m_rhi.get())->dumpStats();
+            MaterialAtlas::instance(m_rhi.get())->dumpStats();
+            qpak::dumpStats();
+            recorder.dumpStats();
+            BrdfLut::instance(m_rhi.get())->dumpStats();
+        }
+    }
+    hsky->recordInitPasses(cb);
+    BrdfLut::instance(m_rhi.get())->recordPasses(cb);
+    recorder.begin(cb);
 
 
     updateCamera(deltaTime);
@@ -464,27 +612,21 @@ void HelloWindow::customRender()
     sphereModel1.transform.rotation.setY( sphereModel1.transform.rotation.y() + 0.5f);
     cubeModel1.transform.rotation.setY(cubeModel1.transform.rotation.y() + 0.5f);
 
-    QMatrix4x4 lightView;
-    QMatrix4x4 lightSpaceMatrix;
-    QMatrix4x4 lightProjection;
-    float nearPlane = 0.1f;
-    float farPlane = 60.0f;
-    float orthoSize = 40.0f;
-
-    lightView.lookAt(lightPosition, center, QVector3D(0,1,0));
-
-    QRhi::Implementation backend = m_rhi->backend();
-    if (backend == QRhi::D3D11 || backend == QRhi::D3D12  || backend == QRhi::Vulkan ) {
-        lightProjection.ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, nearPlane, farPlane);
-        lightSpaceMatrix= lightProjection * lightView;
-        lightSpaceMatrix = m_rhi->clipSpaceCorrMatrix() * lightSpaceMatrix;
-    }
-    else{
-         lightProjection.ortho(-orthoSize, orthoSize, -orthoSize, orthoSize, nearPlane, farPlane);
-         lightSpaceMatrix= lightProjection * lightView;
-    }
-
     QMatrix4x4 view = mainCamera.GetViewMatrix();
+
+    // the light looks at the scene center; each cascade covers one slice of the camera frustum
+    // and keeps the light its cached static depth was drawn with until the cache refreshes it
+    quint64 staticRevision = 0;
+    for (auto m : std::as_const(models))
+        staticRevision += m->staticCaster ? m->revision() + 1 : 0;
+    cascades.fitCamera(m_rhi.get(), view, m_projection, 0.1f);
+    shadowCache.update(cascades, lightPosition, center - lightPosition, staticRevision);
+    FrameUniforms::instance(m_rhi.get())->setShadowCascades(cascades);
+    // local light tiles follow how large each light appears; only a few are redrawn a frame
+    ShadowAtlas *shadowAtlas = ShadowAtlas::instance(m_rhi.get());
+    shadowAtlas->update(view, m_projection, m_sc->currentPixelSize().height());
+    FrameUniforms::instance(m_rhi.get())->setLocalLights(*shadowAtlas);
+    const QMatrix4x4 lightSpaceMatrix = cascades.cascade(0).lightSpace;
     float debug = 0.0F;
     float lightIntensity = 1.0f;
     float ambientStrange = 1.0f;
@@ -511,23 +653,32 @@ void HelloWindow::customRender()
         m->updateUbo(ubo,resourceUpdateBatch);
     }
 
-    for (auto m : std::as_const(models)) {
-        m->updateShadowUbo(ubo,shadowUpdateBatch);
+    Ubo shadowUbo = ubo;
+    for (int i = 0; i < cascades.cascadeCount(); ++i) {
+        shadowUbo.lightSpace = cascades.cascade(i).lightSpace;
+        for (auto m : std::as_const(models))
+            m->updateShadowUbo(shadowUbo, shadowUpdateBatch, i);
+    }
+    for (int k = 0; k < int(shadowAtlas->updates().size()); ++k) {
+        shadowUbo.lightSpace = shadowAtlas->updates()[size_t(k)].lightSpace;
+        for (auto m : std::as_const(models))
+            m->updateShadowUbo(shadowUbo, shadowUpdateBatch, ShadowAtlas::FIRST_VIEW + k);
     }
 
     //float time = m_casovac->elapsedSeconds();
     sky->update(resourceUpdateBatch, invView, invProj, sunDir, lightTime);
     hsky->updateResources(resourceUpdateBatch,view, m_projection);
+    FrameUniforms::instance(m_rhi.get())->update(resourceUpdateBatch);
    // QRhiResourceUpdateBatch *u = rhi->nextResourceUpdateBatch();
     generateCube(1.0f, cVertices, cIndices);
-    cubeModel.updateGeometry(m_rhi.get(), resourceUpdateBatch1, cVertices, cIndices);
+    if (models.contains(&cubeModel)) // its geometry may still be prepared on a worker
+        cubeModel.updateGeometry(m_rhi.get(), resourceUpdateBatch1, cVertices, cIndices);
    // m_rhi->submitResourceUpdate();
     cb->resourceUpdate(resourceUpdateBatch1);
 
     Q_ASSERT(shadowMapRenderTarget);
     Q_ASSERT(shadowPipeline);
     Q_ASSERT(shadowSRB);
-    Q_ASSERT(shadowUbo);
 
     const QSize outputSizeInPixels = m_sc->currentPixelSize();
     const QColor clearColor = QColor::fromRgbF(0.0f, 0.0f, 0.0f, 1.0f);
@@ -537,55 +688,145 @@ void HelloWindow::customRender()
     updateUI(outputSizeInPixels, resourceUpdateBatch);
     QMatrix4x4 mvp_;
     mvp_.setToIdentity();
-    QMatrix4x4 model1;
-
-    model1.setToIdentity();
    // mvp_.perspective(45.0f, rtsz.width() / (float)rtsz.height(), 0.01f, 3000.0f);
-    model1.translate({ -5.0f, 0.0f, -28.0f });
    // mvp_.rotate(rotation_);
-    mvp_ = m_projection * view * model1;
+    mvp_ = m_projection * view * model->transform.getModelMatrix();
+
+    std::vector<AssetImporter::Event> importEvents = importer.takeEvents();
+    for (auto &e : importEvents) {
+        if (e.job != modelImportJob)
+            continue;
+        if (e.type == AssetImporter::Event::Parsed) {
+            const AssetImporter::Progress p = importer.progress(modelImportJob);
+            if (p.hasBounds)
+                model->setBounds(p.boundsMin, p.boundsMax);
+        } else if (e.type == AssetImporter::Event::Finished) {
+            const AssetImporter::Progress p = importer.progress(modelImportJob);
+            qDebug() << "model imported:" << p.meshesTotal << "meshes," << p.texturesTotal << "textures at frame" << m_frameCount;
+        }
+        if (e.type == AssetImporter::Event::Finished || e.type == AssetImporter::Event::Failed) {
+            modelImportDone = true;
+            startup::Profiler &profiler = startup::Profiler::instance();
+            profiler.record(QStringLiteral("FbxModel import"), "startup", modelImportStartUs,
+                            profiler.nowUs() - modelImportStartUs);
+        }
+        AssetImporter::apply(*model, e);
+    }
+    if (!importEvents.empty()) {
+        startup::Scope scope("FbxModel::create");
+        model->create(m_rhi.get(), m_sc->currentFrameRenderTarget(), m_rp.get());
+    }
+    // --profile-startup ends once the scene is complete
+    if (startup::Profiler::isEnabled() && !initGraph && modelImportDone) {
+        startup::Profiler::instance().mark("scene loaded");
+        startup::Profiler::instance().finish();
+        QCoreApplication::quit();
+    }
     model->updateUbo(resourceUpdateBatch, mvp_);
 
+    // finer mips for streamed textures, sized by how large each model appears
+    TextureStreamer *streamer = TextureStreamer::instance(m_rhi.get());
+    const float focalPixels = 0.5f * outputSizeInPixels.height() * m_projection(1, 1);
+    for (auto m : std::as_const(models))
+        m->requestTextureDetail(streamer, mainCamera.Position, focalPixels);
+    model->requestTextureDetail(streamer, mainCamera.Position, focalPixels);
+    streamer->update(resourceUpdateBatch);
+    if (statsRequested) {
+        statsRequested = false;
+        streamer->dumpStats();
+    }
 
-    //========================================draw====================================================
+    //========================================draw list====================================================
+
+    quint64 sceneRevision = quint64(models.size()) + model->revision() + (hsky->isReady() ? 1 : 0);
+    for (auto m : std::as_const(models))
+        sceneRevision += m->revision();
+
+    if (drawList.needsCompile(sceneRevision)) {
+        drawList.beginCompile();
+        for (auto m : std::as_const(models))
+            m->collectPackets(drawList, shadowPipeline);
+        model->collectPackets(drawList);
+        hsky->collectPackets(drawList);
+
+        DrawPacket ui;
+        ui.pass = DrawPass::Overlay;
+        ui.pipeline = uiPipeline.get();
+        ui.srb = uiSRB.get();
+        ui.count = 3;
+        drawList.add(ui);
+        drawList.endCompile(sceneRevision);
+    }
+    drawList.updateDepth(DrawPass::Opaque, mainCamera.Position);
+    drawList.updateDepth(DrawPass::Shadow, lightPosition);
+    drawList.updateDepth(DrawPass::StaticShadow, lightPosition);
+    drawList.sort();
+    cascades.cull(drawList);
+    shadowAtlas->cull(drawList);
 
-    cb->beginPass(shadowMapRenderTarget, Qt::black, { 1.0f, 0 }, shadowUpdateBatch);
-    cb->debugMarkBegin(QByteArrayLiteral("Shadows"));
-    cb->setGraphicsPipeline(shadowPipeline);
-    cb->setViewport(QRhiViewport(0, 0, SHADOW_MAP_SIZE.width(), SHADOW_MAP_SIZE.height()));
 
-        for (auto m : std::as_const(models)) {
-              m->DrawForShadow(cb,shadowPipeline,ubo,shadowUpdateBatch);
+    //========================================draw====================================================
+
+    // static casters only where a cached tile is redrawn, then every tile is
+    // copied into the atlas and the moving casters go on top
+    const bool refreshShadowCache = shadowCache.hasRefresh();
+    if (refreshShadowCache) {
+        recorder.beginPass(shadowCache.renderTarget(), Qt::black, { 1.0f, 0 }, shadowUpdateBatch);
+        recorder.debugMarkBegin(QByteArrayLiteral("Shadow cache"));
+        for (int i = 0; i < cascades.cascadeCount(); ++i) {
+            if (!shadowCache.needsRefresh(i))
+                continue;
+            recorder.setViewport(cascades.cascade(i).viewport);
+            shadowCache.recordClear(recorder);
+            drawList.submit(recorder, DrawPass::StaticShadow, i);
         }
+        recorder.debugMarkEnd();
+        recorder.endPass();
+    }
+
+    recorder.beginPass(shadowMapRenderTarget, Qt::black, { 1.0f, 0 }, refreshShadowCache ? nullptr : shadowUpdateBatch);
+    recorder.debugMarkBegin(QByteArrayLiteral("Shadows"));
+    for (int i = 0; i < cascades.cascadeCount(); ++i) {
+        recorder.setViewport(cascades.cascade(i).viewport);
+        shadowCache.recordComposite(recorder);
+        drawList.submit(recorder, DrawPass::Shadow, i);
+    }
 
     // floor.DrawForShadow(cb,m_shadowPipeline,ubo,shadowUpdateBatch);
     // cubeModel.DrawForShadow(cb,m_shadowPipeline,ubo,shadowUpdateBatch);
     // cubeModel1.DrawForShadow(cb,m_shadowPipeline,ubo,shadowUpdateBatch);
     // sphereModel1.DrawForShadow(cb,m_shadowPipeline,ubo,shadowUpdateBatch);
     // sphereModel.DrawForShadow(cb,m_shadowPipeline,ubo,shadowUpdateBatch);
-    cb->debugMarkEnd();
-    cb->endPass();
-
-    cb->beginPass(m_sc->currentFrameRenderTarget(), clearColor, { 1.0f, 0 }, resourceUpdateBatch);
-
-    cb->setViewport({ 0, 0, float(outputSizeInPixels.width()), float(outputSizeInPixels.height()) });
-    cb->debugMarkBegin(QByteArrayLiteral("Sky"));
-      // sky->draw(cb);
-        hsky->draw(cb);
-
-    cb->debugMarkEnd();
-        for (auto m : std::as_const(models)) {
-            m->draw(cb);
+    recorder.debugMarkEnd();
+    recorder.endPass();
+
+    // the local light tiles due this frame in one pass; the rest keep their depth
+    if (!shadowAtlas->updates().empty()) {
+        recorder.beginPass(shadowAtlas->renderTarget(), Qt::black, { 1.0f, 0 }, nullptr);
+        recorder.debugMarkBegin(QByteArrayLiteral("Local light shadows"));
+        for (int k = 0; k < int(shadowAtlas->updates().size()); ++k) {
+            recorder.setViewport(shadowAtlas->updates()[size_t(k)].viewport);
+            shadowAtlas->recordClear(recorder);
+            drawList.submit(recorder, DrawPass::StaticShadow, ShadowAtlas::FIRST_VIEW + k);
+            drawList.submit(recorder, DrawPass::Shadow, ShadowAtlas::FIRST_VIEW + k);
         }
+        recorder.debugMarkEnd();
+        recorder.endPass();
+    }
+
+    recorder.beginPass(m_sc->currentFrameRenderTarget(), clearColor, { 1.0f, 0 }, resourceUpdateBatch);
 
-        model->draw(cb, { 0, 0, float(outputSizeInPixels.width()), float(outputSizeInPixels.height()) });
+    recorder.setViewport({ 0, 0, float(outputSizeInPixels.width()), float(outputSizeInPixels.height()) });
 
-    cb->setGraphicsPipeline(uiPipeline.get());
-    cb->setShaderResources(uiSRB.get());
-   // cb->resourceUpdate(resourceUpdateBatch);
-    cb->draw(3);
+    // opaques front-to-back grouped by pipeline/material, then the sky (at the far plane) and the UI
+    drawList.submit(recorder, DrawPass::Opaque);
+    recorder.debugMarkBegin(QByteArrayLiteral("Sky"));
+      // sky->draw(recorder);
+    drawList.submit(recorder, DrawPass::Sky);
+    recorder.debugMarkEnd();
+    drawList.submit(recorder, DrawPass::Overlay);
 
-    cb->endPass();
+    recorder.endPass();
 
 }
 //======================================================iNPUT======================================================================
@@ -604,6 +845,10 @@ void HelloWindow::keyPressEvent(QKeyEvent *e)
         }
         return;
     }
+    if (e->key() == Qt::Key_F3) {
+        statsRequested = true;
+        return;
+    }
     pressedKeys.insert(e->key());
 }
 
@@ -664,6 +909,7 @@ void HelloWindow::initShadowMapResources(QRhi *rhi) {
 
     //=======================================shadowpipeline=======================================
 
+    // atlas of the cascade tiles
     shadowMapTexture = rhi->newTexture(
         QRhiTexture::D32F,                  //only depth
         SHADOW_MAP_SIZE,
@@ -671,27 +917,19 @@ void HelloWindow::initShadowMapResources(QRhi *rhi) {
         QRhiTexture::RenderTarget
         );
     shadowMapTexture->create();
+    cascades.setAtlasSize(SHADOW_MAP_SIZE);
 
-    shadowMapSampler = rhi->newSampler(
-        QRhiSampler::Nearest,
-        QRhiSampler::Nearest,
-        QRhiSampler::None,
-        QRhiSampler::ClampToEdge,
-        QRhiSampler::ClampToEdge,
-        QRhiSampler::ClampToEdge
-        );
-
-    shadowMapSampler->create();
-    const quint32 UBUF_SIZE = 512;
+    SamplerKey shadowSamplerKey;
+    shadowSamplerKey.magFilter = QRhiSampler::Nearest;
+    shadowSamplerKey.minFilter = QRhiSampler::Nearest;
+    shadowSamplerKey.mipmapMode = QRhiSampler::None;
+    shadowSamplerKey.addressU = QRhiSampler::ClampToEdge;
+    shadowSamplerKey.addressV = QRhiSampler::ClampToEdge;
+    shadowSamplerKey.addressW = QRhiSampler::ClampToEdge;
+    shadowMapSampler = RhiResourceCache::instance(rhi)->sampler(shadowSamplerKey);
 
-    shadowUbo = rhi->newBuffer(QRhiBuffer::Dynamic, QRhiBuffer::UniformBuffer, UBUF_SIZE);
-    shadowUbo->create();
-
-    shadowSRB = rhi->newShaderResourceBindings();
-    shadowSRB->setBindings({
-        QRhiShaderResourceBinding::uniformBuffer(0, QRhiShaderResourceBinding::VertexStage, shadowUbo)
-    });
-    shadowSRB->create();
+    // same layout (and object) the models bind in the depth pass
+    shadowSRB = Model::shadowSrb(rhi);
 
     //  Render target description with depth attachment
     QRhiTextureRenderTargetDescription shadowRtDesc;
@@ -781,19 +1019,22 @@ void HelloWindow::initShadowMapResources(QRhi *rhi) {
     }
     shadowPipeline->setDepthOp(QRhiGraphicsPipeline::LessOrEqual);
     shadowPipeline->create();
+    shadowCache.create(rhi, SHADOW_MAP_SIZE, shadowMapRenderPassDesc);
 
     //=======================================full screen pipeline=======================================
 
     updateFullscreenTexture(m_sc->surfacePixelSize(), initialUpdateBatch);
 
-    uiSampler.reset(m_rhi->newSampler(QRhiSampler::Linear, QRhiSampler::Linear, QRhiSampler::None,
-                                      QRhiSampler::ClampToEdge, QRhiSampler::ClampToEdge));
-    uiSampler->create();
+    SamplerKey uiSamplerKey;
+    uiSamplerKey.mipmapMode = QRhiSampler::None;
+    uiSamplerKey.addressU = QRhiSampler::ClampToEdge;
+    uiSamplerKey.addressV = QRhiSampler::ClampToEdge;
+    uiSampler = RhiResourceCache::instance(m_rhi.get())->sampler(uiSamplerKey);
 
     uiSRB.reset(m_rhi->newShaderResourceBindings());
     uiSRB->setBindings({
         QRhiShaderResourceBinding::sampledTexture(0, QRhiShaderResourceBinding::FragmentStage,
-                                                  uiTexture.get(), uiSampler.get())
+                                                  uiTexture.get(), uiSampler)
     });
     uiSRB->create();
 
@@ -9,9 +9,17 @@
 #include "qtrhi3d/model.h"
 #include "qtrhi3d/proceduralsky.h"
 #include "qtrhi3d/hdrisky.h"
+#include "qtrhi3d/drawlist.h"
+#include "qtrhi3d/cascadedshadows.h"
+#include "qtrhi3d/shadowcache.h"
+#include "qtrhi3d/shadowatlas.h"
+#include "qtrhi3d/assetimporter.h"
+#include "qtrhi3d/initgraph.h"
+#include "qtrhi3d/startupprofiler.h"
 #include <QWindow>
 #include <QOffscreenSurface>
 #include <QElapsedTimer>
+#include <QSet>
 #include <rhi/qrhi.h>
 
 class RhiWindow : public QWindow
@@ -51,6 +59,7 @@ private:
     bool m_initialized = false;
     bool m_notExposed = false;
     bool m_newlyExposed = false;
+    bool m_firstFramePresented = false;
 
 
 
@@ -81,23 +90,24 @@ private:
     QPointF lastMousePosition;
     QElapsedTimer mainTimer;
     bool cameraMovementEnabled = true;
+    bool statsRequested = false; // F3: log texture streaming stats next frame
     float deltaTime = 0;
     const QSize SHADOW_MAP_SIZE = QSize(2048, 2048);
+    const int TEXTURE_UPLOADS_PER_FRAME = 2; // decoded startup textures handed to the GPU per frame
     QRhiResourceUpdateBatch *initialUpdateBatch = nullptr;
 
     QRhiTexture *shadowMapTexture = nullptr;
-    QRhiSampler *shadowMapSampler = nullptr;
+    QRhiSampler *shadowMapSampler = nullptr; // owned by RhiResourceCache
     QRhiTextureRenderTarget *shadowMapRenderTarget = nullptr;
     QRhiRenderPassDescriptor * shadowMapRenderPassDesc = nullptr;
 
-    QRhiBuffer* shadowUbo = nullptr;
-    QRhiShaderResourceBindings *shadowSRB = nullptr;
+    QRhiShaderResourceBindings *shadowSRB = nullptr; // owned by RhiResourceCache
     QRhiGraphicsPipeline *shadowPipeline = nullptr;
 
     std::unique_ptr<QRhiShaderResourceBindings> uiSRB= nullptr;
     std::unique_ptr<QRhiGraphicsPipeline> uiPipeline = nullptr;
     std::unique_ptr<QRhiTexture> uiTexture = nullptr;
-    std::unique_ptr<QRhiSampler> uiSampler = nullptr;
+    QRhiSampler *uiSampler = nullptr;
 
 public:
     float lightTime = 0.0f;
@@ -117,6 +127,16 @@ public:
     std::unique_ptr<ProceduralSkyRHI> sky = nullptr;
     std::unique_ptr<HdriSky> hsky;
     QVector<Model*> models;
+    DrawList drawList;
+    CascadedShadows cascades;
+    ShadowCache shadowCache;
+    CommandRecorder recorder;
+    AssetImporter importer;
+    int modelImportJob = 0;
+    qint64 modelImportStartUs = 0; // startup::Profiler clock
+    bool modelImportDone = false;
+    // startup work still loading; last, so its workers are gone before the models
+    std::unique_ptr<InitGraph> initGraph;
 
 
 
@@ -0,0 +1,37 @@
+#version 450
+
+layout(location = 0) out vec4 fragColor;
+
+const float PI = 3.14159265359;
+const float SIZE = 256.0;         // BrdfLut::SIZE
+const uint SAMPLE_COUNT = 512u;   // envmap::BRDF_SAMPLES
+
+// Split-sum BRDF table: scale and bias of F0 for (n.v, roughness) at
+// gl_FragCoord / SIZE. Same steps as envmap::brdfLutRow(), the CPU reference.
+void main()
+{
+    float nDotV = gl_FragCoord.x / SIZE;
+    float roughness = gl_FragCoord.y / SIZE;
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float k = a / 2.0;
+    float vx = sqrt(1.0 - nDotV * nDotV);
+    float g1v = nDotV / (nDotV * (1.0 - k) + k);
+
+    float scale = 0.0;
+    float bias = 0.0;
+    for (uint i = 0u; i < SAMPLE_COUNT; ++i) {
+        vec2 xi = vec2(float(i) / float(SAMPLE_COUNT), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+        float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a2 - 1.0) * xi.y));
+        float hx = cos(2.0 * PI * xi.x) * sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+        float vDotH = max(vx * hx + nDotV * cosTheta, 0.0);
+        float nDotL = 2.0 * vDotH * cosTheta - nDotV;
+        if (nDotL <= 0.0)
+            continue;
+        float gVis = g1v * (nDotL / (nDotL * (1.0 - k) + k)) * vDotH / (cosTheta * nDotV);
+        float fc = pow(1.0 - vDotH, 5.0);
+        scale += (1.0 - fc) * gVis;
+        bias += fc * gVis;
+    }
+    fragColor = vec4(scale / float(SAMPLE_COUNT), bias / float(SAMPLE_COUNT), 0.0, 1.0);
+}
@@ -0,0 +1,10 @@
+#version 450
+
+// ShadowCache depth, laid out like the target
+layout(binding = 0) uniform sampler2D tex_depth;
+
+void main()
+{
+    // the same texel on every backend, whichever way its framebuffer is up
+    gl_FragDepth = texelFetch(tex_depth, ivec2(gl_FragCoord.xy), 0).r;
+}
@@ -0,0 +1,9 @@
+#version 450
+
+// Full screen triangle on the far plane. With depth.frag it resets the depth
+// under the viewport to 1, depthblit.frag writes its own.
+void main()
+{
+    vec2 p = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 1.0, 1.0);
+}
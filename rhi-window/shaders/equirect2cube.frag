@@ -1,23 +1,30 @@
 #version 450
 
-layout(location = 0) in vec3 vWorldPos;      // <- explicitní location
 layout(location = 0) out vec4 fragColor;
 
-layout(binding = 1) uniform sampler2D uEquirectangularMap;
+// x: face (+X, -X, +Y, -Y, +Z, -Z), y: face size in pixels
+layout(std140, binding = 0) uniform Params {
+    vec4 face;
+} params;
 
-const vec2 invAtan = vec2(0.1591, 0.3183);
+layout(binding = 1) uniform sampler2D uEquirectangularMap;
 
-vec2 sampleSphericalMap(vec3 v)
+// envmap::faceBasis(); gl_FragCoord.y counts texel rows from the first one on every backend
+vec3 cubeDirection(vec2 fragCoord, int face, float size)
 {
-    vec2 uv = vec2(atan(v.z, v.x), asin(v.y));
-    uv *= invAtan;
-    uv += 0.5;
-    return uv;
+    vec2 n = fragCoord / size * 2.0 - 1.0;
+    if (face == 0) return vec3(1.0, -n.y, -n.x);
+    if (face == 1) return vec3(-1.0, -n.y, n.x);
+    if (face == 2) return vec3(n.x, 1.0, n.y);
+    if (face == 3) return vec3(n.x, -1.0, -n.y);
+    if (face == 4) return vec3(n.x, -n.y, 1.0);
+    return vec3(-n.x, -n.y, -1.0);
 }
 
 void main()
 {
-    vec2 uv = sampleSphericalMap(normalize(vWorldPos));
-    vec3 color = texture(uEquirectangularMap, uv).rgb;
-    fragColor = vec4(color, 1.0);
+    vec3 d = normalize(cubeDirection(gl_FragCoord.xy, int(params.face.x), params.face.y));
+    // equirect rows are stored bottom first
+    vec2 uv = vec2(atan(d.z, d.x) * 0.15915494 + 0.5, asin(d.y) * 0.31830989 + 0.5);
+    fragColor = vec4(textureLod(uEquirectangularMap, uv, 0.0).rgb, 1.0);
 }
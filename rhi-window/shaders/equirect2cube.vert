@@ -1,16 +1,8 @@
 #version 450
 
-layout(location = 0) in vec3 aPos;
-
-layout(std140, binding = 0) uniform Ubuf {
-    mat4 uProjection;
-    mat4 uView;
-} ubuf;
-
-layout(location = 0) out vec3 vWorldPos; // <- location musí být zde
-
+// Fullscreen triangle; the fragment shaders derive the cube direction from gl_FragCoord.
 void main()
 {
-    vWorldPos = aPos;
-    gl_Position = ubuf.uProjection * ubuf.uView * vec4(aPos, 1.0);
+    vec2 uv = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+    gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);
 }
@@ -112,6 +112,14 @@ float shadowCalculation(vec3 normal, vec3 fragPos)
 }
 
 
+vec3 sampleNormal(vec2 uv)
+{
+    // normal maps may be BC5 (two channels), so z is always rebuilt
+    vec3 n = vec3(texture(tex_normal, uv).rg * 2.0 - 1.0, 0.0);
+    n.z = sqrt(max(1.0 - dot(n.xy, n.xy), 0.0));
+    return n;
+}
+
 void main()
 {
     // --- TBN matice (společné) ---
@@ -127,7 +135,7 @@ void main()
     // --- ROZDÍL 3 & 4: Normály a Roughness ---
     if (mode == 3) {
         // Shader 3: Vylepšené normály a omezená roughness
-        vec3 N_local = texture(tex_normal, frag_uv).xyz * 2.0 - 1.0;
+        vec3 N_local = sampleNormal(frag_uv);
 
         // Pozn: Tuto hodnotu můžete také poslat v UBO, např. ubo.misc.x
         float normalStrength = 2.0;
@@ -140,7 +148,7 @@ void main()
 
     } else {
         // Shader 1 & 2: Standardní výpočty
-        N_world = normalize(TBN * (texture(tex_normal, frag_uv).xyz * 2.0 - 1.0));
+        N_world = normalize(TBN * sampleNormal(frag_uv));
         roughness = texture(tex_roughness, frag_uv).r;
     }
 
@@ -8,12 +8,19 @@ layout(location = 4) in vec3 frag_bitangent;
 
 layout(location = 0) out vec4 out_color;
 
-layout(binding = 1) uniform sampler2D tex_albedo;
-layout(binding = 2) uniform sampler2D tex_normal;
-layout(binding = 3) uniform sampler2D tex_metallic;
-layout(binding = 4) uniform sampler2D tex_roughness;
-layout(binding = 5) uniform sampler2D tex_ao;
-layout(binding = 6) uniform sampler2D tex_height;
+// MATERIAL_ARRAYS (the .atlas.frag.qsb build): bindings 1-3 are MaterialAtlas
+// texture arrays and ubo.material holds this object's layer in each.
+#ifdef MATERIAL_ARRAYS
+#define MATERIAL_SAMPLER sampler2DArray
+#define MATERIAL_TEXTURE(tex, layer, uv) texture(tex, vec3(uv, layer))
+#else
+#define MATERIAL_SAMPLER sampler2D
+#define MATERIAL_TEXTURE(tex, layer, uv) texture(tex, uv)
+#endif
+
+layout(binding = 1) uniform MATERIAL_SAMPLER tex_albedo;
+layout(binding = 2) uniform MATERIAL_SAMPLER tex_normal;
+layout(binding = 3) uniform MATERIAL_SAMPLER tex_orm; // r ao, g roughness, b metallic, a height
 layout(binding = 7) uniform sampler2D tex_shadows;
 
 layout(std140, binding = 0) uniform Ubo {
@@ -26,8 +33,40 @@ layout(std140, binding = 0) uniform Ubo {
     vec4 camPos;
     vec4 misc;
     vec4 misc1;
+    vec4 material; // albedo, normal, orm layer
 } ubo;
 
+struct LocalLight {
+    vec4 position;  // xyz, w range
+    vec4 color;     // rgb times intensity, w 0 spot, 1 point
+    vec4 direction; // spot axis, w cos outer angle
+    vec4 shadow;    // x first tile or -1, y cos inner angle
+};
+struct ShadowTile {
+    mat4 matrix; // world to atlas uv (xy) and depth (z)
+    vec4 rect;   // uv min xy, max zw
+};
+
+// FrameUniforms: diffuse IBL as L2 spherical harmonics with the cosine lobe
+// and 1/PI folded in (shirradiance.h), rgb per coefficient
+layout(std140, binding = 8) uniform Frame {
+    vec4 irradiance[9];
+    vec4 ibl; // x specular IBL strength, y last mip of tex_specular
+    // CascadedShadows: world to each cascade's clip space, the view distance
+    // where it ends and its tile of tex_shadows (uv offset xy, scale zw)
+    mat4 shadowMatrix[4];
+    vec4 shadowSplits;
+    vec4 shadowTiles[4];
+    vec4 shadow; // x cascade count
+    // ShadowAtlas: the local lights and the tiles of tex_lightShadows
+    LocalLight lights[8];
+    vec4 lightCount; // x
+    ShadowTile lightTiles[32];
+} frame;
+layout(binding = 9) uniform sampler2D tex_brdf; // BrdfLut: F0 scale, bias over (n.v, roughness)
+layout(binding = 10) uniform samplerCube tex_specular; // HdriSky::specularCubemap(), roughness by mip
+layout(binding = 11) uniform sampler2D tex_lightShadows; // ShadowAtlas depth
+
 
 // --- PBR a Shadow map pomocné funkce ---
 
@@ -71,7 +110,16 @@ float GeometrySmith(vec3 N, vec3 V, vec3 L, float roughness)
 // --- Shadow map helper ---
 float shadowCalculationVulkan(vec3 normal, vec3 fragPos)
 {
-    vec4 fragPosLightSpace = ubo.lightSpace * vec4(fragPos, 1.0);
+    // cascade covering this fragment's view distance
+    float viewDepth = -(ubo.view * vec4(fragPos, 1.0)).z;
+    int cascadeCount = int(frame.shadow.x);
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > frame.shadowSplits[cascade])
+        ++cascade;
+    if (cascade >= cascadeCount)
+        return 0.0;
+
+    vec4 fragPosLightSpace = frame.shadowMatrix[cascade] * vec4(fragPos, 1.0);
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     projCoords = projCoords * 0.5 + 0.5;
 
@@ -83,10 +131,15 @@ float shadowCalculationVulkan(vec3 normal, vec3 fragPos)
     float bias = max(0.005 * (1.0 - dot(normal, normalize(ubo.lightPos.xyz - fragPos))), 0.001);
 
     float shadow = 0.0;
+    // into the tile; PCF taps stay inside it
+    vec4 tile = frame.shadowTiles[cascade];
     vec2 texelSize = 1.0 / vec2(textureSize(tex_shadows, 0));
+    projCoords.xy = tile.xy + projCoords.xy * tile.zw;
+    vec2 tileMin = tile.xy + texelSize * 0.5;
+    vec2 tileMax = tile.xy + tile.zw - texelSize * 0.5;
     for (int x = -1; x <= 1; ++x) {
         for (int y = -1; y <= 1; ++y) {
-            float pcfDepth = texture(tex_shadows, projCoords.xy + vec2(x, y) * texelSize).r;
+            float pcfDepth = texture(tex_shadows, clamp(projCoords.xy + vec2(x, y) * texelSize, tileMin, tileMax)).r;
             // Pokud je fragment dál než nejbližší povrch v mapě, je ve stínu
             shadow += (currentDepth - bias) > pcfDepth ? 1.0 : 0.0;
         }
@@ -97,6 +150,88 @@ float shadowCalculationVulkan(vec3 normal, vec3 fragPos)
 }
 
 
+// 3x3 PCF in one ShadowAtlas tile, clamped so no tap reads a neighbour
+float localShadow(int tile, vec3 fragPos)
+{
+    vec4 p = frame.lightTiles[tile].matrix * vec4(fragPos, 1.0);
+    p.xyz /= p.w;
+    vec4 rect = frame.lightTiles[tile].rect;
+    vec2 texelSize = 1.0 / vec2(textureSize(tex_lightShadows, 0));
+    float shadow = 0.0;
+    for (int x = -1; x <= 1; ++x) {
+        for (int y = -1; y <= 1; ++y) {
+            vec2 uv = clamp(p.xy + vec2(x, y) * texelSize, rect.xy, rect.zw);
+            shadow += p.z - 0.0005 > texture(tex_lightShadows, uv).r ? 1.0 : 0.0;
+        }
+    }
+    return shadow / 9.0;
+}
+
+// Spot and point lights with range falloff; a point light's tiles are its
+// cube faces in +x -x +y -y +z -z order.
+vec3 localLighting(vec3 N, vec3 V, vec3 fragPos, vec3 albedo, float metallic, float roughness, vec3 F0)
+{
+    vec3 Lo = vec3(0.0);
+    int count = int(frame.lightCount.x);
+    for (int i = 0; i < count; ++i) {
+        LocalLight light = frame.lights[i];
+        vec3 toLight = light.position.xyz - fragPos;
+        float dist = length(toLight);
+        if (dist >= light.position.w)
+            continue;
+        vec3 L = toLight / dist;
+        float window = clamp(1.0 - pow(dist / light.position.w, 4.0), 0.0, 1.0);
+        float attenuation = window * window / max(dist * dist, 0.01);
+        int tile = int(light.shadow.x);
+        if (light.color.w < 0.5) {
+            attenuation *= smoothstep(light.direction.w, light.shadow.y, dot(-L, normalize(light.direction.xyz)));
+        } else if (tile >= 0) {
+            vec3 d = -toLight;
+            vec3 a = abs(d);
+            if (a.x >= a.y && a.x >= a.z)
+                tile += d.x > 0.0 ? 0 : 1;
+            else if (a.y >= a.z)
+                tile += d.y > 0.0 ? 2 : 3;
+            else
+                tile += d.z > 0.0 ? 4 : 5;
+        }
+        float NdotL = max(dot(N, L), 0.0);
+        if (attenuation <= 0.0 || NdotL <= 0.0)
+            continue;
+        if (tile >= 0)
+            attenuation *= 1.0 - localShadow(tile, fragPos);
+
+        vec3 H = normalize(V + L);
+        float NdotV = max(dot(N, V), 0.0);
+        float NDF = DistributionGGX(N, H, roughness);
+        float G = GeometrySmith(N, V, L, roughness);
+        vec3 F = F0 + (1.0 - F0) * pow(clamp(1.0 - max(dot(H, V), 0.0), 0.0, 1.0), 5.0);
+        vec3 specular = NDF * G * F / (4.0 * NdotV * NdotL + 0.0001);
+        vec3 kD = (vec3(1.0) - F) * (1.0 - metallic);
+        Lo += (kD * albedo / PI + specular) * light.color.rgb * attenuation * NdotL;
+    }
+    return Lo;
+}
+
+// Lambert diffuse radiance for normal n, sh::evaluate() on the CPU
+vec3 shIrradiance(vec3 n)
+{
+    vec3 e = frame.irradiance[0].rgb;
+    e += frame.irradiance[1].rgb * n.y + frame.irradiance[2].rgb * n.z + frame.irradiance[3].rgb * n.x;
+    e += frame.irradiance[4].rgb * (n.x * n.y) + frame.irradiance[5].rgb * (n.y * n.z)
+       + frame.irradiance[6].rgb * (3.0 * n.y * n.y - 1.0) + frame.irradiance[7].rgb * (n.x * n.z)
+       + frame.irradiance[8].rgb * (n.x * n.x - n.z * n.z);
+    return max(e, vec3(0.0));
+}
+
+vec3 sampleNormal(vec2 uv)
+{
+    // normal maps may be BC5 (two channels), so z is always rebuilt
+    vec3 n = vec3(MATERIAL_TEXTURE(tex_normal, ubo.material.y, uv).rg * 2.0 - 1.0, 0.0);
+    n.z = sqrt(max(1.0 - dot(n.xy, n.xy), 0.0));
+    return n;
+}
+
 void main()
 {
     // --- TBN matice ---
@@ -106,7 +241,7 @@ void main()
     mat3 TBN = mat3(T, B, N);
 
     // --- normála v world space ---
-    vec3 N_world = normalize(TBN * (texture(tex_normal, frag_uv).xyz * 2.0 - 1.0));
+    vec3 N_world = normalize(TBN * sampleNormal(frag_uv));
 
     // --- stíny ---
     float shadowFactor = shadowCalculationVulkan(N_world, frag_pos);
@@ -117,10 +252,11 @@ void main()
     vec3 H = normalize(V + L);
 
     // --- textury ---
-    vec3 albedo = texture(tex_albedo, frag_uv).rgb;
-    float metallic = texture(tex_metallic, frag_uv).r;
-    float roughness = texture(tex_roughness, frag_uv).r;
-    float ao = texture(tex_ao, frag_uv).r;
+    vec3 albedo = MATERIAL_TEXTURE(tex_albedo, ubo.material.x, frag_uv).rgb;
+    vec4 orm = MATERIAL_TEXTURE(tex_orm, ubo.material.z, frag_uv);
+    float metallic = orm.b;
+    float roughness = orm.g;
+    float ao = orm.r;
 
     // --- PBR výpočty ---
     vec3 F0 = mix(vec3(0.04), albedo, metallic);
@@ -140,10 +276,14 @@ void main()
     vec3 radiance = ubo.color.rgb * ubo.misc1.y;
     vec3 Lo = (kD * albedo / PI + specular) * radiance * NdotL;
 
-    vec3 ambient = albedo * ao * 0.1;
+    // split-sum specular IBL
+    vec2 envBrdf = texture(tex_brdf, vec2(NdotV, roughness)).rg;
+    vec3 prefiltered = textureLod(tex_specular, reflect(-V, N_world), roughness * frame.ibl.y).rgb;
+    vec3 ambient = albedo * ao * shIrradiance(N_world) + frame.ibl.x * ao * prefiltered * (F0 * envBrdf.x + envBrdf.y);
 
     // ZDE JE KLÍČOVÁ OPRAVA: (1.0 - shadowFactor)
     vec3 color = ambient + (1.0 - shadowFactor) * Lo;
+    color += localLighting(N_world, V, frag_pos, albedo, metallic, roughness, F0);
 
     // gamma korekce
     color = pow(color, vec3(1.0/2.2));
@@ -21,6 +21,7 @@ layout(std140, binding = 0) uniform Ubo {
     vec4 camPos;
     vec4 misc;
     vec4 misc1;
+    vec4 material;
 } ubo;
 
 void main() {
@@ -0,0 +1,66 @@
+#version 450
+
+layout(location = 0) out vec4 fragColor;
+
+// x: face, y: target level size in pixels, z: roughness, w: environment size (level 0)
+layout(std140, binding = 0) uniform Params {
+    vec4 face;
+} params;
+
+layout(binding = 1) uniform samplerCube environment;
+
+const float PI = 3.14159265359;
+const uint SAMPLE_COUNT = 128u; // envmap::PREFILTER_SAMPLES
+
+vec3 cubeDirection(vec2 fragCoord, int face, float size)
+{
+    vec2 n = fragCoord / size * 2.0 - 1.0;
+    if (face == 0) return vec3(1.0, -n.y, -n.x);
+    if (face == 1) return vec3(-1.0, -n.y, n.x);
+    if (face == 2) return vec3(n.x, 1.0, n.y);
+    if (face == 3) return vec3(n.x, -1.0, -n.y);
+    if (face == 4) return vec3(n.x, -n.y, 1.0);
+    return vec3(-n.x, -n.y, -1.0);
+}
+
+// Same steps as envmap::prefilterFaceRows(), the CPU reference.
+void main()
+{
+    vec3 N = normalize(cubeDirection(gl_FragCoord.xy, int(params.face.x), params.face.y));
+    float roughness = params.face.z;
+    if (roughness <= 0.0) {
+        fragColor = vec4(textureLod(environment, N, 0.0).rgb, 1.0);
+        return;
+    }
+
+    float a = roughness * roughness;
+    float a2 = a * a;
+    float texelSolidAngle = 4.0 * PI / (6.0 * params.face.w * params.face.w);
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+
+    vec3 color = vec3(0.0);
+    float weight = 0.0;
+    for (uint i = 0u; i < SAMPLE_COUNT; ++i) {
+        // Hammersley point, GGX half vector around N
+        vec2 xi = vec2(float(i) / float(SAMPLE_COUNT), float(bitfieldReverse(i)) * 2.3283064365386963e-10);
+        float phi = 2.0 * PI * xi.x;
+        float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a2 - 1.0) * xi.y));
+        float sinTheta = sqrt(max(0.0, 1.0 - cosTheta * cosTheta));
+        vec3 H = tangent * (cos(phi) * sinTheta) + bitangent * (sin(phi) * sinTheta) + N * cosTheta;
+        float NdotH = max(dot(N, H), 0.0);
+        vec3 L = 2.0 * NdotH * H - N;
+        float NdotL = dot(N, L);
+        if (NdotL <= 0.0)
+            continue;
+        // read the mip whose texels cover the sample's solid angle; D * NdotH / (4 * HdotV) with V = N
+        float d = NdotH * NdotH * (a2 - 1.0) + 1.0;
+        float pdf = a2 / (PI * d * d) * 0.25 + 0.0001;
+        float sampleSolidAngle = 1.0 / (float(SAMPLE_COUNT) * pdf);
+        float lod = max(0.5 * log2(sampleSolidAngle / texelSolidAngle), 0.0);
+        color += textureLod(environment, L, lod).rgb * NdotL;
+        weight += NdotL;
+    }
+    fragColor = vec4(color / max(weight, 0.0001), 1.0);
+}
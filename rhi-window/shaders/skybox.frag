@@ -11,8 +11,9 @@ void main()
     vec3 dir = normalize(vDir);
     vec3 color = texture(skybox, dir).rgb;
 
-    // Jednoduchý tonemap pro LDR HDR mix (nepovinné)
+    // HDR cubemap: Reinhard tonemap, then the gamma the PBR shaders apply
     color = color / (color + vec3(1.0));
+    color = pow(color, vec3(1.0/2.2));
 
     fragColor = vec4(color, 1.0);
 }
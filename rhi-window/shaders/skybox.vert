@@ -15,5 +15,7 @@ void main()
     viewNoTrans[3] = vec4(0,0,0,1);
 
     vDir = inPos; // směr pro sampling cubemapy
-    gl_Position = ubo.projection * viewNoTrans * vec4(inPos, 1.0);
+    // z = w -> depth 1.0, the sky is drawn after the opaques and only fills uncovered pixels
+    vec4 clipPos = ubo.projection * viewNoTrans * vec4(inPos, 1.0);
+    gl_Position = clipPos.xyww;
 }
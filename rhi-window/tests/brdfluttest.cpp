@@ -0,0 +1,76 @@
+// Draws the BRDF table with shaders/brdflut.frag on an offscreen QRhi, reads
+// it back and compares it with envmap::brdfLutRow() (BrdfLut::setVerify), and
+// fails when any texel differs by more than MAX_ERROR in table units. Exits
+// with 77, which ctest reports as skipped, when no GPU backend can be created.
+//
+//   brdfluttest
+
+#include "qtrhi3d/brdflut.h"
+
+#include <QGuiApplication>
+#include <QOffscreenSurface>
+#include <QStandardPaths>
+
+namespace {
+
+// The table goes through RG16 or half floats either way; GPU and CPU only
+// differ in float rounding of the same sample sequence.
+constexpr float MAX_ERROR = 0.01f;
+constexpr int SKIPPED = 77;
+
+QRhi *createRhi(std::unique_ptr<QOffscreenSurface> &fallbackSurface)
+{
+#ifdef Q_OS_WIN
+    QRhiD3D11InitParams d3dParams;
+    if (QRhi *rhi = QRhi::create(QRhi::D3D11, &d3dParams))
+        return rhi;
+#endif
+#if QT_CONFIG(metal)
+    QRhiMetalInitParams metalParams;
+    if (QRhi *rhi = QRhi::create(QRhi::Metal, &metalParams))
+        return rhi;
+#endif
+#if QT_CONFIG(opengl)
+    fallbackSurface.reset(QRhiGles2InitParams::newFallbackSurface());
+    QRhiGles2InitParams glParams;
+    glParams.fallbackSurface = fallbackSurface.get();
+    if (QRhi *rhi = QRhi::create(QRhi::OpenGLES2, &glParams))
+        return rhi;
+#endif
+    return nullptr;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+    // keeps the written table out of the user's cache directory
+    QStandardPaths::setTestModeEnabled(true);
+
+    std::unique_ptr<QOffscreenSurface> fallbackSurface;
+    std::unique_ptr<QRhi> rhi(createRhi(fallbackSurface));
+    if (!rhi) {
+        qInfo() << "SKIP no GPU backend";
+        return SKIPPED;
+    }
+
+    BrdfLut::setVerify(true);
+    BrdfLut *lut = BrdfLut::instance(rhi.get());
+    QRhiCommandBuffer *cb = nullptr;
+    if (rhi->beginOffscreenFrame(&cb) != QRhi::FrameOpSuccess) {
+        qWarning() << "FAIL cannot begin an offscreen frame";
+        return 1;
+    }
+    QRhiResourceUpdateBatch *u = rhi->nextResourceUpdateBatch();
+    lut->prepare(u);
+    cb->resourceUpdate(u);
+    lut->recordPasses(cb);
+    // waits for the GPU, so the readback has completed after this
+    rhi->endOffscreenFrame();
+
+    const float error = lut->stats().verifyMaxError;
+    const bool ok = error >= 0.0f && error <= MAX_ERROR;
+    qInfo().noquote() << (ok ? "PASS" : "FAIL") << rhi->backendName() << "max error" << error << "bound" << MAX_ERROR;
+    return ok ? 0 : 1;
+}
@@ -2,6 +2,7 @@
 #include "../shared/cube.h"
 #include <QMatrix4x4>
 #include <QFile>
+#include "../../rhi-window/qtrhi3d/hdrimage.h"
 
 struct {
     QList<QRhiResource *> releasePool;
@@ -17,152 +18,15 @@ struct {
     QRhiResourceUpdateBatch *initialUpdates = nullptr;
 } d;
 
-// Načtení HDR equirectangular mapy
+// Načtení HDR equirectangular mapy, RGBA16F
 QByteArray loadHdr(const QString &fn, QSize *size)
 {
-    QFile f(fn);
-    if (!f.open(QIODevice::ReadOnly)) {
-        qWarning("Failed to open %s", qPrintable(fn));
+    const hdr::Image image = hdr::load(fn);
+    if (image.isNull())
         return QByteArray();
-    }
-
-    char sig[256];
-    f.read(sig, 11);
-    if (strncmp(sig, "#?RADIANCE\n", 11))
-        return QByteArray();
-
-    QByteArray buf = f.readAll();
-    const char *p = buf.constData();
-    const char *pEnd = p + buf.size();
-
-           // Process lines until the empty one.
-    QByteArray line;
-    while (p < pEnd) {
-        char c = *p++;
-        if (c == '\n') {
-            if (line.isEmpty())
-                break;
-            if (line.startsWith(QByteArrayLiteral("FORMAT="))) {
-                const QByteArray format = line.mid(7).trimmed();
-                if (format != QByteArrayLiteral("32-bit_rle_rgbe")) {
-                    qWarning("HDR format '%s' is not supported", format.constData());
-                    return QByteArray();
-                }
-            }
-            line.clear();
-        } else {
-            line.append(c);
-        }
-    }
-    if (p == pEnd) {
-        qWarning("Malformed HDR image data at property strings");
-        return QByteArray();
-    }
-
-           // Get the resolution string.
-    while (p < pEnd) {
-        char c = *p++;
-        if (c == '\n')
-            break;
-        line.append(c);
-    }
-    if (p == pEnd) {
-        qWarning("Malformed HDR image data at resolution string");
-        return QByteArray();
-    }
-
-    int w = 0, h = 0;
-    // We only care about the standard orientation.
-    if (!sscanf(line.constData(), "-Y %d +X %d", &h, &w)) {
-        qWarning("Unsupported HDR resolution string '%s'", line.constData());
-        return QByteArray();
-    }
-    if (w <= 0 || h <= 0) {
-        qWarning("Invalid HDR resolution");
-        return QByteArray();
-    }
-
-           // output is RGBA32F
-    const int blockSize = 4 * sizeof(float);
-    QByteArray data;
-    data.resize(w * h * blockSize);
-
-    typedef unsigned char RGBE[4];
-    RGBE *scanline = new RGBE[w];
-
-    for (int y = 0; y < h; ++y) {
-        if (pEnd - p < 4) {
-            qWarning("Unexpected end of HDR data");
-            delete[] scanline;
-            return QByteArray();
-        }
-
-        scanline[0][0] = *p++;
-        scanline[0][1] = *p++;
-        scanline[0][2] = *p++;
-        scanline[0][3] = *p++;
-
-        if (scanline[0][0] == 2 && scanline[0][1] == 2 && scanline[0][2] < 128) {
-            // new rle, the first pixel was a dummy
-            for (int channel = 0; channel < 4; ++channel) {
-                for (int x = 0; x < w && p < pEnd; ) {
-                    unsigned char c = *p++;
-                    if (c > 128) { // run
-                        if (p < pEnd) {
-                            int repCount = c & 127;
-                            c = *p++;
-                            while (repCount--)
-                                scanline[x++][channel] = c;
-                        }
-                    } else { // not a run
-                        while (c-- && p < pEnd)
-                            scanline[x++][channel] = *p++;
-                    }
-                }
-            }
-        } else {
-            // old rle
-            scanline[0][0] = 2;
-            int bitshift = 0;
-            int x = 1;
-            while (x < w && pEnd - p >= 4) {
-                scanline[x][0] = *p++;
-                scanline[x][1] = *p++;
-                scanline[x][2] = *p++;
-                scanline[x][3] = *p++;
-
-                if (scanline[x][0] == 1 && scanline[x][1] == 1 && scanline[x][2] == 1) { // run
-                    int repCount = scanline[x][3] << bitshift;
-                    while (repCount--) {
-                        memcpy(scanline[x], scanline[x - 1], 4);
-                        ++x;
-                    }
-                    bitshift += 8;
-                } else { // not a run
-                    ++x;
-                    bitshift = 0;
-                }
-            }
-        }
-
-               // adjust for -Y orientation
-        float *fp = reinterpret_cast<float *>(data.data() + (h - 1 - y) * blockSize * w);
-        for (int x = 0; x < w; ++x) {
-            float d = qPow(2.0f, float(scanline[x][3]) - 128.0f);
-            // r, g, b, a
-            *fp++ = scanline[x][0] / 256.0f * d;
-            *fp++ = scanline[x][1] / 256.0f * d;
-            *fp++ = scanline[x][2] / 256.0f * d;
-            *fp++ = 1.0f;
-        }
-    }
-
-    delete[] scanline;
-
     if (size)
-        *size = QSize(w, h);
-
-    return data;
+        *size = image.size;
+    return image.pixels;
 }
 void Window::customInit()
 {
@@ -180,7 +44,7 @@ void Window::customInit()
     QSize hdrSize;
     QByteArray hdrData = loadHdr(QLatin1String(":/OpenfootageNET_fieldairport-512.hdr"), &hdrSize);
     Q_ASSERT(!hdrData.isEmpty());
-    d.equirectTex = m_r->newTexture(QRhiTexture::RGBA32F, hdrSize);
+    d.equirectTex = m_r->newTexture(QRhiTexture::RGBA16F, hdrSize);
     d.releasePool << d.equirectTex;
     d.equirectTex->create();
 
@@ -0,0 +1,127 @@
+// Radiance .hdr load times: stb_image (what HdriSky used, RGB32F) against
+// hdr::load (rhi-window/qtrhi3d/hdrimage.h, RGBA16F) on one thread and on
+// the whole pool. Both start from the file in memory; the first run of each
+// also checks that the two agree after rounding stb's floats to half.
+// It then times the spherical harmonics irradiance projection HdriSky runs
+// on load (shirradiance.h) and compares it with the brute-force integral
+// for a set of normals.
+//
+//   hdrbench <hdr file>...
+
+#include "qtrhi3d/hdrimage.h"
+#include "qtrhi3d/shirradiance.h"
+
+#include "stb/stb_image.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+namespace {
+
+template<typename Fn>
+double millisecondsPerRun(Fn &&fn)
+{
+    QElapsedTimer timer;
+    timer.start();
+    int runs = 0;
+    do {
+        fn();
+        ++runs;
+    } while (timer.nsecsElapsed() < 500'000'000 || runs < 5);
+    return timer.nsecsElapsed() / 1e6 / runs;
+}
+
+void benchmark(const QString &path)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning().noquote() << "cannot open" << path;
+        return;
+    }
+    const QByteArray file = f.readAll();
+    const auto *data = reinterpret_cast<const uchar *>(file.constData());
+    rgbe::Info info;
+    if (!rgbe::parseHeader(data, size_t(file.size()), info)) {
+        qWarning().noquote() << "not a Radiance file:" << path;
+        return;
+    }
+    QByteArray pixels(qsizetype(info.width) * info.height * 8, Qt::Uninitialized);
+    auto *dst = reinterpret_cast<uchar *>(pixels.data());
+
+    stbi_set_flip_vertically_on_load(true);
+    int w = 0, h = 0, comps = 0;
+    float *reference = stbi_loadf_from_memory(data, int(file.size()), &w, &h, &comps, 3);
+    if (!reference || !hdr::decode(data, file.size(), info, dst, qsizetype(info.width) * 8, true)) {
+        qWarning().noquote() << "decode failed:" << path;
+        stbi_image_free(reference);
+        return;
+    }
+    qsizetype mismatches = 0;
+    const auto *halves = reinterpret_cast<const quint16 *>(pixels.constData());
+    for (qsizetype i = 0; i < qsizetype(w) * h; ++i)
+        for (int c = 0; c < 3; ++c)
+            mismatches += rgbe::floatToHalf(reference[i * 3 + c]) != halves[i * 4 + c];
+    stbi_image_free(reference);
+
+    QThreadPool single;
+    single.setMaxThreadCount(1);
+    const double stb = millisecondsPerRun([&] {
+        stbi_image_free(stbi_loadf_from_memory(data, int(file.size()), &w, &h, &comps, 3));
+    });
+    const double serial = millisecondsPerRun([&] {
+        hdr::decode(data, file.size(), info, dst, qsizetype(info.width) * 8, true, &single);
+    });
+    QThreadPool *pool = QThreadPool::globalInstance();
+    const double parallel = millisecondsPerRun([&] {
+        hdr::decode(data, file.size(), info, dst, qsizetype(info.width) * 8, true, pool);
+    });
+
+    qInfo().noquote() << QFileInfo(path).fileName() << QString("%1x%2").arg(info.width).arg(info.height)
+                      << QString("%1 KiB").arg(file.size() / 1024) << mismatches << "half mismatches";
+    qInfo().noquote() << QString("  stb_image %1 ms, hdr 1 thread %2 ms (%3x), %4 threads %5 ms (%6x)")
+                             .arg(stb, 0, 'f', 2)
+                             .arg(serial, 0, 'f', 2)
+                             .arg(stb / serial, 0, 'f', 1)
+                             .arg(pool->maxThreadCount())
+                             .arg(parallel, 0, 'f', 2)
+                             .arg(stb / parallel, 0, 'f', 1);
+
+    const envmap::Source src{ halves, int(info.width), int(info.height) };
+    sh::Irradiance irr;
+    const double project = millisecondsPerRun([&] { irr = sh::project(src, pool); });
+    // axes, edge and corner diagonals
+    double maxError = 0.0, maxValue = 0.0;
+    for (int i = 0; i < 27; ++i) {
+        float n[3] = { float(i % 3 - 1), float(i / 3 % 3 - 1), float(i / 9 - 1) };
+        const float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length == 0.0f)
+            continue;
+        for (float &c : n)
+            c /= length;
+        const std::array<float, 3> approx = sh::evaluate(irr, n);
+        const std::array<double, 3> exact = sh::irradianceReference(src, n);
+        for (int c = 0; c < 3; ++c) {
+            maxError = std::max(maxError, std::abs(approx[size_t(c)] - exact[size_t(c)]));
+            maxValue = std::max(maxValue, exact[size_t(c)]);
+        }
+    }
+    qInfo().noquote() << QString("  SH9 irradiance %1 ms, max error %2% of the brightest reference value")
+                             .arg(project, 0, 'f', 2)
+                             .arg(100.0 * maxError / std::max(maxValue, 1e-9), 0, 'f', 2);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    const QStringList files = app.arguments().mid(1);
+    if (files.isEmpty()) {
+        qInfo() << "usage: hdrbench <hdr file>...";
+        return 1;
+    }
+    for (const QString &path : files)
+        benchmark(path);
+    return 0;
+}
@@ -0,0 +1,98 @@
+// Checks sh::project() (rhi-window/qtrhi3d/shirradiance.h) against the
+// brute-force sh::irradianceReference() on synthetic skies and exits non-zero
+// when the error for any normal exceeds the sky's bound, relative to its
+// brightest reference value. Radiance of degree <= 2 in the direction is
+// held exactly by nine coefficients, so only sampling error is allowed
+// there; a sun over a gradient also measures what the L2 truncation loses.
+//
+//   shtest
+
+#include "qtrhi3d/shirradiance.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <functional>
+
+namespace {
+
+constexpr int WIDTH = 256;
+constexpr int HEIGHT = 128;
+
+struct Sky {
+    const char *name;
+    double tolerance;
+    std::function<std::array<double, 3>(double x, double y, double z)> radiance;
+};
+
+// RGBA16F rows laid out like hdr::load(), with (x, y, z) as in shirradiance.h.
+std::vector<uint16_t> render(const Sky &sky)
+{
+    std::vector<uint16_t> pixels(size_t(WIDTH) * HEIGHT * 4);
+    for (int y = 0; y < HEIGHT; ++y) {
+        const double lat = ((y + 0.5) / HEIGHT - 0.5) * envmap::PI;
+        for (int x = 0; x < WIDTH; ++x) {
+            const double phi = ((x + 0.5) / WIDTH - 0.5) * 2.0 * envmap::PI;
+            const std::array<double, 3> l = sky.radiance(std::cos(lat) * std::cos(phi), std::sin(lat),
+                                                         std::cos(lat) * std::sin(phi));
+            uint16_t *p = &pixels[(size_t(y) * WIDTH + size_t(x)) * 4];
+            for (int c = 0; c < 3; ++c)
+                p[c] = rgbe::floatToHalf(float(l[size_t(c)]));
+            p[3] = rgbe::floatToHalf(1.0f);
+        }
+    }
+    return pixels;
+}
+
+// Over a spiral of normals covering the sphere.
+double maxRelativeError(const envmap::Source &src, const sh::Irradiance &irr)
+{
+    constexpr int NORMALS = 64;
+    double maxError = 0.0, maxValue = 0.0;
+    for (int i = 0; i < NORMALS; ++i) {
+        const double y = 1.0 - (i + 0.5) * 2.0 / NORMALS;
+        const double r = std::sqrt(1.0 - y * y);
+        const double phi = i * 2.39996322972865332; // golden angle
+        const float n[3] = { float(r * std::cos(phi)), float(y), float(r * std::sin(phi)) };
+        const std::array<float, 3> approx = sh::evaluate(irr, n);
+        const std::array<double, 3> exact = sh::irradianceReference(src, n);
+        for (int c = 0; c < 3; ++c) {
+            maxError = std::max(maxError, std::abs(approx[size_t(c)] - exact[size_t(c)]));
+            maxValue = std::max(maxValue, exact[size_t(c)]);
+        }
+    }
+    return maxError / std::max(maxValue, 1e-9);
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    const Sky skies[] = {
+        { "constant", 0.005, [](double, double, double) { return std::array<double, 3>{ 1.0, 0.5, 0.25 }; } },
+        { "quadratic", 0.005,
+          [](double x, double y, double z) {
+              const double l = 1.0 + 0.5 * y + 0.25 * x * z - 0.2 * (3.0 * y * y - 1.0) / 2.0;
+              return std::array<double, 3>{ l, 0.8 * l, 1.2 * l };
+          } },
+        { "sun", 0.05,
+          [](double x, double y, double z) {
+              const double sun = x * 0.48 + y * 0.6 + z * 0.64 > 0.995 ? 50.0 : 0.0;
+              const double sky = 0.2 + 0.8 * std::max(0.0, y);
+              return std::array<double, 3>{ sky * 0.6 + sun, sky * 0.8 + sun, sky + sun };
+          } },
+    };
+
+    int failed = 0;
+    for (const Sky &sky : skies) {
+        const std::vector<uint16_t> pixels = render(sky);
+        const envmap::Source src{ pixels.data(), WIDTH, HEIGHT };
+        const double error = maxRelativeError(src, sh::project(src));
+        const bool ok = error <= sky.tolerance;
+        qInfo().noquote() << (ok ? "PASS" : "FAIL") << sky.name
+                          << QString("max error %1%, bound %2%").arg(100.0 * error, 0, 'f', 3).arg(100.0 * sky.tolerance);
+        failed += !ok;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,280 @@
+// Offline mesh cooker: converts models through assimp once and writes .qmesh
+// files (see rhi-window/qtrhi3d/qmesh.h) that the viewers map at startup.
+//
+//   qmeshcook [--layout static|skinned|both] [--force] <model or directory>...
+
+#include "qtrhi3d/qmesh.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <cfloat>
+#include <map>
+
+namespace {
+
+// must match FbxModel::IMPORT_FLAGS (rhi-window) and Model::IMPORT_FLAGS (rhi-box)
+constexpr unsigned STATIC_FLAGS = aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs |
+                                  aiProcess_CalcTangentSpace | aiProcess_GenUVCoords;
+constexpr unsigned SKINNED_FLAGS =
+    aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace;
+
+constexpr aiTextureType TEXTURE_TYPES[] = {
+    aiTextureType_DIFFUSE,
+    aiTextureType_SPECULAR,
+    aiTextureType_HEIGHT,
+    aiTextureType_AMBIENT,
+};
+
+struct StaticVertex {
+    float position[3];
+    float normal[3];
+    float coords[2];
+};
+
+struct SkinnedVertex {
+    float position[3];
+    float normal[3];
+    float coords[2];
+    qint32 boneIds[4];
+    float weights[4];
+};
+
+static_assert(sizeof(StaticVertex) == qmesh::vertexStride(qmesh::VertexLayout::Static));
+static_assert(sizeof(SkinnedVertex) == qmesh::vertexStride(qmesh::VertexLayout::Skinned));
+
+QMatrix4x4 toMatrix(const aiMatrix4x4 &m)
+{
+    return { m.a1, m.a2, m.a3, m.a4, m.b1, m.b2, m.b3, m.b4,
+             m.c1, m.c2, m.c3, m.c4, m.d1, m.d2, m.d3, m.d4 };
+}
+
+template<typename V>
+void fillBase(V &v, const aiMesh *mesh, unsigned i)
+{
+    v.position[0] = mesh->mVertices[i].x;
+    v.position[1] = mesh->mVertices[i].y;
+    v.position[2] = mesh->mVertices[i].z;
+    if (mesh->HasNormals()) {
+        v.normal[0] = mesh->mNormals[i].x;
+        v.normal[1] = mesh->mNormals[i].y;
+        v.normal[2] = mesh->mNormals[i].z;
+    }
+    if (mesh->mTextureCoords[0]) {
+        v.coords[0] = mesh->mTextureCoords[0][i].x;
+        v.coords[1] = mesh->mTextureCoords[0][i].y;
+    }
+}
+
+class Cooker {
+public:
+    Cooker(const aiScene *scene, qmesh::VertexLayout layout) : scene_(scene), layout_(layout), writer_(layout) {}
+
+    void cook() {
+        addNode(scene_->mRootNode, -1, {});
+        writer_.setBounds(boundsMin_, boundsMax_);
+        for (const auto &[name, bone] : boneIds_)
+            writer_.addBone(name, bone.id, bone.offset);
+        if (layout_ == qmesh::VertexLayout::Skinned && scene_->mNumAnimations)
+            addAnimation(scene_->mAnimations[0]);
+    }
+
+    bool write(const QString &path, const QString &source) const { return writer_.write(path, source); }
+    int submeshes() const { return submeshCount_; }
+
+private:
+    struct BoneEntry {
+        qint32 id;
+        QMatrix4x4 offset;
+    };
+
+    void addNode(const aiNode *node, qint32 parent, const QMatrix4x4 &accumulated) {
+        const QMatrix4x4 local = toMatrix(node->mTransformation);
+        const QMatrix4x4 transform = accumulated * local;
+        const qint32 index = writer_.addNode(std::string_view(node->mName.data, node->mName.length), parent, local);
+        for (unsigned i = 0; i < node->mNumMeshes; ++i)
+            addMesh(scene_->mMeshes[node->mMeshes[i]], index, transform);
+        for (unsigned i = 0; i < node->mNumChildren; ++i)
+            addNode(node->mChildren[i], index, transform);
+    }
+
+    void addMesh(const aiMesh *mesh, qint32 node, const QMatrix4x4 &transform) {
+        qmesh::Submesh sub{};
+        sub.vertexCount = mesh->mNumVertices;
+        sub.node = node;
+        qmesh::fromMatrix(transform, sub.transform);
+
+        sub.firstTexture = writer_.textureCount();
+        const aiMaterial *material = scene_->mMaterials[mesh->mMaterialIndex];
+        for (const aiTextureType type : TEXTURE_TYPES) {
+            for (unsigned t = 0; t < material->GetTextureCount(type); ++t) {
+                aiString path;
+                material->GetTexture(type, t, &path);
+                writer_.addTexture(type, std::string_view(path.data, path.length));
+            }
+        }
+        sub.textureCount = writer_.textureCount() - sub.firstTexture;
+
+        QVector3D lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (unsigned i = 0; i < mesh->mNumVertices; ++i) {
+            const QVector3D p(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+            const QVector3D w = transform.map(p);
+            for (int c = 0; c < 3; ++c) {
+                sub.boundsMin[c] = i ? qMin(sub.boundsMin[c], p[c]) : p[c];
+                sub.boundsMax[c] = i ? qMax(sub.boundsMax[c], p[c]) : p[c];
+                lo[c] = qMin(lo[c], w[c]);
+                hi[c] = qMax(hi[c], w[c]);
+            }
+        }
+        for (int c = 0; c < 3; ++c) {
+            boundsMin_[c] = submeshCount_ ? qMin(boundsMin_[c], lo[c]) : lo[c];
+            boundsMax_[c] = submeshCount_ ? qMax(boundsMax_[c], hi[c]) : hi[c];
+        }
+
+        std::vector<quint32> indices;
+        indices.reserve(size_t(mesh->mNumFaces) * 3);
+        for (unsigned f = 0; f < mesh->mNumFaces; ++f)
+            for (unsigned j = 0; j < mesh->mFaces[f].mNumIndices; ++j)
+                indices.push_back(mesh->mFaces[f].mIndices[j]);
+
+        if (layout_ == qmesh::VertexLayout::Static) {
+            std::vector<StaticVertex> vertices(mesh->mNumVertices, StaticVertex{});
+            for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+                fillBase(vertices[i], mesh, i);
+            writer_.addSubmesh(sub, vertices.data(), indices);
+        } else {
+            std::vector<SkinnedVertex> vertices(mesh->mNumVertices, SkinnedVertex{ {}, {}, {}, { -1, -1, -1, -1 }, {} });
+            for (unsigned i = 0; i < mesh->mNumVertices; ++i)
+                fillBase(vertices[i], mesh, i);
+            addSkin(mesh, vertices);
+            writer_.addSubmesh(sub, vertices.data(), indices);
+        }
+        ++submeshCount_;
+    }
+
+    // the clip rhi-box plays; its Animation reads the channels instead of the source
+    void addAnimation(const aiAnimation *animation) {
+        writer_.setAnimation(animation->mDuration, animation->mTicksPerSecond);
+        for (unsigned i = 0; i < animation->mNumChannels; ++i) {
+            const aiNodeAnim *channel = animation->mChannels[i];
+            std::vector<qmesh::Key> positions, rotations, scales;
+            for (unsigned k = 0; k < channel->mNumPositionKeys; ++k) {
+                const aiVector3D &v = channel->mPositionKeys[k].mValue;
+                positions.push_back({ channel->mPositionKeys[k].mTime, { v.x, v.y, v.z, 0 }, {} });
+            }
+            for (unsigned k = 0; k < channel->mNumRotationKeys; ++k) {
+                const aiQuaternion &q = channel->mRotationKeys[k].mValue;
+                rotations.push_back({ channel->mRotationKeys[k].mTime, { q.w, q.x, q.y, q.z }, {} });
+            }
+            for (unsigned k = 0; k < channel->mNumScalingKeys; ++k) {
+                const aiVector3D &v = channel->mScalingKeys[k].mValue;
+                scales.push_back({ channel->mScalingKeys[k].mTime, { v.x, v.y, v.z, 0 }, {} });
+            }
+            writer_.addChannel(std::string_view(channel->mNodeName.data, channel->mNodeName.length), positions,
+                               rotations, scales);
+        }
+    }
+
+    // same id assignment as rhi-box Model: first come, first numbered, in node order
+    void addSkin(const aiMesh *mesh, std::vector<SkinnedVertex> &vertices) {
+        for (unsigned b = 0; b < mesh->mNumBones; ++b) {
+            const aiBone *bone = mesh->mBones[b];
+            const std::string name = bone->mName.C_Str();
+            auto it = boneIds_.find(name);
+            if (it == boneIds_.end())
+                it = boneIds_.emplace(name, BoneEntry{ qint32(boneIds_.size()), toMatrix(bone->mOffsetMatrix) }).first;
+
+            for (unsigned w = 0; w < bone->mNumWeights; ++w) {
+                SkinnedVertex &v = vertices[bone->mWeights[w].mVertexId];
+                for (int z = 0; z < 4; ++z) {
+                    if (v.boneIds[z] < 0) {
+                        v.boneIds[z] = it->second.id;
+                        v.weights[z] = bone->mWeights[w].mWeight;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    const aiScene *scene_;
+    qmesh::VertexLayout layout_;
+    qmesh::Writer writer_;
+    std::map<std::string, BoneEntry> boneIds_;
+    QVector3D boundsMin_;
+    QVector3D boundsMax_;
+    int submeshCount_ = 0;
+};
+
+bool cookFile(const QString &source, qmesh::VertexLayout layout, bool force)
+{
+    const QString target = qmesh::cookedPath(source, layout);
+    if (!force && qmesh::File::open(target, layout, source)) {
+        qInfo().noquote() << "up to date:" << target;
+        return true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(source.toStdString(),
+                                             layout == qmesh::VertexLayout::Skinned ? SKINNED_FLAGS : STATIC_FLAGS);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
+        qWarning().noquote() << source << importer.GetErrorString();
+        return false;
+    }
+
+    Cooker cooker(scene, layout);
+    cooker.cook();
+    if (!cooker.write(target, source))
+        return false;
+    qInfo().noquote() << "cooked:" << target << cooker.submeshes() << "meshes in" << timer.elapsed() << "ms";
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Cooks models into .qmesh files next to the source.");
+    parser.addHelpOption();
+    QCommandLineOption layoutOption("layout", "Vertex layout: static, skinned or both.", "layout", "both");
+    QCommandLineOption forceOption("force", "Cook even if the output is up to date.");
+    parser.addOption(layoutOption);
+    parser.addOption(forceOption);
+    parser.addPositionalArgument("inputs", "Model files or directories searched for *.fbx.");
+    parser.process(app);
+
+    std::vector<qmesh::VertexLayout> layouts;
+    const QString layout = parser.value(layoutOption);
+    if (layout == "static" || layout == "both")
+        layouts.push_back(qmesh::VertexLayout::Static);
+    if (layout == "skinned" || layout == "both")
+        layouts.push_back(qmesh::VertexLayout::Skinned);
+    if (layouts.empty() || parser.positionalArguments().isEmpty())
+        parser.showHelp(1);
+
+    QStringList sources;
+    for (const QString &input : parser.positionalArguments()) {
+        if (QFileInfo(input).isDir()) {
+            QDirIterator it(input, { "*.fbx", "*.FBX" }, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                sources << it.next();
+        } else {
+            sources << input;
+        }
+    }
+
+    int failed = 0;
+    for (const QString &source : std::as_const(sources))
+        for (const qmesh::VertexLayout l : layouts)
+            failed += cookFile(source, l, parser.isSet(forceOption)) ? 0 : 1;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,111 @@
+// Asset pack builder: collects shaders, textures and other runtime files into
+// one .qpak (see rhi-window/qtrhi3d/assetpack.h) that rhi-window maps at
+// startup instead of compiling them into the executable.
+//
+//   qpack --out assets.qpak [--compress] [--level 1-9] name=path...
+//   qpack --list assets.qpak
+//
+// A file is stored under name; a directory adds every file below it as
+// name/relative/path. Names are the resource paths the code asks for without
+// ":/", e.g. shaders/prebuild=rhi-window/shaders/prebuild. --compress
+// deflates the entries that shrink by at least a tenth; images and other
+// already compressed files are stored as is and read without copying.
+
+#include "qtrhi3d/assetpack.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+namespace {
+
+bool addFile(const QString &name, const QString &path, std::vector<qpak::Input> &inputs)
+{
+    QFile f(path);
+    if (!f.open(QIODevice::ReadOnly)) {
+        qWarning().noquote() << "cannot read" << path << f.errorString();
+        return false;
+    }
+    inputs.push_back({ qpak::nameOf(name), f.readAll() });
+    return true;
+}
+
+int list(const QString &path)
+{
+    const auto pack = qpak::Pack::open(path);
+    if (!pack) {
+        qWarning().noquote() << "cannot open" << path;
+        return 1;
+    }
+    const qpak::Header &h = pack->header();
+    quint64 stored = 0, raw = 0;
+    for (quint32 i = 0; i < h.entryCount; ++i) {
+        const qpak::Entry &e = pack->entry(i);
+        stored += e.size;
+        raw += e.rawSize;
+        qInfo().noquote() << QString("%1 %2 %3").arg(e.rawSize, 10).arg(e.size, 10)
+                                 .arg(e.flags & qpak::Compressed ? "z" : " ")
+                          << QString::fromUtf8(pack->name(e).toByteArray());
+    }
+    qInfo().noquote() << h.entryCount << "entries," << raw << "bytes," << stored << "stored," << h.slotCount
+                      << "index slots";
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Packs runtime assets into one memory mapped .qpak file.");
+    parser.addHelpOption();
+    QCommandLineOption outOption("out", "Pack to write.", "file");
+    QCommandLineOption compressOption("compress", "Deflate entries that shrink by at least a tenth.");
+    QCommandLineOption levelOption("level", "Deflate level, 1 to 9.", "level", "9");
+    QCommandLineOption listOption("list", "Print the entries of an existing pack.", "file");
+    parser.addOptions({ outOption, compressOption, levelOption, listOption });
+    parser.addPositionalArgument("inputs", "name=path pairs; path is a file or a directory.");
+    parser.process(app);
+
+    if (parser.isSet(listOption))
+        return list(parser.value(listOption));
+    if (!parser.isSet(outOption) || parser.positionalArguments().isEmpty())
+        parser.showHelp(1);
+
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<qpak::Input> inputs;
+    for (const QString &input : parser.positionalArguments()) {
+        const qsizetype eq = input.indexOf('=');
+        if (eq <= 0) {
+            qWarning().noquote() << "expected name=path:" << input;
+            return 1;
+        }
+        const QString name = input.left(eq);
+        const QString path = input.mid(eq + 1);
+        if (!QFileInfo(path).isDir()) {
+            if (!addFile(name, path, inputs))
+                return 1;
+            continue;
+        }
+        const QDir root(path);
+        QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+        while (it.hasNext()) {
+            const QString file = it.next();
+            if (!addFile(name + '/' + root.relativeFilePath(file), file, inputs))
+                return 1;
+        }
+    }
+
+    const size_t count = inputs.size();
+    if (!qpak::write(parser.value(outOption), std::move(inputs), parser.isSet(compressOption),
+                     qBound(1, parser.value(levelOption).toInt(), 9)))
+        return 1;
+    qInfo().noquote() << "packed" << count << "files into" << parser.value(outOption) << "in" << timer.elapsed()
+                      << "ms";
+    return 0;
+}
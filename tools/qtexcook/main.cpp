@@ -0,0 +1,262 @@
+// Offline texture cooker: builds the full mip chain of every PNG once and
+// writes .qtex files (see rhi-window/qtrhi3d/qtex.h) in a GPU block format,
+// so the viewers upload them as is instead of decoding and generating mips.
+//
+//   qtexcook [--kind auto|color|normal|mask] [--format bc|raw] [--supercompress]
+//            [--out dir] [--force] <png or directory>...
+//   qtexcook [--format bc|raw] [--out dir] --orm ao,roughness,metallic[,height]... [directory]...
+//   qtexcook --benchmark <qtex or directory>...
+//
+// Kinds map to formats: color -> BC7, normal -> BC5 (z is rebuilt in the
+// shader), mask -> BC4; uncompressed (raw) they are RGBA8, RG8 and R8.
+// --orm packs four masks into the ORM texture the PBR shaders sample
+// (TextureLoader::packOrm) and writes it as BC7 next to the roughness map's
+// cooked file, where TextureLoader::cookedOrmPath() finds it; with --out it
+// mirrors the input directory that holds the roughness map.
+// --supercompress deflates the levels so one file can ship to every backend;
+// --benchmark measures how fast such files transcode at load time.
+
+#include "mipfilter.h"
+#include "qtrhi3d/parallel.h"
+#include "qtrhi3d/qtex.h"
+#include "qtrhi3d/textureloader.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QImage>
+#include <atomic>
+
+namespace {
+
+enum class Kind { Color, Normal, Mask, Packed };
+
+Kind guessKind(const QString &source)
+{
+    const QString name = QFileInfo(source).completeBaseName().toLower();
+    const QString raw = QFileInfo(source).completeBaseName();
+    if (name.contains("normal") || raw.endsWith('N'))
+        return Kind::Normal;
+    static const char *masks[] = { "met", "rough", "height", "occlusion", "_ao", "-ao" };
+    for (const char *m : masks)
+        if (name.contains(m))
+            return Kind::Mask;
+    if (raw.endsWith('M'))
+        return Kind::Mask;
+    return Kind::Color;
+}
+
+bcn::Format formatFor(Kind kind, bool compress)
+{
+    switch (kind) {
+    case Kind::Normal: return compress ? bcn::Format::BC5 : bcn::Format::RG8;
+    case Kind::Mask: return compress ? bcn::Format::BC4 : bcn::Format::R8;
+    case Kind::Color:
+    case Kind::Packed: break;
+    }
+    return compress ? bcn::Format::BC7 : bcn::Format::RGBA8;
+}
+
+struct Options {
+    QString kind = "auto";
+    bool compress = true;
+    bool supercompress = false;
+    bool force = false;
+    QString outDir;
+};
+
+// source is an image file or a TextureLoader::ormPath(); ORM files are
+// stamped with all four maps, which is what the loader checks.
+bool cookFile(const QString &source, const QString &target, const Options &options)
+{
+    const bool orm = TextureLoader::isOrmPath(source);
+    const QStringList stamp = orm ? TextureLoader::ormSources(source) : QStringList{ source };
+    if (!options.force && qtex::File::open(target, stamp)) {
+        qInfo().noquote() << "up to date:" << target;
+        return true;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QImage image = orm ? TextureLoader::packOrm(TextureLoader::ormSources(source)) : QImage(source);
+    if (image.isNull()) {
+        qWarning().noquote() << "cannot read" << source;
+        return false;
+    }
+    // same turn Model::loadTexture gives PNGs on backends with isYUpInNDC()
+    image = image.convertToFormat(QImage::Format_RGBA8888).flipped(Qt::Horizontal | Qt::Vertical);
+
+    const Kind kind = orm ? Kind::Packed
+                    : options.kind == "color" ? Kind::Color
+                    : options.kind == "normal" ? Kind::Normal
+                    : options.kind == "mask" ? Kind::Mask
+                    : guessKind(source);
+    const bcn::Format format = formatFor(kind, options.compress);
+    const bool srgb = kind == Kind::Color;
+
+    const quint32 w = quint32(image.width()), h = quint32(image.height());
+    std::vector<uint8_t> pixels(size_t(w) * h * 4);
+    for (quint32 y = 0; y < h; ++y)
+        memcpy(pixels.data() + size_t(y) * w * 4, image.constScanLine(int(y)), size_t(w) * 4);
+
+    const auto chain = mipfilter::buildChain(mipfilter::fromRGBA8(pixels.data(), w, h, srgb), true, kind == Kind::Normal);
+    std::vector<std::vector<uint8_t>> levels;
+    levels.reserve(chain.size());
+    for (const mipfilter::Image &level : chain) {
+        levels.push_back(mipfilter::toRGBA8(level, srgb));
+        if (format != bcn::Format::RGBA8)
+            levels.back() = bcn::encode(format, levels.back().data(), level.width, level.height);
+    }
+
+    quint32 flags = qtex::FlippedForYUp;
+    if (srgb)
+        flags |= qtex::SrgbContent;
+    if (kind == Kind::Normal)
+        flags |= qtex::NormalMap;
+    if (options.supercompress)
+        flags |= qtex::Supercompressed;
+    if (!qtex::write(target, stamp, format, flags, levels, w, h))
+        return false;
+    qInfo().noquote() << "cooked:" << target << levels.size() << "levels in" << timer.elapsed() << "ms";
+    return true;
+}
+
+// Transcode throughput for the paths a viewer can take, in MB of level data
+// handed to the GPU per second, on one thread and on the whole pool.
+void benchmark(const QString &path)
+{
+    const auto file = qtex::File::open(path);
+    if (!file) {
+        qWarning().noquote() << "cannot open" << path;
+        return;
+    }
+    qtex::Targets native;
+    native.bc4 = native.bc5 = native.bc7 = true;
+    qtex::Targets rotated = native;
+    rotated.yUp = false;
+    const qtex::Targets none{};
+    const struct {
+        const char *name;
+        qtex::Targets targets;
+    } cases[] = { { "bc", native }, { "bc rotated", rotated }, { "rgba8", none } };
+
+    QThreadPool single;
+    single.setMaxThreadCount(1);
+    QThreadPool *pools[] = { &single, QThreadPool::globalInstance() };
+
+    const qtex::Header &h = file->header();
+    qInfo().noquote() << QFileInfo(path).fileName() << QString("%1x%2").arg(h.width).arg(h.height)
+                      << "levels" << h.levelCount << (h.flags & qtex::Supercompressed ? "supercompressed" : "raw");
+    for (const auto &c : cases) {
+        QString line = QString("  %1").arg(c.name, -12);
+        for (QThreadPool *pool : pools) {
+            QElapsedTimer timer;
+            timer.start();
+            quint64 bytes = 0;
+            int runs = 0;
+            do {
+                const qtex::Payload p = file->transcode(c.targets, true, pool);
+                for (const auto &level : p.levels)
+                    bytes += level.size();
+                ++runs;
+            } while (timer.nsecsElapsed() < 300'000'000 || runs < 3);
+            const double seconds = timer.nsecsElapsed() / 1e9;
+            line += QString(" %1 MB/s (%2 threads)").arg(bytes / seconds / 1e6, 8, 'f', 1).arg(pool->maxThreadCount());
+        }
+        qInfo().noquote() << line;
+    }
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Cooks PNG textures into .qtex files with a precomputed mip chain.");
+    parser.addHelpOption();
+    QCommandLineOption kindOption("kind", "Content: auto, color, normal or mask.", "kind", "auto");
+    QCommandLineOption formatOption("format", "Block compressed (bc) or uncompressed (raw).", "format", "bc");
+    QCommandLineOption outOption("out", "Output directory, mirrors input directories. Next to the source if unset.", "dir");
+    QCommandLineOption superOption("supercompress", "Deflate the levels; transcoded per backend at load time.");
+    QCommandLineOption forceOption("force", "Cook even if the output is up to date.");
+    QCommandLineOption benchOption("benchmark", "Measure transcode throughput of existing .qtex files.");
+    QCommandLineOption ormOption("orm", "Pack ao,roughness,metallic[,height] into one ORM texture.", "maps");
+    parser.addOptions({ kindOption, formatOption, superOption, outOption, forceOption, benchOption, ormOption });
+    parser.addPositionalArgument("inputs", "PNG files or directories searched for *.png.");
+    parser.process(app);
+
+    Options options;
+    options.kind = parser.value(kindOption);
+    options.compress = parser.value(formatOption) == "bc";
+    options.supercompress = parser.isSet(superOption);
+    options.force = parser.isSet(forceOption);
+    options.outDir = parser.value(outOption);
+    if (parser.positionalArguments().isEmpty() && !parser.isSet(ormOption))
+        parser.showHelp(1);
+
+    if (parser.isSet(benchOption)) {
+        for (const QString &input : parser.positionalArguments()) {
+            if (!QFileInfo(input).isDir()) {
+                benchmark(input);
+                continue;
+            }
+            QDirIterator it(input, { "*.qtex" }, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext())
+                benchmark(it.next());
+        }
+        return 0;
+    }
+
+    // (source, target) pairs
+    std::vector<std::pair<QString, QString>> jobs;
+    auto targetFor = [&](const QString &source, const QDir &root) {
+        if (options.outDir.isEmpty())
+            return qtex::cookedPath(source);
+        const QString relative = root.relativeFilePath(source);
+        const QFileInfo fi(QDir(options.outDir).filePath(relative));
+        QDir().mkpath(fi.path());
+        return fi.dir().filePath(fi.completeBaseName() + ".qtex");
+    };
+    for (const QString &input : parser.positionalArguments()) {
+        const QFileInfo fi(input);
+        if (fi.isDir()) {
+            QDirIterator it(input, { "*.png", "*.PNG" }, QDir::Files, QDirIterator::Subdirectories);
+            while (it.hasNext()) {
+                const QString source = it.next();
+                jobs.emplace_back(source, targetFor(source, QDir(input)));
+            }
+        } else {
+            jobs.emplace_back(input, targetFor(input, fi.dir()));
+        }
+    }
+    for (const QString &maps : parser.values(ormOption)) {
+        const QStringList sources = maps.split(',');
+        if (sources.size() < 3 || sources.size() > 4) {
+            qWarning().noquote() << "--orm expects ao,roughness,metallic[,height]:" << maps;
+            return 1;
+        }
+        const QString source = TextureLoader::ormPath(sources[0], sources[1], sources[2], sources.value(3));
+        // mirrored like the input directory holding the roughness map, so
+        // the file lands where cookedOrmPath() looks for it
+        QDir root = QFileInfo(sources[1]).dir();
+        for (const QString &input : parser.positionalArguments()) {
+            const QString relative = QDir(input).relativeFilePath(sources[1]);
+            if (QFileInfo(input).isDir() && !relative.startsWith(QLatin1String("..")))
+                root = QDir(input);
+        }
+        const QString roughness = targetFor(sources[1], root);
+        jobs.emplace_back(source, options.outDir.isEmpty() ? TextureLoader::cookedOrmPath(source)
+                                                           : roughness.left(roughness.size() - 5) + ".orm.qtex");
+    }
+
+    // files are independent, cook them side by side
+    std::atomic<int> failed{ 0 };
+    parallelFor(QThreadPool::globalInstance(), int(jobs.size()), [&](int i) {
+        if (!cookFile(jobs[size_t(i)].first, jobs[size_t(i)].second, options))
+            ++failed;
+    });
+    return failed ? 1 : 0;
+}
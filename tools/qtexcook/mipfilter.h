@@ -0,0 +1,165 @@
+#ifndef MIPFILTER_H
+#define MIPFILTER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Mip chain generation for the texture cooker. Each level is filtered from
+// the previous one with a separable Kaiser-windowed sinc (width 3, alpha 4).
+// Colour data is filtered in linear light, normals are renormalized per
+// level. The passes work on float RGBA rows so the inner loops vectorize.
+
+namespace mipfilter {
+
+struct Image {
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<float> rgba; // 4 floats per pixel
+
+    float *row(uint32_t y) { return rgba.data() + size_t(y) * width * 4; }
+    const float *row(uint32_t y) const { return rgba.data() + size_t(y) * width * 4; }
+};
+
+inline float srgbToLinear(float c) { return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f); }
+inline float linearToSrgb(float c) { return c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f; }
+
+inline Image fromRGBA8(const uint8_t *data, uint32_t w, uint32_t h, bool srgb) {
+    Image img{ w, h, std::vector<float>(size_t(w) * h * 4) };
+    float lut[256];
+    for (int i = 0; i < 256; ++i)
+        lut[i] = srgb ? srgbToLinear(i / 255.0f) : i / 255.0f;
+    for (size_t i = 0; i < img.rgba.size(); ++i)
+        img.rgba[i] = (i % 4 == 3) ? data[i] / 255.0f : lut[data[i]];
+    return img;
+}
+
+inline std::vector<uint8_t> toRGBA8(const Image &img, bool srgb) {
+    std::vector<uint8_t> out(img.rgba.size());
+    for (size_t i = 0; i < out.size(); ++i) {
+        float v = std::clamp(img.rgba[i], 0.0f, 1.0f);
+        if (srgb && i % 4 != 3)
+            v = linearToSrgb(v);
+        out[i] = uint8_t(std::lround(v * 255.0f));
+    }
+    return out;
+}
+
+inline double besselI0(double x) {
+    double sum = 1, term = 1;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+inline double kaiser(double x, double width = 3.0, double alpha = 4.0) {
+    if (std::fabs(x) >= width)
+        return 0;
+    const double sinc = x == 0 ? 1 : std::sin(M_PI * x) / (M_PI * x);
+    const double t = x / width;
+    return sinc * besselI0(alpha * std::sqrt(1 - t * t)) / besselI0(alpha);
+}
+
+struct Tap {
+    uint32_t index;
+    float weight;
+};
+
+// Taps for every destination texel along one axis; wrap for tiling textures.
+inline std::vector<std::vector<Tap>> taps(uint32_t src, uint32_t dst, bool wrap) {
+    const double scale = double(src) / dst;
+    const double support = 3.0 * scale;
+    std::vector<std::vector<Tap>> out(dst);
+    for (uint32_t i = 0; i < dst; ++i) {
+        const double center = (i + 0.5) * scale;
+        double total = 0;
+        for (int s = int(std::floor(center - support)); s <= int(std::ceil(center + support)); ++s) {
+            const double w = kaiser((s + 0.5 - center) / scale);
+            if (w == 0)
+                continue;
+            int idx = s;
+            if (wrap)
+                idx = ((idx % int(src)) + int(src)) % int(src);
+            else
+                idx = std::clamp(idx, 0, int(src) - 1);
+            out[i].push_back({ uint32_t(idx), float(w) });
+            total += w;
+        }
+        for (Tap &t : out[i])
+            t.weight = float(t.weight / total);
+    }
+    return out;
+}
+
+inline Image downsample(const Image &src, bool wrap) {
+    const uint32_t dw = std::max(1u, src.width / 2), dh = std::max(1u, src.height / 2);
+
+    // vertical: each destination row is a weighted sum of whole source rows
+    Image tmp{ src.width, dh, std::vector<float>(size_t(src.width) * dh * 4, 0.0f) };
+    const auto vtaps = taps(src.height, dh, wrap);
+    const size_t rowFloats = size_t(src.width) * 4;
+    for (uint32_t y = 0; y < dh; ++y) {
+        float *out = tmp.row(y);
+        for (const Tap &t : vtaps[y]) {
+            const float *in = src.row(t.index);
+            const float w = t.weight;
+            for (size_t i = 0; i < rowFloats; ++i)
+                out[i] += w * in[i];
+        }
+    }
+
+    // horizontal: 4 channels at a time
+    Image dst{ dw, dh, std::vector<float>(size_t(dw) * dh * 4, 0.0f) };
+    const auto htaps = taps(src.width, dw, wrap);
+    for (uint32_t y = 0; y < dh; ++y) {
+        const float *in = tmp.row(y);
+        float *out = dst.row(y);
+        for (uint32_t x = 0; x < dw; ++x) {
+            float acc[4] = {};
+            for (const Tap &t : htaps[x]) {
+                const float *p = in + size_t(t.index) * 4;
+                for (int c = 0; c < 4; ++c)
+                    acc[c] += t.weight * p[c];
+            }
+            for (int c = 0; c < 4; ++c)
+                out[size_t(x) * 4 + c] = acc[c];
+        }
+    }
+    return dst;
+}
+
+// Rescales tangent space normals (stored as 0..1) back to unit length.
+inline void renormalize(Image &img) {
+    for (size_t i = 0; i < img.rgba.size(); i += 4) {
+        float n[3] = { img.rgba[i] * 2 - 1, img.rgba[i + 1] * 2 - 1, img.rgba[i + 2] * 2 - 1 };
+        const float len = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len < 1e-6f)
+            continue;
+        for (int c = 0; c < 3; ++c)
+            img.rgba[i + c] = n[c] / len * 0.5f + 0.5f;
+    }
+}
+
+// Full chain down to 1x1, level 0 included.
+inline std::vector<Image> buildChain(Image base, bool wrap, bool normalMap) {
+    std::vector<Image> chain;
+    chain.push_back(std::move(base));
+    while (chain.back().width > 1 || chain.back().height > 1) {
+        Image next = downsample(chain.back(), wrap);
+        if (normalMap)
+            renormalize(next);
+        chain.push_back(std::move(next));
+    }
+    return chain;
+}
+
+} // namespace mipfilter
+
+#endif // MIPFILTER_H